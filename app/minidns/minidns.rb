@@ -2,24 +2,24 @@ require "socket"
 
 class DNS
   def initialize(s)
-    @pkt = s.unpack("C*")
+    @pkt = s
   end
 
   def decompress(offs)
     a = []
     while true
-      if @pkt[offs] == 0
+      if @pkt.get_u8(offs) == 0
 	offs += 1
         break
-      elsif @pkt[offs] > 0xc0
+      elsif @pkt.get_u8(offs) > 0xc0
         ptr = get16(offs) - 0xc0
 	offs += 3
 	a2, n = decompress(ptr)
 	a += a2
 	break
       else
-        n = @pkt[offs]
-        a << @pkt[offs+1, n].pack("C*")
+        n = @pkt.get_u8(offs)
+        a << @pkt.get_bytes(offs+1, n)
 	offs += n + 1
       end
     end
@@ -27,15 +27,15 @@ class DNS
   end
 
   def get8(offs)
-    @pkt[offs]
+    @pkt.get_u8(offs)
   end
 
   def get16(offs)
-    (@pkt[offs]<<8) + @pkt[offs+1]
+    @pkt.get_u16be(offs)
   end
 
   def get32(offs)
-    (@pkt[offs]<<24) + (@pkt[offs+1]<<16) + (@pkt[offs+2]<<8) + @pkt[offs+3]
+    @pkt.get_u32be(offs)
   end
 
   def parse_header
@@ -0,0 +1,18 @@
+# decode the header and question of a DNS query, as app/minidns does
+
+pkt = "\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00" +
+      "\x03www\x07example\x03com\x00\x00\x01\x00\x01"
+id = qtype = nil
+200_000.times do
+  b = ByteBuffer.new(pkt)
+  id = b.read_u16be
+  flags = b.read_u16be
+  qd = b.read_u16be
+  b.skip(6)
+  labels = []
+  while (n = b.read_u8) != 0
+    labels << b.read_bytes(n)
+  end
+  qtype = b.read_u16be
+  qclass = b.read_u16be
+end
@@ -0,0 +1,9 @@
+# formatting and parsing numbers as text
+
+f = 0.1
+sum = 0.0
+200_000.times do |i|
+  s = (f * i).to_s
+  sum += s.to_f
+  sum += i.to_s.to_i
+end
@@ -0,0 +1,15 @@
+# mutate a few slots of a large old array while minor GCs run
+
+SIZE = 1_000_000
+ROUNDS = 200
+STORES = 100
+
+big = Array.new(SIZE, nil)
+GC.start
+
+ROUNDS.times do |r|
+  STORES.times do |i|
+    big[(r * 7919 + i * 104729) % SIZE] = "s#{i}"
+  end
+  1000.times { "garbage" }
+end
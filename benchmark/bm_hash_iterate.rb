@@ -0,0 +1,10 @@
+# fill a large hash, delete part of it, then walk it repeatedly
+
+h = {}
+200_000.times { |i| h["key#{i}"] = i }
+50_000.times { |i| h.delete("key#{i * 4}") }
+sum = 0
+10.times do
+  h.each { |k, v| sum += v }
+  sum += h.keys.size + h.values.size
+end
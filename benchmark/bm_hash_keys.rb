@@ -0,0 +1,26 @@
+# look up hashes keyed by strings, floats, arrays and ranges, the keys
+# that need hash and eql? rather than an identity compare
+
+n = 2000
+strs = (0...n).map { |i| "key#{i}" }
+flts = (0...n).map { |i| i * 0.5 }
+arys = (0...n).map { |i| [i, "k#{i}", :s] }
+rngs = (0...n).map { |i| (i..i + 10) }
+hs = {}; hf = {}; ha = {}; hr = {}
+n.times do |i|
+  hs[strs[i]] = i
+  hf[flts[i]] = i
+  ha[arys[i]] = i
+  hr[rngs[i]] = i
+end
+x = nil
+500.times do
+  i = 0
+  while i < n
+    x = hs[strs[i].dup]
+    x = hf[flts[i]]
+    x = ha[[i, strs[i], :s]]
+    x = hr[i..i + 10]
+    i += 1
+  end
+end
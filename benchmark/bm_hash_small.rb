@@ -0,0 +1,28 @@
+# create, look up and iterate hashes of 0 to 16 pairs, with symbol,
+# integer and string keys
+
+syms = [:a, :b, :c, :d, :e, :f, :g, :h, :i, :j, :k, :l, :m, :n, :o, :p]
+strs = syms.map { |s| s.to_s }
+x = nil
+17.times do |size|
+  20_000.times do
+    h = {}
+    g = {}
+    i = 0
+    while i < size
+      h[syms[i]] = i
+      g[strs[i]] = i
+      i += 1
+    end
+    i = 0
+    while i < size
+      x = h[syms[i]]
+      x = g[strs[i]]
+      x = h[i]
+      i += 1
+    end
+    x = h[:zz]
+    h.each { |k, v| x = v }
+    x = g.keys
+  end
+end
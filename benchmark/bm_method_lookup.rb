@@ -0,0 +1,24 @@
+# call methods found at different depths of a class hierarchy with
+# included modules, so each call searches several method tables
+
+module M1; def m1; 1; end; end
+module M2; def m2; 2; end; end
+class C0; def c0; 0; end; end
+class C1 < C0; include M1; def c1; 1; end; end
+class C2 < C1; include M2; def c2; 2; end; end
+class C3 < C2; def c3; 3; end; end
+class C4 < C3; def c4; 4; end; end
+
+o = C4.new
+x = 0
+i = 0
+while i < 5_000_000
+  x = o.c4
+  x = o.c2
+  x = o.m2
+  x = o.m1
+  x = o.c0
+  x = o.hash
+  x = o.nil?
+  i += 1
+end
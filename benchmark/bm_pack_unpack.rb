@@ -0,0 +1,11 @@
+# build and decode a DHCP-like header with the same templates, as
+# app/dhcpalert and app/minidns do
+
+mac = [0x00, 0x11, 0x22, 0x33, 0x44, 0x55]
+fields = nil
+200_000.times do |i|
+  pkt = [1, 1, 6, 0, i, 0, 0x8000, 0, 0, 0, 0].pack("CCCCNnnNNNN")
+  pkt += mac.pack("C6") + ["host"].pack("a8")
+  fields = pkt.unpack("CCCCNnnNNNNC6a8")
+  hex = pkt[28, 6].unpack("H*")
+end
@@ -0,0 +1,9 @@
+# the same few templates formatted over and over, as a logger does
+
+levels = ["INFO", "WARN", "DEBUG"]
+out = nil
+200_000.times do |i|
+  out = format("%-5s [%06d] %s: %d items in %.2fs", levels[i % 3], i, "worker", i % 97, i * 0.001)
+  out = format("%s=%d", "count", i)
+  out = sprintf("%<host>s:%<port>d", :host => "localhost", :port => 8080)
+end
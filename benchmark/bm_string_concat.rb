@@ -0,0 +1,10 @@
+# build large strings from many small fragments with << and interpolation
+
+PART = 'x' * 24
+
+20.times do
+  s = ''
+  20_000.times { |i| s << PART }
+  log = ''
+  20_000.times { |i| log << "#{i}: #{PART} ok\n" }
+end
@@ -0,0 +1,12 @@
+# frozen_string_literal: true
+# string literals in a hot loop and records keyed by the same strings
+
+records = []
+200_000.times do |i|
+  rec = {}
+  rec["id"] = i
+  rec["name"] = "anonymous"
+  rec["status"] = "active"
+  rec["description"] = "a record with a rather long description field"
+  records << rec if i % 100 == 0
+end
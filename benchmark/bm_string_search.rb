@@ -0,0 +1,22 @@
+# String#index, #rindex, #include? and #split on short and long haystacks
+
+SHORT = 'the quick brown fox jumps over the lazy dog'
+LONG = ('lorem ipsum dolor sit amet, ' * 4096) + 'needle' + (' consectetur' * 64)
+
+200_000.times do
+  SHORT.index('lazy')
+  SHORT.rindex('the')
+  SHORT.include?('fox')
+  SHORT.split(' ')
+end
+
+300.times do
+  LONG.index('needle')
+  LONG.rindex('lorem')
+  LONG.include?('nonexistent')
+  LONG.index('amet, lorem', 100_000)
+end
+
+30.times do
+  LONG.split(', ')
+end
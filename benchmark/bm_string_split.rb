@@ -0,0 +1,9 @@
+# split a large log buffer into lines and fields
+
+LINE = "2024-01-01T00:00:00 host-01 GET /index.html 200 1234 0.012ms agent\n"
+LOG = LINE * 20_000
+
+5.times do
+  LOG.split("\n").each { |l| l.split(' ') }
+  LOG.lines
+end
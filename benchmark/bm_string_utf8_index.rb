@@ -0,0 +1,14 @@
+# index multibyte text by character (needs mruby-string-utf8)
+
+TEXT = 'いろはにほへと ちりぬるを abc ' * 400
+
+20.times do
+  i = 0
+  len = TEXT.size
+  n = 0
+  while i < len
+    n += 1 if TEXT[i] == 'を'
+    i += 1
+  end
+  TEXT.index('abc', len / 2)
+end
@@ -0,0 +1,17 @@
+# intern strings that are mostly existing symbols, then new ones
+
+names = (0...5000).map { |i| "name_#{i}" }
+x = nil
+n = names.size
+100.times do
+  i = 0
+  while i < n
+    x = names[i].to_sym
+    i += 1
+  end
+end
+i = 0
+while i < 200_000
+  x = "fresh_#{i}".to_sym
+  i += 1
+end
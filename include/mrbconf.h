@@ -59,8 +59,19 @@
 /* fixed size GC arena */
 //#define MRB_GC_FIXED_ARENA
 
+/* use the size-class slab allocator in mrb_open(); off by default as the
+   slab keeps its pages until mrb_close() and gains little over glibc */
+//#define MRB_USE_SLAB_ALLOCF
+
+/* back slab allocator chunks by mmap(2) instead of malloc(3) */
+//#define MRB_SLAB_USE_MMAP
+
+/* fixed key of String#hash for reproducible runs; random per VM if undefined */
+//#define MRB_STR_HASH_SEED 0
+
 /* -DDISABLE_XXXX to drop following features */
 //#define DISABLE_STDIO		/* use of stdio */
+//#define DISABLE_SIMD		/* vectorized substring search and UTF-8 scanning */
 
 /* -DENABLE_XXXX to enable following features */
 //#define ENABLE_DEBUG		/* hooks for debugger */
@@ -75,6 +86,10 @@
 #define DISABLE_DEBUG
 #endif
 
+#ifndef DISABLE_SIMD
+#define ENABLE_SIMD
+#endif
+
 #ifdef ENABLE_STDIO
 # include <stdio.h>
 #endif
@@ -47,6 +47,7 @@ struct mrb_irep;
 struct mrb_state;
 
 typedef void* (*mrb_allocf) (struct mrb_state *mrb, void*, size_t, void *ud);
+typedef void (*mrb_obj_hook) (struct mrb_state *mrb, struct RBasic *obj, void *ud);
 
 #ifndef MRB_GC_ARENA_SIZE
 #define MRB_GC_ARENA_SIZE 100
@@ -100,6 +101,32 @@ enum gc_state {
   GC_STATE_SWEEP
 };
 
+#ifndef MRB_GC_STEP_HISTOGRAM_SIZE
+#define MRB_GC_STEP_HISTOGRAM_SIZE 16
+#endif
+
+struct mrb_gc_phase_stat {
+  size_t count;                           /* number of times the phase ran */
+  size_t objects;                         /* objects marked (freed in sweep) */
+  uint64_t time;                          /* time spent in nanoseconds */
+};
+
+typedef struct mrb_gc_stat {
+  size_t minor_count;                     /* minor GC cycles started */
+  size_t major_count;                     /* major (or non generational) GC cycles started */
+  size_t step_count;                      /* incremental GC steps */
+  uint64_t step_time;                     /* total time of incremental GC steps */
+  uint64_t max_step_time;                 /* longest incremental GC step */
+  struct mrb_gc_phase_stat root_scan;
+  struct mrb_gc_phase_stat incremental_mark;
+  struct mrb_gc_phase_stat final_mark;
+  struct mrb_gc_phase_stat sweep;
+  /* step latency histogram; bucket 0 counts steps shorter than 1 usec,
+     bucket i counts steps in [2^(i-1), 2^i) usec, the last one the rest */
+  size_t step_histogram[MRB_GC_STEP_HISTOGRAM_SIZE];
+  size_t malloc_step_count;               /* GC steps triggered by malloc'd bytes */
+} mrb_gc_stat;
+
 struct mrb_jmpbuf;
 
 typedef struct mrb_state {
@@ -121,6 +148,7 @@ typedef struct mrb_state {
   struct RClass *string_class;
   struct RClass *array_class;
   struct RClass *hash_class;
+  struct RClass *range_class;
 
   struct RClass *float_class;
   struct RClass *fixnum_class;
@@ -130,6 +158,10 @@ typedef struct mrb_state {
   struct RClass *symbol_class;
   struct RClass *kernel_module;
 
+  uint32_t method_serial;                 /* bumped when a method table or an ancestor chain changes */
+  uint32_t hash_key_serial;               /* method_serial hash_key_builtin was computed at */
+  uint32_t hash_key_builtin;              /* key types still using the built-in hash and eql? */
+
   struct heap_page *heaps;                /* heaps for GC */
   struct heap_page *sweeps;
   struct heap_page *free_heaps;
@@ -150,15 +182,41 @@ typedef struct mrb_state {
   size_t gc_threshold;
   int gc_interval_ratio;
   int gc_step_ratio;
+  uint32_t gc_pause_target;               /* target GC step pause in usec; 0 turns pacing off */
+  int gc_growth_budget;                   /* heap growth allowed by the pacer (%) */
+  size_t gc_step_limit;                   /* objects per GC step, adapted by the pacer */
+  size_t gc_cycle_steps;                  /* GC steps taken in the current cycle */
+  size_t gc_malloc_increase;              /* bytes malloc'd since the last GC cycle */
+  size_t gc_malloc_limit;                 /* malloc'd bytes that trigger GC */
+  size_t gc_malloc_live;                  /* bytes held by live objects at the last mark */
+  size_t gc_malloc_marked;                /* bytes held by objects marked in this cycle */
+  int gc_malloc_ratio;                    /* malloc limit relative to gc_malloc_live (%) */
   mrb_bool gc_disabled:1;
   mrb_bool gc_full:1;
   mrb_bool is_generational_gc_mode:1;
   mrb_bool out_of_memory:1;
+  mrb_bool gc_idle_mode:1;                /* allocation defers GC steps to mrb_gc_step_for() */
+  mrb_bool gc_mark_syms:1;                /* marking also marks collectable symbols */
+  mrb_bool gc_iterating:1;                /* objects are being walked; GC is held off */
   size_t majorgc_old_threshold;
+  mrb_gc_stat gc_stat;                    /* GC statistics */
+  mrb_obj_hook obj_alloc_hook;            /* called after an object is allocated */
+  mrb_obj_hook obj_free_hook;             /* called before an object is freed */
+  void *obj_hook_ud;                      /* user data passed to the object hooks */
+  struct kh_gc_cards *gc_cards;           /* card tables of large arrays and hashes */
+  struct kh_gc_class_memsize *gc_class_memsize; /* bytes per class; see mrb_objspace_count_class_memsize() */
   struct alloca_header *mems;
 
   mrb_sym symidx;
   struct kh_n2s *name2sym;      /* symbol table */
+  struct symbol_name *symtbl;   /* names of dynamic symbols, by id */
+  size_t symcapa;
+  mrb_sym symfree;              /* first id freed by symbol collection */
+  size_t symmortal;             /* count of collectable symbols */
+  size_t symmortal_limit;       /* symmortal that triggers a collection */
+  uint64_t str_hash_seed;       /* per-VM key of mrb_str_hash() */
+  struct kh_fstr *fstr_table;   /* frozen strings, deduplicated by contents */
+  struct kh_fstr_lit *fstr_lits; /* frozen pool literals to their fstring */
 
 #ifdef ENABLE_DEBUG
   void (*code_fetch_hook)(struct mrb_state* mrb, struct mrb_irep *irep, mrb_code *pc, mrb_value *regs);
@@ -250,6 +308,8 @@ mrb_sym mrb_intern(mrb_state*,const char*,size_t);
 mrb_sym mrb_intern_static(mrb_state*,const char*,size_t);
 #define mrb_intern_lit(mrb, lit) mrb_intern_static(mrb, lit, mrb_strlen_lit(lit))
 mrb_sym mrb_intern_str(mrb_state*,mrb_value);
+/* like mrb_intern(), but the symbol is freed once no value refers to it */
+mrb_sym mrb_intern_collectable(mrb_state*,const char*,size_t);
 mrb_value mrb_check_intern_cstr(mrb_state*,const char*);
 mrb_value mrb_check_intern(mrb_state*,const char*,size_t);
 mrb_value mrb_check_intern_str(mrb_state*,mrb_value);
@@ -272,6 +332,7 @@ mrb_value mrb_str_new_static(mrb_state *mrb, const char *p, size_t len);
 
 mrb_state* mrb_open(void);
 mrb_state* mrb_open_allocf(mrb_allocf, void *ud);
+mrb_state* mrb_open_slab(void);
 void mrb_close(mrb_state*);
 
 mrb_value mrb_top_self(mrb_state *);
@@ -293,18 +354,23 @@ mrb_bool mrb_eql(mrb_state *mrb, mrb_value obj1, mrb_value obj2);
 
 void mrb_garbage_collect(mrb_state*);
 void mrb_full_gc(mrb_state*);
+void mrb_gc_collect_symbols(mrb_state*);
 void mrb_incremental_gc(mrb_state *);
+mrb_bool mrb_gc_step_for(mrb_state *, uint32_t usec);
 int mrb_gc_arena_save(mrb_state*);
 void mrb_gc_arena_restore(mrb_state*,int);
 void mrb_gc_mark(mrb_state*,struct RBasic*);
+void mrb_gc_mark_sym(mrb_state*,mrb_sym);
 #define mrb_gc_mark_value(mrb,val) do {\
   if (mrb_type(val) >= MRB_TT_HAS_BASIC) mrb_gc_mark((mrb), mrb_basic_ptr(val));\
+  else if ((mrb)->gc_mark_syms && mrb_symbol_p(val)) mrb_gc_mark_sym((mrb), mrb_symbol(val));\
 } while (0)
 void mrb_field_write_barrier(mrb_state *, struct RBasic*, struct RBasic*);
 #define mrb_field_write_barrier_value(mrb, obj, val) do{\
   if ((val.tt >= MRB_TT_HAS_BASIC)) mrb_field_write_barrier((mrb), (obj), mrb_basic_ptr(val));\
 } while (0)
 void mrb_write_barrier(mrb_state *, struct RBasic*);
+void mrb_write_barrier_slots(mrb_state *, struct RBasic*, size_t, size_t);
 
 mrb_value mrb_check_convert_type(mrb_state *mrb, mrb_value val, enum mrb_vtype type, const char *tname, const char *method);
 mrb_value mrb_any_to_s(mrb_state *mrb, mrb_value obj);
@@ -400,6 +466,22 @@ void mrb_pool_close(struct mrb_pool*);
 void* mrb_pool_alloc(struct mrb_pool*, size_t);
 void* mrb_pool_realloc(struct mrb_pool*, void*, size_t oldlen, size_t newlen);
 mrb_bool mrb_pool_can_realloc(struct mrb_pool*, void*, size_t);
+
+/* size-class slab allocator */
+typedef struct mrb_slab mrb_slab;
+typedef struct mrb_slab_stat {
+  size_t chunks;          /* chunks taken from the system */
+  size_t chunk_bytes;     /* bytes of those chunks */
+  size_t page_bytes;      /* bytes of pages carved into blocks */
+  size_t used_bytes;      /* bytes of blocks in use */
+  size_t free_bytes;      /* bytes of carved blocks on free lists */
+  size_t large_count;     /* allocations too large for a size class */
+  size_t large_bytes;     /* bytes of those allocations */
+} mrb_slab_stat;
+struct mrb_slab* mrb_slab_open(void);
+void mrb_slab_close(struct mrb_slab*);
+void* mrb_slab_allocf(struct mrb_state*, void*, size_t, void *ud);
+mrb_bool mrb_slab_get_stat(mrb_state*, mrb_slab_stat*);
 void* mrb_alloca(mrb_state *mrb, size_t);
 
 #ifdef MRB_DEBUG
@@ -28,6 +28,7 @@ typedef struct mrbc_context {
   mrb_bool capture_errors:1;
   mrb_bool dump_result:1;
   mrb_bool no_exec:1;
+  mrb_bool frozen_string_literal:1;
 } mrbc_context;
 
 mrbc_context* mrbc_context_new(mrb_state *mrb);
@@ -141,6 +142,8 @@ struct mrb_parser_state {
   mrb_ast_node *tree;
 
   mrb_bool capture_errors:1;
+  mrb_bool token_seen:1;                /* magic comments are over */
+  mrb_bool frozen_string_literal:1;     /* string literals are frozen */
   struct mrb_parser_message error_buffer[10];
   struct mrb_parser_message warn_buffer[10];
 
@@ -14,6 +14,7 @@ extern "C" {
 typedef struct mrb_data_type {
   const char *struct_name;
   void (*dfree)(mrb_state *mrb, void*);
+  size_t (*dsize)(mrb_state *mrb, const void*);   /* optional; bytes malloc'd for the data */
 } mrb_data_type;
 
 struct RData {
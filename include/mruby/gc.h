@@ -13,7 +13,14 @@ extern "C" {
 
 typedef void (mrb_each_object_callback)(mrb_state *mrb, struct RBasic *obj, void *data);
 void mrb_objspace_each_objects(mrb_state *mrb, mrb_each_object_callback *callback, void *data);
+void mrb_objspace_each_reference(mrb_state *mrb, struct RBasic *obj, mrb_each_object_callback *callback, void *data);
+size_t mrb_objspace_memsize_of(mrb_state *mrb, struct RBasic *obj);
+typedef void (mrb_class_memsize_callback)(mrb_state *mrb, struct RClass *c, size_t bytes, void *data);
+void mrb_objspace_count_class_memsize(mrb_state *mrb, mrb_bool enable);
+void mrb_objspace_each_class_memsize(mrb_state *mrb, mrb_class_memsize_callback *callback, void *data);
 void mrb_free_context(mrb_state *mrb, struct mrb_context *c);
+void mrb_gc_get_stat(mrb_state *mrb, mrb_gc_stat *stat);
+void mrb_gc_clear_stat(mrb_state *mrb);
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
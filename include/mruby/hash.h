@@ -14,7 +14,7 @@ extern "C" {
 struct RHash {
   MRB_OBJECT_HEADER;
   struct iv_tbl *iv;
-  struct kh_ht *ht;
+  struct htable *ht;
 };
 
 #define mrb_hash_ptr(v)    ((struct RHash*)(mrb_ptr(v)))
@@ -31,13 +31,15 @@ mrb_value mrb_hash_keys(mrb_state *mrb, mrb_value hash);
 mrb_value mrb_check_hash_type(mrb_state *mrb, mrb_value hash);
 mrb_value mrb_hash_empty_p(mrb_state *mrb, mrb_value self);
 mrb_value mrb_hash_clear(mrb_state *mrb, mrb_value hash);
+typedef int (mrb_hash_foreach_func)(mrb_state *mrb, mrb_value key, mrb_value val, void *data);
+void mrb_hash_foreach(mrb_state *mrb, struct RHash *hash, mrb_hash_foreach_func *func, void *p);
 
-/* RHASH_TBL allocates st_table if not available. */
 #define RHASH(obj)   ((struct RHash*)(mrb_ptr(obj)))
 #define RHASH_TBL(h)          (RHASH(h)->ht)
 #define RHASH_IFNONE(h)       mrb_iv_get(mrb, (h), mrb_intern_lit(mrb, "ifnone"))
 #define RHASH_PROCDEFAULT(h)  RHASH_IFNONE(h)
-struct kh_ht * mrb_hash_tbl(mrb_state *mrb, mrb_value hash);
+/* mrb_hash_tbl allocates the table if not available. */
+struct htable *mrb_hash_tbl(mrb_state *mrb, mrb_value hash);
 
 #define MRB_HASH_PROC_DEFAULT 256
 #define MRB_RHASH_PROCDEFAULT_P(h) (RHASH(h)->flags & MRB_HASH_PROC_DEFAULT)
@@ -45,6 +47,9 @@ struct kh_ht * mrb_hash_tbl(mrb_state *mrb, mrb_value hash);
 /* GC functions */
 void mrb_gc_mark_hash(mrb_state*, struct RHash*);
 size_t mrb_gc_mark_hash_size(mrb_state*, struct RHash*);
+void mrb_gc_mark_hash_slots(mrb_state*, struct RHash*, size_t, size_t);
+size_t mrb_gc_hash_slots(mrb_state*, struct RHash*);
+size_t mrb_gc_hash_bytes(mrb_state*, struct RHash*);
 void mrb_gc_free_hash(mrb_state*, struct RHash*);
 
 #if defined(__cplusplus)
@@ -45,6 +45,15 @@ static const uint8_t __m_either[8] = {0x03, 0x0c, 0x30, 0xc0};
   v++;\
 } while (0)
 
+/* the control bytes of a group of buckets of a Swiss table (see below).
+   kh_exist() and friends serve both table layouts and tell them apart
+   at compile time by the type of ed_flags. */
+#define KH_GROUP_SIZE 16
+typedef struct kh_group {
+  uint8_t ctrl[KH_GROUP_SIZE];
+} kh_group_t;
+#define kh_swiss_p(h) (sizeof(*(h)->ed_flags) == sizeof(kh_group_t))
+
 /* declare struct kh_xxx and kh_xxx_funcs
 
    name: hash name
@@ -64,6 +73,9 @@ static const uint8_t __m_either[8] = {0x03, 0x0c, 0x30, 0xc0};
     khint_t mask;                                                       \
     khint_t inc;                                                        \
   } kh_##name##_t;                                                      \
+  KHASH_DECLARE_FUNCS(name, khkey_t)
+
+#define KHASH_DECLARE_FUNCS(name, khkey_t)                              \
   void kh_alloc_##name(mrb_state *mrb, kh_##name##_t *h);               \
   kh_##name##_t *kh_init_##name##_size(mrb_state *mrb, khint_t size);   \
   kh_##name##_t *kh_init_##name(mrb_state *mrb);                        \
@@ -216,6 +228,270 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
   }
 
 
+/*
+  = Swiss tables
+
+  KHASH_SWISS_DECLARE and KHASH_SWISS_DEFINE take the same arguments as
+  KHASH_DECLARE and KHASH_DEFINE and generate the same kh_xxx functions,
+  so an instantiation switches layouts by changing the two macro names.
+
+  The table keeps one control byte per bucket in ed_flags: KH_CTRL_EMPTY,
+  KH_CTRL_DELETED, or the top 7 bits (the tag) of the mixed hash of the
+  key in it.  Buckets come in groups of KH_GROUP_SIZE, and a lookup
+  probes whole groups, checking all the control bytes of a group at once
+  (with SSE2 where available) for the tag of the key, so it only compares
+  keys whose tags match and stops at the first group with an empty
+  bucket.  Groups are probed triangularly and the table is filled up to
+  7/8.  Deleting a key leaves KH_CTRL_DELETED only if its group has no
+  empty bucket; no probe can have gone past such a group.
+
+  mask is the number of groups - 1; inc is unused.
+*/
+
+#define KH_CTRL_EMPTY   0x80
+#define KH_CTRL_DELETED 0xfe
+#define KH_CTRL_FREE    0x80    /* set in empty and deleted */
+#define KH_SWISS_UPPER_BOUND(x) ((x) - (x)/8)
+#define KH_CTRL(h) ((uint8_t*)(h)->ed_flags)
+
+#if defined(ENABLE_SIMD) && defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+
+/* bit i set if byte i of the group is c */
+static inline uint32_t
+kh_group_match(const uint8_t *g, uint8_t c)
+{
+  __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+}
+
+/* bit i set if bucket i of the group is empty or deleted */
+static inline uint32_t
+kh_group_free(const uint8_t *g)
+{
+  return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+}
+#else
+static inline uint32_t
+kh_group_match(const uint8_t *g, uint8_t c)
+{
+  uint32_t m = 0;
+  int i;
+
+  for (i = 0; i < KH_GROUP_SIZE; i++) {
+    if (g[i] == c) m |= (uint32_t)1 << i;
+  }
+  return m;
+}
+
+static inline uint32_t
+kh_group_free(const uint8_t *g)
+{
+  uint32_t m = 0;
+  int i;
+
+  for (i = 0; i < KH_GROUP_SIZE; i++) {
+    if (g[i] & KH_CTRL_FREE) m |= (uint32_t)1 << i;
+  }
+  return m;
+}
+#endif
+
+static inline int
+kh_group_first(uint32_t m)
+{
+#ifdef __GNUC__
+  return __builtin_ctz(m);
+#else
+  int i = 0;
+
+  while (!(m & 1)) {
+    m >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+/* spread a hash over the group number (low bits) and the tag (top 7
+   bits); weak hashes such as kh_int_hash_func() and the X31 string hash
+   vary mostly in their low bits */
+static inline khint_t
+kh_swiss_hash(khint_t h)
+{
+  h *= 0x9e3779b1;
+  return h ^ (h >> 16);
+}
+#define KH_SWISS_GROUP(h, hv) ((hv) & (h)->mask)
+#define KH_SWISS_TAG(hv) ((uint8_t)((hv) >> 25))
+
+#define KHASH_SWISS_DECLARE(name, khkey_t, khval_t, kh_is_map)          \
+  typedef struct kh_##name {                                            \
+    khint_t n_buckets;                                                  \
+    khint_t size;                                                       \
+    khint_t n_occupied;                                                 \
+    khint_t upper_bound;                                                \
+    kh_group_t *ed_flags;                                               \
+    khkey_t *keys;                                                      \
+    khval_t *vals;                                                      \
+    khint_t mask;                                                       \
+    khint_t inc;                                                        \
+  } kh_##name##_t;                                                      \
+  KHASH_DECLARE_FUNCS(name, khkey_t)
+
+#define KHASH_SWISS_DEFINE(name, khkey_t, khval_t, kh_is_map, __hash_func, __hash_equal) \
+  void kh_alloc_##name(mrb_state *mrb, kh_##name##_t *h)                \
+  {                                                                     \
+    khint_t sz = h->n_buckets;                                          \
+    int len = sizeof(khkey_t) + (kh_is_map ? sizeof(khval_t) : 0);      \
+    uint8_t *p = (uint8_t*)mrb_malloc(mrb, sz+len*sz);                  \
+    h->size = h->n_occupied = 0;                                        \
+    h->upper_bound = KH_SWISS_UPPER_BOUND(sz);                          \
+    h->keys = (khkey_t *)p;                                             \
+    h->vals = kh_is_map ? (khval_t *)(p+sizeof(khkey_t)*sz) : NULL;     \
+    h->ed_flags = (kh_group_t*)(p+len*sz);                              \
+    memset(h->ed_flags, KH_CTRL_EMPTY, sz);                             \
+    h->mask = sz/KH_GROUP_SIZE-1;                                       \
+    h->inc = 0;                                                         \
+  }                                                                     \
+  kh_##name##_t *kh_init_##name##_size(mrb_state *mrb, khint_t size) {  \
+    kh_##name##_t *h = (kh_##name##_t*)mrb_calloc(mrb, 1, sizeof(kh_##name##_t)); \
+    if (size < KH_GROUP_SIZE)                                           \
+      size = KH_GROUP_SIZE;                                             \
+    khash_power2(size);                                                 \
+    h->n_buckets = size;                                                \
+    kh_alloc_##name(mrb, h);                                            \
+    return h;                                                           \
+  }                                                                     \
+  kh_##name##_t *kh_init_##name(mrb_state *mrb){                        \
+    return kh_init_##name##_size(mrb, KHASH_DEFAULT_SIZE);              \
+  }                                                                     \
+  void kh_destroy_##name(mrb_state *mrb, kh_##name##_t *h)              \
+  {                                                                     \
+    if (h) {                                                            \
+      mrb_free(mrb, h->keys);                                           \
+      mrb_free(mrb, h);                                                 \
+    }                                                                   \
+  }                                                                     \
+  void kh_clear_##name(mrb_state *mrb, kh_##name##_t *h)                \
+  {                                                                     \
+    (void)mrb;                                                          \
+    if (h && h->ed_flags) {                                             \
+      memset(h->ed_flags, KH_CTRL_EMPTY, h->n_buckets);                 \
+      h->size = h->n_occupied = 0;                                      \
+    }                                                                   \
+  }                                                                     \
+  khint_t kh_get_##name(mrb_state *mrb, kh_##name##_t *h, khkey_t key)  \
+  {                                                                     \
+    khint_t hv = kh_swiss_hash(__hash_func(mrb,key));                   \
+    khint_t g = KH_SWISS_GROUP(h, hv), step = 0;                        \
+    uint8_t tag = KH_SWISS_TAG(hv);                                     \
+    (void)mrb;                                                          \
+    for (;;) {                                                          \
+      const uint8_t *ctrl = h->ed_flags[g].ctrl;                        \
+      uint32_t m = kh_group_match(ctrl, tag);                           \
+      while (m) {                                                       \
+        khint_t k = g*KH_GROUP_SIZE + kh_group_first(m);                \
+        if (__hash_equal(mrb,h->keys[k], key)) return k;                \
+        m &= m - 1;                                                     \
+      }                                                                 \
+      if (kh_group_match(ctrl, KH_CTRL_EMPTY)) return h->n_buckets;     \
+      g = (g + ++step) & h->mask;                                       \
+    }                                                                   \
+  }                                                                     \
+  void kh_resize_##name(mrb_state *mrb, kh_##name##_t *h, khint_t new_n_buckets) \
+  {                                                                     \
+    if (new_n_buckets < KH_GROUP_SIZE)                                  \
+      new_n_buckets = KH_GROUP_SIZE;                                    \
+    khash_power2(new_n_buckets);                                        \
+    {                                                                   \
+      uint8_t *old_ctrl = KH_CTRL(h);                                   \
+      khkey_t *old_keys = h->keys;                                      \
+      khval_t *old_vals = h->vals;                                      \
+      khint_t old_n_buckets = h->n_buckets;                             \
+      khint_t i, n = 0;                                                 \
+      h->n_buckets = new_n_buckets;                                     \
+      kh_alloc_##name(mrb, h);                                          \
+      /* relocate; the keys are known to be distinct */                 \
+      for (i=0 ; i<old_n_buckets ; i++) {                               \
+        if (!(old_ctrl[i] & KH_CTRL_FREE)) {                            \
+          khint_t hv = kh_swiss_hash(__hash_func(mrb,old_keys[i]));     \
+          khint_t g = KH_SWISS_GROUP(h, hv), step = 0, k;               \
+          uint32_t m;                                                   \
+          while (!(m = kh_group_free(h->ed_flags[g].ctrl))) {           \
+            g = (g + ++step) & h->mask;                                 \
+          }                                                             \
+          k = g*KH_GROUP_SIZE + kh_group_first(m);                      \
+          KH_CTRL(h)[k] = KH_SWISS_TAG(hv);                             \
+          h->keys[k] = old_keys[i];                                     \
+          if (kh_is_map) kh_value(h,k) = old_vals[i];                   \
+          n++;                                                          \
+        }                                                               \
+      }                                                                 \
+      h->size = h->n_occupied = n;                                      \
+      mrb_free(mrb, old_keys);                                          \
+    }                                                                   \
+  }                                                                     \
+  khint_t kh_put_##name(mrb_state *mrb, kh_##name##_t *h, khkey_t key)  \
+  {                                                                     \
+    khint_t hv, g, k, step = 0;                                         \
+    uint8_t tag;                                                        \
+    if (h->n_occupied >= h->upper_bound) {                              \
+      /* grow, or just drop the deleted buckets if they fill the table */ \
+      kh_resize_##name(mrb, h, h->size >= h->upper_bound/2 ? h->n_buckets*2 : h->n_buckets); \
+    }                                                                   \
+    hv = kh_swiss_hash(__hash_func(mrb,key));                           \
+    g = KH_SWISS_GROUP(h, hv);                                          \
+    tag = KH_SWISS_TAG(hv);                                             \
+    k = h->n_buckets;                                                   \
+    for (;;) {                                                          \
+      const uint8_t *ctrl = h->ed_flags[g].ctrl;                        \
+      uint32_t m = kh_group_match(ctrl, tag);                           \
+      while (m) {                                                       \
+        khint_t i = g*KH_GROUP_SIZE + kh_group_first(m);                \
+        if (__hash_equal(mrb,h->keys[i], key)) return i;                \
+        m &= m - 1;                                                     \
+      }                                                                 \
+      if (k == h->n_buckets && (m = kh_group_free(ctrl)) != 0) {        \
+        k = g*KH_GROUP_SIZE + kh_group_first(m);                        \
+      }                                                                 \
+      if (kh_group_match(ctrl, KH_CTRL_EMPTY)) break;                   \
+      g = (g + ++step) & h->mask;                                       \
+    }                                                                   \
+    if (KH_CTRL(h)[k] == KH_CTRL_EMPTY) h->n_occupied++;                \
+    KH_CTRL(h)[k] = tag;                                                \
+    h->keys[k] = key;                                                   \
+    h->size++;                                                          \
+    return k;                                                           \
+  }                                                                     \
+  void kh_del_##name(mrb_state *mrb, kh_##name##_t *h, khint_t x)       \
+  {                                                                     \
+    (void)mrb;                                                          \
+    if (kh_group_match(h->ed_flags[x/KH_GROUP_SIZE].ctrl, KH_CTRL_EMPTY)) { \
+      KH_CTRL(h)[x] = KH_CTRL_EMPTY;                                    \
+      h->n_occupied--;                                                  \
+    }                                                                   \
+    else {                                                              \
+      KH_CTRL(h)[x] = KH_CTRL_DELETED;                                  \
+    }                                                                   \
+    h->size--;                                                          \
+  }                                                                     \
+  kh_##name##_t *kh_copy_##name(mrb_state *mrb, kh_##name##_t *h)       \
+  {                                                                     \
+    kh_##name##_t *h2;                                                  \
+    khint_t sz = h->n_buckets;                                          \
+    int len = sizeof(khkey_t) + (kh_is_map ? sizeof(khval_t) : 0);      \
+                                                                        \
+    h2 = (kh_##name##_t*)mrb_malloc(mrb, sizeof(kh_##name##_t));        \
+    *h2 = *h;                                                           \
+    h2->keys = (khkey_t*)mrb_malloc(mrb, sz+len*sz);                    \
+    memcpy(h2->keys, h->keys, sz+len*sz);                               \
+    h2->vals = kh_is_map ? (khval_t *)((uint8_t*)h2->keys+sizeof(khkey_t)*sz) : NULL; \
+    h2->ed_flags = (kh_group_t*)((uint8_t*)h2->keys+len*sz);            \
+    return h2;                                                          \
+  }
+
+
 #define khash_t(name) kh_##name##_t
 
 #define kh_init_size(name,mrb,size) kh_init_##name##_size(mrb,size)
@@ -228,7 +504,7 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
 #define kh_del(name, mrb, h, k) kh_del_##name(mrb, h, k)
 #define kh_copy(name, mrb, h) kh_copy_##name(mrb, h)
 
-#define kh_exist(h, x) (!__ac_iseither((h)->ed_flags, (x)))
+#define kh_exist(h, x) (kh_swiss_p(h) ? !(KH_CTRL(h)[x] & KH_CTRL_FREE) : !__ac_iseither(KH_CTRL(h), (x)))
 #define kh_key(h, x) ((h)->keys[x])
 #define kh_val(h, x) ((h)->vals[x])
 #define kh_value(h, x) ((h)->vals[x])
@@ -236,6 +512,7 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
 #define kh_end(h) ((h)->n_buckets)
 #define kh_size(h) ((h)->size)
 #define kh_n_buckets(h) ((h)->n_buckets)
+#define kh_flags_bytes(h) (kh_swiss_p(h) ? (h)->n_buckets : (h)->n_buckets/4)
 
 #define kh_int_hash_func(mrb,key) (khint_t)((key)^((key)<<2)^((key)>>2))
 #define kh_int_hash_equal(mrb,a, b) (a == b)
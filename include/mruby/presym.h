@@ -0,0 +1,36 @@
+/*
+** presym.h - pre-interned symbols
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_PRESYM_H
+#define MRUBY_PRESYM_H
+
+/*
+ * Symbols whose names appear in the core and gem sources are interned at
+ * build time (see tasks/presym.rake) and get fixed ids, so C code can use
+ * them without calling mrb_intern():
+ *
+ *   MRB_SYM(each)        :each
+ *   MRB_SYM_Q(nil)       :nil?
+ *   MRB_SYM_B(map)       :map!
+ *   MRB_SYM_E(name)      :name=
+ *   MRB_IVSYM(name)      :@name
+ *   MRB_CVSYM(name)      :@@name
+ *   MRB_GVSYM(name)      :$name
+ *
+ * Using one of these macros in a scanned source file is enough to make
+ * the name pre-interned.
+ */
+#include "mruby/presym/id.h"
+
+#define MRB_SYM(name) ((mrb_sym)MRB_PRESYM__##name)
+#define MRB_SYM_Q(name) ((mrb_sym)MRB_PRESYM_Q_##name)
+#define MRB_SYM_B(name) ((mrb_sym)MRB_PRESYM_B_##name)
+#define MRB_SYM_E(name) ((mrb_sym)MRB_PRESYM_E_##name)
+#define MRB_IVSYM(name) ((mrb_sym)MRB_PRESYM_A_##name)
+#define MRB_CVSYM(name) ((mrb_sym)MRB_PRESYM_C_##name)
+#define MRB_GVSYM(name) ((mrb_sym)MRB_PRESYM_G_##name)
+
+#endif  /* MRUBY_PRESYM_H */
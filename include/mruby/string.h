@@ -54,8 +54,16 @@ mrb_int mrb_str_strlen(mrb_state*, struct RString*);
 #define MRB_STR_EMBED     4
 #define MRB_STR_EMBED_LEN_MASK 0xf8
 #define MRB_STR_EMBED_LEN_SHIFT 3
+#define MRB_STR_HASHED    256
+#define MRB_STR_INDEXED   512   /* character index cached by mruby-string-utf8 */
+/* flags that describe the contents; cleared whenever they change */
+#define MRB_STR_CACHE_MASK (MRB_STR_HASHED|MRB_STR_INDEXED)
+#define MRB_STR_FROZEN    1024
+#define MRB_STR_FSTRING   2048  /* member of the frozen string table */
+#define MRB_STR_FROZEN_P(s) (((s)->flags & MRB_STR_FROZEN) != 0)
 
 void mrb_gc_free_str(mrb_state*, struct RString*);
+void mrb_gc_mark_fstr_lits(mrb_state*);
 void mrb_str_modify(mrb_state*, struct RString*);
 void mrb_str_concat(mrb_state*, mrb_value, mrb_value);
 mrb_value mrb_str_plus(mrb_state*, mrb_value, mrb_value);
@@ -77,6 +85,7 @@ mrb_value mrb_str_to_inum(mrb_state *mrb, mrb_value str, int base, mrb_bool badc
 double mrb_str_to_dbl(mrb_state *mrb, mrb_value str, mrb_bool badcheck);
 mrb_value mrb_str_to_str(mrb_state *mrb, mrb_value str);
 mrb_int mrb_str_hash(mrb_state *mrb, mrb_value str);
+uint32_t mrb_str_hash_bytes(mrb_state *mrb, const char *p, size_t len);
 mrb_value mrb_str_buf_append(mrb_state *mrb, mrb_value str, mrb_value str2);
 mrb_value mrb_str_inspect(mrb_state *mrb, mrb_value str);
 mrb_bool mrb_str_equal(mrb_state *mrb, mrb_value str1, mrb_value str2);
@@ -89,6 +98,39 @@ mrb_value mrb_str_append(mrb_state *mrb, mrb_value str, mrb_value str2);
 int mrb_str_cmp(mrb_state *mrb, mrb_value str1, mrb_value str2);
 char *mrb_str_to_cstr(mrb_state *mrb, mrb_value str);
 mrb_value mrb_str_pool(mrb_state *mrb, mrb_value str);
+mrb_value mrb_str_freeze(mrb_state *mrb, mrb_value str);
+mrb_value mrb_str_fstring(mrb_state *mrb, mrb_value str);
+mrb_value mrb_str_frozen_literal(mrb_state *mrb, mrb_value lit);
+void mrb_str_forget_literal(mrb_state *mrb, mrb_value lit);
+mrb_int mrb_memsearch(const void *x, mrb_int m, const void *y, mrb_int n);
+mrb_int mrb_memrsearch(const void *x, mrb_int m, const void *y, mrb_int n);
+
+/*
+ * Per-VM caches of data derived from strings.  A cache is an Array of
+ * MRB_STR_CACHE_SLOTS Data objects kept in the hidden instance variable
+ * name of owner and indexed by a hash; a new entry replaces the one in
+ * its slot.
+ */
+#define MRB_STR_CACHE_SLOTS 64
+
+mrb_value mrb_str_cache_get(mrb_state *mrb, struct RObject *owner, mrb_sym name, uint32_t hash);
+void mrb_str_cache_set(mrb_state *mrb, struct RObject *owner, mrb_sym name, uint32_t hash, mrb_value obj);
+
+/* the head of an entry compiled from the contents of a string */
+typedef struct mrb_str_cache_key {
+  uint32_t hash;
+  mrb_int len;
+  char *str;                    /* copy of the string, freed by the entry */
+} mrb_str_cache_key;
+
+typedef struct mrb_str_cache_type {
+  const struct mrb_data_type *dtype;
+  size_t size;                  /* of an entry, which starts with a key */
+  mrb_int max_len;              /* entries of longer strings are not kept */
+  void (*compile)(mrb_state *mrb, void *entry);
+} mrb_str_cache_type;
+
+void *mrb_str_cache_fetch(mrb_state *mrb, struct RObject *owner, mrb_sym name, mrb_value str, const mrb_str_cache_type *type);
 
 /* For backward compatibility */
 static inline mrb_value
@@ -9,13 +9,17 @@
 
 #ifdef MRB_USE_FLOAT
   typedef float mrb_float;
-# define mrb_float_to_str(buf, i) sprintf(buf, "%.7e", i)
 # define str_to_mrb_float(buf) strtof(buf, NULL)
 #else
   typedef double mrb_float;
-# define mrb_float_to_str(buf, i) sprintf(buf, "%.16e", i)
-# define str_to_mrb_float(buf) strtod(buf, NULL)
+# define str_to_mrb_float(buf) mrb_float_read(buf, NULL)
 #endif
+#define mrb_float_to_str(buf, i) mrb_float_to_cstr(buf, i)
+
+/* shortest round-trip conversions (src/fpconv.c) */
+#define MRB_FLOAT_STR_MAX 32
+int mrb_float_to_cstr(char *buf, mrb_float f);
+double mrb_float_read(const char *str, char **endp);
 
 #if defined(MRB_INT16) && defined(MRB_INT64)
 # error "You can't define MRB_INT16 and MRB_INT64 at the same time."
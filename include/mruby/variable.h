@@ -47,6 +47,8 @@ mrb_value mrb_iv_get(mrb_state *mrb, mrb_value obj, mrb_sym sym);
 void mrb_iv_set(mrb_state *mrb, mrb_value obj, mrb_sym sym, mrb_value v);
 mrb_bool mrb_iv_defined(mrb_state*, mrb_value, mrb_sym);
 mrb_value mrb_iv_remove(mrb_state *mrb, mrb_value obj, mrb_sym sym);
+typedef int (mrb_iv_foreach_func)(mrb_state*,mrb_sym,mrb_value,void*);
+void mrb_iv_foreach(mrb_state *mrb, mrb_value obj, mrb_iv_foreach_func *func, void *p);
 void mrb_iv_copy(mrb_state *mrb, mrb_value dst, mrb_value src);
 int mrb_const_defined_at(mrb_state *mrb, struct RClass *klass, mrb_sym id);
 mrb_value mrb_mod_constants(mrb_state *mrb, mrb_value mod);
@@ -70,6 +72,7 @@ void mrb_gc_mark_gv(mrb_state*);
 void mrb_gc_free_gv(mrb_state*);
 void mrb_gc_mark_iv(mrb_state*, struct RObject*);
 size_t mrb_gc_mark_iv_size(mrb_state*, struct RObject*);
+size_t mrb_gc_iv_bytes(mrb_state*, struct RObject*);
 void mrb_gc_free_iv(mrb_state*, struct RObject*);
 
 #if defined(__cplusplus)
@@ -14,3 +14,9 @@ assert('regression for #1572') do
   o = `bin/mruby -b #{bin.path}`.strip
   assert_equal o, '"ok"'
 end
+
+assert('float literals warn only when out of range') do
+  assert_equal "5.0e-324\n", `bin/mruby -e 'p 5e-324' 2>&1`
+  assert_equal "-e:1:7: float 1e400 out of range\ninf\n", `bin/mruby -e 'p 1e400' 2>&1`
+  assert_equal "-e:1:8: float 1e-400 out of range\n0.0\n", `bin/mruby -e 'p 1e-400' 2>&1`
+end
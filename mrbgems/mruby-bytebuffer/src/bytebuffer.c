@@ -0,0 +1,494 @@
+/*
+** bytebuffer.c - binary fields of String, ByteBuffer class
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <string.h>
+#include "mruby.h"
+#include "mruby/class.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+#include "mruby/presym.h"
+
+/*
+  Fixed-width integers and floats are read and written in place at a
+  byte offset of a String, with no unpacking into an Array:
+
+    pkt.get_u16be(2)            # 16-bit unsigned, big endian, at byte 2
+    pkt.set_u32le(4, 0xdeadbeef)
+
+  For each type in BB_FIELDS String gets get_TYPE(offset) and
+  set_TYPE(offset, value), and ByteBuffer, a cursor over a String for
+  streaming protocols, gets read_TYPE and write_TYPE(value).  Offsets
+  may be negative to count from the end.  Integers that do not fit in a
+  Fixnum are returned as Float, as integer arithmetic does on overflow.
+*/
+
+typedef struct bb_field {
+  unsigned char size;           /* bytes */
+  unsigned char sign;           /* signed integer */
+  unsigned char flt;            /* IEEE 754 float */
+  unsigned char le;             /* little endian */
+} bb_field;
+
+#define BB_FIELDS(X) \
+  X(u8,    1, 0, 0, 0) \
+  X(s8,    1, 1, 0, 0) \
+  X(u16be, 2, 0, 0, 0) \
+  X(u16le, 2, 0, 0, 1) \
+  X(s16be, 2, 1, 0, 0) \
+  X(s16le, 2, 1, 0, 1) \
+  X(u32be, 4, 0, 0, 0) \
+  X(u32le, 4, 0, 0, 1) \
+  X(s32be, 4, 1, 0, 0) \
+  X(s32le, 4, 1, 0, 1) \
+  X(u64be, 8, 0, 0, 0) \
+  X(u64le, 8, 0, 0, 1) \
+  X(s64be, 8, 1, 0, 0) \
+  X(s64le, 8, 1, 0, 1) \
+  X(f32be, 4, 0, 1, 0) \
+  X(f32le, 4, 0, 1, 1) \
+  X(f64be, 8, 0, 1, 0) \
+  X(f64le, 8, 0, 1, 1)
+
+static inline uint64_t
+bb_load(const unsigned char *p, const bb_field *f)
+{
+  uint64_t v = 0;
+  int i;
+
+  if (f->le) {
+    for (i = f->size; i-- > 0;) v = (v << 8) | p[i];
+  }
+  else {
+    for (i = 0; i < f->size; i++) v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+static inline void
+bb_store(unsigned char *p, uint64_t v, const bb_field *f)
+{
+  int i;
+
+  if (f->le) {
+    for (i = 0; i < f->size; i++, v >>= 8) p[i] = (unsigned char)v;
+  }
+  else {
+    for (i = f->size; i-- > 0; v >>= 8) p[i] = (unsigned char)v;
+  }
+}
+
+static mrb_value
+bb_value(mrb_state *mrb, uint64_t v, const bb_field *f)
+{
+  if (f->flt) {
+    if (f->size == 4) {
+      uint32_t u = (uint32_t)v;
+      float x;
+
+      memcpy(&x, &u, sizeof(x));
+      return mrb_float_value(mrb, (mrb_float)x);
+    }
+    else {
+      double x;
+
+      memcpy(&x, &v, sizeof(x));
+      return mrb_float_value(mrb, (mrb_float)x);
+    }
+  }
+  if (f->sign) {
+    int shift = 64 - f->size * 8;
+    int64_t s = (int64_t)(v << shift) >> shift;
+
+    if (MRB_INT_MIN <= s && s <= MRB_INT_MAX) {
+      return mrb_fixnum_value((mrb_int)s);
+    }
+    return mrb_float_value(mrb, (mrb_float)s);
+  }
+  if (v <= (uint64_t)MRB_INT_MAX) {
+    return mrb_fixnum_value((mrb_int)v);
+  }
+  return mrb_float_value(mrb, (mrb_float)v);
+}
+
+/* the bytes of val; integers may be given signed or unsigned */
+static uint64_t
+bb_bits(mrb_state *mrb, mrb_value val, const bb_field *f)
+{
+  int bits = f->size * 8;
+
+  if (f->flt) {
+    mrb_float x = mrb_float(mrb_Float(mrb, val));
+
+    if (f->size == 4) {
+      float y = (float)x;
+      uint32_t u;
+
+      memcpy(&u, &y, sizeof(u));
+      return u;
+    }
+    else {
+      double y = (double)x;
+      uint64_t u;
+
+      memcpy(&u, &y, sizeof(u));
+      return u;
+    }
+  }
+  if (mrb_float_p(val)) {
+    double d = (double)mrb_float(val);
+    double lim = bits == 64 ? 18446744073709551616.0 : (double)((uint64_t)1 << bits);
+
+    if (d >= -lim / 2 && d < lim) {
+      return d < 0 ? (uint64_t)(int64_t)d : (uint64_t)d;
+    }
+  }
+  else {
+    int64_t n;
+
+    if (!mrb_fixnum_p(val)) {
+      val = mrb_to_int(mrb, val);
+    }
+    n = (int64_t)mrb_fixnum(val);
+    if (bits == 64 || (-((int64_t)1 << (bits - 1)) <= n && n < ((int64_t)1 << bits))) {
+      return (uint64_t)n;
+    }
+  }
+  mrb_raisef(mrb, E_RANGE_ERROR, "%S out of range for %S-bit field", val, mrb_fixnum_value(bits));
+  return 0;                     /* not reached */
+}
+
+static mrb_int
+bb_offset(mrb_state *mrb, mrb_value str, mrb_int off, mrb_int size)
+{
+  mrb_int len = RSTRING_LEN(str);
+  mrb_int pos = off < 0 ? off + len : off;
+
+  if (pos < 0 || len - pos < size) {
+    mrb_raisef(mrb, E_INDEX_ERROR, "offset %S out of string", mrb_fixnum_value(off));
+  }
+  return pos;
+}
+
+static inline mrb_value
+str_get(mrb_state *mrb, mrb_value self, const bb_field *f)
+{
+  mrb_int off;
+
+  mrb_get_args(mrb, "i", &off);
+  off = bb_offset(mrb, self, off, f->size);
+  return bb_value(mrb, bb_load((unsigned char*)RSTRING_PTR(self) + off, f), f);
+}
+
+static inline mrb_value
+str_set(mrb_state *mrb, mrb_value self, const bb_field *f)
+{
+  mrb_int off;
+  mrb_value val;
+  uint64_t v;
+
+  mrb_get_args(mrb, "io", &off, &val);
+  off = bb_offset(mrb, self, off, f->size);
+  v = bb_bits(mrb, val, f);
+  mrb_str_modify(mrb, mrb_str_ptr(self));
+  bb_store((unsigned char*)RSTRING_PTR(self) + off, v, f);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     str.get_bytes(offset, len)  -> string
+ *
+ *  Returns the <i>len</i> bytes at <i>offset</i>.  A long result shares
+ *  the buffer of <i>str</i> rather than copying it.
+ */
+static mrb_value
+str_get_bytes(mrb_state *mrb, mrb_value self)
+{
+  mrb_int off, len;
+
+  mrb_get_args(mrb, "ii", &off, &len);
+  if (len < 0) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative length %S", mrb_fixnum_value(len));
+  }
+  off = bb_offset(mrb, self, off, len);
+  return mrb_str_substr(mrb, self, off, len);
+}
+
+/*
+  = ByteBuffer
+
+  A ByteBuffer reads and writes fields in sequence at its position in a
+  String (@string), which is used in place: reads take from it and
+  writes modify it, extending it as needed.
+*/
+
+static mrb_value
+bb_string(mrb_state *mrb, mrb_value self)
+{
+  mrb_value str = mrb_iv_get(mrb, self, MRB_IVSYM(string));
+
+  if (!mrb_string_p(str)) {
+    mrb_raise(mrb, E_TYPE_ERROR, "uninitialized ByteBuffer");
+  }
+  return str;
+}
+
+static mrb_int
+bb_pos(mrb_state *mrb, mrb_value self)
+{
+  mrb_value pos = mrb_iv_get(mrb, self, MRB_IVSYM(pos));
+
+  return mrb_fixnum_p(pos) ? mrb_fixnum(pos) : 0;
+}
+
+static void
+bb_set_pos(mrb_state *mrb, mrb_value self, mrb_int pos)
+{
+  mrb_iv_set(mrb, self, MRB_IVSYM(pos), mrb_fixnum_value(pos));
+}
+
+/* a pointer to len bytes at the position, and advances past them */
+static unsigned char*
+bb_take(mrb_state *mrb, mrb_value self, mrb_value str, mrb_int len)
+{
+  mrb_int pos = bb_pos(mrb, self);
+
+  if (RSTRING_LEN(str) - pos < len) {
+    mrb_raise(mrb, E_INDEX_ERROR, "read past end of buffer");
+  }
+  bb_set_pos(mrb, self, pos + len);
+  return (unsigned char*)RSTRING_PTR(str) + pos;
+}
+
+/* makes room for len bytes at the position, and advances past them */
+static unsigned char*
+bb_room(mrb_state *mrb, mrb_value self, mrb_value str, mrb_int len)
+{
+  mrb_int pos = bb_pos(mrb, self);
+  mrb_int slen = RSTRING_LEN(str);
+
+  if (pos > MRB_INT_MAX - len) {
+    mrb_raisef(mrb, E_INDEX_ERROR, "position %S out of range", mrb_fixnum_value(pos));
+  }
+  if (slen - pos < len) {
+    mrb_str_resize(mrb, str, pos + len);
+    if (slen < pos) {
+      memset(RSTRING_PTR(str) + slen, 0, pos - slen);
+    }
+  }
+  else {
+    mrb_str_modify(mrb, mrb_str_ptr(str));
+  }
+  bb_set_pos(mrb, self, pos + len);
+  return (unsigned char*)RSTRING_PTR(str) + pos;
+}
+
+static inline mrb_value
+bb_read(mrb_state *mrb, mrb_value self, const bb_field *f)
+{
+  mrb_value str = bb_string(mrb, self);
+
+  return bb_value(mrb, bb_load(bb_take(mrb, self, str, f->size), f), f);
+}
+
+static inline mrb_value
+bb_write(mrb_state *mrb, mrb_value self, const bb_field *f)
+{
+  mrb_value str = bb_string(mrb, self);
+  mrb_value val;
+  uint64_t v;
+
+  mrb_get_args(mrb, "o", &val);
+  v = bb_bits(mrb, val, f);
+  bb_store(bb_room(mrb, self, str, f->size), v, f);
+  return self;
+}
+
+#define BB_DEFINE(name, size, sign, flt, le) \
+  static const bb_field bb_##name = { size, sign, flt, le }; \
+  static mrb_value str_get_##name(mrb_state *mrb, mrb_value self) { return str_get(mrb, self, &bb_##name); } \
+  static mrb_value str_set_##name(mrb_state *mrb, mrb_value self) { return str_set(mrb, self, &bb_##name); } \
+  static mrb_value bb_read_##name(mrb_state *mrb, mrb_value self) { return bb_read(mrb, self, &bb_##name); } \
+  static mrb_value bb_write_##name(mrb_state *mrb, mrb_value self) { return bb_write(mrb, self, &bb_##name); }
+
+BB_FIELDS(BB_DEFINE)
+
+/*
+ *  call-seq:
+ *     ByteBuffer.new(str="")  -> byte_buffer
+ *
+ *  Returns a buffer positioned at the start of <i>str</i>, which is
+ *  not copied.
+ */
+static mrb_value
+bb_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_value str = mrb_nil_value();
+
+  mrb_get_args(mrb, "|S", &str);
+  if (mrb_nil_p(str)) {
+    str = mrb_str_new(mrb, NULL, 0);
+  }
+  mrb_iv_set(mrb, self, MRB_IVSYM(string), str);
+  bb_set_pos(mrb, self, 0);
+  return self;
+}
+
+static mrb_value
+bb_get_string(mrb_state *mrb, mrb_value self)
+{
+  return bb_string(mrb, self);
+}
+
+static mrb_value
+bb_get_pos(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(bb_pos(mrb, self));
+}
+
+/*
+ *  call-seq:
+ *     buf.pos = n   -> n
+ *     buf.seek(n)   -> buf
+ *
+ *  Moves the position to byte <i>n</i>, which may lie past the end for
+ *  writing; the gap is filled with zeros.
+ */
+static mrb_value
+bb_set_pos_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_int pos;
+
+  mrb_get_args(mrb, "i", &pos);
+  if (pos < 0) {
+    mrb_raisef(mrb, E_INDEX_ERROR, "negative position %S", mrb_fixnum_value(pos));
+  }
+  bb_set_pos(mrb, self, pos);
+  return mrb_fixnum_value(pos);
+}
+
+static mrb_value
+bb_seek(mrb_state *mrb, mrb_value self)
+{
+  bb_set_pos_m(mrb, self);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     buf.skip(n)  -> buf
+ *
+ *  Moves the position <i>n</i> bytes forward (backward if negative).
+ */
+static mrb_value
+bb_skip(mrb_state *mrb, mrb_value self)
+{
+  mrb_int n, pos;
+
+  mrb_get_args(mrb, "i", &n);
+  pos = bb_pos(mrb, self);
+  if (n > 0 && pos > MRB_INT_MAX - n) {
+    mrb_raisef(mrb, E_INDEX_ERROR, "position %S out of range", mrb_fixnum_value(pos));
+  }
+  pos += n;
+  if (pos < 0) {
+    mrb_raisef(mrb, E_INDEX_ERROR, "negative position %S", mrb_fixnum_value(pos));
+  }
+  bb_set_pos(mrb, self, pos);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     buf.remaining  -> integer
+ *
+ *  Returns the number of bytes after the position.
+ */
+static mrb_value
+bb_remaining(mrb_state *mrb, mrb_value self)
+{
+  mrb_int n = RSTRING_LEN(bb_string(mrb, self)) - bb_pos(mrb, self);
+
+  return mrb_fixnum_value(n < 0 ? 0 : n);
+}
+
+static mrb_value
+bb_eof(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(bb_pos(mrb, self) >= RSTRING_LEN(bb_string(mrb, self)));
+}
+
+/*
+ *  call-seq:
+ *     buf.read_bytes(len)  -> string
+ *
+ *  Returns the next <i>len</i> bytes.  A long result shares the buffer
+ *  of the string rather than copying it.
+ */
+static mrb_value
+bb_read_bytes(mrb_state *mrb, mrb_value self)
+{
+  mrb_value str = bb_string(mrb, self);
+  mrb_int len, pos = bb_pos(mrb, self);
+
+  mrb_get_args(mrb, "i", &len);
+  if (len < 0) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative length %S", mrb_fixnum_value(len));
+  }
+  bb_take(mrb, self, str, len);
+  return mrb_str_substr(mrb, str, pos, len);
+}
+
+static mrb_value
+bb_write_bytes(mrb_state *mrb, mrb_value self)
+{
+  mrb_value str = bb_string(mrb, self);
+  mrb_value data;
+  mrb_int len;
+  unsigned char *p;
+
+  mrb_get_args(mrb, "S", &data);
+  len = RSTRING_LEN(data);
+  p = bb_room(mrb, self, str, len);
+  /* data may be the buffer's own string, just resized */
+  memmove(p, RSTRING_PTR(data), len);
+  return self;
+}
+
+void
+mrb_mruby_bytebuffer_gem_init(mrb_state* mrb)
+{
+  struct RClass *s = mrb->string_class;
+  struct RClass *bb;
+
+  bb = mrb_define_class(mrb, "ByteBuffer", mrb->object_class);
+
+#define BB_INIT(name, size, sign, flt, le) \
+  mrb_define_method(mrb, s, "get_" #name, str_get_##name, MRB_ARGS_REQ(1)); \
+  mrb_define_method(mrb, s, "set_" #name, str_set_##name, MRB_ARGS_REQ(2)); \
+  mrb_define_method(mrb, bb, "read_" #name, bb_read_##name, MRB_ARGS_NONE()); \
+  mrb_define_method(mrb, bb, "write_" #name, bb_write_##name, MRB_ARGS_REQ(1));
+  BB_FIELDS(BB_INIT)
+#undef BB_INIT
+
+  mrb_define_method(mrb, s, "get_bytes", str_get_bytes, MRB_ARGS_REQ(2));
+
+  mrb_define_method(mrb, bb, "initialize", bb_initialize, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, bb, "string", bb_get_string, MRB_ARGS_NONE());
+  mrb_define_method(mrb, bb, "pos", bb_get_pos, MRB_ARGS_NONE());
+  mrb_define_method(mrb, bb, "pos=", bb_set_pos_m, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, bb, "seek", bb_seek, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, bb, "skip", bb_skip, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, bb, "remaining", bb_remaining, MRB_ARGS_NONE());
+  mrb_define_method(mrb, bb, "eof?", bb_eof, MRB_ARGS_NONE());
+  mrb_define_method(mrb, bb, "read_bytes", bb_read_bytes, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, bb, "write_bytes", bb_write_bytes, MRB_ARGS_REQ(1));
+}
+
+void
+mrb_mruby_bytebuffer_gem_final(mrb_state* mrb)
+{
+}
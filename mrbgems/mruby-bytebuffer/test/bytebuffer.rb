@@ -0,0 +1,97 @@
+##
+# String binary field and ByteBuffer Test
+
+assert('String#get_u8, #get_s8') do
+  s = "\x01\xff"
+  assert_equal 1, s.get_u8(0)
+  assert_equal 255, s.get_u8(1)
+  assert_equal(-1, s.get_s8(1))
+  assert_equal 255, s.get_u8(-1)
+  assert_raise(IndexError) { s.get_u8(2) }
+  assert_raise(IndexError) { s.get_u8(-3) }
+end
+
+assert('String#get_u16be and friends') do
+  s = "\x12\x34\xff\xfe"
+  assert_equal 0x1234, s.get_u16be(0)
+  assert_equal 0x3412, s.get_u16le(0)
+  assert_equal 0xfffe, s.get_u16be(2)
+  assert_equal(-2, s.get_s16be(2))
+  assert_equal(-257, s.get_s16le(2))
+  assert_equal 0x1234fffe, s.get_u32be(0)
+  assert_equal(-16829422, s.get_s32le(0))
+  assert_equal 4278137874.0, s.get_u32le(0)
+  assert_raise(IndexError) { s.get_u16be(3) }
+end
+
+assert('String#get_u64be, #get_f64le, #get_f32be') do
+  s = "\x00\x00\x00\x00\x00\x00\x01\x00"
+  assert_equal 256, s.get_u64be(0)
+  assert_equal 1.5, "\x00\x00\x00\x00\x00\x00\xf8\x3f".get_f64le(0)
+  assert_equal(-2.0, "\xc0\x00\x00\x00".get_f32be(0))
+end
+
+assert('String#set_u16be and friends') do
+  s = "\0" * 8
+  s.set_u16be(0, 0x1234)
+  s.set_u16le(2, 0x1234)
+  s.set_s32be(4, -2)
+  assert_equal "\x12\x34\x34\x12\xff\xff\xff\xfe", s
+  s.set_u32le(0, 0xdeadbeef)
+  assert_equal 0xdeadbeef, s.get_u32le(0)
+  s.set_f64be(0, 0.1)
+  assert_equal 0.1, s.get_f64be(0)
+  assert_raise(RangeError) { s.set_u8(0, 256) }
+  assert_raise(RangeError) { s.set_s8(0, -129) }
+  assert_raise(IndexError) { s.set_u32be(6, 0) }
+  assert_raise(RuntimeError) { "ab".freeze.set_u8(0, 1) }
+end
+
+assert('String#get_bytes') do
+  s = "abcdefgh"
+  assert_equal "cde", s.get_bytes(2, 3)
+  assert_equal "", s.get_bytes(8, 0)
+  assert_raise(IndexError) { s.get_bytes(6, 3) }
+end
+
+assert('ByteBuffer reading') do
+  b = ByteBuffer.new("\x00\x2a\x00\x00\x01\x00\x03abc")
+  assert_equal 42, b.read_u16be
+  assert_equal 256, b.read_u32be
+  assert_equal 3, b.read_u8
+  assert_equal 3, b.remaining
+  assert_equal "abc", b.read_bytes(3)
+  assert_true b.eof?
+  assert_raise(IndexError) { b.read_u8 }
+  b.pos = 1
+  assert_equal 42, b.read_u8
+  assert_equal 1, b.skip(-1).pos
+end
+
+assert('ByteBuffer writing') do
+  b = ByteBuffer.new
+  b.write_u16be(0xabcd).write_u8(1).write_bytes("xy")
+  assert_equal "\xab\xcd\x01xy", b.string
+  b.seek(7).write_u8(9)
+  assert_equal "\xab\xcd\x01xy\x00\x00\x09", b.string
+  b.pos = 0
+  b.write_s16le(-1)
+  assert_equal "\xff\xff\x01xy\x00\x00\x09", b.string
+
+  s = "pkt"
+  ByteBuffer.new(s).write_u8(0x50)
+  assert_equal "Pkt", s
+end
+
+assert('ByteBuffer position near the Integer limit') do
+  max = 1
+  max = max + max + 1 while (max + max + 1).kind_of?(Fixnum)
+  b = ByteBuffer.new("ab")
+  b.pos = max - 1
+  assert_raise(IndexError) { b.write_u32be(1) }
+  assert_raise(IndexError) { b.write_bytes("xyz") }
+  assert_raise(IndexError) { b.skip(2) }
+  assert_raise(IndexError) { b.read_u32be }
+  assert_equal max - 1, b.pos
+  assert_equal "ab", b.string
+end
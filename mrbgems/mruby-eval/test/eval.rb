@@ -6,3 +6,16 @@ end
 assert('eval') do
   assert_equal(10) { eval '1 * 10' }
 end
+
+assert('eval with frozen_string_literal magic comment') do
+  a, b = eval "# frozen_string_literal: true\n[\"lit\", \"lit\"]"
+  assert_true a.frozen?
+  assert_true a.equal?(b)
+  assert_true a.equal?(-"lit")
+  c = eval "# -*- frozen_string_literal: false -*-\n\"lit\""
+  assert_false c.frozen?
+  d = eval "x = 1\n# frozen_string_literal: true\n\"lit\""
+  assert_false d.frozen?
+  e = eval '# frozen_string_literal: true' + "\n" + '"l#{1}t"'
+  assert_false e.frozen?
+end
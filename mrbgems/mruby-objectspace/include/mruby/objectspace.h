@@ -0,0 +1,31 @@
+/*
+** mruby/objectspace.h - ObjectSpace module
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_OBJECTSPACE_H
+#define MRUBY_OBJECTSPACE_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef void (mrb_objspace_dump_writer)(mrb_state *mrb, const char *buf, size_t len, void *data);
+
+/*
+ * Streams every live object to writer, one JSON object per line:
+ *
+ *   {"address":"0x...","type":"STRING","class":"0x...","bytesize":5,
+ *    "memsize":48,"references":["0x..."]}
+ *
+ * Classes and modules with a name also carry "name". GC is disabled
+ * while the heap is walked; writer may allocate objects.
+ */
+void mrb_objspace_dump_all(mrb_state *mrb, mrb_objspace_dump_writer *writer, void *data);
+
+#if defined(__cplusplus)
+}  /* extern "C" { */
+#endif
+
+#endif  /* MRUBY_OBJECTSPACE_H */
@@ -0,0 +1,30 @@
+module ObjectSpace
+  ##
+  # Returns a text report of the allocation sites recorded by
+  # trace_allocations_start, one site per line, most allocating first.
+  # At most +limit+ sites are listed when given.
+  def self.allocation_report(limit = nil)
+    sites = self.allocation_sites
+    sites = sites[0, limit] if limit
+    lines = ["allocated\tlive\tsite\tclass"]
+    sites.each do |s|
+      pos = s[:file] ? "#{s[:file]}:#{s[:line]}" : "(unknown)"
+      lines << "#{s[:allocated]}\t#{s[:live]}\t#{pos}\t#{s[:class].inspect}"
+    end
+    lines.join("\n") + "\n"
+  end
+
+  ##
+  # Streams every live object as one line of JSON to the file at +path+,
+  # or to +io+ through its +write+ method. Each line carries the address,
+  # type, class address, memory size and the addresses of the objects it
+  # refers to. GC is disabled during the dump.
+  def self.dump_all(path_or_io)
+    disabled = GC.disable
+    begin
+      self.__dump_all(path_or_io)
+    ensure
+      GC.enable unless disabled
+    end
+  end
+end
@@ -1,7 +1,18 @@
+#include <stdlib.h>
+#include <string.h>
 #include <mruby.h>
 #include <mruby/gc.h>
 #include <mruby/hash.h>
 #include <mruby/class.h>
+#include <mruby/array.h>
+#include <mruby/proc.h>
+#include <mruby/irep.h>
+#include <mruby/debug.h>
+#include <mruby/variable.h>
+#include <mruby/khash.h>
+#include <mruby/string.h>
+#include <mruby/data.h>
+#include <mruby/objectspace.h>
 
 struct os_count_struct {
   mrb_int total;
@@ -143,15 +154,748 @@ os_each_object(mrb_state *mrb, mrb_value self)
   return mrb_fixnum_value(d.count);
 }
 
+/*
+ * Allocation tracing
+ *
+ * Every sample_rate-th object allocation is attributed to the Ruby code
+ * position (irep and pc) that caused it and to the allocated class. Sampled
+ * objects are remembered until they are freed so that each site also
+ * reports how many of its sampled objects are still alive.
+ */
+
+struct os_site_key {
+  mrb_irep *irep;
+  uint32_t pc;
+  struct RClass *klass;
+};
+
+struct os_alloc_site {
+  struct os_site_key key;
+  mrb_int allocated;
+  mrb_int live;
+};
+
+#define os_site_hash(mrb,k) (khint_t)(((uintptr_t)(k).irep>>4) ^ ((k).pc<<7) ^ ((uintptr_t)(k).klass>>4))
+#define os_site_equal(mrb,a,b) ((a).irep == (b).irep && (a).pc == (b).pc && (a).klass == (b).klass)
+#define os_ptr_hash(mrb,k) kh_int64_hash_func(mrb,(uint64_t)((uintptr_t)(k)>>3))
+
+KHASH_DECLARE(os_site, struct os_site_key, mrb_int, 1)
+KHASH_DEFINE(os_site, struct os_site_key, mrb_int, 1, os_site_hash, os_site_equal)
+KHASH_DECLARE(os_live, struct RBasic*, mrb_int, 1)
+KHASH_DEFINE(os_live, struct RBasic*, mrb_int, 1, os_ptr_hash, kh_int_hash_equal)
+
+struct os_alloc_trace {
+  mrb_int sample_rate;                  /* 0 if sampling is stopped */
+  mrb_int countdown;
+  khash_t(os_site) *index;              /* site key -> index of sites */
+  khash_t(os_live) *live;               /* sampled object -> index of sites */
+  struct os_alloc_site *sites;
+  mrb_int len;
+  mrb_int capa;
+  struct RArray *classes;               /* keeps sampled classes alive */
+};
+
+static void os_alloc_hook(mrb_state *mrb, struct RBasic *obj, void *ud);
+static void os_free_hook(mrb_state *mrb, struct RBasic *obj, void *ud);
+
+static struct os_alloc_trace*
+os_alloc_trace_get(mrb_state *mrb)
+{
+  if (mrb->obj_free_hook != os_free_hook) return NULL;
+  return (struct os_alloc_trace*)mrb->obj_hook_ud;
+}
+
+/* find the innermost Ruby frame and the position it is executing */
+static void
+os_alloc_position(mrb_state *mrb, struct os_site_key *key)
+{
+  struct mrb_context *c = mrb->c;
+  mrb_callinfo *ci;
+
+  key->irep = NULL;
+  key->pc = 0;
+  for (ci = c->ci; ci >= c->cibase; ci--) {
+    struct RProc *p = ci->proc;
+    mrb_code *pc;
+
+    if (!p || MRB_PROC_CFUNC_P(p)) continue;
+    if (ci->err) {
+      pc = ci->err;
+    }
+    else if (ci < c->ci && ci[1].pc) {
+      pc = ci[1].pc - 1;
+    }
+    else {
+      /* allocated by the VM at a position it does not record */
+      return;
+    }
+    key->irep = p->body.irep;
+    key->pc = (uint32_t)(pc - p->body.irep->iseq);
+    return;
+  }
+}
+
+static void
+os_alloc_hook(mrb_state *mrb, struct RBasic *obj, void *ud)
+{
+  struct os_alloc_trace *t = (struct os_alloc_trace*)ud;
+  struct os_site_key key;
+  khiter_t k;
+  mrb_int idx;
+
+  if (t->sample_rate == 0 || --t->countdown > 0) return;
+  t->countdown = t->sample_rate;
+
+  os_alloc_position(mrb, &key);
+  /* the class field of an env refers to its parent env */
+  key.klass = obj->tt == MRB_TT_ENV ? NULL : obj->c;
+  k = kh_get(os_site, mrb, t->index, key);
+  if (k == kh_end(t->index)) {
+    if (t->len == t->capa) {
+      t->capa = t->capa ? t->capa * 2 : 32;
+      t->sites = (struct os_alloc_site*)mrb_realloc(mrb, t->sites, sizeof(struct os_alloc_site)*t->capa);
+    }
+    idx = t->len++;
+    t->sites[idx].key = key;
+    t->sites[idx].allocated = 0;
+    t->sites[idx].live = 0;
+    if (key.irep) mrb_irep_incref(mrb, key.irep);
+    if (key.klass) {
+      mrb_ary_push(mrb, mrb_obj_value(t->classes), mrb_obj_value(key.klass));
+    }
+    k = kh_put(os_site, mrb, t->index, key);
+    kh_value(t->index, k) = idx;
+  }
+  else {
+    idx = kh_value(t->index, k);
+  }
+  t->sites[idx].allocated++;
+  t->sites[idx].live++;
+  k = kh_put(os_live, mrb, t->live, obj);
+  kh_value(t->live, k) = idx;
+}
+
+static void
+os_free_hook(mrb_state *mrb, struct RBasic *obj, void *ud)
+{
+  struct os_alloc_trace *t = (struct os_alloc_trace*)ud;
+  khiter_t k;
+
+  if (kh_size(t->live) == 0) return;
+  k = kh_get(os_live, mrb, t->live, obj);
+  if (k != kh_end(t->live)) {
+    t->sites[kh_value(t->live, k)].live--;
+    kh_del(os_live, mrb, t->live, k);
+  }
+}
+
+static void
+os_alloc_trace_free(mrb_state *mrb)
+{
+  struct os_alloc_trace *t = os_alloc_trace_get(mrb);
+  mrb_int i;
+
+  if (!t) return;
+  mrb->obj_alloc_hook = NULL;
+  mrb->obj_free_hook = NULL;
+  mrb->obj_hook_ud = NULL;
+  for (i = 0; i < t->len; i++) {
+    if (t->sites[i].key.irep) mrb_irep_decref(mrb, t->sites[i].key.irep);
+  }
+  mrb_free(mrb, t->sites);
+  kh_destroy(os_site, mrb, t->index);
+  kh_destroy(os_live, mrb, t->live);
+  mrb_free(mrb, t);
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.trace_allocations_start(sample_rate=1) -> nil
+ *
+ *  Starts recording the allocation site of every +sample_rate+-th
+ *  allocated object. Calling it again while tracing changes the rate.
+ *
+ */
+
+static mrb_value
+os_trace_allocations_start(mrb_state *mrb, mrb_value self)
+{
+  mrb_int rate = 1;
+  struct os_alloc_trace *t;
+
+  mrb_get_args(mrb, "|i", &rate);
+  if (rate < 1) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "sample rate must be positive");
+  }
+  t = os_alloc_trace_get(mrb);
+  if (!t) {
+    mrb_value classes;
+
+    if (mrb->obj_alloc_hook || mrb->obj_free_hook) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "object hooks are already in use");
+    }
+    classes = mrb_ary_new(mrb);
+    mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__allocation_classes__"), classes);
+    t = (struct os_alloc_trace*)mrb_calloc(mrb, 1, sizeof(struct os_alloc_trace));
+    t->index = kh_init(os_site, mrb);
+    t->live = kh_init(os_live, mrb);
+    t->classes = mrb_ary_ptr(classes);
+    mrb->obj_hook_ud = t;
+    mrb->obj_free_hook = os_free_hook;
+    mrb->obj_alloc_hook = os_alloc_hook;
+  }
+  t->sample_rate = rate;
+  t->countdown = rate;
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.trace_allocations_stop -> nil
+ *
+ *  Stops sampling allocations. Already sampled objects are still
+ *  accounted when they are freed, so that live counts stay correct.
+ *
+ */
+
+static mrb_value
+os_trace_allocations_stop(mrb_state *mrb, mrb_value self)
+{
+  struct os_alloc_trace *t = os_alloc_trace_get(mrb);
+
+  if (t) {
+    t->sample_rate = 0;
+  }
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.trace_allocations_clear -> nil
+ *
+ *  Stops tracing and discards all collected allocation sites.
+ *
+ */
+
+static mrb_value
+os_trace_allocations_clear(mrb_state *mrb, mrb_value self)
+{
+  os_alloc_trace_free(mrb);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__allocation_classes__"), mrb_nil_value());
+  return mrb_nil_value();
+}
+
+static int
+os_site_cmp(const void *a, const void *b)
+{
+  const struct os_alloc_site *s1 = (const struct os_alloc_site*)a;
+  const struct os_alloc_site *s2 = (const struct os_alloc_site*)b;
+
+  if (s1->allocated != s2->allocated) {
+    return (s1->allocated < s2->allocated) ? 1 : -1;
+  }
+  return (s1->live < s2->live) ? 1 : (s1->live > s2->live) ? -1 : 0;
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.allocation_sites -> array
+ *
+ *  Returns the allocation sites recorded by trace_allocations_start,
+ *  most allocating first. Each site is a hash such as:
+ *
+ *    {:file=>"app.rb", :line=>12, :class=>String, :allocated=>120, :live=>3}
+ *
+ *  +:allocated+ and +:live+ count sampled objects only; multiply them by
+ *  the sample rate to estimate the real numbers. +:file+ and +:line+ are
+ *  nil when the allocation could not be attributed to Ruby code.
+ *
+ */
+
+static mrb_value
+os_allocation_sites(mrb_state *mrb, mrb_value self)
+{
+  struct os_alloc_trace *t = os_alloc_trace_get(mrb);
+  struct os_alloc_site *order;
+  mrb_int i, len;
+  mrb_value ary;
+  int ai;
+
+  if (!t || t->len == 0) {
+    return mrb_ary_new(mrb);
+  }
+
+  /* work on a snapshot; the allocations below may add new sites */
+  len = t->len;
+  order = (struct os_alloc_site*)mrb_malloc(mrb, sizeof(struct os_alloc_site)*len);
+  memcpy(order, t->sites, sizeof(struct os_alloc_site)*len);
+  qsort(order, len, sizeof(struct os_alloc_site), os_site_cmp);
+
+  ary = mrb_ary_new_capa(mrb, len);
+  ai = mrb_gc_arena_save(mrb);
+  for (i = 0; i < len; i++) {
+    struct os_alloc_site *site = &order[i];
+    mrb_value h = mrb_hash_new(mrb);
+    mrb_value file = mrb_nil_value();
+    mrb_value line = mrb_nil_value();
+
+    if (site->key.irep) {
+      const char *filename = mrb_debug_get_filename(site->key.irep, site->key.pc);
+      int32_t lineno = mrb_debug_get_line(site->key.irep, site->key.pc);
+
+      if (filename) file = mrb_str_new_cstr(mrb, filename);
+      if (lineno >= 0) line = mrb_fixnum_value(lineno);
+    }
+    mrb_hash_set(mrb, h, mrb_symbol_value(mrb_intern_lit(mrb, "file")), file);
+    mrb_hash_set(mrb, h, mrb_symbol_value(mrb_intern_lit(mrb, "line")), line);
+    mrb_hash_set(mrb, h, mrb_symbol_value(mrb_intern_lit(mrb, "class")),
+                 site->key.klass ? mrb_obj_value(site->key.klass) : mrb_nil_value());
+    mrb_hash_set(mrb, h, mrb_symbol_value(mrb_intern_lit(mrb, "allocated")), mrb_fixnum_value(site->allocated));
+    mrb_hash_set(mrb, h, mrb_symbol_value(mrb_intern_lit(mrb, "live")), mrb_fixnum_value(site->live));
+    mrb_ary_push(mrb, ary, h);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  mrb_free(mrb, order);
+
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.memsize_of(obj) -> fixnum
+ *
+ *  Returns the bytes used by +obj+: its heap slot and the buffers it
+ *  owns (string and array contents, hash and instance variable tables,
+ *  method tables, and Data reported by the +dsize+ function of its
+ *  mrb_data_type).  Immediate values use no memory.
+ *
+ */
+
+static mrb_value
+os_memsize_of(mrb_state *mrb, mrb_value self)
+{
+  mrb_value obj;
+
+  mrb_get_args(mrb, "o", &obj);
+  if (mrb_special_const_p(obj)) {
+    return mrb_fixnum_value(0);
+  }
+  return mrb_fixnum_value(mrb_objspace_memsize_of(mrb, mrb_basic_ptr(obj)));
+}
+
+struct os_memsize_data {
+  struct RClass *target_module;
+  size_t total;
+};
+
+static void
+os_memsize_of_all_cb(mrb_state *mrb, struct RBasic *obj, void *ud)
+{
+  struct os_memsize_data *d = (struct os_memsize_data*)ud;
+
+  if (is_dead(mrb, obj)) {
+    return;
+  }
+  if (d->target_module) {
+    /* the class field of an env refers to its parent env */
+    if (obj->tt == MRB_TT_ENV) return;
+    if (!mrb_obj_is_kind_of(mrb, mrb_obj_value(obj), d->target_module)) return;
+  }
+  d->total += mrb_objspace_memsize_of(mrb, obj);
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.memsize_of_all([klass]) -> fixnum
+ *
+ *  Returns the total memsize_of of all live objects, or of the
+ *  instances of +klass+ when given.
+ *
+ */
+
+static mrb_value
+os_memsize_of_all(mrb_state *mrb, mrb_value self)
+{
+  mrb_value cls = mrb_nil_value();
+  struct os_memsize_data d;
+
+  mrb_get_args(mrb, "|C", &cls);
+  d.target_module = mrb_nil_p(cls) ? NULL : mrb_class_ptr(cls);
+  d.total = 0;
+  mrb_objspace_each_objects(mrb, os_memsize_of_all_cb, &d);
+  return mrb_fixnum_value(d.total);
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.trace_memsize_start -> nil
+ *     ObjectSpace.trace_memsize_stop  -> nil
+ *
+ *  Starts (stops) counting the bytes used by the instances of each
+ *  class.  Objects are counted while major GC cycles mark them, so the
+ *  counters cost no extra heap walk; see ObjectSpace.memsize_by_class.
+ *
+ */
+
+static mrb_value
+os_trace_memsize_start(mrb_state *mrb, mrb_value self)
+{
+  mrb_objspace_count_class_memsize(mrb, TRUE);
+  return mrb_nil_value();
+}
+
+static mrb_value
+os_trace_memsize_stop(mrb_state *mrb, mrb_value self)
+{
+  mrb_objspace_count_class_memsize(mrb, FALSE);
+  return mrb_nil_value();
+}
+
+static void
+os_memsize_by_class_cb(mrb_state *mrb, struct RClass *c, size_t bytes, void *data)
+{
+  mrb_hash_set(mrb, *(mrb_value*)data, mrb_obj_value(c), mrb_fixnum_value(bytes));
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.memsize_by_class -> hash
+ *
+ *  Returns the bytes used by the live instances of each class, as
+ *  counted by the last major GC cycle since trace_memsize_start:
+ *
+ *    {String=>48210, Array=>10520, ...}
+ *
+ */
+
+static mrb_value
+os_memsize_by_class(mrb_state *mrb, mrb_value self)
+{
+  mrb_value hash = mrb_hash_new(mrb);
+
+  mrb_objspace_each_class_memsize(mrb, os_memsize_by_class_cb, &hash);
+  return hash;
+}
+
+#define OS_DUMP_BUFSIZE 4096
+
+/*
+ * Records are buffered and flushed between objects once the buffer is
+ * full.  The buffer belongs to a Data object, so it is freed by the GC
+ * if the writer raises.
+ */
+struct os_dump {
+  mrb_objspace_dump_writer *writer;
+  void *data;
+  mrb_bool first_ref;
+  size_t len;
+  size_t capa;
+  char *buf;
+};
+
+static void
+os_dump_free(mrb_state *mrb, void *p)
+{
+  struct os_dump *d = (struct os_dump*)p;
+
+  mrb_free(mrb, d->buf);
+  mrb_free(mrb, d);
+}
+
+static size_t
+os_dump_size(mrb_state *mrb, const void *p)
+{
+  return sizeof(struct os_dump) + ((const struct os_dump*)p)->capa;
+}
+
+static const struct mrb_data_type os_dump_type = {
+  "ObjectSpaceDump", os_dump_free, os_dump_size,
+};
+
+static const char*
+os_type_name(enum mrb_vtype tt)
+{
+  switch (tt) {
+#define TYPE_NAME(t) case MRB_TT_##t: return #t;
+    TYPE_NAME(FREE);
+    TYPE_NAME(OBJECT);
+    TYPE_NAME(CLASS);
+    TYPE_NAME(MODULE);
+    TYPE_NAME(ICLASS);
+    TYPE_NAME(SCLASS);
+    TYPE_NAME(PROC);
+    TYPE_NAME(ARRAY);
+    TYPE_NAME(HASH);
+    TYPE_NAME(STRING);
+    TYPE_NAME(RANGE);
+    TYPE_NAME(EXCEPTION);
+    TYPE_NAME(FILE);
+    TYPE_NAME(ENV);
+    TYPE_NAME(DATA);
+    TYPE_NAME(FIBER);
+#ifdef MRB_WORD_BOXING
+    TYPE_NAME(FLOAT);
+#endif
+#undef TYPE_NAME
+  default:
+    return NULL;
+  }
+}
+
+static void
+os_dump_flush(mrb_state *mrb, struct os_dump *d)
+{
+  if (d->len > 0) {
+    d->writer(mrb, d->buf, d->len, d->data);
+    d->len = 0;
+  }
+}
+
+static void
+os_dump_write(mrb_state *mrb, struct os_dump *d, const char *s, size_t len)
+{
+  if (d->capa - d->len < len) {
+    size_t capa = d->capa;
+
+    while (capa - d->len < len) {
+      capa *= 2;
+    }
+    d->buf = (char*)mrb_realloc(mrb, d->buf, capa);
+    d->capa = capa;
+  }
+  memcpy(d->buf + d->len, s, len);
+  d->len += len;
+}
+
+#define os_dump_lit(mrb, d, lit) os_dump_write((mrb), (d), (lit), sizeof(lit) - 1)
+
+static void
+os_dump_addr(mrb_state *mrb, struct os_dump *d, const void *p)
+{
+  char tmp[sizeof(uintptr_t)*2 + 4];
+  char *e = tmp + sizeof(tmp), *s = e;
+  uintptr_t v = (uintptr_t)p;
+
+  *--s = '"';
+  do {
+    *--s = "0123456789abcdef"[v & 15];
+    v >>= 4;
+  } while (v);
+  *--s = 'x';
+  *--s = '0';
+  *--s = '"';
+  os_dump_write(mrb, d, s, e - s);
+}
+
+static void
+os_dump_num(mrb_state *mrb, struct os_dump *d, size_t n)
+{
+  char tmp[sizeof(size_t)*3 + 1];
+  char *e = tmp + sizeof(tmp), *s = e;
+
+  do {
+    *--s = '0' + (n % 10);
+    n /= 10;
+  } while (n);
+  os_dump_write(mrb, d, s, e - s);
+}
+
+static void
+os_dump_str(mrb_state *mrb, struct os_dump *d, const char *s, size_t len)
+{
+  const char *p = s, *e = s + len;
+
+  os_dump_lit(mrb, d, "\"");
+  for (; p < e; p++) {
+    unsigned char c = (unsigned char)*p;
+
+    if (c == '"' || c == '\\' || c < 0x20) {
+      char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+
+      os_dump_write(mrb, d, s, p - s);
+      s = p + 1;
+      if (c >= 0x20) {
+        esc[1] = c;
+        os_dump_write(mrb, d, esc, 2);
+      }
+      else {
+        esc[4] = "0123456789abcdef"[c >> 4];
+        esc[5] = "0123456789abcdef"[c & 15];
+        os_dump_write(mrb, d, esc, 6);
+      }
+    }
+  }
+  os_dump_write(mrb, d, s, p - s);
+  os_dump_lit(mrb, d, "\"");
+}
+
+static void
+os_dump_ref(mrb_state *mrb, struct RBasic *obj, void *ud)
+{
+  struct os_dump *d = (struct os_dump*)ud;
+
+  if (!d->first_ref) {
+    os_dump_lit(mrb, d, ",");
+  }
+  d->first_ref = FALSE;
+  os_dump_addr(mrb, d, obj);
+}
+
+static void
+os_dump_object(mrb_state *mrb, struct RBasic *obj, void *ud)
+{
+  struct os_dump *d = (struct os_dump*)ud;
+  const char *type;
+
+  if (is_dead(mrb, obj)) {
+    return;
+  }
+
+  type = os_type_name(obj->tt);
+  os_dump_lit(mrb, d, "{\"address\":");
+  os_dump_addr(mrb, d, obj);
+  os_dump_lit(mrb, d, ",\"type\":");
+  if (type) {
+    os_dump_str(mrb, d, type, strlen(type));
+  }
+  else {
+    os_dump_num(mrb, d, obj->tt);
+  }
+  if (obj->c && obj->tt != MRB_TT_ENV) {
+    os_dump_lit(mrb, d, ",\"class\":");
+    os_dump_addr(mrb, d, obj->c);
+  }
+
+  switch (obj->tt) {
+  case MRB_TT_CLASS:
+  case MRB_TT_MODULE:
+    {
+      int ai = mrb_gc_arena_save(mrb);
+      mrb_value path = mrb_class_path(mrb, (struct RClass*)obj);
+
+      if (mrb_string_p(path)) {
+        os_dump_lit(mrb, d, ",\"name\":");
+        os_dump_str(mrb, d, RSTRING_PTR(path), RSTRING_LEN(path));
+      }
+      mrb_gc_arena_restore(mrb, ai);
+    }
+    break;
+
+  case MRB_TT_STRING:
+    os_dump_lit(mrb, d, ",\"bytesize\":");
+    os_dump_num(mrb, d, RSTRING_LEN(mrb_obj_value(obj)));
+    break;
+
+  default:
+    break;
+  }
+
+  os_dump_lit(mrb, d, ",\"memsize\":");
+  os_dump_num(mrb, d, mrb_objspace_memsize_of(mrb, obj));
+  os_dump_lit(mrb, d, ",\"references\":[");
+  d->first_ref = TRUE;
+  mrb_objspace_each_reference(mrb, obj, os_dump_ref, d);
+  os_dump_lit(mrb, d, "]}\n");
+  if (d->len >= OS_DUMP_BUFSIZE) {
+    os_dump_flush(mrb, d);
+  }
+}
+
+void
+mrb_objspace_dump_all(mrb_state *mrb, mrb_objspace_dump_writer *writer, void *data)
+{
+  int ai = mrb_gc_arena_save(mrb);
+  struct RData *obj = mrb_data_object_alloc(mrb, mrb->object_class, NULL, &os_dump_type);
+  struct os_dump *d = (struct os_dump*)mrb_calloc(mrb, 1, sizeof(struct os_dump));
+
+  obj->data = d;
+  d->writer = writer;
+  d->data = data;
+  d->buf = (char*)mrb_malloc(mrb, OS_DUMP_BUFSIZE);
+  d->capa = OS_DUMP_BUFSIZE;
+
+  /* GC does not run during the walk, even if the writer allocates */
+  mrb_objspace_each_objects(mrb, os_dump_object, d);
+  os_dump_flush(mrb, d);
+  mrb_gc_arena_restore(mrb, ai);
+}
+
+static void
+os_dump_io_writer(mrb_state *mrb, const char *buf, size_t len, void *data)
+{
+  int ai = mrb_gc_arena_save(mrb);
+
+  mrb_funcall(mrb, *(mrb_value*)data, "write", 1, mrb_str_new(mrb, buf, len));
+  mrb_gc_arena_restore(mrb, ai);
+}
+
+#ifdef ENABLE_STDIO
+static void
+os_dump_file_writer(mrb_state *mrb, const char *buf, size_t len, void *data)
+{
+  fwrite(buf, 1, len, (FILE*)data);
+}
+#endif
+
+/*
+ *  call-seq:
+ *     ObjectSpace.__dump_all(path_or_io) -> path_or_io
+ *
+ *  Streams every live object to the file at +path+, or to an object
+ *  that responds to +write+, as JSON lines.  See ObjectSpace.dump_all.
+ *
+ */
+
+static mrb_value
+os_dump_all(mrb_state *mrb, mrb_value self)
+{
+  mrb_value out;
+
+  mrb_get_args(mrb, "o", &out);
+  if (mrb_string_p(out)) {
+#ifdef ENABLE_STDIO
+    FILE *fp = fopen(mrb_string_value_cstr(mrb, &out), "w");
+
+    if (!fp) {
+      mrb_raisef(mrb, E_RUNTIME_ERROR, "cannot open %S", out);
+    }
+    mrb_objspace_dump_all(mrb, os_dump_file_writer, fp);
+    if (fclose(fp) != 0) {
+      mrb_raisef(mrb, E_RUNTIME_ERROR, "cannot write %S", out);
+    }
+#else
+    mrb_raise(mrb, E_NOTIMP_ERROR, "dumping to a file needs stdio");
+#endif
+  }
+  else if (mrb_respond_to(mrb, out, mrb_intern_lit(mrb, "write"))) {
+    mrb_objspace_dump_all(mrb, os_dump_io_writer, &out);
+  }
+  else {
+    mrb_raise(mrb, E_TYPE_ERROR, "expected a path or an object that responds to write");
+  }
+  return out;
+}
+
 void
 mrb_mruby_objectspace_gem_init(mrb_state *mrb)
 {
   struct RClass *os = mrb_define_module(mrb, "ObjectSpace");
   mrb_define_class_method(mrb, os, "count_objects", os_count_objects, MRB_ARGS_OPT(1));
   mrb_define_class_method(mrb, os, "each_object", os_each_object, MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, os, "trace_allocations_start", os_trace_allocations_start, MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, os, "trace_allocations_stop", os_trace_allocations_stop, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "trace_allocations_clear", os_trace_allocations_clear, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "allocation_sites", os_allocation_sites, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "memsize_of", os_memsize_of, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, os, "memsize_of_all", os_memsize_of_all, MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, os, "trace_memsize_start", os_trace_memsize_start, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "trace_memsize_stop", os_trace_memsize_stop, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "memsize_by_class", os_memsize_by_class, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "__dump_all", os_dump_all, MRB_ARGS_REQ(1));
 }
 
 void
 mrb_mruby_objectspace_gem_final(mrb_state *mrb)
 {
+  os_alloc_trace_free(mrb);
 }
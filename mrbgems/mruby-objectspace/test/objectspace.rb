@@ -50,3 +50,152 @@ assert('ObjectSpace.each_object') do
   assert_equal arys.length, arys_count
   assert_true arys.length < objs.length
 end
+
+assert('ObjectSpace.allocation_sites') do
+  ObjectSpace.trace_allocations_start
+  begin
+    objs = []
+    100.times { objs << "alloc site" }
+    sites = ObjectSpace.allocation_sites
+  ensure
+    ObjectSpace.trace_allocations_stop
+  end
+
+  site = sites.find { |s| s[:class] == String && s[:allocated] >= 100 }
+  assert_kind_of Hash, site
+  if site[:file]   # nil without debug info
+    assert_true site[:file].end_with?("objectspace.rb")
+    assert_kind_of Integer, site[:line]
+  end
+  assert_true site[:live] >= 100
+
+  objs = nil
+  GC.start
+  site2 = ObjectSpace.allocation_sites.find { |s| s[:file] == site[:file] && s[:line] == site[:line] && s[:class] == String }
+  assert_equal site[:allocated], site2[:allocated]
+  assert_true site2[:live] < site[:live]
+
+  assert_kind_of String, ObjectSpace.allocation_report(3)
+
+  ObjectSpace.trace_allocations_clear
+  assert_equal [], ObjectSpace.allocation_sites
+  assert_raise(ArgumentError) { ObjectSpace.trace_allocations_start(0) }
+end
+
+assert('ObjectSpace.allocation_sites with closures') do
+  def os_closure_site(n)
+    x = n
+    lambda { x }
+  end
+
+  ObjectSpace.trace_allocations_start
+  begin
+    procs = []
+    100.times { |i| procs << os_closure_site(i) }
+    sites = ObjectSpace.allocation_sites
+  ensure
+    ObjectSpace.trace_allocations_stop
+  end
+
+  ObjectSpace.trace_allocations_clear
+  assert_equal 99, procs[99].call
+  assert_true sites.all? { |s| s[:class].nil? || s[:class].kind_of?(Module) }
+  assert_true sites.any? { |s| s[:class] == Proc }
+  assert_true sites.any? { |s| s[:class].nil? }
+end
+
+assert('ObjectSpace.dump_all') do
+  class ObjectSpaceDumpSink
+    attr_reader :buf
+    def initialize; @buf = ""; end
+    def write(s); @buf << s; s.size; end
+  end
+
+  sink = ObjectSpaceDumpSink.new
+  keep = ["dump \"me\"\n"]
+  assert_equal sink, ObjectSpace.dump_all(sink)
+  assert_false GC.disable
+  GC.enable
+
+  lines = sink.buf.split("\n")
+  assert_true lines.size > 100
+  assert_true lines.all? { |l| l.start_with?('{"address":"0x') && l.end_with?(']}') }
+  assert_true lines.any? { |l| l.include?('"type":"CLASS"') && l.include?('"name":"ObjectSpaceDumpSink"') }
+  assert_true lines.any? { |l| l.include?('"type":"STRING"') && l.include?('"bytesize":10,') }
+  assert_raise(TypeError) { ObjectSpace.dump_all(1) }
+  assert_false GC.disable
+  GC.enable
+  keep
+end
+
+assert('ObjectSpace.dump_all with a raising writer') do
+  class ObjectSpaceFailingSink
+    def initialize(n); @n = n; end
+    def write(s)
+      @n -= 1
+      raise RuntimeError, "disk full" if @n < 0
+      s.size
+    end
+  end
+
+  big = Array.new(20000) { |i| [i] }
+  assert_raise(RuntimeError) { ObjectSpace.dump_all(ObjectSpaceFailingSink.new(2)) }
+  assert_false GC.disable
+  GC.enable
+  count = GC.stat(:count)
+  GC.start
+  assert_true GC.stat(:count) > count
+  big = nil
+  GC.start
+  assert_equal 3, [1, 2, 3].size
+end
+
+assert('ObjectSpace.each_object holds off GC') do
+  count = GC.stat(:count)
+  started = false
+  ObjectSpace.each_object(String) do |s|
+    GC.start unless started
+    started = true
+  end
+  assert_equal count, GC.stat(:count)
+  assert_raise(RuntimeError) { ObjectSpace.each_object { raise "stop" } }
+  GC.start
+  assert_true GC.stat(:count) > count
+end
+
+assert('ObjectSpace.memsize_of') do
+  assert_equal 0, ObjectSpace.memsize_of(1)
+  assert_equal 0, ObjectSpace.memsize_of(nil)
+  small = ObjectSpace.memsize_of("a")
+  assert_true small > 0
+  assert_true ObjectSpace.memsize_of("a" * 10000) >= small + 10000
+  assert_true ObjectSpace.memsize_of(Array.new(1000, 1)) > ObjectSpace.memsize_of([])
+  o = Object.new
+  before = ObjectSpace.memsize_of(o)
+  o.instance_variable_set(:@iv, 1)
+  assert_true ObjectSpace.memsize_of(o) > before
+  assert_true ObjectSpace.memsize_of(String) > small
+end
+
+assert('ObjectSpace.memsize_of_all') do
+  all = ObjectSpace.memsize_of_all
+  strings = ObjectSpace.memsize_of_all(String)
+  assert_true strings > 0
+  assert_true all > strings
+end
+
+assert('ObjectSpace.memsize_by_class') do
+  class ObjectSpaceMemsizeTest; end
+  ObjectSpace.trace_memsize_start
+  begin
+    keep = Array.new(10) { ObjectSpaceMemsizeTest.new }
+    GC.start
+    bytes = ObjectSpace.memsize_by_class
+    assert_kind_of Hash, bytes
+    assert_true bytes[String] > 0
+    assert_true bytes[ObjectSpaceMemsizeTest] >= ObjectSpace.memsize_of(keep[0]) * 10
+  ensure
+    ObjectSpace.trace_memsize_stop
+  end
+  assert_equal({}, ObjectSpace.memsize_by_class)
+end
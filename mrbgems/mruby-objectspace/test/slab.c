@@ -0,0 +1,131 @@
+/*
+** slab.c - tests of the slab allocator
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+
+struct slab_align {
+  char c;
+  long double ld;
+};
+#define SLAB_ALIGN offsetof(struct slab_align, ld)
+
+#define SLAB_CHECK(cond) do {\
+  if (!(cond)) mrb_ary_push(mrb, fails, mrb_fixnum_value(__LINE__));\
+} while (0)
+
+static size_t
+slab_used(mrb_state *s)
+{
+  mrb_slab_stat st;
+
+  mrb_slab_get_stat(s, &st);
+  return st.used_bytes;
+}
+
+/*
+ * Exercises mrb_slab_allocf on a VM of its own: every size class, the
+ * large path, reallocation between them and the statistics.  Returns
+ * the lines of the checks that failed.
+ */
+static mrb_value
+slab_check(mrb_state *mrb, mrb_value self)
+{
+  static const size_t size[] = { 1, 16, 17, 48, 128, 129, 200, 256, 257, 512, 513, 1000, 1024 };
+  static const size_t block[] = { 16, 16, 32, 48, 128, 160, 224, 256, 320, 512, 640, 1024, 1024 };
+  mrb_value fails = mrb_ary_new(mrb);
+  mrb_state *s = mrb_open_slab();
+  mrb_slab_stat st0, st;
+  mrb_value h;
+  char *p[300], *q, *r;
+  size_t i, j;
+
+  if (!s) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "mrb_open_slab failed");
+  }
+  SLAB_CHECK(mrb_slab_get_stat(s, &st0));
+  SLAB_CHECK(st0.chunks > 0 && st0.chunk_bytes > 0);
+
+  /* one block from each size class */
+  for (i = 0; i < sizeof(size) / sizeof(size[0]); i++) {
+    q = (char*)mrb_slab_allocf(s, NULL, size[i], s->ud);
+    SLAB_CHECK(q != NULL);
+    memset(q, 0xa5, size[i]);
+    SLAB_CHECK(slab_used(s) == st0.used_bytes + block[i]);
+    mrb_slab_allocf(s, q, 0, s->ud);
+    SLAB_CHECK(slab_used(s) == st0.used_bytes);
+  }
+
+  /* realloc within a class, across classes and through the large path */
+  q = (char*)mrb_slab_allocf(s, NULL, 20, s->ud);
+  for (i = 0; i < 20; i++) q[i] = (char)i;
+  r = (char*)mrb_slab_allocf(s, q, 30, s->ud);
+  SLAB_CHECK(r == q);
+  r = (char*)mrb_slab_allocf(s, r, 100, s->ud);
+  SLAB_CHECK(r != q);
+  SLAB_CHECK(slab_used(s) == st0.used_bytes + 112);
+  r = (char*)mrb_slab_allocf(s, r, 2000, s->ud);
+  mrb_slab_get_stat(s, &st);
+  SLAB_CHECK(st.used_bytes == st0.used_bytes);
+  SLAB_CHECK(st.large_count == st0.large_count + 1);
+  SLAB_CHECK(st.large_bytes == st0.large_bytes + 2000);
+  SLAB_CHECK((uintptr_t)r % SLAB_ALIGN == 0);
+  memset(r + 20, 0x5a, 1980);
+  r = (char*)mrb_slab_allocf(s, r, 5000, s->ud);
+  mrb_slab_get_stat(s, &st);
+  SLAB_CHECK(st.large_count == st0.large_count + 1);
+  SLAB_CHECK(st.large_bytes == st0.large_bytes + 5000);
+  SLAB_CHECK((unsigned char)r[1999] == 0x5a);
+  r = (char*)mrb_slab_allocf(s, r, 64, s->ud);
+  mrb_slab_get_stat(s, &st);
+  SLAB_CHECK(st.large_count == st0.large_count);
+  SLAB_CHECK(st.large_bytes == st0.large_bytes);
+  SLAB_CHECK(st.used_bytes == st0.used_bytes + 64);
+  for (i = 0; i < 20; i++) {
+    SLAB_CHECK(r[i] == (char)i);
+  }
+  mrb_slab_allocf(s, r, 0, s->ud);
+
+  /* more blocks than a chunk holds */
+  for (i = 0; i < sizeof(p) / sizeof(p[0]); i++) {
+    p[i] = (char*)mrb_slab_allocf(s, NULL, 1024, s->ud);
+    SLAB_CHECK(p[i] != NULL);
+    memset(p[i], (int)i, 1024);
+  }
+  mrb_slab_get_stat(s, &st);
+  SLAB_CHECK(st.chunks > st0.chunks);
+  SLAB_CHECK(st.used_bytes == st0.used_bytes + 300 * 1024);
+  SLAB_CHECK(st.page_bytes <= st.chunk_bytes);
+  SLAB_CHECK(st.used_bytes + st.free_bytes <= st.page_bytes);
+  for (i = 0; i < sizeof(p) / sizeof(p[0]); i++) {
+    for (j = 0; j < 1024; j += 256) {
+      SLAB_CHECK(p[i][j] == (char)i);
+    }
+    mrb_slab_allocf(s, p[i], 0, s->ud);
+  }
+  mrb_slab_get_stat(s, &st);
+  SLAB_CHECK(st.used_bytes == st0.used_bytes);
+  SLAB_CHECK(st.free_bytes >= 300 * 1024);
+
+  /* GC.stat reports the slab of the VM it runs in */
+  h = mrb_funcall(s, mrb_obj_value(mrb_module_get(s, "GC")), "stat", 0);
+  SLAB_CHECK(mrb_fixnum_p(mrb_hash_get(s, h, mrb_symbol_value(mrb_intern_lit(s, "slab_used_bytes")))));
+  SLAB_CHECK(mrb_fixnum_p(mrb_hash_get(s, h, mrb_symbol_value(mrb_intern_lit(s, "slab_large_count")))));
+  mrb_close(s);
+  return fails;
+}
+
+void
+mrb_mruby_objectspace_gem_test(mrb_state *mrb)
+{
+  struct RClass *t = mrb_define_module(mrb, "SlabTest");
+
+  mrb_define_module_function(mrb, t, "check", slab_check, MRB_ARGS_NONE());
+}
@@ -0,0 +1,4 @@
+assert('slab allocator') do
+  # lines of the failed checks in slab.c
+  assert_equal [], SlabTest.check
+end
@@ -0,0 +1,651 @@
+/*
+** pack.c - Array#pack, String#unpack
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include "mruby.h"
+#include "mruby/array.h"
+#include "mruby/data.h"
+#include "mruby/string.h"
+#include "mruby/presym.h"
+
+/*
+  = Compiled templates
+
+  A template is compiled once into a list of ops, one per directive,
+  with its count already decoded.  Compiled templates are kept in a
+  string cache (mrb_str_cache_fetch()) on the Array class, as
+  Kernel#sprintf does with formats.  pack writes into a string presized
+  for the fixed-size directives and unpack stores straight into an
+  array presized for the values it will produce.
+
+  Directives:
+
+    C c      8-bit unsigned, signed integer
+    n N      16-, 32-bit unsigned integer, big endian (network order)
+    v V      16-, 32-bit unsigned integer, little endian (VAX order)
+    a A Z    byte string: NUL padded, space padded, NUL terminated
+    H h      hex string, high or low nibble first
+    m        base64; m0 packs without line feeds and unpacks strictly
+    x        NUL byte
+
+  A directive may be followed by a count or `*'; whitespace between
+  directives is ignored.
+*/
+
+#define PACK_CACHE_MAX_LEN 256  /* longer templates are not kept */
+
+#define PACK_HINT_MAX 65536     /* largest result presized */
+
+#define PACK_STAR (-1)          /* count given as `*' */
+#define PACK_B64_LINE 45        /* default bytes per line of `m' */
+
+enum pack_kind {
+  PACK_INT,                     /* C c n N v V */
+  PACK_STR,                     /* a A Z */
+  PACK_HEX,                     /* H h */
+  PACK_BASE64,                  /* m */
+  PACK_NUL                      /* x */
+};
+
+typedef struct pack_op {
+  enum pack_kind kind;
+  char dir;                     /* directive character */
+  unsigned char size;           /* PACK_INT: bytes */
+  unsigned char sign;           /* PACK_INT: signed */
+  unsigned char le;             /* PACK_INT: little endian */
+  mrb_int count;                /* count, PACK_STAR, or `m' line length */
+} pack_op;
+
+typedef struct pack_prog {
+  mrb_str_cache_key key;        /* the template */
+  pack_op *ops;
+  int nops;
+  int ops_capa;
+  mrb_int nvalues;              /* unpacked values, but for `*' integers */
+  mrb_bool star;                /* has an integer directive with `*' */
+  mrb_int size_hint;            /* bytes packed by fixed-size directives,
+                                   up to PACK_HINT_MAX */
+} pack_prog;
+
+static void
+pack_prog_free(mrb_state *mrb, void *p)
+{
+  pack_prog *prog = (pack_prog*)p;
+
+  mrb_free(mrb, prog->key.str);
+  mrb_free(mrb, prog->ops);
+  mrb_free(mrb, prog);
+}
+
+static size_t
+pack_prog_size(mrb_state *mrb, const void *p)
+{
+  const pack_prog *prog = (const pack_prog*)p;
+
+  return sizeof(pack_prog) + prog->key.len + 1 + sizeof(pack_op) * prog->ops_capa;
+}
+
+static const struct mrb_data_type pack_prog_type = {
+  "PackTemplate", pack_prog_free, pack_prog_size,
+};
+
+static pack_op*
+pack_add_op(mrb_state *mrb, pack_prog *prog)
+{
+  pack_op *op;
+
+  if (prog->nops == prog->ops_capa) {
+    prog->ops_capa = prog->ops_capa ? prog->ops_capa * 2 : 8;
+    prog->ops = (pack_op*)mrb_realloc(mrb, prog->ops, sizeof(pack_op) * prog->ops_capa);
+  }
+  op = &prog->ops[prog->nops++];
+  memset(op, 0, sizeof(*op));
+  return op;
+}
+
+/* counts bytes that pack will write for sure */
+static void
+pack_hint(pack_prog *prog, mrb_int count, int unit)
+{
+  if (count > (PACK_HINT_MAX - prog->size_hint) / unit) {
+    prog->size_hint = PACK_HINT_MAX;
+  }
+  else {
+    prog->size_hint += count * unit;
+  }
+}
+
+static void
+pack_compile(mrb_state *mrb, void *entry)
+{
+  pack_prog *prog = (pack_prog*)entry;
+  const char *p = prog->key.str;
+  const char *end = p + prog->key.len;
+
+  while (p < end) {
+    char c = *p++;
+    pack_op *op;
+    mrb_int count = 1;
+    mrb_bool given = FALSE;
+
+    if (ISSPACE(c)) continue;
+    op = pack_add_op(mrb, prog);
+    op->dir = c;
+    switch (c) {
+      case 'C': op->kind = PACK_INT; op->size = 1; break;
+      case 'c': op->kind = PACK_INT; op->size = 1; op->sign = 1; break;
+      case 'n': op->kind = PACK_INT; op->size = 2; break;
+      case 'N': op->kind = PACK_INT; op->size = 4; break;
+      case 'v': op->kind = PACK_INT; op->size = 2; op->le = 1; break;
+      case 'V': op->kind = PACK_INT; op->size = 4; op->le = 1; break;
+      case 'a': case 'A': case 'Z': op->kind = PACK_STR; break;
+      case 'H': case 'h': op->kind = PACK_HEX; break;
+      case 'm': op->kind = PACK_BASE64; break;
+      case 'x': op->kind = PACK_NUL; break;
+      default:
+        mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown pack directive '%S'", mrb_str_new(mrb, &c, 1));
+    }
+    if (p < end && *p == '*') {
+      count = PACK_STAR;
+      p++;
+    }
+    else if (p < end && ISDIGIT(*p)) {
+      count = 0;
+      for (; p < end && ISDIGIT(*p); p++) {
+        if (count > (INT_MAX - (*p - '0')) / 10) {
+          mrb_raise(mrb, E_RANGE_ERROR, "pack length too big");
+        }
+        count = count * 10 + (*p - '0');
+      }
+      given = TRUE;
+    }
+
+    switch (op->kind) {
+      case PACK_INT:
+        if (count == PACK_STAR) {
+          prog->star = TRUE;
+        }
+        else {
+          prog->nvalues = count > INT_MAX - prog->nvalues ? INT_MAX : prog->nvalues + count;
+          pack_hint(prog, count, op->size);
+        }
+        break;
+      case PACK_BASE64:
+        /* bytes per line, a multiple of 3; 0 for no line feeds */
+        if (count == PACK_STAR || (count <= 2 && !(given && count == 0))) {
+          count = PACK_B64_LINE;
+        }
+        else {
+          count = count / 3 * 3;
+        }
+        prog->nvalues++;
+        break;
+      case PACK_STR:
+      case PACK_HEX:
+        prog->nvalues++;
+        if (count != PACK_STAR) {
+          pack_hint(prog, op->kind == PACK_HEX ? count / 2 + (count & 1) : count, 1);
+        }
+        break;
+      case PACK_NUL:
+        if (count != PACK_STAR) pack_hint(prog, count, 1);
+        break;
+    }
+    op->count = count;
+  }
+}
+
+static const mrb_str_cache_type pack_cache_type = {
+  &pack_prog_type, sizeof(pack_prog), PACK_CACHE_MAX_LEN, pack_compile,
+};
+
+/* the compiled form of tmpl, from the cache or compiled now */
+static const pack_prog*
+pack_lookup(mrb_state *mrb, mrb_value tmpl)
+{
+  return (const pack_prog*)mrb_str_cache_fetch(mrb, (struct RObject*)mrb->array_class,
+                                               MRB_SYM(__pack_templates__), tmpl, &pack_cache_type);
+}
+
+static const char b64_chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int
+b64_value(unsigned char c)
+{
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+static int
+hex_nibble(unsigned char c)
+{
+  return ISALPHA(c) ? ((c & 7) + 9) & 15 : c & 15;
+}
+
+/*
+  == Array#pack
+*/
+
+/* room for n more bytes after the first blen of result */
+static char*
+pack_room(mrb_state *mrb, mrb_value result, mrb_int *bsiz, mrb_int blen, mrb_int n)
+{
+  if (n > *bsiz - blen) {
+    mrb_int siz = *bsiz;
+
+    if (n > MRB_INT_MAX / 2 - blen) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "pack result too big");
+    }
+    while (n > siz - blen) siz *= 2;
+    mrb_str_resize(mrb, result, siz);
+    *bsiz = siz;
+  }
+  return RSTRING_PTR(result) + blen;
+}
+
+static mrb_value
+pack_arg(mrb_state *mrb, mrb_value ary, mrb_int *idx)
+{
+  if (*idx >= RARRAY_LEN(ary)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "too few arguments");
+  }
+  return RARRAY_PTR(ary)[(*idx)++];
+}
+
+/* the low bits of an integer, which may be given signed or unsigned */
+static uint64_t
+pack_int_bits(mrb_state *mrb, mrb_value v)
+{
+  if (mrb_float_p(v)) {
+    double d = (double)mrb_float(v);
+
+    if (d >= -9223372036854775808.0 && d < 18446744073709551616.0) {
+      return d < 0 ? (uint64_t)(int64_t)d : (uint64_t)d;
+    }
+    mrb_raisef(mrb, E_RANGE_ERROR, "%S out of range of integer", v);
+  }
+  if (!mrb_fixnum_p(v)) {
+    v = mrb_to_int(mrb, v);
+  }
+  return (uint64_t)(int64_t)mrb_fixnum(v);
+}
+
+static mrb_int
+pack_base64(mrb_state *mrb, mrb_value result, mrb_int *bsiz, mrb_int blen,
+            const unsigned char *s, mrb_int slen, mrb_int line)
+{
+  mrb_int n, i;
+  char *p;
+
+  if (slen > MRB_INT_MAX / 3) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "pack result too big");
+  }
+  n = (slen + 2) / 3 * 4;
+  if (line > 0) n += (slen + line - 1) / line;
+  p = pack_room(mrb, result, bsiz, blen, n);
+
+  while (slen > 0) {
+    mrb_int chunk = line > 0 && line < slen ? line : slen;
+
+    for (i = 0; i + 2 < chunk; i += 3) {
+      *p++ = b64_chars[s[i] >> 2];
+      *p++ = b64_chars[((s[i] & 3) << 4) | (s[i+1] >> 4)];
+      *p++ = b64_chars[((s[i+1] & 15) << 2) | (s[i+2] >> 6)];
+      *p++ = b64_chars[s[i+2] & 63];
+    }
+    if (chunk - i == 2) {
+      *p++ = b64_chars[s[i] >> 2];
+      *p++ = b64_chars[((s[i] & 3) << 4) | (s[i+1] >> 4)];
+      *p++ = b64_chars[(s[i+1] & 15) << 2];
+      *p++ = '=';
+    }
+    else if (chunk - i == 1) {
+      *p++ = b64_chars[s[i] >> 2];
+      *p++ = b64_chars[(s[i] & 3) << 4];
+      *p++ = '=';
+      *p++ = '=';
+    }
+    if (line > 0) *p++ = '\n';
+    s += chunk;
+    slen -= chunk;
+  }
+  return blen + n;
+}
+
+/*
+ *  call-seq:
+ *     ary.pack(template)   -> string
+ *
+ *  Packs the elements of <i>ary</i> into a binary string as directed
+ *  by <i>template</i>; see the directives above.
+ *
+ *     [1, 2, 0x1234].pack("C2n")    #=> "\x01\x02\x124"
+ *     ["abc", "6162"].pack("a4H*")  #=> "abc\x00ab"
+ */
+static mrb_value
+mrb_ary_pack(mrb_state *mrb, mrb_value ary)
+{
+  mrb_value tmpl, result;
+  const pack_prog *prog;
+  const pack_op *op, *op_end;
+  mrb_int idx = 0;
+  mrb_int blen = 0;
+  mrb_int bsiz;
+  int ai;
+
+  mrb_get_args(mrb, "S", &tmpl);
+  prog = pack_lookup(mrb, tmpl);
+  bsiz = prog->size_hint < 16 ? 16 : prog->size_hint;
+  result = mrb_str_buf_new(mrb, bsiz);
+  mrb_str_resize(mrb, result, bsiz);
+  ai = mrb_gc_arena_save(mrb);
+
+  op_end = prog->ops + prog->nops;
+  for (op = prog->ops; op < op_end; op++) {
+    mrb_int count = op->count;
+    char *p;
+
+    switch (op->kind) {
+      case PACK_INT:
+        if (count == PACK_STAR || count > RARRAY_LEN(ary) - idx) {
+          if (count != PACK_STAR) {
+            mrb_raise(mrb, E_ARGUMENT_ERROR, "too few arguments");
+          }
+          count = RARRAY_LEN(ary) - idx;
+        }
+        p = pack_room(mrb, result, &bsiz, blen, count * op->size);
+        blen += count * op->size;
+        for (; count > 0; count--) {
+          uint64_t u = pack_int_bits(mrb, pack_arg(mrb, ary, &idx));
+          int i;
+
+          if (op->le) {
+            for (i = 0; i < op->size; i++, u >>= 8) p[i] = (char)u;
+          }
+          else {
+            for (i = op->size; i-- > 0; u >>= 8) p[i] = (char)u;
+          }
+          p += op->size;
+        }
+        break;
+
+      case PACK_STR:
+        {
+          mrb_value s = mrb_string_type(mrb, pack_arg(mrb, ary, &idx));
+          mrb_int slen = RSTRING_LEN(s);
+          mrb_int n = count == PACK_STAR ? slen + (op->dir == 'Z') : count;
+
+          p = pack_room(mrb, result, &bsiz, blen, n);
+          if (slen > n) slen = n;
+          memcpy(p, RSTRING_PTR(s), slen);
+          memset(p + slen, op->dir == 'A' ? ' ' : '\0', n - slen);
+          blen += n;
+        }
+        break;
+
+      case PACK_HEX:
+        {
+          mrb_value s = mrb_string_type(mrb, pack_arg(mrb, ary, &idx));
+          const unsigned char *sp = (const unsigned char*)RSTRING_PTR(s);
+          mrb_int slen = RSTRING_LEN(s);
+          mrb_int n = count == PACK_STAR ? slen : count;
+          mrb_int i;
+
+          p = pack_room(mrb, result, &bsiz, blen, (n + 1) / 2);
+          memset(p, 0, (n + 1) / 2);
+          for (i = 0; i < n && i < slen; i++) {
+            int v = hex_nibble(sp[i]);
+
+            if ((i & 1) == (op->dir == 'h')) v <<= 4;
+            p[i / 2] |= (char)v;
+          }
+          blen += (n + 1) / 2;
+        }
+        break;
+
+      case PACK_BASE64:
+        {
+          mrb_value s = mrb_string_type(mrb, pack_arg(mrb, ary, &idx));
+
+          blen = pack_base64(mrb, result, &bsiz, blen, (const unsigned char*)RSTRING_PTR(s),
+                             RSTRING_LEN(s), count);
+        }
+        break;
+
+      case PACK_NUL:
+        if (count == PACK_STAR) count = 0;
+        p = pack_room(mrb, result, &bsiz, blen, count);
+        memset(p, 0, count);
+        blen += count;
+        break;
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  mrb_str_resize(mrb, result, blen);
+  return result;
+}
+
+/*
+  == String#unpack
+*/
+
+/* appends v to an array with room for it, mrb_ary_push otherwise */
+static inline void
+unpack_push(mrb_state *mrb, mrb_value ary, mrb_value v)
+{
+  struct RArray *a = mrb_ary_ptr(ary);
+
+  if (a->len < a->aux.capa) {
+    a->ptr[a->len++] = v;
+    mrb_field_write_barrier_value(mrb, (struct RBasic*)a, v);
+  }
+  else {
+    mrb_ary_push(mrb, ary, v);
+  }
+}
+
+static mrb_value
+unpack_int(mrb_state *mrb, const unsigned char *p, const pack_op *op)
+{
+  uint32_t u = 0;
+  int i;
+
+  if (op->le) {
+    for (i = op->size; i-- > 0;) u = (u << 8) | p[i];
+  }
+  else {
+    for (i = 0; i < op->size; i++) u = (u << 8) | p[i];
+  }
+  if (op->sign) {
+    return mrb_fixnum_value((mrb_int)(int8_t)u);
+  }
+  if (u <= (uint32_t)MRB_INT_MAX) {
+    return mrb_fixnum_value((mrb_int)u);
+  }
+  return mrb_float_value(mrb, (mrb_float)u);
+}
+
+static mrb_value
+unpack_base64(mrb_state *mrb, const unsigned char *s, mrb_int len, mrb_bool strict)
+{
+  mrb_value str = mrb_str_new(mrb, NULL, len / 4 * 3 + 2);
+  unsigned char *out = (unsigned char*)RSTRING_PTR(str);
+  mrb_int n = 0;
+  mrb_int i;
+
+  if (strict) {
+    if (len % 4 != 0) goto invalid;
+    for (i = 0; i < len; i += 4) {
+      int a = b64_value(s[i]), b = b64_value(s[i+1]);
+      int c, d;
+
+      if (a < 0 || b < 0) goto invalid;
+      out[n++] = (unsigned char)(a << 2 | b >> 4);
+      if (s[i+2] == '=') {
+        if (i + 4 != len || s[i+3] != '=' || (b & 15)) goto invalid;
+        break;
+      }
+      c = b64_value(s[i+2]);
+      if (c < 0) goto invalid;
+      out[n++] = (unsigned char)(b << 4 | c >> 2);
+      if (s[i+3] == '=') {
+        if (i + 4 != len || (c & 3)) goto invalid;
+        break;
+      }
+      d = b64_value(s[i+3]);
+      if (d < 0) goto invalid;
+      out[n++] = (unsigned char)(c << 6 | d);
+    }
+  }
+  else {
+    uint32_t bits = 0;
+    int nbits = 0;
+
+    /* characters outside the alphabet are skipped */
+    for (i = 0; i < len && s[i] != '='; i++) {
+      int v = b64_value(s[i]);
+
+      if (v < 0) continue;
+      bits = (bits << 6) | v;
+      nbits += 6;
+      if (nbits >= 8) {
+        nbits -= 8;
+        out[n++] = (unsigned char)(bits >> nbits);
+      }
+    }
+  }
+  mrb_str_resize(mrb, str, n);
+  return str;
+
+ invalid:
+  mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid base64");
+  return mrb_nil_value();       /* not reached */
+}
+
+/*
+ *  call-seq:
+ *     str.unpack(template)   -> array
+ *
+ *  Decodes <i>str</i> as directed by <i>template</i> and returns an
+ *  array of the values extracted.  An integer directive with a count
+ *  that runs past the end of <i>str</i> gives <code>nil</code> for the
+ *  missing values.
+ *
+ *     "\x01\x02\x124".unpack("C2n")   #=> [1, 2, 4660]
+ *     "abc \x00\x00".unpack("A*")     #=> ["abc"]
+ */
+static mrb_value
+mrb_str_unpack(mrb_state *mrb, mrb_value str)
+{
+  mrb_value tmpl, result;
+  const pack_prog *prog;
+  const pack_op *op, *op_end;
+  const unsigned char *s = (const unsigned char*)RSTRING_PTR(str);
+  mrb_int len = RSTRING_LEN(str);
+  mrb_int pos = 0;
+  mrb_int capa;
+  int ai;
+
+  mrb_get_args(mrb, "S", &tmpl);
+  prog = pack_lookup(mrb, tmpl);
+  capa = prog->nvalues < len + prog->nops ? prog->nvalues : len + prog->nops;
+  if (prog->star) capa += len;
+  result = mrb_ary_new_capa(mrb, capa);
+  ai = mrb_gc_arena_save(mrb);
+
+  op_end = prog->ops + prog->nops;
+  for (op = prog->ops; op < op_end; op++) {
+    mrb_int count = op->count;
+    mrb_int rest = len - pos;
+
+    switch (op->kind) {
+      case PACK_INT:
+        if (count == PACK_STAR) count = rest / op->size;
+        for (; count > 0; count--) {
+          if (len - pos < op->size) {
+            unpack_push(mrb, result, mrb_nil_value());
+          }
+          else {
+            unpack_push(mrb, result, unpack_int(mrb, s + pos, op));
+            pos += op->size;
+          }
+        }
+        break;
+
+      case PACK_STR:
+        {
+          mrb_int n = count == PACK_STAR || count > rest ? rest : count;
+          mrb_int take = n;
+
+          if (op->dir == 'Z') {
+            const unsigned char *nul = (const unsigned char*)memchr(s + pos, '\0', n);
+
+            if (nul) {
+              take = nul - (s + pos);
+              if (count == PACK_STAR) n = take + 1;
+            }
+          }
+          else if (op->dir == 'A') {
+            while (take > 0 && (s[pos+take-1] == ' ' || s[pos+take-1] == '\0')) take--;
+          }
+          unpack_push(mrb, result, mrb_str_new(mrb, (const char*)s + pos, take));
+          pos += n;
+        }
+        break;
+
+      case PACK_HEX:
+        {
+          mrb_int n = count == PACK_STAR || count / 2 >= rest ? rest * 2 : count;
+          mrb_value h = mrb_str_new(mrb, NULL, n);
+          char *p = RSTRING_PTR(h);
+          mrb_int i;
+
+          for (i = 0; i < n; i++) {
+            int b = s[pos + i / 2];
+
+            p[i] = "0123456789abcdef"[((i & 1) == (op->dir == 'h') ? b >> 4 : b) & 15];
+          }
+          unpack_push(mrb, result, h);
+          pos += (n + 1) / 2;
+        }
+        break;
+
+      case PACK_BASE64:
+        unpack_push(mrb, result, unpack_base64(mrb, s + pos, rest, count == 0));
+        pos = len;
+        break;
+
+      case PACK_NUL:
+        if (count == PACK_STAR) count = rest;
+        if (count > rest) {
+          mrb_raise(mrb, E_ARGUMENT_ERROR, "x outside of string");
+        }
+        pos += count;
+        break;
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return result;
+}
+
+void
+mrb_mruby_pack_gem_init(mrb_state* mrb)
+{
+  mrb_define_method(mrb, mrb->array_class, "pack", mrb_ary_pack, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mrb->string_class, "unpack", mrb_str_unpack, MRB_ARGS_REQ(1));
+}
+
+void
+mrb_mruby_pack_gem_final(mrb_state* mrb)
+{
+}
@@ -0,0 +1,80 @@
+##
+# Array#pack and String#unpack Test
+
+assert('Array#pack integers') do
+  assert_equal "\x01\xff", [1, 255].pack("C2")
+  assert_equal "\xff\x80", [-1, -128].pack("c*")
+  assert_equal "\x12\x34\x12\x34\x56\x78", [0x1234, 0x12345678].pack("nN")
+  assert_equal "\x34\x12\x78\x56\x34\x12", [0x1234, 0x12345678].pack("vV")
+  assert_equal "\xff\xff\xff\xff", [4294967295.0].pack("N")
+  assert_equal "\x01\x02", [0x101, 0x202].pack("C C")
+  assert_raise(ArgumentError) { [1].pack("C2") }
+  assert_raise(TypeError) { ["1"].pack("C") }
+end
+
+assert('Array#pack strings') do
+  assert_equal "ab\0\0", ["ab"].pack("a4")
+  assert_equal "ab  ", ["ab"].pack("A4")
+  assert_equal "a", ["abc"].pack("a")
+  assert_equal "abc\0", ["abc"].pack("Z*")
+  assert_equal "abc", ["abc"].pack("a*")
+  assert_equal "\xab\xc0", ["abc"].pack("H*")
+  assert_equal "\xba\x0c", ["abc"].pack("h*")
+  assert_equal "\x10\x00", ["1"].pack("H4")
+  assert_equal "\0\0\x01", [1].pack("x2C")
+end
+
+assert('Array#pack base64') do
+  assert_equal "", [""].pack("m")
+  assert_equal "YWJj\n", ["abc"].pack("m")
+  assert_equal "YQ==", ["a"].pack("m0")
+  assert_equal "YWI=\n", ["ab"].pack("m")
+  assert_equal "YWJj\nZGVm\n", ["abcdef"].pack("m3")
+  assert_equal "YWJjZGVm" * 10, ["abcdef" * 10].pack("m0")
+end
+
+assert('Array#pack unknown directive') do
+  assert_raise(ArgumentError) { [1].pack("y") }
+  assert_raise(ArgumentError) { "a".unpack("Cy") }
+end
+
+assert('String#unpack integers') do
+  assert_equal [1, 255], "\x01\xff".unpack("C*")
+  assert_equal [1, -1], "\x01\xff".unpack("cc")
+  assert_equal [0x1234, 0x12345678], "\x12\x34\x12\x34\x56\x78".unpack("nN")
+  assert_equal [0x3412, 0x78563412], "\x12\x34\x12\x34\x56\x78".unpack("vV")
+  assert_equal [4294967295.0], "\xff\xff\xff\xff".unpack("N")
+  assert_equal [1, nil, nil], "\x01".unpack("C3")
+  assert_equal [0x102], "\x01\x02\x03".unpack("n*")
+  assert_equal [], "".unpack("C*")
+end
+
+assert('String#unpack strings') do
+  assert_equal ["ab\0 "], "ab\0 ".unpack("a*")
+  assert_equal ["ab"], "ab\0 ".unpack("A*")
+  assert_equal ["ab", "c"], "ab\0c".unpack("Z*a")
+  assert_equal ["ab", "c"], "ab\0\0c".unpack("Z4a")
+  assert_equal ["ab", "cd"], "abcd".unpack("a2a2")
+  assert_equal ["abc"], "abc".unpack("a10")
+  assert_equal ["61626"], "abc".unpack("H5")
+  assert_equal ["16"], "abc".unpack("h2")
+  assert_equal ["616263"], "abc".unpack("H*")
+  assert_equal [3], "\0\0\3".unpack("x2C")
+  assert_raise(ArgumentError) { "ab".unpack("x3") }
+end
+
+assert('String#unpack base64') do
+  assert_equal ["abc"], "YWJj\n".unpack("m")
+  assert_equal ["ab"], "YW\nI=".unpack("m")
+  assert_equal ["a"], "YQ==".unpack("m0")
+  assert_equal ["abcdef" * 10], (["abcdef" * 10].pack("m")).unpack("m")
+  assert_raise(ArgumentError) { "YQ=".unpack("m0") }
+  assert_raise(ArgumentError) { "YR==".unpack("m0") }
+  assert_raise(ArgumentError) { "Y Q==".unpack("m0") }
+end
+
+assert('pack and unpack round trip') do
+  a = [1, 0x1234, 0x12345678, "host", "deadbeef"]
+  t = "CnNa8H*"
+  assert_equal [1, 0x1234, 0x12345678, "host\0\0\0\0", "deadbeef"], a.pack(t).unpack(t)
+end
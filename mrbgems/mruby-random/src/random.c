@@ -15,8 +15,14 @@
 
 static char const MT_STATE_KEY[] = "$mrb_i_mt_state";
 
+static size_t
+mt_state_size(mrb_state *mrb, const void *ptr)
+{
+  return sizeof(mt_state);
+}
+
 static const struct mrb_data_type mt_state_type = {
-  MT_STATE_KEY, mrb_free,
+  MT_STATE_KEY, mrb_free, mt_state_size,
 };
 
 static mrb_value mrb_random_rand(mrb_state *mrb, mrb_value self);
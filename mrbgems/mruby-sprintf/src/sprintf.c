@@ -7,11 +7,14 @@
 #include "mruby.h"
 
 #include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include "mruby/data.h"
 #include "mruby/string.h"
 #include "mruby/hash.h"
 #include "mruby/numeric.h"
+#include "mruby/presym.h"
 #include <math.h>
 #include <ctype.h>
 
@@ -120,12 +123,14 @@ mrb_fix2binstr(mrb_state *mrb, mrb_value x, int base)
 
 #define CHECK(l) do {\
 /*  int cr = ENC_CODERANGE(result);*/\
-  while (blen + (l) >= bsiz) {\
-    bsiz*=2;\
+  if (blen + (l) >= bsiz) {\
+    while (blen + (l) >= bsiz) {\
+      bsiz*=2;\
+    }\
+    mrb_str_resize(mrb, result, bsiz);\
+    buf = RSTRING_PTR(result);\
   }\
-  mrb_str_resize(mrb, result, bsiz);\
 /*  ENC_CODERANGE_SET(result, cr);*/\
-  buf = RSTRING_PTR(result);\
 } while (0)
 
 #define PUSH(s, l) do { \
@@ -140,57 +145,6 @@ mrb_fix2binstr(mrb_state *mrb, mrb_value x, int base)
   blen += (l);\
 } while (0)
 
-#define GETARG() (!mrb_undef_p(nextvalue) ? nextvalue : \
-  posarg == -1 ? \
-  (mrb_raisef(mrb, E_ARGUMENT_ERROR, "unnumbered(%S) mixed with numbered", mrb_fixnum_value(nextarg)), mrb_undef_value()) : \
-  posarg == -2 ? \
-  (mrb_raisef(mrb, E_ARGUMENT_ERROR, "unnumbered(%S) mixed with named", mrb_fixnum_value(nextarg)), mrb_undef_value()) : \
-  (posarg = nextarg++, GETNTHARG(posarg)))
-
-#define GETPOSARG(n) (posarg > 0 ? \
-  (mrb_raisef(mrb, E_ARGUMENT_ERROR, "numbered(%S) after unnumbered(%S)", mrb_fixnum_value(n), mrb_fixnum_value(posarg)), mrb_undef_value()) : \
-  posarg == -2 ? \
-  (mrb_raisef(mrb, E_ARGUMENT_ERROR, "numbered(%S) after named", mrb_fixnum_value(n)), mrb_undef_value()) : \
-  ((n < 1) ? \
-  (mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid index - %S$", mrb_fixnum_value(n)), mrb_undef_value()) : \
-  (posarg = -1, GETNTHARG(n))))
-
-#define GETNTHARG(nth) \
-  ((nth >= argc) ? (mrb_raise(mrb, E_ARGUMENT_ERROR, "too few arguments"), mrb_undef_value()) : argv[nth])
-
-#define GETNAMEARG(id, name, len) ( \
-  posarg > 0 ? \
-  (mrb_raisef(mrb, E_ARGUMENT_ERROR, "named%S after unnumbered(%S)", mrb_str_new(mrb, (name), (len)), mrb_fixnum_value(posarg)), mrb_undef_value()) : \
-  posarg == -1 ? \
-  (mrb_raisef(mrb, E_ARGUMENT_ERROR, "named%S after numbered", mrb_str_new(mrb, (name), (len))), mrb_undef_value()) :    \
-  (posarg = -2, mrb_hash_fetch(mrb, get_hash(mrb, &hash, argc, argv), id, mrb_undef_value())))
-
-#define GETNUM(n, val) \
-  for (; p < end && ISDIGIT(*p); p++) {\
-    int next_n = 10 * n + (*p - '0'); \
-    if (next_n / 10 != n) {\
-      mrb_raise(mrb, E_ARGUMENT_ERROR, #val " too big"); \
-    } \
-    n = next_n; \
-  } \
-  if (p >= end) { \
-    mrb_raise(mrb, E_ARGUMENT_ERROR, "malformed format string - %*[0-9]"); \
-  }
-
-#define GETASTER(num) do { \
-  t = p++; \
-  n = 0; \
-  GETNUM(n, val); \
-  if (*p == '$') { \
-    tmp = GETPOSARG(n); \
-  } \
-  else { \
-    tmp = GETARG(); \
-    p = t; \
-  } \
-  num = mrb_fixnum(tmp); \
-} while (0)
-
 static mrb_value
 get_hash(mrb_state *mrb, mrb_value *hash, int argc, const mrb_value *argv)
 {
@@ -207,6 +161,448 @@ get_hash(mrb_state *mrb, mrb_value *hash, int argc, const mrb_value *argv)
   return (*hash = tmp);
 }
 
+/*
+  = Compiled formats
+
+  A format string is compiled once into a list of ops: runs of text to
+  copy and conversions with their flags, width, precision and argument
+  positions already decoded.  An error in the format becomes an op that
+  raises ArgumentError, so the conversions before it still run first as
+  they did when the string was scanned while formatting.
+
+  Compiled formats are kept in a string cache (mrb_str_cache_fetch())
+  on the Kernel module, so a template used over and over is parsed
+  once.
+*/
+
+#define FMT_CACHE_MAX_LEN 1024  /* longer formats are not kept */
+
+#define FMT_NOARG (-1)          /* no argument */
+#define FMT_NAMED (-2)          /* the value of %<name> or %{name} */
+
+enum fmt_op_type {
+  FMT_TEXT,                     /* copy bytes of the format string */
+  FMT_CONV,                     /* format a value */
+  FMT_RAISE                     /* raise ArgumentError */
+};
+
+typedef struct fmt_op {
+  enum fmt_op_type type;
+  char conv;                    /* conversion character */
+  char term;                    /* '>' or '}' closing a name */
+  int flags;
+  int arg;                      /* argv index of the value or FMT_NAMED */
+  int width_arg;                /* argv index of a `*' width, or FMT_NOARG */
+  int prec_arg;                 /* argv index of a `.*' precision, or FMT_NOARG */
+  mrb_int width;
+  mrb_int prec;
+  mrb_sym name;
+  mrb_int off;                  /* FMT_TEXT, FMT_RAISE: bytes in fmt_prog.str */
+  mrb_int len;
+} fmt_op;
+
+typedef struct fmt_prog {
+  mrb_str_cache_key key;        /* the format string, then error messages */
+  fmt_op *ops;
+  int nops;
+  int ops_capa;
+  mrb_int size_hint;            /* initial capacity of the result */
+} fmt_prog;
+
+static void
+fmt_prog_free(mrb_state *mrb, void *p)
+{
+  fmt_prog *prog = (fmt_prog*)p;
+
+  mrb_free(mrb, prog->key.str);
+  mrb_free(mrb, prog->ops);
+  mrb_free(mrb, prog);
+}
+
+static size_t
+fmt_prog_size(mrb_state *mrb, const void *p)
+{
+  const fmt_prog *prog = (const fmt_prog*)p;
+
+  return sizeof(fmt_prog) + prog->key.len + 1 + sizeof(fmt_op) * prog->ops_capa;
+}
+
+static const struct mrb_data_type fmt_prog_type = {
+  "SprintfFormat", fmt_prog_free, fmt_prog_size,
+};
+
+static fmt_op*
+fmt_add_op(mrb_state *mrb, fmt_prog *prog, enum fmt_op_type type)
+{
+  fmt_op *op;
+
+  if (prog->nops == prog->ops_capa) {
+    prog->ops_capa = prog->ops_capa ? prog->ops_capa * 2 : 8;
+    prog->ops = (fmt_op*)mrb_realloc(mrb, prog->ops, sizeof(fmt_op) * prog->ops_capa);
+  }
+  op = &prog->ops[prog->nops++];
+  memset(op, 0, sizeof(*op));
+  op->type = type;
+  op->arg = op->width_arg = op->prec_arg = FMT_NOARG;
+  return op;
+}
+
+static void
+fmt_add_text(mrb_state *mrb, fmt_prog *prog, mrb_int off, mrb_int len)
+{
+  fmt_op *op;
+
+  if (len == 0) return;
+  prog->size_hint += len;
+  if (prog->nops > 0) {
+    op = &prog->ops[prog->nops - 1];
+    if (op->type == FMT_TEXT && op->off + op->len == off) {
+      op->len += len;
+      return;
+    }
+  }
+  op = fmt_add_op(mrb, prog, FMT_TEXT);
+  op->off = off;
+  op->len = len;
+}
+
+/* ends the program with an op raising the message; messages are
+   stored after the format string */
+static void
+fmt_add_error(mrb_state *mrb, fmt_prog *prog, const char *fmt, ...)
+{
+  char msg[256];
+  va_list ap;
+  int n;
+  fmt_op *op;
+
+  va_start(ap, fmt);
+  n = vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  if (n < 0) n = 0;
+  if (n >= (int)sizeof(msg)) n = sizeof(msg) - 1;
+  prog->key.str = (char*)mrb_realloc(mrb, prog->key.str, prog->key.len + n + 1);
+  memcpy(prog->key.str + prog->key.len, msg, n);
+  op = fmt_add_op(mrb, prog, FMT_RAISE);
+  op->off = prog->key.len;
+  op->len = n;
+}
+
+static mrb_bool
+fmt_getnum(mrb_state *mrb, fmt_prog *prog, const char **pp, const char *end,
+           mrb_int *np, const char *what)
+{
+  const char *p = *pp;
+  mrb_int n = 0;
+
+  for (; p < end && ISDIGIT(*p); p++) {
+    if (n > (INT_MAX - (*p - '0')) / 10) {
+      fmt_add_error(mrb, prog, "%s too big", what);
+      return FALSE;
+    }
+    n = 10 * n + (*p - '0');
+  }
+  if (p >= end) {
+    fmt_add_error(mrb, prog, "malformed format string - %%*[0-9]");
+    return FALSE;
+  }
+  *pp = p;
+  *np = n;
+  return TRUE;
+}
+
+/*
+  posarg is the index of the last unnumbered argument taken, -1 after a
+  numbered one (n$) and -2 after a named one; the kinds cannot be mixed.
+*/
+static mrb_bool
+fmt_next_arg(mrb_state *mrb, fmt_prog *prog, int *nextarg, int *posarg, int *argp)
+{
+  if (*posarg == -1) {
+    fmt_add_error(mrb, prog, "unnumbered(%d) mixed with numbered", *nextarg);
+    return FALSE;
+  }
+  if (*posarg == -2) {
+    fmt_add_error(mrb, prog, "unnumbered(%d) mixed with named", *nextarg);
+    return FALSE;
+  }
+  *argp = *posarg = (*nextarg)++;
+  return TRUE;
+}
+
+static mrb_bool
+fmt_nth_arg(mrb_state *mrb, fmt_prog *prog, mrb_int n, int *posarg, int *argp)
+{
+  if (*posarg > 0) {
+    fmt_add_error(mrb, prog, "numbered(%d) after unnumbered(%d)", (int)n, *posarg);
+    return FALSE;
+  }
+  if (*posarg == -2) {
+    fmt_add_error(mrb, prog, "numbered(%d) after named", (int)n);
+    return FALSE;
+  }
+  if (n < 1) {
+    fmt_add_error(mrb, prog, "invalid index - %d$", (int)n);
+    return FALSE;
+  }
+  *posarg = -1;
+  *argp = (int)n;
+  return TRUE;
+}
+
+/* `*' or `*n$' at *pp; a value already given to the conversion (by n$
+   or a name) is taken as the number */
+static mrb_bool
+fmt_aster(mrb_state *mrb, fmt_prog *prog, const char **pp, const char *end,
+          int value_arg, int *nextarg, int *posarg, int *argp)
+{
+  const char *p = *pp + 1;
+  mrb_int n;
+
+  if (!fmt_getnum(mrb, prog, &p, end, &n, "val")) return FALSE;
+  if (*p == '$') {
+    if (!fmt_nth_arg(mrb, prog, n, posarg, argp)) return FALSE;
+    *pp = p;
+  }
+  else if (value_arg != FMT_NOARG) {
+    *argp = value_arg;
+  }
+  else if (!fmt_next_arg(mrb, prog, nextarg, posarg, argp)) {
+    return FALSE;
+  }
+  return TRUE;
+}
+
+#define CHECK_FOR_WIDTH(f)                                                  \
+  if ((f) & FWIDTH) {                                                       \
+    fmt_add_error(mrb, prog, "width given twice");                          \
+    return;                                                                 \
+  }                                                                         \
+  if ((f) & FPREC0) {                                                       \
+    fmt_add_error(mrb, prog, "width after precision");                      \
+    return;                                                                 \
+  }
+#define CHECK_FOR_FLAGS(f)                                                  \
+  if ((f) & FWIDTH) {                                                       \
+    fmt_add_error(mrb, prog, "flag after width");                           \
+    return;                                                                 \
+  }                                                                         \
+  if ((f) & FPREC0) {                                                       \
+    fmt_add_error(mrb, prog, "flag after precision");                       \
+    return;                                                                 \
+  }
+
+static void
+fmt_compile(mrb_state *mrb, void *entry)
+{
+  fmt_prog *prog = (fmt_prog*)entry;
+  const char *p = prog->key.str;
+  const char *end = p + prog->key.len;
+  int nextarg = 1;
+  int posarg = 0;
+
+  while (p < end) {
+    const char *t;
+    int flags = FNONE;
+    mrb_int width = -1, prec = -1, n;
+    int arg = FMT_NOARG, width_arg = FMT_NOARG, prec_arg = FMT_NOARG;
+    mrb_sym name = 0;
+    char term = 0;
+    char c;
+    fmt_op *op;
+
+    for (t = p; t < end && *t != '%'; t++) ;
+    fmt_add_text(mrb, prog, p - prog->key.str, t - p);
+    if (t >= end) break;
+    p = t + 1;    /* skip `%' */
+
+retry:
+    c = p < end ? *p : '\0';
+    switch (c) {
+      default:
+        fmt_add_error(mrb, prog, "malformed format string - %%%c", c);
+        return;
+
+      case ' ':
+        CHECK_FOR_FLAGS(flags);
+        flags |= FSPACE;
+        p++;
+        goto retry;
+
+      case '#':
+        CHECK_FOR_FLAGS(flags);
+        flags |= FSHARP;
+        p++;
+        goto retry;
+
+      case '+':
+        CHECK_FOR_FLAGS(flags);
+        flags |= FPLUS;
+        p++;
+        goto retry;
+
+      case '-':
+        CHECK_FOR_FLAGS(flags);
+        flags |= FMINUS;
+        p++;
+        goto retry;
+
+      case '0':
+        CHECK_FOR_FLAGS(flags);
+        flags |= FZERO;
+        p++;
+        goto retry;
+
+      case '1': case '2': case '3': case '4':
+      case '5': case '6': case '7': case '8': case '9':
+        if (!fmt_getnum(mrb, prog, &p, end, &n, "width")) return;
+        if (*p == '$') {
+          if (arg != FMT_NOARG) {
+            fmt_add_error(mrb, prog, "value given twice - %d$", (int)n);
+            return;
+          }
+          if (!fmt_nth_arg(mrb, prog, n, &posarg, &arg)) return;
+          p++;
+          goto retry;
+        }
+        CHECK_FOR_WIDTH(flags);
+        width = n;
+        flags |= FWIDTH;
+        goto retry;
+
+      case '<':
+      case '{': {
+        const char *start = p;
+        char tc = (*p == '<') ? '>' : '}';
+        int len;
+
+        for (; p < end && *p != tc; p++) ;
+        if (p >= end) {
+          fmt_add_error(mrb, prog, "malformed name - unmatched parenthesis");
+          return;
+        }
+        len = (int)(p - start + 1);
+        if (name) {
+          mrb_int nlen;
+          const char *nstr = mrb_sym2name_len(mrb, name, &nlen);
+
+          fmt_add_error(mrb, prog, "name%.*s after <%.*s>", len, start, (int)nlen, nstr);
+          return;
+        }
+        if (posarg > 0) {
+          fmt_add_error(mrb, prog, "named%.*s after unnumbered(%d)", len, start, posarg);
+          return;
+        }
+        if (posarg == -1) {
+          fmt_add_error(mrb, prog, "named%.*s after numbered", len, start);
+          return;
+        }
+        posarg = -2;
+        name = mrb_intern(mrb, start + 1, p - start - 1);
+        term = tc;
+        arg = FMT_NAMED;
+        if (tc == '}') {
+          c = 's';
+          goto conv;
+        }
+        p++;
+        goto retry;
+      }
+
+      case '*':
+        CHECK_FOR_WIDTH(flags);
+        flags |= FWIDTH;
+        if (!fmt_aster(mrb, prog, &p, end, arg, &nextarg, &posarg, &width_arg)) return;
+        p++;
+        goto retry;
+
+      case '.':
+        if (flags & FPREC0) {
+          fmt_add_error(mrb, prog, "precision given twice");
+          return;
+        }
+        flags |= FPREC|FPREC0;
+
+        prec = 0;
+        p++;
+        if (p < end && *p == '*') {
+          if (!fmt_aster(mrb, prog, &p, end, arg, &nextarg, &posarg, &prec_arg)) return;
+          p++;
+          goto retry;
+        }
+        if (!fmt_getnum(mrb, prog, &p, end, &prec, "precision")) return;
+        goto retry;
+
+      case '\n':
+      case '\0':
+        p--;
+        /* fallthrough */
+      case '%':
+        if (flags != FNONE) {
+          fmt_add_error(mrb, prog, "invalid format character - %%");
+          return;
+        }
+        fmt_add_text(mrb, prog, t - prog->key.str, 1);
+        break;
+
+      case 'c': case 's': case 'p':
+      case 'd': case 'i': case 'o': case 'x': case 'X': case 'b': case 'B': case 'u':
+      case 'f': case 'g': case 'G': case 'e': case 'E': case 'a': case 'A':
+        if (arg == FMT_NOARG && !fmt_next_arg(mrb, prog, &nextarg, &posarg, &arg)) return;
+      conv:
+        op = fmt_add_op(mrb, prog, FMT_CONV);
+        op->conv = c;
+        op->term = term;
+        op->flags = flags;
+        op->arg = arg;
+        op->width_arg = width_arg;
+        op->prec_arg = prec_arg;
+        op->width = width;
+        op->prec = prec;
+        op->name = name;
+        prog->size_hint += (width > 0 ? width : 0) + 16;
+        break;
+    }
+    p++;
+  }
+}
+
+static const mrb_str_cache_type fmt_cache_type = {
+  &fmt_prog_type, sizeof(fmt_prog), FMT_CACHE_MAX_LEN, fmt_compile,
+};
+
+/* the compiled form of fmt, from the cache or compiled now */
+static const fmt_prog*
+fmt_lookup(mrb_state *mrb, mrb_value fmt)
+{
+  return (const fmt_prog*)mrb_str_cache_fetch(mrb, (struct RObject*)mrb->kernel_module,
+                                              MRB_SYM(__sprintf_formats__), fmt, &fmt_cache_type);
+}
+
+static mrb_value
+fmt_arg(mrb_state *mrb, const fmt_op *op, int n, int argc, const mrb_value *argv, mrb_value *hash)
+{
+  mrb_value val;
+
+  if (n != FMT_NAMED) {
+    if (n >= argc) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "too few arguments");
+    }
+    return argv[n];
+  }
+  val = mrb_hash_fetch(mrb, get_hash(mrb, hash, argc, argv), mrb_symbol_value(op->name), mrb_undef_value());
+  if (mrb_undef_p(val)) {
+    mrb_int len;
+    const char *name = mrb_sym2name_len(mrb, op->name, &len);
+    mrb_value key = mrb_str_new(mrb, op->term == '>' ? "<" : "{", 1);
+
+    mrb_str_cat(mrb, key, name, len);
+    mrb_str_cat(mrb, key, &op->term, 1);
+    mrb_raisef(mrb, E_KEY_ERROR, "key%S not found", key);
+  }
+  return val;
+}
+
 /*
  *  call-seq:
  *     format(format_string [, arguments...] )   -> string
@@ -488,182 +884,63 @@ mrb_f_sprintf(mrb_state *mrb, mrb_value obj)
 mrb_value
 mrb_str_format(mrb_state *mrb, int argc, const mrb_value *argv, mrb_value fmt)
 {
-  const char *p, *end;
+  const fmt_prog *prog;
+  const fmt_op *op, *op_end;
   char *buf;
   mrb_int blen;
   mrb_int bsiz;
   mrb_value result;
   mrb_int n;
-  mrb_int width;
-  mrb_int prec;
-  int flags = FNONE;
-  int nextarg = 1;
-  int posarg = 0;
-  mrb_value nextvalue;
-  mrb_value tmp;
   mrb_value str;
   mrb_value hash = mrb_undef_value();
-
-#define CHECK_FOR_WIDTH(f)                                                  \
-  if ((f) & FWIDTH) {                                                       \
-    mrb_raise(mrb, E_ARGUMENT_ERROR, "width given twice");         \
-  }                                                                         \
-  if ((f) & FPREC0) {                                                       \
-    mrb_raise(mrb, E_ARGUMENT_ERROR, "width after precision");     \
-  }
-#define CHECK_FOR_FLAGS(f)                                                  \
-  if ((f) & FWIDTH) {                                                       \
-    mrb_raise(mrb, E_ARGUMENT_ERROR, "flag after width");          \
-  }                                                                         \
-  if ((f) & FPREC0) {                                                       \
-    mrb_raise(mrb, E_ARGUMENT_ERROR, "flag after precision");      \
-  }
+  int ai;
 
   ++argc;
   --argv;
   fmt = mrb_str_to_str(mrb, fmt);
-  p = RSTRING_PTR(fmt);
-  end = p + RSTRING_LEN(fmt);
+  prog = fmt_lookup(mrb, fmt);
   blen = 0;
-  bsiz = 120;
+  bsiz = prog->size_hint < 120 ? 120 : prog->size_hint;
   result = mrb_str_buf_new(mrb, bsiz);
+  mrb_str_resize(mrb, result, bsiz);
   buf = RSTRING_PTR(result);
-  memset(buf, 0, bsiz);
-
-  for (; p < end; p++) {
-    const char *t;
-    mrb_sym id = 0;
+  ai = mrb_gc_arena_save(mrb);
 
-    for (t = p; t < end && *t != '%'; t++) ;
-    PUSH(p, t - p);
-    if (t >= end)
-      goto sprint_exit; /* end of fmt string */
-
-    p = t + 1;    /* skip `%' */
-
-    width = prec = -1;
-    nextvalue = mrb_undef_value();
-
-retry:
-    switch (*p) {
-      default:
-        mrb_raisef(mrb, E_ARGUMENT_ERROR, "malformed format string - \\%%S", mrb_str_new(mrb, p, 1));
-        break;
+  for (op = prog->ops, op_end = op + prog->nops; op < op_end; op++) {
+    int flags;
+    mrb_int width, prec;
+    char conv;
+    mrb_value val;
 
-      case ' ':
-        CHECK_FOR_FLAGS(flags);
-        flags |= FSPACE;
-        p++;
-        goto retry;
-
-      case '#':
-        CHECK_FOR_FLAGS(flags);
-        flags |= FSHARP;
-        p++;
-        goto retry;
-
-      case '+':
-        CHECK_FOR_FLAGS(flags);
-        flags |= FPLUS;
-        p++;
-        goto retry;
+    if (op->type == FMT_TEXT) {
+      PUSH(prog->key.str + op->off, op->len);
+      continue;
+    }
+    if (op->type == FMT_RAISE) {
+      mrb_exc_raise(mrb, mrb_exc_new(mrb, E_ARGUMENT_ERROR, prog->key.str + op->off, op->len));
+    }
 
-      case '-':
-        CHECK_FOR_FLAGS(flags);
+    flags = op->flags;
+    width = op->width;
+    prec = op->prec;
+    conv = op->conv;
+    if (op->width_arg != FMT_NOARG) {
+      width = mrb_fixnum(fmt_arg(mrb, op, op->width_arg, argc, argv, &hash));
+      if (width < 0) {
         flags |= FMINUS;
-        p++;
-        goto retry;
-
-      case '0':
-        CHECK_FOR_FLAGS(flags);
-        flags |= FZERO;
-        p++;
-        goto retry;
-
-      case '1': case '2': case '3': case '4':
-      case '5': case '6': case '7': case '8': case '9':
-        n = 0;
-        GETNUM(n, width);
-        if (*p == '$') {
-          if (!mrb_undef_p(nextvalue)) {
-            mrb_raisef(mrb, E_ARGUMENT_ERROR, "value given twice - %S$", mrb_fixnum_value(n));
-          }
-          nextvalue = GETPOSARG(n);
-          p++;
-          goto retry;
-        }
-        CHECK_FOR_WIDTH(flags);
-        width = n;
-        flags |= FWIDTH;
-        goto retry;
-
-      case '<':
-      case '{': {
-        const char *start = p;
-        char term = (*p == '<') ? '>' : '}';
-        mrb_value symname;
-
-        for (; p < end && *p != term; )
-          p++;
-        if (id) {
-          mrb_raisef(mrb, E_ARGUMENT_ERROR, "name%S after <%S>",
-                     mrb_str_new(mrb, start, p - start + 1), mrb_sym2str(mrb, id));
-        }
-        symname = mrb_str_new(mrb, start + 1, p - start - 1);
-        id = mrb_intern_str(mrb, symname);
-        nextvalue = GETNAMEARG(mrb_symbol_value(id), start, (int)(p - start + 1));
-        if (mrb_undef_p(nextvalue)) {
-          mrb_raisef(mrb, E_KEY_ERROR, "key%S not found", mrb_str_new(mrb, start, p - start + 1));
-        }
-        if (term == '}') goto format_s;
-        p++;
-        goto retry;
+        width = -width;
       }
+    }
+    if (op->prec_arg != FMT_NOARG) {
+      prec = mrb_fixnum(fmt_arg(mrb, op, op->prec_arg, argc, argv, &hash));
+      if (prec < 0) {  /* ignore negative precision */
+        flags &= ~FPREC;
+      }
+    }
+    val = fmt_arg(mrb, op, op->arg, argc, argv, &hash);
 
-      case '*':
-        CHECK_FOR_WIDTH(flags);
-        flags |= FWIDTH;
-        GETASTER(width);
-        if (width < 0) {
-          flags |= FMINUS;
-          width = -width;
-        }
-        p++;
-        goto retry;
-
-      case '.':
-        if (flags & FPREC0) {
-          mrb_raise(mrb, E_ARGUMENT_ERROR, "precision given twice");
-        }
-        flags |= FPREC|FPREC0;
-
-        prec = 0;
-        p++;
-        if (*p == '*') {
-          GETASTER(prec);
-          if (prec < 0) {  /* ignore negative precision */
-            flags &= ~FPREC;
-          }
-          p++;
-          goto retry;
-        }
-
-        GETNUM(prec, precision);
-        goto retry;
-
-      case '\n':
-      case '\0':
-        p--;
-        /* fallthrough */
-      case '%':
-        if (flags != FNONE) {
-          mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid format character - %");
-        }
-        PUSH("%", 1);
-        break;
-
+    switch (conv) {
       case 'c': {
-        mrb_value val = GETARG();
         mrb_value tmp;
         char *c;
 
@@ -702,23 +979,14 @@ retry:
       break;
 
       case 's':
-      case 'p':
-  format_s:
-      {
-        mrb_value arg = GETARG();
+      case 'p': {
+        mrb_value arg = val;
         mrb_int len;
         mrb_int slen;
 
-        if (*p == 'p') arg = mrb_inspect(mrb, arg);
+        if (conv == 'p') arg = mrb_inspect(mrb, arg);
         str = mrb_obj_as_string(mrb, arg);
         len = RSTRING_LEN(str);
-        if (RSTRING(result)->flags & MRB_STR_EMBED) {
-          mrb_int tmp_n = len;
-          RSTRING(result)->flags &= ~MRB_STR_EMBED_LEN_MASK;
-          RSTRING(result)->flags |= tmp_n << MRB_STR_EMBED_LEN_SHIFT;
-        } else {
-          RSTRING(result)->as.heap.len = blen;
-        }
         if (flags&(FPREC|FWIDTH)) {
           slen = RSTRING_LEN(str);
           if (slen < 0) {
@@ -762,7 +1030,6 @@ retry:
       case 'b':
       case 'B':
       case 'u': {
-        mrb_value val = GETARG();
         char fbuf[32], nbuf[64], *s;
         const char *prefix = NULL;
         int sign = 0, dots = 0;
@@ -771,7 +1038,7 @@ retry:
         int base;
         mrb_int len;
 
-        switch (*p) {
+        switch (conv) {
           case 'd':
           case 'i':
           case 'u':
@@ -787,7 +1054,7 @@ retry:
             break;
         }
         if (flags & FSHARP) {
-          switch (*p) {
+          switch (conv) {
             case 'o': prefix = "0"; break;
             case 'x': prefix = "0x"; break;
             case 'X': prefix = "0X"; break;
@@ -818,7 +1085,7 @@ retry:
             goto bin_retry;
         }
 
-        switch (*p) {
+        switch (conv) {
           case 'o':
             base = 8; break;
           case 'x':
@@ -846,7 +1113,7 @@ retry:
           v = mrb_fixnum(mrb_str_to_inum(mrb, val, 10, FALSE));
         }
         if (sign) {
-          char c = *p;
+          char c = conv;
           if (c == 'i') c = 'd'; /* %d and %i are identical */
           if (base == 2) c = 'd';
           if (v < 0) {
@@ -867,7 +1134,7 @@ retry:
           s = nbuf;
         }
         else {
-          char c = *p;
+          char c = conv;
           if (c == 'X') c = 'x';
           if (base == 2) c = 'd';
           s = nbuf;
@@ -904,7 +1171,7 @@ retry:
           width -= 2;
         }
 
-        if (*p == 'X') {
+        if (conv == 'X') {
           char *pp = s;
           int c;
           while ((c = (int)(unsigned char)*pp) != 0) {
@@ -966,7 +1233,7 @@ retry:
         if (dots) PUSH("..", 2);
 
         if (v < 0 || (base == 2 && org_v < 0)) {
-          char c = sign_bits(base, p);
+          char c = sign_bits(base, &conv);
           while (len < prec--) {
             buf[blen++] = c;
           }
@@ -993,7 +1260,6 @@ retry:
       case 'E':
       case 'a':
       case 'A': {
-        mrb_value val = GETARG();
         double fval;
         int i, need = 6;
         char fbuf[32];
@@ -1039,9 +1305,9 @@ retry:
           break;
         }
 
-        fmt_setup(fbuf, sizeof(fbuf), *p, flags, width, prec);
+        fmt_setup(fbuf, sizeof(fbuf), conv, flags, width, prec);
         need = 0;
-        if (*p != 'e' && *p != 'E') {
+        if (conv != 'e' && conv != 'E') {
           i = INT_MIN;
           frexp(fval, &i);
           if (i > 0)
@@ -1058,19 +1324,9 @@ retry:
       }
       break;
     }
-    flags = FNONE;
+    mrb_gc_arena_restore(mrb, ai);
   }
 
-  sprint_exit:
-#if 0
-  /* XXX - We cannot validate the number of arguments if (digit)$ style used.
-   */
-  if (posarg >= 0 && nextarg < argc) {
-    const char *mesg = "too many arguments for format string";
-    if (mrb_test(ruby_debug)) mrb_raise(mrb, E_ARGUMENT_ERROR, mesg);
-    if (mrb_test(ruby_verbose)) mrb_warn(mrb, "%S", mrb_str_new_cstr(mrb, mesg));
-  }
-#endif
   mrb_str_resize(mrb, result, blen);
 
   return result;
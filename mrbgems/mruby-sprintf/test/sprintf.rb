@@ -1,3 +1,25 @@
 ##
 # Kernel#sprintf Kernel#format Test
 
+
+assert('Kernel.#sprintf') do
+  assert_equal "123 007b", sprintf("%d %04x", 123, 123)
+  assert_equal "   hello 8 hello", sprintf("%1$*2$s %2$d %1$s", "hello", 8)
+  assert_equal "hello    -8", sprintf("%1$*2$s %2$d", "hello", -8)
+  assert_equal "+1.23: 1.23:1.23", sprintf("%+g:% g:%-g", 1.23, 1.23, 1.23)
+  assert_equal "1 : 2.000000", sprintf("%<foo>d : %<bar>f", { :foo => 1, :bar => 2 })
+  assert_equal "1f", sprintf("%{foo}f", { :foo => 1 })
+  assert_equal "%5%", sprintf("%%%d%%", 5)
+  assert_equal "abc%", sprintf("abc%")
+end
+
+assert('Kernel.#format with a repeated format string') do
+  fmt = "[%-5s] %3d%%"
+  assert_equal "[ab   ]   7%", format(fmt, "ab", 7)
+  assert_equal "[cdefg] 100%", format(fmt, "cdefg", 100)
+  assert_equal "[x    ]   1%", format(fmt.dup, "x", 1)
+  assert_raise(ArgumentError) { format(fmt, "x") }
+  assert_raise(ArgumentError) { format("%s %1$s", 1) }
+  assert_raise(ArgumentError) { format("%s %1$s", 1) }
+  assert_raise(KeyError) { format("%<b>s", { :a => 1 }) }
+end
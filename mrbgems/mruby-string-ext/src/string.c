@@ -1,6 +1,7 @@
 #include <ctype.h>
 #include <string.h>
 #include "mruby.h"
+#include "mruby/array.h"
 #include "mruby/string.h"
 
 static mrb_value
@@ -163,6 +164,35 @@ mrb_str_end_with(mrb_state *mrb, mrb_value self)
   return mrb_false_value();
 }
 
+/*
+ *  call-seq:
+ *     str.lines   -> array
+ *
+ *  Returns the lines of +str+, each with its trailing newline.  The lines
+ *  share the buffer of +str+ where possible.
+ *
+ *    "a\nbc\n\nd".lines   #=> ["a\n", "bc\n", "\n", "d"]
+ */
+static mrb_value
+mrb_str_lines(mrb_state *mrb, mrb_value self)
+{
+  mrb_value result = mrb_ary_new(mrb);
+  mrb_int len = RSTRING_LEN(self), beg = 0;
+  int ai = mrb_gc_arena_save(mrb);
+
+  while (beg < len) {
+    /* reload: the first piece may move the buffer to share it */
+    const char *p = RSTRING_PTR(self);
+    const char *nl = (const char*)memchr(p + beg, '\n', len - beg);
+    mrb_int end = nl ? (nl - p) + 1 : len;
+
+    mrb_ary_push(mrb, result, mrb_str_substr(mrb, self, beg, end - beg));
+    mrb_gc_arena_restore(mrb, ai);
+    beg = end;
+  }
+  return result;
+}
+
 void
 mrb_mruby_string_ext_gem_init(mrb_state* mrb)
 {
@@ -176,6 +206,7 @@ mrb_mruby_string_ext_gem_init(mrb_state* mrb)
   mrb_define_method(mrb, s, "<<",              mrb_str_concat2,         MRB_ARGS_REQ(1));
   mrb_define_method(mrb, s, "start_with?",     mrb_str_start_with,      MRB_ARGS_REST());
   mrb_define_method(mrb, s, "end_with?",       mrb_str_end_with,        MRB_ARGS_REST());
+  mrb_define_method(mrb, s, "lines",           mrb_str_lines,           MRB_ARGS_NONE());
 }
 
 void
@@ -93,6 +93,16 @@ assert('String#concat') do
   assert_equal "Hello World!", s
 end
 
+assert('String#<< in a loop') do
+  s = ""
+  1000.times { |i| s << "#{i}," }
+  assert_equal 3890, s.size
+  assert_equal "998,999,", s[-8, 8]
+  s << s
+  assert_equal 7780, s.size
+  assert_equal "0,1,", s[3890, 4]
+end
+
 assert('String#casecmp') do
   assert_equal 1, "abcdef".casecmp("abcde")
   assert_equal 0, "aBcDeF".casecmp("abcdef")
@@ -114,6 +124,16 @@ assert('String#end_with?') do
   assert_raise TypeError do "hello".end_with?(true) end
 end
 
+assert('String#lines') do
+  assert_equal ["a\n", "bc\n", "\n", "d"], "a\nbc\n\nd".lines
+  assert_equal ["a\n"], "a\n".lines
+  assert_equal [], "".lines
+  long = "#{'x' * 40}\n" * 3
+  lines = long.lines
+  long[0] = 'y'
+  assert_equal "#{'x' * 40}\n", lines[0]
+end
+
 assert('String#partition') do
   assert_equal ["a", "x", "axa"], "axaxa".partition("x")
   assert_equal ["aaaaa", "", ""], "aaaaa".partition("x")
@@ -1,9 +1,16 @@
 #include "mruby.h"
+#include "mruby/data.h"
 #include "mruby/string.h"
 #include "mruby/range.h"
+#include "mruby/presym.h"
 #include <ctype.h>
 #include <string.h>
 
+#if defined(ENABLE_SIMD) && defined(__GNUC__) && defined(__SSE2__)
+#define UTF8_SSE2
+#include <emmintrin.h>
+#endif
+
 /* TODO: duplicate definition in src/re.h */
 #define REGEXP_CLASS "Regexp"
 
@@ -19,43 +26,306 @@ static const char utf8len_codepage[256] =
   3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,4,4,4,4,4,1,1,1,1,1,1,1,1,1,1,1,
 };
 
+/* length of the character at p, which must be before e */
 static mrb_int
-utf8len(unsigned char* p)
+utf8len(const unsigned char *p, const unsigned char *e)
 {
   mrb_int len;
   mrb_int i;
 
-  if (*p == 0)
-    return 1;
   len = utf8len_codepage[*p];
+  if (len > e - p)
+    return 1;
   for (i = 1; i < len; ++i)
     if ((p[i] & 0xc0) != 0x80)
       return 1;
   return len;
 }
 
+/*
+  A string is well-formed when every byte that starts a multibyte
+  sequence is followed by exactly the continuation bytes it asks for and
+  no continuation byte appears anywhere else.  Its characters are then
+  simply its non-continuation bytes, which can be counted and located a
+  vector at a time; other strings are walked with utf8len().
+*/
+#define UTF8_CONT(c) (((c) & 0xc0) == 0x80)
+#define UTF8_LEAD2(c) ((c) >= 0xc0 && (c) <= 0xf4)
+#define UTF8_LEAD3(c) ((c) >= 0xe0 && (c) <= 0xf4)
+#define UTF8_LEAD4(c) ((c) >= 0xf0 && (c) <= 0xf4)
+
+static mrb_bool
+utf8_check(const unsigned char *p, mrb_int from, mrb_int to, mrb_int *count)
+{
+  mrb_int i;
+
+  for (i = from; i < to; i++) {
+    mrb_bool need = (i >= 1 && UTF8_LEAD2(p[i-1])) ||
+                    (i >= 2 && UTF8_LEAD3(p[i-2])) ||
+                    (i >= 3 && UTF8_LEAD4(p[i-3]));
+
+    if (need != UTF8_CONT(p[i])) return FALSE;
+    if (!need) (*count)++;
+  }
+  return TRUE;
+}
+
+#ifdef UTF8_SSE2
+#define UTF8_IN_RANGE(v, lo, hi) \
+  _mm_and_si128(_mm_cmpgt_epi8((v), _mm_set1_epi8((lo)-1)), _mm_cmplt_epi8((v), _mm_set1_epi8((hi)+1)))
+/* bytes in 0x80..0xbf, compared as signed chars */
+#define UTF8_CONT_MASK(v) _mm_cmplt_epi8((v), _mm_set1_epi8(-0x40))
+#endif
+
+/* counts the characters of a well-formed string; returns -1 otherwise */
+static mrb_int
+utf8_count(const unsigned char *p, mrb_int len)
+{
+  mrb_int i, count = 0;
+
+  i = len < 16 ? len : 16;
+  if (!utf8_check(p, 0, i, &count)) return -1;
+#ifdef UTF8_SSE2
+  for (; i + 16 <= len; i += 16) {
+    __m128i cont = UTF8_CONT_MASK(_mm_loadu_si128((const __m128i*)(p+i)));
+    __m128i need = _mm_or_si128(
+      _mm_or_si128(UTF8_IN_RANGE(_mm_loadu_si128((const __m128i*)(p+i-1)), -0x40, -0x0c),
+                   UTF8_IN_RANGE(_mm_loadu_si128((const __m128i*)(p+i-2)), -0x20, -0x0c)),
+      UTF8_IN_RANGE(_mm_loadu_si128((const __m128i*)(p+i-3)), -0x10, -0x0c));
+    int contbits = _mm_movemask_epi8(cont);
+
+    if (_mm_movemask_epi8(_mm_xor_si128(cont, need))) return -1;
+    count += 16 - __builtin_popcount(contbits);
+  }
+#endif
+  if (!utf8_check(p, i, len, &count)) return -1;
+  /* nor may the last sequence run past the end */
+  if ((len >= 1 && UTF8_LEAD2(p[len-1])) ||
+      (len >= 2 && UTF8_LEAD3(p[len-2])) ||
+      (len >= 3 && UTF8_LEAD4(p[len-3]))) {
+    return -1;
+  }
+  return count;
+}
+
+/*
+  Character index cache.  Strings of UTF8_INDEX_MIN bytes or more keep
+  their character length, and once a character is looked up by position
+  also the byte offset of every UTF8_INDEX_STEP-th character, in a
+  string cache (mrb_str_cache_get()) on the String class hashed by object
+  address.  The Data object of a slot is reused for the next string
+  hashed to it, so the cache allocates only while it fills up.  An
+  entry is valid while its string
+  carries MRB_STR_INDEXED, which core clears whenever the contents change
+  (see mrb_str_modify()); a new object at a recycled address starts
+  without the flag.
+*/
+#define UTF8_INDEX_MIN 64
+#define UTF8_INDEX_STEP 64
+
+typedef struct utf8_index {
+  struct RString *s;
+  mrb_int len;            /* bytes */
+  mrb_int clen;           /* characters */
+  mrb_bool wellformed : 1;
+  mrb_bool has_offs : 1;
+  mrb_int *offs;          /* offs[i]: offset of character i*UTF8_INDEX_STEP */
+  mrb_int offs_capa;
+} utf8_index;
+
+static void
+utf8_index_free(mrb_state *mrb, void *p)
+{
+  utf8_index *ix = (utf8_index*)p;
+
+  mrb_free(mrb, ix->offs);
+  mrb_free(mrb, ix);
+}
+
+static size_t
+utf8_index_size(mrb_state *mrb, const void *p)
+{
+  const utf8_index *ix = (const utf8_index*)p;
+
+  return sizeof(utf8_index) + sizeof(mrb_int) * ix->offs_capa;
+}
+
+static const struct mrb_data_type utf8_index_type = {
+  "UTF8Index", utf8_index_free, utf8_index_size,
+};
+
 static mrb_int
-mrb_utf8_strlen(mrb_value str)
+utf8_walk_count(const unsigned char *p, const unsigned char *e)
 {
   mrb_int total = 0;
-  unsigned char* p = (unsigned char*) RSTRING_PTR(str);
-  unsigned char* e = p + RSTRING_LEN(str);
-  while (p<e) {
-    p += utf8len(p);
+
+  while (p < e) {
+    p += utf8len(p, e);
     total++;
   }
   return total;
 }
 
+static void
+utf8_index_init(utf8_index *ix, struct RString *s, const unsigned char *p, mrb_int len)
+{
+  mrb_int clen = utf8_count(p, len);
+
+  ix->s = s;
+  ix->len = len;
+  ix->wellformed = clen >= 0;
+  ix->clen = ix->wellformed ? clen : utf8_walk_count(p, p + len);
+  ix->has_offs = FALSE;
+}
+
+static void
+utf8_index_build_offs(mrb_state *mrb, utf8_index *ix, const unsigned char *p)
+{
+  mrb_int n = (ix->clen + UTF8_INDEX_STEP - 1) / UTF8_INDEX_STEP;
+  mrb_int i = 0, c = 0, k = 0;
+
+  if (n > ix->offs_capa) {
+    ix->offs = (mrb_int*)mrb_realloc(mrb, ix->offs, sizeof(mrb_int) * n);
+    ix->offs_capa = n;
+  }
+  ix->has_offs = TRUE;
+  if (!ix->wellformed) {
+    const unsigned char *e = p + ix->len;
+
+    while (i < ix->len) {
+      if (c % UTF8_INDEX_STEP == 0) ix->offs[k++] = i;
+      i += utf8len(p + i, e);
+      c++;
+    }
+    return;
+  }
+#ifdef UTF8_SSE2
+  for (; i + 16 <= ix->len; i += 16) {
+    int starts = ~_mm_movemask_epi8(UTF8_CONT_MASK(_mm_loadu_si128((const __m128i*)(p+i)))) & 0xffff;
+    int m = __builtin_popcount(starts);
+
+    if (c + m <= k * UTF8_INDEX_STEP) {
+      c += m;
+      continue;
+    }
+    while (starts) {
+      if (c == k * UTF8_INDEX_STEP) ix->offs[k++] = i + __builtin_ctz(starts);
+      starts &= starts - 1;
+      c++;
+    }
+  }
+#endif
+  for (; i < ix->len; i++) {
+    if (UTF8_CONT(p[i])) continue;
+    if (c == k * UTF8_INDEX_STEP) ix->offs[k++] = i;
+    c++;
+  }
+}
+
+/*
+  Returns the index of str.  Short strings are not cached: their entry is
+  built in tmp and has no offsets.
+*/
+static utf8_index*
+utf8_index_get(mrb_state *mrb, mrb_value str, utf8_index *tmp)
+{
+  struct RString *s = mrb_str_ptr(str);
+  const unsigned char *p = (const unsigned char*)RSTRING_PTR(str);
+  mrb_int len = RSTRING_LEN(str);
+  struct RObject *owner = (struct RObject*)mrb->string_class;
+  uint32_t hash = (uint32_t)((uintptr_t)s >> 4);
+  mrb_value obj;
+  utf8_index *ix;
+
+  if (len < UTF8_INDEX_MIN) {
+    utf8_index_init(tmp, s, p, len);
+    return tmp;
+  }
+  obj = mrb_str_cache_get(mrb, owner, MRB_SYM(__utf8_index__), hash);
+  if (mrb_nil_p(obj)) {
+    ix = (utf8_index*)mrb_calloc(mrb, 1, sizeof(utf8_index));
+    obj = mrb_obj_value(mrb_data_object_alloc(mrb, mrb->object_class, ix, &utf8_index_type));
+    mrb_str_cache_set(mrb, owner, MRB_SYM(__utf8_index__), hash, obj);
+  }
+  else {
+    ix = DATA_GET_PTR(mrb, obj, &utf8_index_type, utf8_index);
+    if (ix->s == s && (s->flags & MRB_STR_INDEXED) && ix->len == len) {
+      return ix;
+    }
+  }
+  utf8_index_init(ix, s, p, len);
+  s->flags |= MRB_STR_INDEXED;
+  return ix;
+}
+
+/* byte offset of character ci, which is at most ix->clen */
+static mrb_int
+utf8_offset(mrb_state *mrb, utf8_index *ix, const unsigned char *p, mrb_int ci)
+{
+  const unsigned char *e = p + ix->len;
+  mrb_int b = 0;
+
+  if (ix->clen == ix->len) return ci;
+  if (ci >= ix->clen) return ix->len;
+  if (ix->len >= UTF8_INDEX_MIN) {
+    if (!ix->has_offs) utf8_index_build_offs(mrb, ix, p);
+    b = ix->offs[ci / UTF8_INDEX_STEP];
+    ci %= UTF8_INDEX_STEP;
+  }
+  while (ci-- > 0) {
+    b += utf8len(p + b, e);
+  }
+  return b;
+}
+
+/* index of the character containing byte pos */
+static mrb_int
+utf8_char_index(mrb_state *mrb, utf8_index *ix, const unsigned char *p, mrb_int pos)
+{
+  const unsigned char *e = p + ix->len;
+  mrb_int b = 0, ci = 0;
+
+  if (ix->clen == ix->len) return pos;
+  if (ix->len >= UTF8_INDEX_MIN) {
+    mrb_int lo = 0, hi = (ix->clen + UTF8_INDEX_STEP - 1) / UTF8_INDEX_STEP;
+
+    if (!ix->has_offs) utf8_index_build_offs(mrb, ix, p);
+    while (hi - lo > 1) {
+      mrb_int mid = (lo + hi) / 2;
+
+      if (ix->offs[mid] <= pos) lo = mid;
+      else hi = mid;
+    }
+    b = ix->offs[lo];
+    ci = lo * UTF8_INDEX_STEP;
+  }
+  while (b < ix->len) {
+    mrb_int next = b + utf8len(p + b, e);
+
+    if (next > pos) break;
+    b = next;
+    ci++;
+  }
+  return ci;
+}
+
+static mrb_int
+mrb_utf8_strlen(mrb_state *mrb, mrb_value str)
+{
+  utf8_index tmp;
+
+  return utf8_index_get(mrb, str, &tmp)->clen;
+}
+
 static mrb_value
 mrb_str_size(mrb_state *mrb, mrb_value str)
 {
-  mrb_int size = mrb_utf8_strlen(str);
+  mrb_int size = mrb_utf8_strlen(mrb, str);
 
   return mrb_fixnum_value(size);
 }
 
-#define RSTRING_LEN_UTF8(s) mrb_utf8_strlen(s)
+#define RSTRING_LEN_UTF8(s) mrb_utf8_strlen(mrb, s)
 
 static mrb_value
 noregexp(mrb_state *mrb, mrb_value self)
@@ -72,64 +342,16 @@ regexp_check(mrb_state *mrb, mrb_value obj)
   }
 }
 
-static inline mrb_int
-mrb_memsearch_qs(const unsigned char *xs, mrb_int m, const unsigned char *ys, mrb_int n)
-{
-  const unsigned char *x = xs, *xe = xs + m;
-  const unsigned char *y = ys;
-  int i, qstable[256];
-
-  /* Preprocessing */
-  for (i = 0; i < 256; ++i)
-    qstable[i] = m + 1;
-  for (; x < xe; ++x)
-    qstable[*x] = xe - x;
- /* Searching */
-  for (; y + m <= ys + n; y += *(qstable + y[m])) {
-    if (*xs == *y && memcmp(xs, y, m) == 0)
-        return y - ys;
-  }
-  return -1;
-}
-static mrb_int
-mrb_memsearch(const void *x0, mrb_int m, const void *y0, mrb_int n)
-{
-  const unsigned char *x = (const unsigned char *)x0, *y = (const unsigned char *)y0;
-
-  if (m > n) return -1;
-  else if (m == n) {
-    return memcmp(x0, y0, m) == 0 ? 0 : -1;
-  }
-  else if (m < 1) {
-    return 0;
-  }
-  else if (m == 1) {
-    const unsigned char *ys = y, *ye = ys + n;
-    for (; y < ye; ++y) {
-      if (*x == *y)
-        return y - ys;
-    }
-    return -1;
-  }
-  return mrb_memsearch_qs((const unsigned char *)x0, m, (const unsigned char *)y0, n);
-}
-
 static mrb_value
 str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
 {
-  mrb_int i;
-  unsigned char *p = (unsigned char*) RSTRING_PTR(str), *t;
-  unsigned char *e = p + RSTRING_LEN(str);
-  
+  utf8_index tmp, *ix = utf8_index_get(mrb, str, &tmp);
+  const unsigned char *p = (const unsigned char*)RSTRING_PTR(str);
+  mrb_int b, e;
 
-  for (i = 0; i < beg && p<e; i++) {
-    p += utf8len(p);
-  }
-  t = p;
-  for (i = 0; i < len && t<e; i++) {
-    t += utf8len(t);
-  }
-  return mrb_str_new(mrb, (const char*)p, (int)(t - p));
+  b = utf8_offset(mrb, ix, p, beg);
+  e = utf8_offset(mrb, ix, p, len < ix->clen - beg ? beg + len : ix->clen);
+  return mrb_str_substr(mrb, str, b, e - b);
 }
 
 static mrb_value
@@ -247,10 +469,62 @@ mrb_str_aref_m(mrb_state *mrb, mrb_value str)
   return mrb_str_aref(mrb, str, a1);
 }
 
+/*
+ *  call-seq:
+ *     str.index(substring [, offset])   => fixnum or nil
+ *
+ *  Returns the character index of the first occurrence of
+ *  <i>substring</i> in <i>str</i>, or <code>nil</code> if not found.
+ *  The search starts at character <i>offset</i>, counted from the end
+ *  when negative.  An Integer <i>substring</i> is taken as a byte.
+ *
+ *     "こんにちわ世界".index("世")      #=> 5
+ *     "こんにちわ世界".index("ち", 4)   #=> nil
+ */
+static mrb_value
+mrb_str_index_m(mrb_state *mrb, mrb_value str)
+{
+  mrb_value sub, tmp;
+  mrb_int pos = 0, b, found;
+  utf8_index buf, *ix;
+  const unsigned char *p;
+  const char *subp;
+  mrb_int sublen;
+  char c;
+
+  mrb_get_args(mrb, "o|i", &sub, &pos);
+  regexp_check(mrb, sub);
+  if (mrb_fixnum_p(sub)) {
+    c = (char)mrb_fixnum(sub);
+    subp = &c;
+    sublen = 1;
+  }
+  else {
+    tmp = mrb_check_string_type(mrb, sub);
+    if (mrb_nil_p(tmp)) {
+      mrb_raisef(mrb, E_TYPE_ERROR, "type mismatch: %S given", sub);
+    }
+    subp = RSTRING_PTR(tmp);
+    sublen = RSTRING_LEN(tmp);
+  }
+
+  ix = utf8_index_get(mrb, str, &buf);
+  p = (const unsigned char*)RSTRING_PTR(str);
+  if (pos < 0) {
+    pos += ix->clen;
+    if (pos < 0) return mrb_nil_value();
+  }
+  if (pos > ix->clen) return mrb_nil_value();
+  b = utf8_offset(mrb, ix, p, pos);
+  found = mrb_memsearch(subp, sublen, (const char*)p + b, ix->len - b);
+  if (found < 0) return mrb_nil_value();
+  return mrb_fixnum_value(utf8_char_index(mrb, ix, p, b + found));
+}
+
 static mrb_value
 mrb_str_reverse_bang(mrb_state *mrb, mrb_value str)
 {
-  mrb_int utf8_len = mrb_utf8_strlen(str);
+  mrb_int utf8_len = mrb_utf8_strlen(mrb, str);
   if (utf8_len > 1) {
     mrb_int len = RSTRING_LEN(str);
     char *buf = (char *)mrb_malloc(mrb, (size_t)len);
@@ -262,7 +536,7 @@ mrb_str_reverse_bang(mrb_state *mrb, mrb_value str)
     mrb_str_modify(mrb, mrb_str_ptr(str));
     
     while (p<e) {
-      mrb_int clen = utf8len(p);
+      mrb_int clen = utf8len(p, e);
       r -= clen;
       memcpy(r, p, clen);
       p += clen;
@@ -323,6 +597,7 @@ mrb_mruby_string_utf8_gem_init(mrb_state* mrb)
   mrb_define_method(mrb, s, "length", mrb_str_size, MRB_ARGS_NONE());
   mrb_define_method(mrb, s, "[]", mrb_str_aref_m, MRB_ARGS_ANY());
   mrb_define_method(mrb, s, "slice", mrb_str_aref_m, MRB_ARGS_ANY());
+  mrb_define_method(mrb, s, "index", mrb_str_index_m, MRB_ARGS_ANY());
   mrb_define_method(mrb, s, "reverse",  mrb_str_reverse,      MRB_ARGS_NONE());
   mrb_define_method(mrb, s, "reverse!", mrb_str_reverse_bang, MRB_ARGS_NONE());
 
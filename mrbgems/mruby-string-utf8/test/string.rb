@@ -30,3 +30,59 @@ assert('Invalid sequence') do
   assert_equal 5, "\xF8\x88\x80\x80\x80".size
   assert_equal 6, "\xFC\x84\x80\x80\x80\x80".size
 end
+
+assert('String#index') do
+  assert_equal 5, "こんにちわ世界".index("世")
+  assert_equal 2, "こんにちわ世界".index("にち")
+  assert_equal 3, "こんにちわ世界ち".index("ち", 1)
+  assert_equal 7, "こんにちわ世界ち".index("ち", 4)
+  assert_equal 5, "こんにちわ世界".index("世", -3)
+  assert_equal nil, "こんにちわ世界".index("ち", 4)
+  assert_equal nil, "こんにちわ世界".index("ち", 8)
+  assert_equal 7, "こんにちわ世界".index("", 7)
+end
+
+assert('String#[] on long multibyte strings') do
+  s = "aあ" * 200 + "z"
+  assert_equal 401, s.size
+  assert_equal "a", s[0]
+  assert_equal "あ", s[1]
+  assert_equal "あ", s[199]
+  assert_equal "z", s[400]
+  assert_equal "z", s[-1]
+  assert_equal nil, s[401]
+  assert_equal "あaあ", s[299, 3]
+  assert_equal "あz", s[-2..-1]
+  assert_equal 400, s.index("z")
+  assert_equal 201, s.index("あ", 200)
+end
+
+assert('String#[] after modification') do
+  s = "いろはにほへと" * 20
+  assert_equal 140, s.size
+  assert_equal "と", s[139]
+  s[0] = "abc"
+  assert_equal 142, s.size
+  assert_equal "と", s[141]
+  s << "ちりぬるを"
+  assert_equal "を", s[-1]
+  assert_equal 147, s.size
+  s.replace("xyz" * 30)
+  assert_equal 90, s.size
+  assert_equal "z", s[89]
+end
+
+assert('String#size with invalid sequences') do
+  assert_equal 3, "\xE3\x81a".size
+  assert_equal 2, "a\x81".size
+  assert_equal 2, "\xE3\x81\x82\xE3".size
+  s = "\xE3\x81" * 40
+  assert_equal 80, s.size
+  assert_equal "\x81", s[79]
+end
+
+assert('String#each_line') do
+  lines = []
+  "いろは\nにほへと\nち".each_line { |l| lines << l }
+  assert_equal ["いろは\n", "にほへと\n", "ち"], lines
+end
@@ -1,14 +1,6 @@
 #include "mruby.h"
-#include "mruby/khash.h"
 #include "mruby/array.h"
 
-typedef struct symbol_name {
-  size_t len;
-  const char *name;
-} symbol_name;
-
-KHASH_DECLARE(n2s, symbol_name, mrb_sym, 1)
-
 /*
  *  call-seq:
  *     Symbol.all_symbols    => array
@@ -27,15 +19,12 @@ KHASH_DECLARE(n2s, symbol_name, mrb_sym, 1)
 static mrb_value
 mrb_sym_all_symbols(mrb_state *mrb, mrb_value self)
 {
-  khiter_t k;
-  mrb_sym sym;
-  khash_t(n2s) *h = mrb->name2sym;
-  mrb_value ary = mrb_ary_new_capa(mrb, kh_size(h));
+  mrb_int i;
+  mrb_value ary = mrb_ary_new_capa(mrb, mrb->symidx);
 
-  for (k = kh_begin(h); k != kh_end(h); k++) {
-    if (kh_exist(h, k)) {
-      sym = kh_value(h, k);
-      mrb_ary_push(mrb, ary, mrb_symbol_value(sym));
+  for (i = 1; i <= mrb->symidx; i++) {
+    if (mrb_sym2name_len(mrb, (mrb_sym)i, NULL)) {
+      mrb_ary_push(mrb, ary, mrb_symbol_value((mrb_sym)i));
     }
   }
 
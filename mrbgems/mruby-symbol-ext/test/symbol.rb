@@ -11,6 +11,16 @@ assert('Symbol.all_symbols') do
   assert_equal foo, symbols
 end
 
+assert('Symbol.all_symbols after GC.start') do
+  kept = "__symbol_gc_kept".to_sym
+  100.times { |i| "__symbol_gc_dropped_#{i}".to_sym }
+  GC.start
+  names = Symbol.all_symbols.map { |sym| sym.to_s }
+  assert_true names.include?("__symbol_gc_kept")
+  assert_false names.include?("__symbol_gc_dropped_1")
+  assert_equal kept, "__symbol_gc_kept".to_sym
+end
+
 assert("Symbol#length") do
   assert_equal 5, :hello.size
   assert_equal 5, :mruby.length
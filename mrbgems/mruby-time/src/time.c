@@ -159,7 +159,13 @@ struct mrb_time {
   struct tm           datetime;
 };
 
-static const struct mrb_data_type mrb_time_type = { "Time", mrb_free };
+static size_t
+mrb_time_size(mrb_state *mrb, const void *ptr)
+{
+  return sizeof(struct mrb_time);
+}
+
+static const struct mrb_data_type mrb_time_type = { "Time", mrb_free, mrb_time_size };
 
 /** Updates the datetime of a mrb_time based on it's timezone and
 seconds setting. Returns self on success, NULL of failure. */
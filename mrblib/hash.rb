@@ -45,7 +45,13 @@ class Hash
   def each(&block)
     return to_enum :each unless block_given?
 
-    self.keys.each { |k| block.call [k, self[k]] }
+    keys = self.keys
+    vals = self.values
+    i = 0
+    while i < keys.size
+      block.call [keys[i], vals[i]]
+      i += 1
+    end
     self
   end
 
@@ -97,7 +103,7 @@ class Hash
   def each_value(&block)
     return to_enum :each_value unless block_given?
 
-    self.keys.each{|k| block.call(self[k])}
+    self.values.each{|v| block.call(v)}
     self
   end
 
@@ -9,6 +9,7 @@
 #include "mruby/class.h"
 #include "mruby/string.h"
 #include "mruby/range.h"
+#include "mruby/presym.h"
 #include "value_array.h"
 
 #define ARY_DEFAULT_LEN   4
@@ -251,7 +252,7 @@ ary_concat(mrb_state *mrb, struct RArray *a, mrb_value *ptr, mrb_int blen)
   ary_modify(mrb, a);
   if (a->aux.capa < len) ary_expand_capa(mrb, a, len);
   array_copy(a->ptr+a->len, ptr, blen);
-  mrb_write_barrier(mrb, (struct RBasic*)a);
+  mrb_write_barrier_slots(mrb, (struct RBasic*)a, a->len, blen);
   a->len = len;
 }
 
@@ -347,7 +348,7 @@ ary_replace(mrb_state *mrb, struct RArray *a, mrb_value *argv, mrb_int len)
   if (a->aux.capa < len)
     ary_expand_capa(mrb, a, len);
   array_copy(a->ptr, argv, len);
-  mrb_write_barrier(mrb, (struct RBasic*)a);
+  mrb_write_barrier_slots(mrb, (struct RBasic*)a, 0, len);
   a->len = len;
 }
 
@@ -405,7 +406,7 @@ mrb_ary_reverse_bang(mrb_state *mrb, mrb_value self)
   if (a->len > 1) {
     mrb_value *p1, *p2;
 
-    ary_modify(mrb, a);
+    mrb_ary_modify(mrb, a);
     p1 = a->ptr;
     p2 = a->ptr + a->len - 1;
 
@@ -449,7 +450,7 @@ mrb_ary_push(mrb_state *mrb, mrb_value ary, mrb_value elem)
   if (a->len == a->aux.capa)
     ary_expand_capa(mrb, a, a->len + 1);
   a->ptr[a->len++] = elem;
-  mrb_write_barrier(mrb, (struct RBasic*)a);
+  mrb_write_barrier_slots(mrb, (struct RBasic*)a, a->len - 1, 1);
 }
 
 static mrb_value
@@ -489,6 +490,8 @@ mrb_ary_shift(mrb_state *mrb, mrb_value self)
     val = a->ptr[0];
     a->ptr++;
     a->len--;
+    /* every slot moved; dirty cards no longer cover them */
+    mrb_write_barrier(mrb, (struct RBasic*)a);
     return val;
   }
   if (a->len > ARY_SHIFT_SHARED_MIN) {
@@ -597,7 +600,7 @@ mrb_ary_set(mrb_state *mrb, mrb_value ary, mrb_int n, mrb_value val)
   }
 
   a->ptr[n] = val;
-  mrb_write_barrier(mrb, (struct RBasic*)a);
+  mrb_write_barrier_slots(mrb, (struct RBasic*)a, n, 1);
 }
 
 mrb_value
@@ -831,7 +834,7 @@ mrb_ary_delete_at(mrb_state *mrb, mrb_value self)
   if (index < 0) index += a->len;
   if (index < 0 || a->len <= index) return mrb_nil_value();
 
-  ary_modify(mrb, a);
+  mrb_ary_modify(mrb, a);
   val = a->ptr[index];
 
   ptr = a->ptr + index;
@@ -930,7 +933,7 @@ mrb_ary_splat(mrb_state *mrb, mrb_value v)
   if (mrb_array_p(v)) {
     return v;
   }
-  if (mrb_respond_to(mrb, v, mrb_intern_lit(mrb, "to_a"))) {
+  if (mrb_respond_to(mrb, v, MRB_SYM(to_a))) {
     return mrb_funcall(mrb, v, "to_a", 0);
   }
   else {
@@ -1149,7 +1152,7 @@ mrb_ary_equal(mrb_state *mrb, mrb_value ary1)
   if (mrb_obj_equal(mrb, ary1, ary2)) return mrb_true_value();
   if (mrb_special_const_p(ary2)) return mrb_false_value();
   if (!mrb_array_p(ary2)) {
-    if (!mrb_respond_to(mrb, ary2, mrb_intern_lit(mrb, "to_ary"))) {
+    if (!mrb_respond_to(mrb, ary2, MRB_SYM(to_ary))) {
       return mrb_false_value();
     }
     else {
@@ -1166,6 +1169,23 @@ mrb_ary_equal(mrb_state *mrb, mrb_value ary1)
 }
 
 /* 15.2.12.5.34 (x) */
+/* see hash.c */
+mrb_int mrb_hash_code(mrb_state *mrb, mrb_value obj);
+
+/*
+ *  call-seq:
+ *     ary.hash   -> fixnum
+ *
+ *  Compute a hash-code for this array. Two arrays with the same content
+ *  will have the same hash code (and will compare using <code>eql?</code>).
+ */
+
+mrb_value
+mrb_ary_hash(mrb_state *mrb, mrb_value ary)
+{
+  return mrb_fixnum_value(mrb_hash_code(mrb, ary));
+}
+
 /*
  *  call-seq:
  *     ary.eql?(other)  -> true or false
@@ -1174,7 +1194,7 @@ mrb_ary_equal(mrb_state *mrb, mrb_value ary1)
  *  or are both arrays with the same content.
  */
 
-static mrb_value
+mrb_value
 mrb_ary_eql(mrb_state *mrb, mrb_value ary1)
 {
   mrb_value ary2;
@@ -1232,5 +1252,6 @@ mrb_init_array(mrb_state *mrb)
   mrb_define_alias(mrb,  a, "to_s", "inspect");                                        /* 15.2.12.5.32 (x) */
   mrb_define_method(mrb, a, "==",              mrb_ary_equal,        MRB_ARGS_REQ(1)); /* 15.2.12.5.33 (x) */
   mrb_define_method(mrb, a, "eql?",            mrb_ary_eql,          MRB_ARGS_REQ(1)); /* 15.2.12.5.34 (x) */
+  mrb_define_method(mrb, a, "hash",            mrb_ary_hash,         MRB_ARGS_NONE()); /* 15.2.12.5.35 (x) */
   mrb_define_method(mrb, a, "<=>",             mrb_ary_cmp,          MRB_ARGS_REQ(1)); /* 15.2.12.5.36 (x) */
 }
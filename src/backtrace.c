@@ -13,6 +13,7 @@
 #include "mruby/class.h"
 #include "mruby/debug.h"
 #include "mruby/error.h"
+#include "mruby/presym.h"
 
 typedef void (*output_stream_func)(mrb_state*, void*, int, const char*, ...);
 
@@ -132,8 +133,8 @@ output_backtrace(mrb_state *mrb, mrb_int ciidx, mrb_code *pc0, output_stream_fun
 static void
 exc_output_backtrace(mrb_state *mrb, struct RObject *exc, output_stream_func func, void *stream)
 {
-  output_backtrace(mrb, mrb_fixnum(mrb_obj_iv_get(mrb, exc, mrb_intern_lit(mrb, "ciidx"))),
-                   (mrb_code*)mrb_cptr(mrb_obj_iv_get(mrb, exc, mrb_intern_lit(mrb, "lastpc"))),
+  output_backtrace(mrb, mrb_fixnum(mrb_obj_iv_get(mrb, exc, MRB_SYM(ciidx))),
+                   (mrb_code*)mrb_cptr(mrb_obj_iv_get(mrb, exc, MRB_SYM(lastpc))),
                    func, stream);
 }
 
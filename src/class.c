@@ -15,6 +15,7 @@
 #include "mruby/variable.h"
 #include "mruby/error.h"
 #include "mruby/data.h"
+#include "mruby/presym.h"
 
 KHASH_DEFINE(mt, mrb_sym, struct RProc*, 1, kh_int_hash_func, kh_int_hash_equal)
 
@@ -28,6 +29,8 @@ mrb_gc_mark_mt(mrb_state *mrb, struct RClass *c)
   for (k = kh_begin(h); k != kh_end(h); k++) {
     if (kh_exist(h, k)){
       struct RProc *m = kh_value(h, k);
+
+      if (mrb->gc_mark_syms) mrb_gc_mark_sym(mrb, kh_key(h, k));
       if (m) {
         mrb_gc_mark(mrb, (struct RBasic*)m);
       }
@@ -44,6 +47,17 @@ mrb_gc_mark_mt_size(mrb_state *mrb, struct RClass *c)
   return kh_size(h);
 }
 
+size_t
+mrb_gc_mt_bytes(mrb_state *mrb, struct RClass *c)
+{
+  khash_t(mt) *h = c->mt;
+  khint_t n;
+
+  if (!h) return 0;
+  n = kh_n_buckets(h);
+  return sizeof(khash_t(mt)) + kh_flags_bytes(h) + n*(sizeof(mrb_sym)+sizeof(struct RProc*));
+}
+
 void
 mrb_gc_free_mt(mrb_state *mrb, struct RClass *c)
 {
@@ -54,7 +68,7 @@ static void
 name_class(mrb_state *mrb, struct RClass *c, mrb_sym name)
 {
   mrb_obj_iv_set(mrb, (struct RObject*)c,
-                 mrb_intern_lit(mrb, "__classid__"), mrb_symbol_value(name));
+                 MRB_SYM(__classid__), mrb_symbol_value(name));
 }
 
 static void
@@ -63,7 +77,7 @@ setup_class(mrb_state *mrb, struct RClass *outer, struct RClass *c, mrb_sym id)
   name_class(mrb, c, id);
   mrb_obj_iv_set(mrb, (struct RObject*)outer, id, mrb_obj_value(c));
   if (outer != mrb->object_class) {
-    mrb_obj_iv_set(mrb, (struct RObject*)c, mrb_intern_lit(mrb, "__outer__"),
+    mrb_obj_iv_set(mrb, (struct RObject*)c, MRB_SYM(__outer__),
                    mrb_obj_value(outer));
   }
 }
@@ -101,7 +115,7 @@ prepare_singleton_class(mrb_state *mrb, struct RBasic *o)
   o->c = sc;
   mrb_field_write_barrier(mrb, (struct RBasic*)o, (struct RBasic*)sc);
   mrb_field_write_barrier(mrb, (struct RBasic*)sc, (struct RBasic*)o);
-  mrb_obj_iv_set(mrb, (struct RObject*)sc, mrb_intern_lit(mrb, "__attached__"), mrb_obj_value(o));
+  mrb_obj_iv_set(mrb, (struct RObject*)sc, MRB_SYM(__attached__), mrb_obj_value(o));
 }
 
 static struct RClass *
@@ -127,7 +141,7 @@ mrb_class_outer_module(mrb_state *mrb, struct RClass *c)
 {
   mrb_value outer;
 
-  outer = mrb_obj_iv_get(mrb, (struct RObject*)c, mrb_intern_lit(mrb, "__outer__"));
+  outer = mrb_obj_iv_get(mrb, (struct RObject*)c, MRB_SYM(__outer__));
   if (mrb_nil_p(outer)) return 0;
   return mrb_class_ptr(outer);
 }
@@ -315,6 +329,7 @@ mrb_define_method_raw(mrb_state *mrb, struct RClass *c, mrb_sym mid, struct RPro
   if (!h) h = c->mt = kh_init(mt, mrb);
   k = kh_put(mt, mrb, h, mid);
   kh_value(h, k) = p;
+  mrb->method_serial++;
   if (p) {
     mrb_field_write_barrier(mrb, (struct RBasic *)c, (struct RBasic *)p);
   }
@@ -349,6 +364,7 @@ mrb_define_method_vm(mrb_state *mrb, struct RClass *c, mrb_sym name, mrb_value b
   k = kh_put(mt, mrb, h, name);
   p = mrb_proc_ptr(body);
   kh_value(h, k) = p;
+  mrb->method_serial++;
   if (p) {
     mrb_field_write_barrier(mrb, (struct RBasic *)c, (struct RBasic *)p);
   }
@@ -785,6 +801,7 @@ mrb_include_module(mrb_state *mrb, struct RClass *c, struct RClass *m)
     ic->super = ins_pos->super;
     ins_pos->super = ic;
     mrb_field_write_barrier(mrb, (struct RBasic*)ins_pos, (struct RBasic*)ic);
+    mrb->method_serial++;
     ins_pos = ic;
   skip:
     m = m->super;
@@ -1100,7 +1117,7 @@ mrb_instance_new(mrb_state *mrb, mrb_value cv)
 
   obj = mrb_instance_alloc(mrb, cv);
   mrb_get_args(mrb, "*&", &argv, &argc, &blk);
-  mrb_funcall_with_block(mrb, obj, mrb_intern_lit(mrb, "initialize"), argc, argv, blk);
+  mrb_funcall_with_block(mrb, obj, MRB_SYM(initialize), argc, argv, blk);
 
   return obj;
 }
@@ -1111,7 +1128,7 @@ mrb_obj_new(mrb_state *mrb, struct RClass *c, int argc, mrb_value *argv)
   mrb_value obj;
 
   obj = mrb_instance_alloc(mrb, mrb_obj_value(c));
-  mrb_funcall_argv(mrb, obj, mrb_intern_lit(mrb, "initialize"), argc, argv);
+  mrb_funcall_argv(mrb, obj, MRB_SYM(initialize), argc, argv);
 
   return obj;
 }
@@ -1127,7 +1144,7 @@ mrb_class_new_class(mrb_state *mrb, mrb_value cv)
   }
   new_class = mrb_obj_value(mrb_class_new(mrb, mrb_class_ptr(super)));
   if (!mrb_nil_p(blk)) {
-    mrb_funcall_with_block(mrb, new_class, mrb_intern_lit(mrb, "class_eval"), 0, NULL, blk);
+    mrb_funcall_with_block(mrb, new_class, MRB_SYM(class_eval), 0, NULL, blk);
   }
   mrb_funcall(mrb, super, "inherited", 1, new_class);
   return new_class;
@@ -1203,7 +1220,7 @@ mrb_bob_missing(mrb_state *mrb, mrb_value mod)
 
   mrb_get_args(mrb, "n*", &name, &a, &alen);
 
-  inspect = mrb_intern_lit(mrb, "inspect");
+  inspect = MRB_SYM(inspect);
   if (mrb->c->ci > mrb->c->cibase && mrb->c->ci[-1].mid == inspect) {
     /* method missing in inspect; avoid recursion */
     repr = mrb_any_to_s(mrb, mod);
@@ -1260,7 +1277,7 @@ mrb_class_path(mrb_state *mrb, struct RClass *c)
   mrb_value path;
   const char *name;
   mrb_int len;
-  mrb_sym classpath = mrb_intern_lit(mrb, "__classpath__");
+  mrb_sym classpath = MRB_SYM(__classpath__);
 
   path = mrb_obj_iv_get(mrb, (struct RObject*)c, classpath);
   if (mrb_nil_p(path)) {
@@ -1421,7 +1438,7 @@ mrb_mod_to_s(mrb_state *mrb, mrb_value klass)
   mrb_value str;
 
   if (mrb_type(klass) == MRB_TT_SCLASS) {
-    mrb_value v = mrb_iv_get(mrb, klass, mrb_intern_lit(mrb, "__attached__"));
+    mrb_value v = mrb_iv_get(mrb, klass, MRB_SYM(__attached__));
 
     str = mrb_str_new_lit(mrb, "#<Class:");
 
@@ -1784,6 +1801,7 @@ remove_method(mrb_state *mrb, mrb_value mod, mrb_sym mid)
     k = kh_get(mt, mrb, h, mid);
     if (k != kh_end(h)) {
       kh_del(mt, mrb, h, k);
+      mrb->method_serial++;
       return;
     }
   }
@@ -1957,10 +1975,10 @@ mrb_init_class(mrb_state *mrb)
   mrb_define_const(mrb, obj, "Class",       mrb_obj_value(cls));
 
   /* name each classes */
-  name_class(mrb, bob, mrb_intern_lit(mrb, "BasicObject"));
-  name_class(mrb, obj, mrb_intern_lit(mrb, "Object"));
-  name_class(mrb, mod, mrb_intern_lit(mrb, "Module"));
-  name_class(mrb, cls, mrb_intern_lit(mrb, "Class"));
+  name_class(mrb, bob, MRB_SYM(BasicObject));
+  name_class(mrb, obj, MRB_SYM(Object));
+  name_class(mrb, mod, MRB_SYM(Module));
+  name_class(mrb, cls, MRB_SYM(Class));
 
   MRB_SET_INSTANCE_TT(cls, MRB_TT_CLASS);
   mrb_define_method(mrb, bob, "initialize",              mrb_bob_init,             MRB_ARGS_NONE());
@@ -6,6 +6,7 @@
 
 #include <ctype.h>
 #include <limits.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include "mruby.h"
@@ -14,6 +15,7 @@
 #include "mruby/numeric.h"
 #include "mruby/string.h"
 #include "mruby/debug.h"
+#include "mruby/presym.h"
 #include "node.h"
 #include "opcode.h"
 #include "re.h"
@@ -414,6 +416,7 @@ new_lit(codegen_scope *s, mrb_value val)
       pv = &s->irep->pool[i];
 
       if (mrb_type(*pv) != MRB_TT_STRING) continue;
+      if ((RSTRING(*pv)->flags ^ RSTRING(val)->flags) & MRB_STR_FROZEN) continue;
       if ((len = RSTRING_LEN(*pv)) != RSTRING_LEN(val)) continue;
       if (memcmp(RSTRING_PTR(*pv), RSTRING_PTR(val), len) == 0)
         return i;
@@ -423,7 +426,9 @@ new_lit(codegen_scope *s, mrb_value val)
     for (i=0; i<s->irep->plen; i++) {
       pv = &s->irep->pool[i];
       if (mrb_type(*pv) != MRB_TT_FLOAT) continue;
-      if (mrb_float(*pv) == mrb_float(val)) return i;
+      /* 0.0 and -0.0 compare equal but are different literals */
+      if (mrb_float(*pv) == mrb_float(val) &&
+          !signbit(mrb_float(*pv)) == !signbit(mrb_float(val))) return i;
     }
     break;
   case MRB_TT_FIXNUM:
@@ -573,7 +578,7 @@ for_body(codegen_scope *s, node *tree)
   s = prev;
   genop(s, MKOP_Abc(OP_LAMBDA, cursp(), s->irep->rlen-1, OP_L_BLOCK));
   pop();
-  idx = new_msym(s, mrb_intern_lit(s->mrb, "each"));
+  idx = new_msym(s, MRB_SYM(each));
   genop(s, MKOP_ABC(OP_SENDB, cursp(), idx, 0));
 }
 
@@ -989,9 +994,39 @@ static void
 gen_send_intern(codegen_scope *s)
 {
   pop();
-  genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "intern")), 0));
+  genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, MRB_SYM(intern)), 0));
   push();
 }
+/* pushes the string literal tree, which OP_STRING copies unless frozen */
+static void
+gen_str(codegen_scope *s, node *tree, mrb_bool frozen)
+{
+  char *p = (char*)tree->car;
+  size_t len = (intptr_t)tree->cdr;
+  int ai = mrb_gc_arena_save(s->mrb);
+  mrb_value str = mrb_str_new(s->mrb, p, len);
+  int off;
+
+  if (frozen) mrb_str_freeze(s->mrb, str);
+  off = new_lit(s, str);
+  mrb_gc_arena_restore(s->mrb, ai);
+  genop(s, MKOP_ABx(OP_STRING, cursp(), off));
+  push();
+}
+
+/* pushes the first piece of an interpolated string, the target of the
+   OP_STRCATs that follow */
+static void
+gen_str_head(codegen_scope *s, node *tree)
+{
+  if ((intptr_t)tree->car == NODE_STR) {
+    gen_str(s, tree->cdr, FALSE);
+  }
+  else {
+    codegen(s, tree, VAL);
+  }
+}
+
 static void
 gen_literal_array(codegen_scope *s, node *tree, mrb_bool sym, int val)
 {
@@ -1003,7 +1038,13 @@ gen_literal_array(codegen_scope *s, node *tree, mrb_bool sym, int val)
       case NODE_STR:
         if ((tree->cdr == NULL) && ((intptr_t)tree->car->cdr->cdr == 0))
           break;
-        /* fall through */
+        /* a word in one piece may be frozen; the first piece of a
+           longer one is the target of OP_STRCAT */
+        gen_str(s, tree->car->cdr, !sym && j == 0 && s->parser->frozen_string_literal &&
+                (tree->cdr == NULL || (intptr_t)tree->cdr->car->car == NODE_LITERAL_DELIM));
+        ++j;
+        break;
+
       case NODE_BEGIN:
         codegen(s, tree->car, VAL);
         ++j;
@@ -1187,13 +1228,13 @@ codegen(codegen_scope *s, node *tree, int val)
               codegen(s, n4->car, VAL);
             }
             else {
-              genop(s, MKOP_ABx(OP_GETCONST, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "StandardError"))));
+              genop(s, MKOP_ABx(OP_GETCONST, cursp(), new_msym(s, MRB_SYM(StandardError))));
               push();
             }
             genop(s, MKOP_AB(OP_MOVE, cursp(), exc));
             pop();
             if (n4 && n4->car && (intptr_t)n4->car->car == NODE_SPLAT) {
-              genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "__case_eqq")), 1));
+              genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, MRB_SYM(__case_eqq)), 1));
             }
             else {
               genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "===")), 1));
@@ -1392,7 +1433,7 @@ codegen(codegen_scope *s, node *tree, int val)
             genop(s, MKOP_AB(OP_MOVE, cursp(), head));
             pop();
             if ((intptr_t)n->car->car == NODE_SPLAT) {
-              genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "__case_eqq")), 1));
+              genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, MRB_SYM(__case_eqq)), 1));
             }
             else {
               genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "===")), 1));
@@ -1513,7 +1554,7 @@ codegen(codegen_scope *s, node *tree, int val)
           genop(s, MKOP_ABC(OP_HASH, cursp(), cursp(), len));
           if (update) {
             pop();
-            genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "__update")), 1));
+            genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, MRB_SYM(__update)), 1));
           }
           push();
           update = TRUE;
@@ -1525,7 +1566,7 @@ codegen(codegen_scope *s, node *tree, int val)
         genop(s, MKOP_ABC(OP_HASH, cursp(), cursp(), len));
         if (update) {
           pop();
-          genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "__update")), 1));
+          genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, MRB_SYM(__update)), 1));
         }
         push();
       }
@@ -1754,7 +1795,7 @@ codegen(codegen_scope *s, node *tree, int val)
       }
       pop_n(n+1);
       if (sendv) n = CALL_MAXARGS;
-      genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "call")), n));
+      genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, MRB_SYM(call)), n));
       if (val) push();
     }
     break;
@@ -2039,14 +2080,7 @@ codegen(codegen_scope *s, node *tree, int val)
 
   case NODE_STR:
     if (val) {
-      char *p = (char*)tree->car;
-      size_t len = (intptr_t)tree->cdr;
-      int ai = mrb_gc_arena_save(s->mrb);
-      int off = new_lit(s, mrb_str_new(s->mrb, p, len));
-
-      mrb_gc_arena_restore(s->mrb, ai);
-      genop(s, MKOP_ABx(OP_STRING, cursp(), off));
-      push();
+      gen_str(s, tree, s->parser->frozen_string_literal);
     }
     break;
 
@@ -2057,7 +2091,7 @@ codegen(codegen_scope *s, node *tree, int val)
     if (val) {
       node *n = tree;
 
-      codegen(s, n->car, VAL);
+      gen_str_head(s, n->car);
       n = n->cdr;
       while (n) {
         codegen(s, n->car, VAL);
@@ -2092,7 +2126,7 @@ codegen(codegen_scope *s, node *tree, int val)
       char *p = (char*)tree->car;
       size_t len = (intptr_t)tree->cdr;
       int ai = mrb_gc_arena_save(s->mrb);
-      int sym = new_sym(s, mrb_intern_lit(s->mrb, "Kernel"));
+      int sym = new_sym(s, MRB_SYM(Kernel));
       int off = new_lit(s, mrb_str_new(s->mrb, p, len));
 
       genop(s, MKOP_A(OP_OCLASS, cursp()));
@@ -2128,7 +2162,7 @@ codegen(codegen_scope *s, node *tree, int val)
         pop();
       }
       pop();
-      sym = new_sym(s, mrb_intern_lit(s->mrb, "compile"));
+      sym = new_sym(s, MRB_SYM(compile));
       genop(s, MKOP_ABC(OP_SEND, cursp(), sym, argc));
       mrb_gc_arena_restore(s->mrb, ai);
       push();
@@ -2147,7 +2181,7 @@ codegen(codegen_scope *s, node *tree, int val)
       genop(s, MKOP_A(OP_OCLASS, cursp()));
       genop(s, MKOP_ABx(OP_GETMCNST, cursp(), sym));
       push();
-      codegen(s, n->car, VAL);
+      gen_str_head(s, n->car);
       n = n->cdr;
       while (n) {
         codegen(s, n->car, VAL);
@@ -2176,7 +2210,7 @@ codegen(codegen_scope *s, node *tree, int val)
         pop();
       }
       pop();
-      sym = new_sym(s, mrb_intern_lit(s->mrb, "compile"));
+      sym = new_sym(s, MRB_SYM(compile));
       genop(s, MKOP_ABC(OP_SEND, cursp(), sym, argc));
       mrb_gc_arena_restore(s->mrb, ai);
       push();
@@ -2241,7 +2275,7 @@ codegen(codegen_scope *s, node *tree, int val)
     {
       int a = new_msym(s, sym(tree->car));
       int b = new_msym(s, sym(tree->cdr));
-      int c = new_msym(s, mrb_intern_lit(s->mrb,"alias_method"));
+      int c = new_msym(s, MRB_SYM(alias_method));
 
       genop(s, MKOP_A(OP_TCLASS, cursp()));
       push();
@@ -2260,7 +2294,7 @@ codegen(codegen_scope *s, node *tree, int val)
 
   case NODE_UNDEF:
     {
-      int undef = new_msym(s, mrb_intern_lit(s->mrb, "undef_method"));
+      int undef = new_msym(s, MRB_SYM(undef_method));
       int num = 0;
       node *t = tree;
 
@@ -15,6 +15,7 @@
 #include "mruby/variable.h"
 #include "mruby/debug.h"
 #include "mruby/error.h"
+#include "mruby/presym.h"
 #include "mrb_throw.h"
 
 mrb_value
@@ -44,7 +45,7 @@ exc_initialize(mrb_state *mrb, mrb_value exc)
   mrb_value mesg;
 
   if (mrb_get_args(mrb, "|o", &mesg) == 1) {
-    mrb_iv_set(mrb, exc, mrb_intern_lit(mrb, "mesg"), mesg);
+    mrb_iv_set(mrb, exc, MRB_SYM(mesg), mesg);
   }
   return exc;
 }
@@ -73,7 +74,7 @@ exc_exception(mrb_state *mrb, mrb_value self)
   if (argc == 0) return self;
   if (mrb_obj_equal(mrb, self, a)) return self;
   exc = mrb_obj_clone(mrb, self);
-  mrb_iv_set(mrb, exc, mrb_intern_lit(mrb, "mesg"), a);
+  mrb_iv_set(mrb, exc, MRB_SYM(mesg), a);
 
   return exc;
 }
@@ -89,7 +90,7 @@ exc_exception(mrb_state *mrb, mrb_value self)
 static mrb_value
 exc_to_s(mrb_state *mrb, mrb_value exc)
 {
-  mrb_value mesg = mrb_attr_get(mrb, exc, mrb_intern_lit(mrb, "mesg"));
+  mrb_value mesg = mrb_attr_get(mrb, exc, MRB_SYM(mesg));
 
   if (mrb_nil_p(mesg)) return mrb_str_new_cstr(mrb, mrb_obj_classname(mrb, exc));
   return mesg;
@@ -123,9 +124,9 @@ exc_inspect(mrb_state *mrb, mrb_value exc)
 {
   mrb_value str, mesg, file, line;
 
-  mesg = mrb_attr_get(mrb, exc, mrb_intern_lit(mrb, "mesg"));
-  file = mrb_attr_get(mrb, exc, mrb_intern_lit(mrb, "file"));
-  line = mrb_attr_get(mrb, exc, mrb_intern_lit(mrb, "line"));
+  mesg = mrb_attr_get(mrb, exc, MRB_SYM(mesg));
+  file = mrb_attr_get(mrb, exc, MRB_SYM(file));
+  line = mrb_attr_get(mrb, exc, MRB_SYM(line));
 
   if (!mrb_nil_p(file) && !mrb_nil_p(line)) {
     str = file;
@@ -162,7 +163,7 @@ exc_equal(mrb_state *mrb, mrb_value exc)
   mrb_value obj;
   mrb_value mesg;
   mrb_bool equal_p;
-  mrb_sym id_mesg = mrb_intern_lit(mrb, "mesg");
+  mrb_sym id_mesg = MRB_SYM(mesg);
 
   mrb_get_args(mrb, "o", &obj);
   if (mrb_obj_equal(mrb, exc, obj)) {
@@ -170,7 +171,7 @@ exc_equal(mrb_state *mrb, mrb_value exc)
   }
   else {
     if (mrb_obj_class(mrb, exc) != mrb_obj_class(mrb, obj)) {
-      if (mrb_respond_to(mrb, obj, mrb_intern_lit(mrb, "message"))) {
+      if (mrb_respond_to(mrb, obj, MRB_SYM(message))) {
         mesg = mrb_funcall(mrb, obj, "message", 0);
       }
       else
@@ -192,7 +193,7 @@ exc_debug_info(mrb_state *mrb, struct RObject *exc)
   mrb_callinfo *ci = mrb->c->ci;
   mrb_code *pc = ci->pc;
 
-  mrb_obj_iv_set(mrb, exc, mrb_intern_lit(mrb, "ciidx"), mrb_fixnum_value(ci - mrb->c->cibase));
+  mrb_obj_iv_set(mrb, exc, MRB_SYM(ciidx), mrb_fixnum_value(ci - mrb->c->cibase));
   while (ci >= mrb->c->cibase) {
     mrb_code *err = ci->err;
 
@@ -203,8 +204,8 @@ exc_debug_info(mrb_state *mrb, struct RObject *exc)
       int32_t const line = mrb_debug_get_line(irep, err - irep->iseq);
       char const* file = mrb_debug_get_filename(irep, err - irep->iseq);
       if (line != -1 && file) {
-        mrb_obj_iv_set(mrb, exc, mrb_intern_lit(mrb, "file"), mrb_str_new_cstr(mrb, file));
-        mrb_obj_iv_set(mrb, exc, mrb_intern_lit(mrb, "line"), mrb_fixnum_value(line));
+        mrb_obj_iv_set(mrb, exc, MRB_SYM(file), mrb_str_new_cstr(mrb, file));
+        mrb_obj_iv_set(mrb, exc, MRB_SYM(line), mrb_fixnum_value(line));
         return;
       }
     }
@@ -380,7 +381,7 @@ make_exception(mrb_state *mrb, int argc, mrb_value *argv, mrb_bool isstr)
       n = 1;
 exception_call:
       {
-        mrb_sym exc = mrb_intern_lit(mrb, "exception");
+        mrb_sym exc = MRB_SYM(exception);
         if (mrb_respond_to(mrb, argv[0], exc)) {
           mesg = mrb_funcall_argv(mrb, argv[0], exc, n, argv+1);
         }
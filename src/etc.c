@@ -78,8 +78,9 @@ mrb_obj_to_sym(mrb_state *mrb, mrb_value name)
       name = tmp;
       /* fall through */
     case MRB_TT_STRING:
-      name = mrb_str_intern(mrb, name);
-      /* fall through */
+      /* the caller keeps the bare id, so it must not be collectable */
+      id = mrb_intern_str(mrb, name);
+      break;
     case MRB_TT_SYMBOL:
       id = mrb_symbol(name);
   }
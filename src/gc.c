@@ -6,6 +6,10 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#ifdef _WIN32
+# include <windows.h>
+#endif
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
@@ -16,6 +20,8 @@
 #include "mruby/string.h"
 #include "mruby/variable.h"
 #include "mruby/gc.h"
+#include "mruby/khash.h"
+#include "mrb_throw.h"
 
 /*
   = Tri-color Incremental Garbage Collection
@@ -60,6 +66,36 @@
 
   For details, see the comments for each function.
 
+  == Pacing Mode
+
+  Instead of fixed ratios, a target pause (GC.pause_target) can be given.
+  The collector then measures each step and adapts the step size to the
+  speed it observes, so that a step is expected to stay under the target.
+  The interval ratio is recomputed at the end of each cycle so that the
+  heap does not grow beyond the growth budget (GC.growth_budget) while a
+  cycle is in progress. In generational mode a minor GC cannot be split;
+  its interval is shrunk instead until the minor GC pause fits the target.
+  Root scan and final marking are atomic, so their cost is a lower bound
+  of the achievable pause.
+
+  == Idle Time Collection
+
+  An embedder that knows when it is idle can run GC steps there with
+  mrb_gc_step_for() (GC.step), which steps until the time budget is spent
+  or the cycle completes. In idle mode (GC.idle_mode) allocation does not
+  trigger GC steps, unless the live objects exceed twice the threshold,
+  so that GC work moves out of the request path entirely.
+
+  == Malloc Limit
+
+  Objects such as large strings hold much more memory than their slot in
+  the heap. All bytes requested through mrb_malloc()/mrb_realloc() are
+  counted, and once they exceed the malloc limit, allocating an object
+  triggers a GC step even if the live object count is below the
+  threshold. The marking phase sums the buffers held by live Strings,
+  Arrays and Hashes; the next limit is that sum times the malloc ratio
+  (GC.malloc_ratio), but at least MRB_GC_MALLOC_LIMIT_MIN bytes.
+
   == Write Barrier
 
   mruby implementer and C extension library writer must write a write
@@ -69,6 +105,19 @@
     * mrb_field_write_barrier
     * mrb_write_barrier
 
+  == Card Marking
+
+  Writing into a large Array or Hash that is already black would have the
+  whole object rescanned atomically by mrb_write_barrier(). Instead,
+  mrb_write_barrier_slots() divides such objects into cards of
+  MRB_GC_CARD_SIZE slots and records which cards were written to. The
+  object is still put on the atomic gray list, but the final marking
+  phase only scans its dirty cards. Any unmodified slot of a black object
+  refers to an object that is already marked (or old, in generational
+  mode), so skipping it is safe. Operations that move many slots use
+  mrb_write_barrier(), which turns a card marked object back into one that
+  is scanned in full.
+
   == Generational Mode
 
   mruby's GC offers an Generational Mode while re-using the tri-color GC
@@ -85,6 +134,13 @@
   The difference to a "traditional" generational GC is, that the major GC
   in mruby is triggered incrementally in a tri-color manner.
 
+  == Statistics
+
+  Each GC phase (root scan, incremental mark, final mark and sweep) records
+  how often it ran, how many objects it processed and how long it took.
+  Every call to mrb_incremental_gc() is a step from the mutator's point of
+  view; its pause is added to a histogram of power-of-two microsecond
+  buckets. See mrb_gc_get_stat() and GC.stat.
 
   For details, see the comments for each function.
 
@@ -161,6 +217,84 @@ gettimeofday_time(void)
 
 #define GC_STEP_SIZE 1024
 
+#ifndef MRB_GC_CARD_SIZE
+#define MRB_GC_CARD_SIZE 128        /* slots per card */
+#endif
+#ifndef MRB_GC_CARD_THRESHOLD
+#define MRB_GC_CARD_THRESHOLD 1024  /* minimum slots for card marking */
+#endif
+#define MRB_GC_CARD_MARKED (1 << 20)
+
+#define gc_carded_p(o) (((o)->tt == MRB_TT_ARRAY || (o)->tt == MRB_TT_HASH) && ((o)->flags & MRB_GC_CARD_MARKED))
+
+struct gc_card_table {
+  size_t ncards;
+  uint8_t *dirty;
+};
+
+#define gc_card_hash(mrb,k) kh_int64_hash_func(mrb,(uint64_t)((uintptr_t)(k)>>3))
+
+KHASH_DECLARE(gc_cards, struct RBasic*, struct gc_card_table*, 1)
+KHASH_DEFINE(gc_cards, struct RBasic*, struct gc_card_table*, 1, gc_card_hash, kh_int_hash_equal)
+
+struct gc_class_memsize {
+  size_t bytes;                         /* counted in the current major cycle */
+  size_t last_bytes;                    /* counted in the last complete one */
+};
+
+KHASH_DECLARE(gc_class_memsize, struct RClass*, struct gc_class_memsize, 1)
+KHASH_DEFINE(gc_class_memsize, struct RClass*, struct gc_class_memsize, 1, gc_card_hash, kh_int_hash_equal)
+
+/* monotonic clock in nanoseconds used for GC statistics */
+static uint64_t
+gc_clock(void)
+{
+#if defined(_WIN32)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER count;
+
+  if (freq.QuadPart == 0) {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&count);
+  return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000 +
+    (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+static void
+gc_stat_phase(struct mrb_gc_phase_stat *phase, uint64_t start, size_t objects)
+{
+  phase->count++;
+  phase->objects += objects;
+  phase->time += gc_clock() - start;
+}
+
+static void
+gc_stat_step(mrb_state *mrb, uint64_t t)
+{
+  uint64_t usec = t / 1000;
+  int i = 0;
+
+  while (usec > 0 && i < MRB_GC_STEP_HISTOGRAM_SIZE - 1) {
+    usec >>= 1;
+    i++;
+  }
+  mrb->gc_stat.step_histogram[i]++;
+  mrb->gc_stat.step_count++;
+  mrb->gc_stat.step_time += t;
+  if (t > mrb->gc_stat.max_step_time) {
+    mrb->gc_stat.max_step_time = t;
+  }
+}
+
 
 void*
 mrb_realloc_simple(mrb_state *mrb, void *p,  size_t len)
@@ -172,6 +306,9 @@ mrb_realloc_simple(mrb_state *mrb, void *p,  size_t len)
     mrb_full_gc(mrb);
     p2 = (mrb->allocf)(mrb, p, len, mrb->ud);
   }
+  if (p2) {
+    mrb->gc_malloc_increase += len;
+  }
 
   return p2;
 }
@@ -319,6 +456,14 @@ add_heap(mrb_state *mrb)
 #define DEFAULT_GC_INTERVAL_RATIO 200
 #define DEFAULT_GC_STEP_RATIO 200
 #define DEFAULT_MAJOR_GC_INC_RATIO 200
+#define DEFAULT_GC_GROWTH_BUDGET 100
+#define MIN_GC_STEP_LIMIT (GC_STEP_SIZE/16)
+#define MIN_GC_PACED_INTERVAL_RATIO 110
+#define MAX_GC_GROWTH_BUDGET 10000
+#define DEFAULT_GC_MALLOC_RATIO 100
+#ifndef MRB_GC_MALLOC_LIMIT_MIN
+#define MRB_GC_MALLOC_LIMIT_MIN (8*1024*1024)
+#endif
 #define is_generational(mrb) ((mrb)->is_generational_gc_mode)
 #define is_major_gc(mrb) (is_generational(mrb) && (mrb)->gc_full)
 #define is_minor_gc(mrb) (is_generational(mrb) && !(mrb)->gc_full)
@@ -331,6 +476,10 @@ mrb_init_heap(mrb_state *mrb)
   add_heap(mrb);
   mrb->gc_interval_ratio = DEFAULT_GC_INTERVAL_RATIO;
   mrb->gc_step_ratio = DEFAULT_GC_STEP_RATIO;
+  mrb->gc_growth_budget = DEFAULT_GC_GROWTH_BUDGET;
+  mrb->gc_step_limit = (GC_STEP_SIZE/100) * DEFAULT_GC_STEP_RATIO;
+  mrb->gc_malloc_ratio = DEFAULT_GC_MALLOC_RATIO;
+  mrb->gc_malloc_limit = MRB_GC_MALLOC_LIMIT_MIN;
 #ifndef MRB_GC_TURN_OFF_GENERATIONAL
   mrb->is_generational_gc_mode = TRUE;
   mrb->gc_full = TRUE;
@@ -342,6 +491,7 @@ mrb_init_heap(mrb_state *mrb)
 }
 
 static void obj_free(mrb_state *mrb, struct RBasic *obj);
+static void gc_cards_clear(mrb_state *mrb);
 
 void
 mrb_free_heap(mrb_state *mrb)
@@ -359,6 +509,14 @@ mrb_free_heap(mrb_state *mrb)
     }
     mrb_free(mrb, tmp);
   }
+  if (mrb->gc_cards) {
+    kh_destroy(gc_cards, mrb, mrb->gc_cards);
+    mrb->gc_cards = NULL;
+  }
+  if (mrb->gc_class_memsize) {
+    kh_destroy(gc_class_memsize, mrb, mrb->gc_class_memsize);
+    mrb->gc_class_memsize = NULL;
+  }
 }
 
 static void
@@ -387,6 +545,32 @@ mrb_gc_protect(mrb_state *mrb, mrb_value obj)
   gc_protect(mrb, mrb_basic_ptr(obj));
 }
 
+static mrb_bool
+gc_malloc_exceeded_p(mrb_state *mrb)
+{
+  size_t limit = mrb->gc_malloc_limit;
+
+  if (mrb->gc_malloc_ratio <= 0) return FALSE;
+  if (mrb->gc_idle_mode) limit *= 2;
+  return mrb->gc_malloc_increase > limit;
+}
+
+static void
+gc_malloc_reset_limit(mrb_state *mrb)
+{
+  size_t limit = mrb->gc_malloc_live / 100 * mrb->gc_malloc_ratio;
+
+  if (limit < MRB_GC_MALLOC_LIMIT_MIN) limit = MRB_GC_MALLOC_LIMIT_MIN;
+  mrb->gc_malloc_limit = limit;
+}
+
+static void
+gc_malloc_reset(mrb_state *mrb)
+{
+  mrb->gc_malloc_increase = 0;
+  gc_malloc_reset_limit(mrb);
+}
+
 struct RBasic*
 mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
 {
@@ -397,6 +581,12 @@ mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
   mrb_full_gc(mrb);
 #endif
   if (mrb->gc_threshold < mrb->live) {
+    if (!mrb->gc_idle_mode || mrb->gc_threshold < mrb->live / 2) {
+      mrb_incremental_gc(mrb);
+    }
+  }
+  else if (gc_malloc_exceeded_p(mrb)) {
+    mrb->gc_stat.malloc_step_count++;
     mrb_incremental_gc(mrb);
   }
   if (mrb->free_heaps == NULL) {
@@ -415,9 +605,96 @@ mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
   p->tt = ttype;
   p->c = cls;
   paint_partial_white(mrb, p);
+  if (mrb->obj_alloc_hook) {
+    mrb->obj_alloc_hook(mrb, p, mrb->obj_hook_ud);
+  }
   return p;
 }
 
+/* bytes malloc'd for obj besides its heap slot */
+static size_t
+gc_obj_payload(mrb_state *mrb, struct RBasic *obj)
+{
+  switch (obj->tt) {
+  case MRB_TT_OBJECT:
+  case MRB_TT_EXCEPTION:
+    return mrb_gc_iv_bytes(mrb, (struct RObject*)obj);
+
+  case MRB_TT_CLASS:
+  case MRB_TT_MODULE:
+  case MRB_TT_SCLASS:
+    return mrb_gc_iv_bytes(mrb, (struct RObject*)obj) + mrb_gc_mt_bytes(mrb, (struct RClass*)obj);
+
+  case MRB_TT_DATA:
+    {
+      struct RData *d = (struct RData*)obj;
+      size_t size = mrb_gc_iv_bytes(mrb, (struct RObject*)obj);
+
+      if (d->type && d->type->dsize && d->data) {
+        size += d->type->dsize(mrb, d->data);
+      }
+      return size;
+    }
+
+  case MRB_TT_ENV:
+    if (((struct REnv*)obj)->cioff < 0) {
+      return (size_t)obj->flags * sizeof(mrb_value);
+    }
+    return 0;
+
+  case MRB_TT_RANGE:
+    return ((struct RRange*)obj)->edges ? sizeof(mrb_range_edges) : 0;
+
+  case MRB_TT_ARRAY:
+    if (obj->flags & MRB_ARY_SHARED) return 0;
+    return ((struct RArray*)obj)->aux.capa * sizeof(mrb_value);
+
+  case MRB_TT_HASH:
+    return mrb_gc_iv_bytes(mrb, (struct RObject*)obj) + mrb_gc_hash_bytes(mrb, (struct RHash*)obj);
+
+  case MRB_TT_STRING:
+    if (obj->flags & (MRB_STR_SHARED|MRB_STR_NOFREE|MRB_STR_EMBED)) return 0;
+    return ((struct RString*)obj)->as.heap.aux.capa + 1;
+
+  default:
+    return 0;
+  }
+}
+
+static void
+gc_count_class_memsize(mrb_state *mrb, struct RBasic *obj, size_t size)
+{
+  khash_t(gc_class_memsize) *h = mrb->gc_class_memsize;
+  struct RClass *c = obj->c;
+  khiter_t k;
+
+  /* the class field of an env refers to its parent env */
+  if (obj->tt == MRB_TT_ENV) return;
+  while (c && (c->tt == MRB_TT_SCLASS || c->tt == MRB_TT_ICLASS)) {
+    c = c->super;
+  }
+  if (!c) return;
+  k = kh_get(gc_class_memsize, mrb, h, c);
+  if (k == kh_end(h)) {
+    k = kh_put(gc_class_memsize, mrb, h, c);
+    kh_value(h, k).bytes = 0;
+    kh_value(h, k).last_bytes = 0;
+  }
+  kh_value(h, k).bytes += size;
+}
+
+/* called when obj is reached for the first time in a GC cycle */
+static void
+gc_account(mrb_state *mrb, struct RBasic *obj)
+{
+  size_t payload = gc_obj_payload(mrb, obj);
+
+  mrb->gc_malloc_marked += payload;
+  if (mrb->gc_class_memsize && !is_minor_gc(mrb)) {
+    gc_count_class_memsize(mrb, obj, sizeof(RVALUE) + payload);
+  }
+}
+
 static inline void
 add_gray_list(mrb_state *mrb, struct RBasic *obj)
 {
@@ -429,6 +706,7 @@ add_gray_list(mrb_state *mrb, struct RBasic *obj)
   paint_gray(obj);
   obj->gcnext = mrb->gray_list;
   mrb->gray_list = obj;
+  gc_account(mrb, obj);
 }
 
 static void
@@ -463,6 +741,7 @@ mark_context(mrb_state *mrb, struct mrb_context *c)
   /* mark VM stack */
   if (c->cibase) {
     for (ci = c->cibase; ci <= c->ci; ci++) {
+      if (mrb->gc_mark_syms) mrb_gc_mark_sym(mrb, ci->mid);
       mrb_gc_mark(mrb, (struct RBasic*)ci->env);
       mrb_gc_mark(mrb, (struct RBasic*)ci->proc);
       mrb_gc_mark(mrb, (struct RBasic*)ci->target_class);
@@ -474,12 +753,105 @@ mark_context(mrb_state *mrb, struct mrb_context *c)
   }
 }
 
+static size_t
+gc_slots(mrb_state *mrb, struct RBasic *obj)
+{
+  switch (obj->tt) {
+  case MRB_TT_ARRAY:
+    return ((struct RArray*)obj)->len;
+  case MRB_TT_HASH:
+    return mrb_gc_hash_slots(mrb, (struct RHash*)obj);
+  default:
+    return 0;
+  }
+}
+
+static void
+gc_card_table_free(mrb_state *mrb, struct gc_card_table *t)
+{
+  mrb_free(mrb, t->dirty);
+  mrb_free(mrb, t);
+}
+
+static void
+gc_cards_drop(mrb_state *mrb, struct RBasic *obj)
+{
+  khash_t(gc_cards) *h = mrb->gc_cards;
+  khiter_t k;
+
+  obj->flags &= ~MRB_GC_CARD_MARKED;
+  if (!h) return;
+  k = kh_get(gc_cards, mrb, h, obj);
+  if (k != kh_end(h)) {
+    gc_card_table_free(mrb, kh_value(h, k));
+    kh_del(gc_cards, mrb, h, k);
+  }
+}
+
+static void
+gc_cards_clear(mrb_state *mrb)
+{
+  khash_t(gc_cards) *h = mrb->gc_cards;
+  khiter_t k;
+
+  if (!h || kh_size(h) == 0) return;
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      kh_key(h, k)->flags &= ~MRB_GC_CARD_MARKED;
+      gc_card_table_free(mrb, kh_value(h, k));
+    }
+  }
+  kh_clear(gc_cards, mrb, h);
+}
+
+/* mark the dirty cards of obj; returns FALSE if obj has to be scanned in full */
+static mrb_bool
+gc_mark_cards(mrb_state *mrb, struct RBasic *obj)
+{
+  khash_t(gc_cards) *h = mrb->gc_cards;
+  struct gc_card_table *t;
+  khiter_t k;
+  size_t i;
+
+  obj->flags &= ~MRB_GC_CARD_MARKED;
+  if (!h) return FALSE;
+  k = kh_get(gc_cards, mrb, h, obj);
+  if (k == kh_end(h)) return FALSE;
+
+  t = kh_value(h, k);
+  for (i = 0; i < t->ncards; i++) {
+    size_t from, to;
+
+    if (!t->dirty[i]) continue;
+    from = i * MRB_GC_CARD_SIZE;
+    to = from + MRB_GC_CARD_SIZE;
+    if (obj->tt == MRB_TT_ARRAY) {
+      struct RArray *a = (struct RArray*)obj;
+      size_t j;
+
+      if (to > (size_t)a->len) to = a->len;
+      for (j = from; j < to; j++) {
+        mrb_gc_mark_value(mrb, a->ptr[j]);
+      }
+    }
+    else {
+      mrb_gc_mark_hash_slots(mrb, (struct RHash*)obj, from, to);
+    }
+  }
+  gc_card_table_free(mrb, t);
+  kh_del(gc_cards, mrb, h, k);
+  return TRUE;
+}
+
 static void
 gc_mark_children(mrb_state *mrb, struct RBasic *obj)
 {
   mrb_assert(is_gray(obj));
   paint_black(obj);
   mrb->gray_list = obj->gcnext;
+  if (gc_carded_p(obj) && gc_mark_cards(mrb, obj)) {
+    return;
+  }
   mrb_gc_mark(mrb, (struct RBasic*)obj->c);
   switch (obj->tt) {
   case MRB_TT_ICLASS:
@@ -515,6 +887,7 @@ gc_mark_children(mrb_state *mrb, struct RBasic *obj)
     {
       struct REnv *e = (struct REnv*)obj;
 
+      if (mrb->gc_mark_syms) mrb_gc_mark_sym(mrb, e->mid);
       if (e->cioff < 0) {
         int i, len;
 
@@ -582,6 +955,19 @@ static void
 obj_free(mrb_state *mrb, struct RBasic *obj)
 {
   DEBUG(printf("obj_free(%p,tt=%d)\n",obj,obj->tt));
+  if (gc_carded_p(obj)) {
+    gc_cards_drop(mrb, obj);
+  }
+  if (mrb->gc_class_memsize && (obj->tt == MRB_TT_CLASS || obj->tt == MRB_TT_MODULE)) {
+    khiter_t k = kh_get(gc_class_memsize, mrb, mrb->gc_class_memsize, (struct RClass*)obj);
+
+    if (k != kh_end(mrb->gc_class_memsize)) {
+      kh_del(gc_class_memsize, mrb, mrb->gc_class_memsize, k);
+    }
+  }
+  if (mrb->obj_free_hook) {
+    mrb->obj_free_hook(mrb, obj, mrb->obj_hook_ud);
+  }
   switch (obj->tt) {
     /* immediate - no mark */
   case MRB_TT_TRUE:
@@ -679,12 +1065,20 @@ root_scan_phase(mrb_state *mrb)
 {
   size_t i, e;
 
-  if (!is_minor_gc(mrb)) {
+  mrb->gc_malloc_marked = 0;
+  if (is_minor_gc(mrb)) {
+    mrb->gc_stat.minor_count++;
+  }
+  else {
+    mrb->gc_stat.major_count++;
     mrb->gray_list = NULL;
     mrb->atomic_gray_list = NULL;
+    gc_cards_clear(mrb);
   }
 
   mrb_gc_mark_gv(mrb);
+  /* mark frozen literals in use */
+  mrb_gc_mark_fstr_lits(mrb);
   /* mark arena */
   for (i=0,e=mrb->arena_idx; i<e; i++) {
     mrb_gc_mark(mrb, mrb->arena[i]);
@@ -786,14 +1180,19 @@ gc_gray_mark(mrb_state *mrb, struct RBasic *obj)
 }
 
 
-static void
+static size_t
 gc_mark_gray_list(mrb_state *mrb) {
+  size_t marked = 0;
+
   while (mrb->gray_list) {
-    if (is_gray(mrb->gray_list))
+    if (is_gray(mrb->gray_list)) {
       gc_mark_children(mrb, mrb->gray_list);
+      marked++;
+    }
     else
       mrb->gray_list = mrb->gray_list->gcnext;
   }
+  return marked;
 }
 
 
@@ -801,24 +1200,64 @@ static size_t
 incremental_marking_phase(mrb_state *mrb, size_t limit)
 {
   size_t tried_marks = 0;
+  size_t marked = 0;
+  uint64_t start = gc_clock();
 
   while (mrb->gray_list && tried_marks < limit) {
     tried_marks += gc_gray_mark(mrb, mrb->gray_list);
+    marked++;
   }
+  gc_stat_phase(&mrb->gc_stat.incremental_mark, start, marked);
 
   return tried_marks;
 }
 
+/* the counts of the finished major cycle become the reported ones */
+static void
+gc_class_memsize_flip(mrb_state *mrb)
+{
+  khash_t(gc_class_memsize) *h = mrb->gc_class_memsize;
+  khiter_t k;
+
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      if (kh_value(h, k).bytes == 0) {
+        kh_del(gc_class_memsize, mrb, h, k);
+      }
+      else {
+        kh_value(h, k).last_bytes = kh_value(h, k).bytes;
+        kh_value(h, k).bytes = 0;
+      }
+    }
+  }
+}
+
 static void
 final_marking_phase(mrb_state *mrb)
 {
+  size_t marked;
+  uint64_t start = gc_clock();
+
   mark_context_stack(mrb, mrb->root_c);
-  gc_mark_gray_list(mrb);
+  /* literals first used during the incremental marking */
+  mrb_gc_mark_fstr_lits(mrb);
+  marked = gc_mark_gray_list(mrb);
   mrb_assert(mrb->gray_list == NULL);
   mrb->gray_list = mrb->atomic_gray_list;
   mrb->atomic_gray_list = NULL;
-  gc_mark_gray_list(mrb);
+  marked += gc_mark_gray_list(mrb);
   mrb_assert(mrb->gray_list == NULL);
+  gc_stat_phase(&mrb->gc_stat.final_mark, start, marked);
+  if (is_minor_gc(mrb)) {
+    /* survivors join the old objects counted before */
+    mrb->gc_malloc_live += mrb->gc_malloc_marked;
+  }
+  else {
+    mrb->gc_malloc_live = mrb->gc_malloc_marked;
+    if (mrb->gc_class_memsize) {
+      gc_class_memsize_flip(mrb);
+    }
+  }
 }
 
 static void
@@ -834,6 +1273,8 @@ incremental_sweep_phase(mrb_state *mrb, size_t limit)
 {
   struct heap_page *page = mrb->sweeps;
   size_t tried_sweep = 0;
+  size_t total_freed = 0;
+  uint64_t start = gc_clock();
 
   while (page && (tried_sweep < limit)) {
     RVALUE *p = page->objects;
@@ -886,8 +1327,10 @@ incremental_sweep_phase(mrb_state *mrb, size_t limit)
     tried_sweep += MRB_HEAP_PAGE_SIZE;
     mrb->live -= freed;
     mrb->gc_live_after_mark -= freed;
+    total_freed += freed;
   }
   mrb->sweeps = page;
+  gc_stat_phase(&mrb->gc_stat.sweep, start, total_freed);
   return tried_sweep;
 }
 
@@ -896,7 +1339,17 @@ incremental_gc(mrb_state *mrb, size_t limit)
 {
   switch (mrb->gc_state) {
   case GC_STATE_NONE:
-    root_scan_phase(mrb);
+    {
+      uint64_t start = gc_clock();
+      size_t grayed = 0;
+      struct RBasic *obj;
+
+      root_scan_phase(mrb);
+      for (obj = mrb->gray_list; obj; obj = obj->gcnext) {
+        grayed++;
+      }
+      gc_stat_phase(&mrb->gc_stat.root_scan, start, grayed);
+    }
     mrb->gc_state = GC_STATE_MARK;
     flip_white_part(mrb);
     return 0;
@@ -931,11 +1384,15 @@ incremental_gc_until(mrb_state *mrb, enum gc_state to_state)
   } while (mrb->gc_state != to_state);
 }
 
-static void
+static size_t
 incremental_gc_step(mrb_state *mrb)
 {
   size_t limit = 0, result = 0;
-  limit = (GC_STEP_SIZE/100) * mrb->gc_step_ratio;
+
+  if (mrb->gc_pause_target > 0)
+    limit = mrb->gc_step_limit;
+  else
+    limit = (GC_STEP_SIZE/100) * mrb->gc_step_ratio;
   while (result < limit) {
     result += incremental_gc(mrb, limit);
     if (mrb->gc_state == GC_STATE_NONE)
@@ -943,6 +1400,68 @@ incremental_gc_step(mrb_state *mrb)
   }
 
   mrb->gc_threshold = mrb->live + GC_STEP_SIZE;
+  return result;
+}
+
+/*
+ * Pacing: adapt the step limit to the speed measured in the last step,
+ * aiming at 3/4 of the target pause to leave room for jitter.
+ */
+static void
+gc_pace_step(mrb_state *mrb, uint64_t t, size_t work)
+{
+  uint64_t target = (uint64_t)mrb->gc_pause_target * 1000;
+  uint64_t limit;
+
+  if (work == 0) return;
+  if (t == 0) t = 1;
+  limit = (uint64_t)work * target * 3 / 4 / t;
+  limit = (mrb->gc_step_limit + limit) / 2;
+  if (limit < MIN_GC_STEP_LIMIT) limit = MIN_GC_STEP_LIMIT;
+  if (limit > SIZE_MAX / 2) limit = SIZE_MAX / 2;
+  mrb->gc_step_limit = (size_t)limit;
+}
+
+/*
+ * Pacing: choose the interval ratio for the next cycle.
+ */
+static void
+gc_pace_cycle(mrb_state *mrb, uint64_t t, size_t young)
+{
+  size_t live = mrb->gc_live_after_mark;
+  int max_ratio = 100 + mrb->gc_growth_budget;
+  int ratio;
+
+  if (live == 0) live = 1;
+  if (is_minor_gc(mrb)) {
+    /* the whole minor GC is one pause; scale the young generation */
+    uint64_t target = (uint64_t)mrb->gc_pause_target * 1000;
+    uint64_t desired;
+
+    if (t == 0) t = 1;
+    desired = (uint64_t)young * target * 3 / 4 / t;
+    if (desired > (uint64_t)live * mrb->gc_growth_budget / 100) {
+      ratio = max_ratio;
+    }
+    else {
+      ratio = 100 + (int)(desired * 100 / live);
+    }
+    ratio = (mrb->gc_interval_ratio + ratio) / 2;
+  }
+  else {
+    /* objects allocated while the cycle ran eat into the budget */
+    size_t during = mrb->gc_cycle_steps * GC_STEP_SIZE;
+
+    if ((uint64_t)during * 100 >= (uint64_t)live * mrb->gc_growth_budget) {
+      ratio = 100;
+    }
+    else {
+      ratio = max_ratio - (int)(during * 100 / live);
+    }
+  }
+  if (ratio < MIN_GC_PACED_INTERVAL_RATIO) ratio = MIN_GC_PACED_INTERVAL_RATIO;
+  if (ratio > max_ratio) ratio = max_ratio;
+  mrb->gc_interval_ratio = ratio;
 }
 
 static void
@@ -965,24 +1484,44 @@ clear_all_old(mrb_state *mrb)
 
   /* The gray objects has already been painted as white */
   mrb->atomic_gray_list = mrb->gray_list = NULL;
+  gc_cards_clear(mrb);
 }
 
 void
 mrb_incremental_gc(mrb_state *mrb)
 {
-  if (mrb->gc_disabled) return;
+  uint64_t start, t;
+  size_t young = 0, work = 0;
+
+  if (mrb->gc_disabled || mrb->gc_iterating) return;
 
   GC_INVOKE_TIME_REPORT("mrb_incremental_gc()");
   GC_TIME_START;
+  start = gc_clock();
 
   if (is_minor_gc(mrb)) {
+    if (mrb->live > mrb->gc_live_after_mark)
+      young = mrb->live - mrb->gc_live_after_mark;
     incremental_gc_until(mrb, GC_STATE_NONE);
   }
   else {
-    incremental_gc_step(mrb);
+    work = incremental_gc_step(mrb);
+    mrb->gc_cycle_steps++;
+  }
+  t = gc_clock() - start;
+
+  if (mrb->gc_pause_target > 0) {
+    if (work > 0) {
+      gc_pace_step(mrb, t, work);
+    }
+    if (mrb->gc_state == GC_STATE_NONE) {
+      gc_pace_cycle(mrb, t, young);
+    }
   }
 
   if (mrb->gc_state == GC_STATE_NONE) {
+    mrb->gc_cycle_steps = 0;
+    gc_malloc_reset(mrb);
     mrb_assert(mrb->live >= mrb->gc_live_after_mark);
     mrb->gc_threshold = (mrb->gc_live_after_mark/100) * mrb->gc_interval_ratio;
     if (mrb->gc_threshold < GC_STEP_SIZE) {
@@ -1001,14 +1540,40 @@ mrb_incremental_gc(mrb_state *mrb)
     }
   }
 
+  gc_stat_step(mrb, t);
   GC_TIME_STOP_AND_REPORT;
 }
 
+/*
+ * Perform GC steps until usec microseconds are spent or the current GC
+ * cycle completes. A new cycle is started only if objects were allocated
+ * since the last one. Returns TRUE if no GC cycle is in progress.
+ */
+mrb_bool
+mrb_gc_step_for(mrb_state *mrb, uint32_t usec)
+{
+  uint64_t deadline;
+
+  if (mrb->gc_disabled || mrb->gc_iterating) return FALSE;
+  if (mrb->gc_state == GC_STATE_NONE && mrb->live <= mrb->gc_live_after_mark) {
+    return TRUE;
+  }
+
+  deadline = gc_clock() + (uint64_t)usec * 1000;
+  do {
+    mrb_incremental_gc(mrb);
+  } while (mrb->gc_state != GC_STATE_NONE && gc_clock() < deadline);
+
+  return mrb->gc_state == GC_STATE_NONE;
+}
+
 /* Perform a full gc cycle */
-void
-mrb_full_gc(mrb_state *mrb)
+void mrb_gc_sweep_symtbl(mrb_state *mrb);
+
+static void
+full_gc(mrb_state *mrb, mrb_bool syms)
 {
-  if (mrb->gc_disabled) return;
+  if (mrb->gc_disabled || mrb->gc_iterating) return;
   GC_INVOKE_TIME_REPORT("mrb_full_gc()");
   GC_TIME_START;
 
@@ -1022,7 +1587,16 @@ mrb_full_gc(mrb_state *mrb)
     incremental_gc_until(mrb, GC_STATE_NONE);
   }
 
+  /* symbol values have no write barrier, so symbols can only be marked
+     by a cycle that runs without interruption, like this one */
+  mrb->gc_mark_syms = syms;
   incremental_gc_until(mrb, GC_STATE_NONE);
+  if (syms) {
+    mrb->gc_mark_syms = FALSE;
+    mrb_gc_sweep_symtbl(mrb);
+  }
+  mrb->gc_cycle_steps = 0;
+  gc_malloc_reset(mrb);
   mrb->gc_threshold = (mrb->gc_live_after_mark/100) * mrb->gc_interval_ratio;
 
   if (is_generational(mrb)) {
@@ -1033,6 +1607,24 @@ mrb_full_gc(mrb_state *mrb)
   GC_TIME_STOP_AND_REPORT;
 }
 
+void
+mrb_full_gc(mrb_state *mrb)
+{
+  full_gc(mrb, FALSE);
+}
+
+/*
+ * Runs a full GC that also frees the collectable symbols no longer
+ * referred to (see mrb_intern_collectable()).  Plain mrb_full_gc() keeps
+ * them, because it may run from an allocation while C code holds a bare
+ * mrb_sym.
+ */
+void
+mrb_gc_collect_symbols(mrb_state *mrb)
+{
+  full_gc(mrb, mrb->symmortal > 0);
+}
+
 void
 mrb_garbage_collect(mrb_state *mrb)
 {
@@ -1100,7 +1692,13 @@ mrb_field_write_barrier(mrb_state *mrb, struct RBasic *obj, struct RBasic *value
 void
 mrb_write_barrier(mrb_state *mrb, struct RBasic *obj)
 {
-  if (!is_black(obj)) return;
+  if (!is_black(obj)) {
+    if (is_gray(obj) && gc_carded_p(obj)) {
+      /* scan in full instead of dirty cards */
+      gc_cards_drop(mrb, obj);
+    }
+    return;
+  }
 
   mrb_assert(!is_dead(mrb, obj));
   mrb_assert(is_generational(mrb) || mrb->gc_state != GC_STATE_NONE);
@@ -1110,25 +1708,136 @@ mrb_write_barrier(mrb_state *mrb, struct RBasic *obj)
 }
 
 /*
- *  call-seq:
- *     GC.start                     -> nil
- *
- *  Initiates full garbage collection.
- *
+ * Card write barrier
+ *   Same as mrb_write_barrier, but only the slots from..from+len-1 of
+ *   obj (elements of an Array, buckets of a Hash) are rescanned if obj
+ *   is large enough for card marking.
  */
 
-static mrb_value
-gc_start(mrb_state *mrb, mrb_value obj)
+void
+mrb_write_barrier_slots(mrb_state *mrb, struct RBasic *obj, size_t from, size_t len)
 {
-  mrb_full_gc(mrb);
-  return mrb_nil_value();
-}
+  struct gc_card_table *t;
+  size_t i, last;
 
-/*
- *  call-seq:
- *     GC.enable    -> true or false
- *
- *  Enables garbage collection, returning <code>true</code> if garbage
+  if (is_white(obj) || len == 0) return;
+  if (is_black(obj)) {
+    khiter_t k;
+
+    mrb_write_barrier(mrb, obj);
+    if (gc_slots(mrb, obj) < MRB_GC_CARD_THRESHOLD) return;
+    if (!mrb->gc_cards) {
+      mrb->gc_cards = kh_init(gc_cards, mrb);
+    }
+    t = (struct gc_card_table*)mrb_calloc(mrb, 1, sizeof(struct gc_card_table));
+    k = kh_put(gc_cards, mrb, mrb->gc_cards, obj);
+    kh_value(mrb->gc_cards, k) = t;
+    obj->flags |= MRB_GC_CARD_MARKED;
+  }
+  else if (gc_carded_p(obj) && mrb->gc_cards) {
+    khiter_t k = kh_get(gc_cards, mrb, mrb->gc_cards, obj);
+
+    if (k == kh_end(mrb->gc_cards)) return;
+    t = kh_value(mrb->gc_cards, k);
+  }
+  else {
+    /* gray; will be scanned in full */
+    return;
+  }
+
+  last = (from + len - 1) / MRB_GC_CARD_SIZE;
+  if (last >= t->ncards) {
+    size_t n = t->ncards * 2;
+
+    if (n <= last) n = last + 1;
+    t->dirty = (uint8_t*)mrb_realloc(mrb, t->dirty, n);
+    memset(t->dirty + t->ncards, 0, n - t->ncards);
+    t->ncards = n;
+  }
+  for (i = from / MRB_GC_CARD_SIZE; i <= last; i++) {
+    t->dirty[i] = 1;
+  }
+}
+
+/*
+ *  call-seq:
+ *     GC.start                     -> nil
+ *
+ *  Initiates full garbage collection.  Symbols made by String#to_sym
+ *  that are no longer referred to are freed as well.
+ *
+ */
+
+static mrb_value
+gc_start(mrb_state *mrb, mrb_value obj)
+{
+  mrb_gc_collect_symbols(mrb);
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.step(usec)    -> true or false
+ *
+ *  Performs GC steps until +usec+ microseconds are spent or the current
+ *  GC cycle completes. Returns <code>true</code> if no GC cycle is left
+ *  in progress. Intended to be called when the application is idle.
+ *
+ *     GC.step(500)   #=> false
+ *
+ */
+
+static mrb_value
+gc_step(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int usec;
+
+  mrb_get_args(mrb, "i", &usec);
+  if (usec < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative time budget");
+  }
+  return mrb_bool_value(mrb_gc_step_for(mrb, (uint32_t)usec));
+}
+
+/*
+ *  call-seq:
+ *     GC.idle_mode    -> true or false
+ *
+ *  Returns whether allocation defers GC steps to GC.step.
+ *
+ */
+
+static mrb_value
+gc_idle_mode_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_bool_value(mrb->gc_idle_mode);
+}
+
+/*
+ *  call-seq:
+ *     GC.idle_mode = true or false   -> true or false
+ *
+ *  In idle mode allocation does not trigger GC steps; the application
+ *  promises to call GC.step when idle. If it falls behind and the live
+ *  objects exceed twice the GC threshold, allocation steps again.
+ *
+ */
+
+static mrb_value
+gc_idle_mode_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_bool enable;
+
+  mrb_get_args(mrb, "b", &enable);
+  mrb->gc_idle_mode = enable;
+  return mrb_bool_value(enable);
+}
+
+/*
+ *  call-seq:
+ *     GC.enable    -> true or false
+ *
+ *  Enables garbage collection, returning <code>true</code> if garbage
  *  collection was previously disabled.
  *
  *     GC.disable   #=> false
@@ -1235,6 +1944,128 @@ gc_step_ratio_set(mrb_state *mrb, mrb_value obj)
   return mrb_nil_value();
 }
 
+/*
+ *  call-seq:
+ *     GC.pause_target    -> fixnum
+ *
+ *  Returns the target pause of a GC step in microseconds.
+ *  0 (the default) means pacing mode is off.
+ *
+ */
+
+static mrb_value
+gc_pause_target_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_pause_target);
+}
+
+/*
+ *  call-seq:
+ *     GC.pause_target = fixnum   -> nil
+ *
+ *  Turns on pacing mode with the given target pause of a GC step in
+ *  microseconds, or turns it off with 0. In pacing mode the step size
+ *  and the interval ratio are adapted by the collector, so the values
+ *  given to GC.step_ratio= and GC.interval_ratio= are ignored.
+ *
+ *     GC.pause_target = 1000   # aim at steps shorter than 1ms
+ *
+ */
+
+static mrb_value
+gc_pause_target_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int usec;
+
+  mrb_get_args(mrb, "i", &usec);
+  if (usec < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative pause target");
+  }
+  if (mrb->gc_pause_target == 0 && usec > 0) {
+    mrb->gc_step_limit = (GC_STEP_SIZE/100) * mrb->gc_step_ratio;
+  }
+  mrb->gc_pause_target = (uint32_t)usec;
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.growth_budget    -> fixnum
+ *
+ *  Returns how much the heap may grow over the live objects in pacing
+ *  mode. Default value is 100(%).
+ *
+ */
+
+static mrb_value
+gc_growth_budget_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_growth_budget);
+}
+
+/*
+ *  call-seq:
+ *     GC.growth_budget = fixnum   -> nil
+ *
+ *  Updates how much the heap may grow over the live objects in pacing
+ *  mode, in percent. A smaller budget makes GC cycles start earlier.
+ *  The budget is clamped between 10 and 10000.
+ *
+ */
+
+static mrb_value
+gc_growth_budget_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int budget;
+
+  mrb_get_args(mrb, "i", &budget);
+  if (budget < MIN_GC_PACED_INTERVAL_RATIO - 100) {
+    budget = MIN_GC_PACED_INTERVAL_RATIO - 100;
+  }
+  else if (budget > MAX_GC_GROWTH_BUDGET) {
+    budget = MAX_GC_GROWTH_BUDGET;
+  }
+  mrb->gc_growth_budget = (int)budget;
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.malloc_ratio    -> fixnum
+ *
+ *  Returns the ratio of the malloc limit to the bytes held by live
+ *  objects. Default value is 100(%).
+ *
+ */
+
+static mrb_value
+gc_malloc_ratio_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_malloc_ratio);
+}
+
+/*
+ *  call-seq:
+ *     GC.malloc_ratio = fixnum   -> nil
+ *
+ *  Updates the ratio of the malloc limit to the bytes held by live
+ *  objects. A GC step is triggered when more bytes than the limit
+ *  are malloc'd since the last cycle. 0 turns the malloc limit off.
+ *
+ */
+
+static mrb_value
+gc_malloc_ratio_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int ratio;
+
+  mrb_get_args(mrb, "i", &ratio);
+  if (ratio < 0) ratio = 0;
+  mrb->gc_malloc_ratio = ratio;
+  gc_malloc_reset_limit(mrb);
+  return mrb_nil_value();
+}
+
 static void
 change_gen_gc_mode(mrb_state *mrb, mrb_int enable)
 {
@@ -1286,7 +2117,278 @@ gc_generational_mode_set(mrb_state *mrb, mrb_value self)
 }
 
 void
-mrb_objspace_each_objects(mrb_state *mrb, mrb_each_object_callback *callback, void *data)
+mrb_gc_get_stat(mrb_state *mrb, mrb_gc_stat *stat)
+{
+  *stat = mrb->gc_stat;
+}
+
+void
+mrb_gc_clear_stat(mrb_state *mrb)
+{
+  memset(&mrb->gc_stat, 0, sizeof(mrb->gc_stat));
+}
+
+static mrb_value
+gc_stat_time(mrb_state *mrb, uint64_t t)
+{
+  /* nanoseconds to milliseconds */
+  return mrb_float_value(mrb, (mrb_float)t / 1000000.0);
+}
+
+static void
+gc_stat_set(mrb_state *mrb, mrb_value hash, const char *key, mrb_value val)
+{
+  mrb_hash_set(mrb, hash, mrb_symbol_value(mrb_intern_cstr(mrb, key)), val);
+}
+
+#define gc_stat_set_phase(mrb, hash, name, phase) do {\
+  gc_stat_set((mrb), (hash), name "_count", mrb_fixnum_value((phase)->count));\
+  gc_stat_set((mrb), (hash), name "_objects", mrb_fixnum_value((phase)->objects));\
+  gc_stat_set((mrb), (hash), name "_time", gc_stat_time((mrb), (phase)->time));\
+} while (0)
+
+/*
+ *  call-seq:
+ *     GC.stat([result_hash])  -> hash
+ *     GC.stat(key)            -> value
+ *
+ *  Returns statistics of the garbage collector. Times are reported in
+ *  milliseconds as Float; +:step_histogram+ is an Array whose first
+ *  element counts steps shorter than 1 microsecond, and whose element
+ *  +i+ counts steps between 2**(i-1) and 2**i microseconds.  When the
+ *  VM uses the slab allocator, +:slab_*+ keys report its usage.
+ *
+ *     GC.stat   #=> {:count=>3, :minor_gc_count=>2, :major_gc_count=>1, ...}
+ *     GC.stat(:max_step_time)   #=> 0.041
+ *
+ *  If the optional argument +result_hash+ is given,
+ *  it is overwritten and returned.
+ */
+
+static mrb_value
+gc_stat(mrb_state *mrb, mrb_value self)
+{
+  mrb_value arg = mrb_nil_value();
+  mrb_value hash, hist;
+  mrb_gc_stat st;
+  mrb_slab_stat slab;
+  int i;
+
+  mrb_get_args(mrb, "|o", &arg);
+  if (mrb_hash_p(arg)) {
+    hash = arg;
+    mrb_hash_clear(mrb, hash);
+  }
+  else if (mrb_nil_p(arg) || mrb_symbol_p(arg)) {
+    hash = mrb_hash_new(mrb);
+  }
+  else {
+    mrb_raise(mrb, E_TYPE_ERROR, "non-hash or symbol given");
+  }
+
+  mrb_gc_get_stat(mrb, &st);
+  gc_stat_set(mrb, hash, "count", mrb_fixnum_value(st.minor_count + st.major_count));
+  gc_stat_set(mrb, hash, "minor_gc_count", mrb_fixnum_value(st.minor_count));
+  gc_stat_set(mrb, hash, "major_gc_count", mrb_fixnum_value(st.major_count));
+  gc_stat_set(mrb, hash, "live", mrb_fixnum_value(mrb->live));
+  gc_stat_set(mrb, hash, "threshold", mrb_fixnum_value(mrb->gc_threshold));
+  gc_stat_set(mrb, hash, "interval_ratio", mrb_fixnum_value(mrb->gc_interval_ratio));
+  gc_stat_set(mrb, hash, "step_limit", mrb_fixnum_value(mrb->gc_pause_target > 0 ? (mrb_int)mrb->gc_step_limit : (GC_STEP_SIZE/100) * mrb->gc_step_ratio));
+  gc_stat_set(mrb, hash, "step_count", mrb_fixnum_value(st.step_count));
+  gc_stat_set(mrb, hash, "step_time", gc_stat_time(mrb, st.step_time));
+  gc_stat_set(mrb, hash, "max_step_time", gc_stat_time(mrb, st.max_step_time));
+  gc_stat_set_phase(mrb, hash, "root_scan", &st.root_scan);
+  gc_stat_set_phase(mrb, hash, "incremental_mark", &st.incremental_mark);
+  gc_stat_set_phase(mrb, hash, "final_mark", &st.final_mark);
+  gc_stat_set_phase(mrb, hash, "sweep", &st.sweep);
+  hist = mrb_ary_new_capa(mrb, MRB_GC_STEP_HISTOGRAM_SIZE);
+  for (i = 0; i < MRB_GC_STEP_HISTOGRAM_SIZE; i++) {
+    mrb_ary_push(mrb, hist, mrb_fixnum_value(st.step_histogram[i]));
+  }
+  gc_stat_set(mrb, hash, "step_histogram", hist);
+  gc_stat_set(mrb, hash, "malloc_increase", mrb_fixnum_value(mrb->gc_malloc_increase));
+  gc_stat_set(mrb, hash, "malloc_limit", mrb_fixnum_value(mrb->gc_malloc_limit));
+  gc_stat_set(mrb, hash, "malloc_live", mrb_fixnum_value(mrb->gc_malloc_live));
+  gc_stat_set(mrb, hash, "malloc_step_count", mrb_fixnum_value(st.malloc_step_count));
+  if (mrb_slab_get_stat(mrb, &slab)) {
+    gc_stat_set(mrb, hash, "slab_chunk_bytes", mrb_fixnum_value(slab.chunk_bytes));
+    gc_stat_set(mrb, hash, "slab_used_bytes", mrb_fixnum_value(slab.used_bytes));
+    gc_stat_set(mrb, hash, "slab_free_bytes", mrb_fixnum_value(slab.free_bytes));
+    gc_stat_set(mrb, hash, "slab_large_count", mrb_fixnum_value(slab.large_count));
+    gc_stat_set(mrb, hash, "slab_large_bytes", mrb_fixnum_value(slab.large_bytes));
+  }
+
+  if (mrb_symbol_p(arg)) {
+    mrb_value val = mrb_hash_fetch(mrb, hash, arg, mrb_undef_value());
+
+    if (mrb_undef_p(val)) {
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown key: %S", mrb_sym2str(mrb, mrb_symbol(arg)));
+    }
+    return val;
+  }
+  return hash;
+}
+
+struct gc_walk {
+  mrb_each_object_callback *callback;
+  void *data;
+};
+
+static void
+walk_ref(mrb_state *mrb, struct RBasic *obj, struct gc_walk *w)
+{
+  if (obj) (*w->callback)(mrb, obj, w->data);
+}
+
+#define walk_ref_value(mrb, v, w) do {\
+  if (mrb_type(v) >= MRB_TT_HAS_BASIC) walk_ref((mrb), mrb_basic_ptr(v), (w));\
+} while (0)
+
+static int
+walk_iv_i(mrb_state *mrb, mrb_sym sym, mrb_value v, void *p)
+{
+  walk_ref_value(mrb, v, (struct gc_walk*)p);
+  return 0;
+}
+
+static int
+walk_hash_i(mrb_state *mrb, mrb_value key, mrb_value val, void *p)
+{
+  walk_ref_value(mrb, key, (struct gc_walk*)p);
+  walk_ref_value(mrb, val, (struct gc_walk*)p);
+  return 0;
+}
+
+/* same references as mark_context() */
+static void
+walk_context(mrb_state *mrb, struct mrb_context *c, struct gc_walk *w)
+{
+  size_t i;
+  size_t e;
+  mrb_callinfo *ci;
+
+  e = c->stack - c->stbase;
+  if (c->ci) e += c->ci->nregs;
+  if (c->stbase + e > c->stend) e = c->stend - c->stbase;
+  for (i=0; i<e; i++) {
+    walk_ref_value(mrb, c->stbase[i], w);
+  }
+  e = (c->ci) ? c->ci->eidx : 0;
+  for (i=0; i<e; i++) {
+    walk_ref(mrb, (struct RBasic*)c->ensure[i], w);
+  }
+  if (c->cibase) {
+    for (ci = c->cibase; ci <= c->ci; ci++) {
+      walk_ref(mrb, (struct RBasic*)ci->env, w);
+      walk_ref(mrb, (struct RBasic*)ci->proc, w);
+      walk_ref(mrb, (struct RBasic*)ci->target_class, w);
+    }
+  }
+  if (c->prev && c->prev->fib) {
+    walk_ref(mrb, (struct RBasic*)c->prev->fib, w);
+  }
+}
+
+/* same references as gc_mark_children(), without touching the GC state */
+static void
+walk_refs(mrb_state *mrb, struct RBasic *obj, struct gc_walk *w)
+{
+  walk_ref(mrb, (struct RBasic*)obj->c, w);
+  switch (obj->tt) {
+  case MRB_TT_ICLASS:
+    walk_ref(mrb, (struct RBasic*)((struct RClass*)obj)->super, w);
+    break;
+
+  case MRB_TT_CLASS:
+  case MRB_TT_MODULE:
+  case MRB_TT_SCLASS:
+    {
+      struct RClass *c = (struct RClass*)obj;
+      khash_t(mt) *h = c->mt;
+      khiter_t k;
+
+      if (h) {
+        for (k = kh_begin(h); k != kh_end(h); k++) {
+          if (kh_exist(h, k)) {
+            walk_ref(mrb, (struct RBasic*)kh_value(h, k), w);
+          }
+        }
+      }
+      walk_ref(mrb, (struct RBasic*)c->super, w);
+    }
+    /* fall through */
+
+  case MRB_TT_OBJECT:
+  case MRB_TT_DATA:
+    mrb_iv_foreach(mrb, mrb_obj_value(obj), walk_iv_i, w);
+    break;
+
+  case MRB_TT_PROC:
+    {
+      struct RProc *p = (struct RProc*)obj;
+
+      walk_ref(mrb, (struct RBasic*)p->env, w);
+      walk_ref(mrb, (struct RBasic*)p->target_class, w);
+    }
+    break;
+
+  case MRB_TT_ENV:
+    {
+      struct REnv *e = (struct REnv*)obj;
+
+      if (e->cioff < 0) {
+        int i, len;
+
+        len = (int)e->flags;
+        for (i=0; i<len; i++) {
+          walk_ref_value(mrb, e->stack[i], w);
+        }
+      }
+    }
+    break;
+
+  case MRB_TT_FIBER:
+    {
+      struct mrb_context *c = ((struct RFiber*)obj)->cxt;
+
+      if (c) walk_context(mrb, c, w);
+    }
+    break;
+
+  case MRB_TT_ARRAY:
+    {
+      struct RArray *a = (struct RArray*)obj;
+      size_t i, e;
+
+      for (i=0,e=a->len; i<e; i++) {
+        walk_ref_value(mrb, a->ptr[i], w);
+      }
+    }
+    break;
+
+  case MRB_TT_HASH:
+    mrb_iv_foreach(mrb, mrb_obj_value(obj), walk_iv_i, w);
+    mrb_hash_foreach(mrb, (struct RHash*)obj, walk_hash_i, w);
+    break;
+
+  case MRB_TT_RANGE:
+    {
+      struct RRange *r = (struct RRange*)obj;
+
+      if (r->edges) {
+        walk_ref_value(mrb, r->edges->beg, w);
+        walk_ref_value(mrb, r->edges->end, w);
+      }
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+static void
+walk_heap(mrb_state *mrb, struct gc_walk *w)
 {
   struct heap_page* page = mrb->heaps;
 
@@ -1296,13 +2398,131 @@ mrb_objspace_each_objects(mrb_state *mrb, mrb_each_object_callback *callback, vo
     p = page->objects;
     pend = p + MRB_HEAP_PAGE_SIZE;
     for (;p < pend; p++) {
-      (*callback)(mrb, &p->as.basic, data);
+      (*w->callback)(mrb, &p->as.basic, w->data);
     }
 
     page = page->next;
   }
 }
 
+/*
+ * Walks the references of obj, or the whole heap if obj is NULL. GC is
+ * held off meanwhile so that no object is freed under the walk, and
+ * allowed again even if the callback raises.
+ */
+static void
+gc_walk(mrb_state *mrb, struct RBasic *obj, mrb_each_object_callback *callback, void *data)
+{
+  struct mrb_jmpbuf *prev_jmp = mrb->jmp;
+  struct mrb_jmpbuf c_jmp;
+  mrb_bool iterating = mrb->gc_iterating;
+  struct gc_walk w;
+
+  w.callback = callback;
+  w.data = data;
+  MRB_TRY(&c_jmp) {
+    mrb->jmp = &c_jmp;
+    mrb->gc_iterating = TRUE;
+    if (obj) {
+      walk_refs(mrb, obj, &w);
+    }
+    else {
+      walk_heap(mrb, &w);
+    }
+    mrb->gc_iterating = iterating;
+    mrb->jmp = prev_jmp;
+  }
+  MRB_CATCH(&c_jmp) {
+    mrb->gc_iterating = iterating;
+    mrb->jmp = prev_jmp;
+    mrb_exc_raise(mrb, mrb_obj_value(mrb->exc));
+  }
+  MRB_END_EXC(&c_jmp);
+}
+
+/*
+ * Calls callback for each heap slot, live or not; use is_dead() to tell
+ * them apart. GC does not run until the walk is over.
+ */
+void
+mrb_objspace_each_objects(mrb_state *mrb, mrb_each_object_callback *callback, void *data)
+{
+  gc_walk(mrb, NULL, callback, data);
+}
+
+/*
+ * Calls callback for each object referred to by obj, in the order the
+ * marking phase would visit them. GC does not run until the walk is
+ * over; the callback must not modify obj.
+ */
+void
+mrb_objspace_each_reference(mrb_state *mrb, struct RBasic *obj, mrb_each_object_callback *callback, void *data)
+{
+  if (obj->tt == MRB_TT_FREE) return;
+  gc_walk(mrb, obj, callback, data);
+}
+
+/* Returns the bytes used by obj: its heap slot and its malloc'd buffers. */
+size_t
+mrb_objspace_memsize_of(mrb_state *mrb, struct RBasic *obj)
+{
+  return sizeof(RVALUE) + gc_obj_payload(mrb, obj);
+}
+
+/*
+ * Turns counting of bytes per class on or off. Objects are counted as
+ * they are marked by major GC cycles; the counts are reported by
+ * mrb_objspace_each_class_memsize() once a cycle completes.
+ */
+void
+mrb_objspace_count_class_memsize(mrb_state *mrb, mrb_bool enable)
+{
+  if (enable && !mrb->gc_class_memsize) {
+    mrb->gc_class_memsize = kh_init(gc_class_memsize, mrb);
+  }
+  else if (!enable && mrb->gc_class_memsize) {
+    kh_destroy(gc_class_memsize, mrb, mrb->gc_class_memsize);
+    mrb->gc_class_memsize = NULL;
+  }
+}
+
+/*
+ * Calls callback with the bytes used by the instances of each class,
+ * as counted by the last complete major GC cycle. GC is disabled while
+ * callback runs; it must not raise.
+ */
+void
+mrb_objspace_each_class_memsize(mrb_state *mrb, mrb_class_memsize_callback *callback, void *data)
+{
+  khash_t(gc_class_memsize) *h = mrb->gc_class_memsize;
+  struct RClass **classes;
+  size_t *bytes;
+  size_t i, n = 0;
+  khiter_t k;
+  mrb_bool disabled;
+
+  if (!h || kh_size(h) == 0) return;
+
+  /* work on a snapshot; GC may update the table while callback runs */
+  classes = (struct RClass**)mrb_malloc(mrb, (sizeof(struct RClass*)+sizeof(size_t))*kh_size(h));
+  bytes = (size_t*)(classes + kh_size(h));
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k) && kh_value(h, k).last_bytes > 0) {
+      classes[n] = kh_key(h, k);
+      bytes[n] = kh_value(h, k).last_bytes;
+      n++;
+    }
+  }
+  /* the classes are not protected from GC otherwise */
+  disabled = mrb->gc_disabled;
+  mrb->gc_disabled = TRUE;
+  for (i = 0; i < n; i++) {
+    (*callback)(mrb, classes[i], bytes[i], data);
+  }
+  mrb->gc_disabled = disabled;
+  mrb_free(mrb, classes);
+}
+
 #ifdef GC_TEST
 #ifdef GC_DEBUG
 static mrb_value gc_test(mrb_state *, mrb_value);
@@ -1317,6 +2537,7 @@ mrb_init_gc(mrb_state *mrb)
   gc = mrb_define_module(mrb, "GC");
 
   mrb_define_class_method(mrb, gc, "start", gc_start, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "step", gc_step, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "enable", gc_enable, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "disable", gc_disable, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "interval_ratio", gc_interval_ratio_get, MRB_ARGS_NONE());
@@ -1325,6 +2546,15 @@ mrb_init_gc(mrb_state *mrb)
   mrb_define_class_method(mrb, gc, "step_ratio=", gc_step_ratio_set, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "generational_mode=", gc_generational_mode_set, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "generational_mode", gc_generational_mode_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "pause_target", gc_pause_target_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "pause_target=", gc_pause_target_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "growth_budget", gc_growth_budget_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "growth_budget=", gc_growth_budget_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "malloc_ratio", gc_malloc_ratio_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "malloc_ratio=", gc_malloc_ratio_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "idle_mode", gc_idle_mode_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "idle_mode=", gc_idle_mode_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "stat", gc_stat, MRB_ARGS_OPT(1));
 #ifdef GC_TEST
 #ifdef GC_DEBUG
   mrb_define_class_method(mrb, gc, "test", gc_test, MRB_ARGS_NONE());
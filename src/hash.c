@@ -4,105 +4,694 @@
 ** See Copyright Notice in mruby.h
 */
 
+#include <string.h>
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
 #include "mruby/hash.h"
-#include "mruby/khash.h"
+#include "mruby/proc.h"
+#include "mruby/range.h"
 #include "mruby/string.h"
 #include "mruby/variable.h"
+#include "mruby/presym.h"
 
 /* a function to get hash value of a float number */
 mrb_int mrb_float_id(mrb_float f);
 
-static inline khint_t
-mrb_hash_ht_hash_func(mrb_state *mrb, mrb_value key)
+/* the built-in hash and eql? of the key types hashed natively below */
+mrb_value mrb_obj_equal_m(mrb_state *mrb, mrb_value self);
+mrb_value mrb_str_eql(mrb_state *mrb, mrb_value self);
+mrb_value mrb_num_eql(mrb_state *mrb, mrb_value self);
+mrb_value mrb_ary_hash(mrb_state *mrb, mrb_value self);
+mrb_value mrb_ary_eql(mrb_state *mrb, mrb_value self);
+mrb_value mrb_range_hash(mrb_state *mrb, mrb_value self);
+mrb_value mrb_range_eql(mrb_state *mrb, mrb_value self);
+
+/*
+  = Key hashing and comparison
+
+  Keys of the built-in types (String, Symbol, Fixnum, Float, Array and
+  Range) are hashed and compared in C instead of by calling their hash
+  and eql? methods, as long as those methods are still the built-in
+  ones.  Which types qualify is cached in mrb->hash_key_builtin and
+  checked again whenever mrb->method_serial shows that a method was
+  defined or removed or a module included somewhere; instances of
+  subclasses and objects with a singleton class look their methods up
+  each time.  Strings, symbols and numbers were always hashed natively,
+  whatever their hash method says.
+
+  Arrays and ranges recurse into their elements, keeping the chain of
+  containers being visited on the C stack.  A recursive array hashes to
+  a fixed value and compares equal to itself, and past HT_REC_MAX levels
+  hashing stops descending and comparison falls back to eql?.
+*/
+
+#define HT_KEY_STRING   1
+#define HT_KEY_SYMBOL   2
+#define HT_KEY_FIXNUM   4
+#define HT_KEY_FLOAT    8
+#define HT_KEY_ARRAY   16
+#define HT_KEY_RANGE   32
+
+#define HT_REC_MAX 64
+
+struct ht_rec {
+  struct ht_rec *prev;
+  mrb_value a, b;               /* the containers being visited */
+  int depth;
+};
+
+static mrb_bool
+ht_method_p(mrb_state *mrb, struct RClass *c, mrb_sym mid, mrb_func_t func)
+{
+  struct RProc *p = mrb_method_search_vm(mrb, &c, mid);
+
+  return p != NULL && MRB_PROC_CFUNC_P(p) && p->body.func == func;
+}
+
+/* whether instances of c of type tt use the built-in hash and eql? */
+static mrb_bool
+ht_class_builtin_p(mrb_state *mrb, struct RClass *c, enum mrb_vtype tt)
+{
+  if (c == NULL) return FALSE;
+  switch (tt) {
+  case MRB_TT_STRING:
+    return ht_method_p(mrb, c, MRB_SYM_Q(eql), mrb_str_eql);
+  case MRB_TT_FIXNUM:
+    return ht_method_p(mrb, c, MRB_SYM_Q(eql), mrb_num_eql);
+  case MRB_TT_SYMBOL:
+  case MRB_TT_FLOAT:
+    return ht_method_p(mrb, c, MRB_SYM_Q(eql), mrb_obj_equal_m);
+  case MRB_TT_ARRAY:
+    return ht_method_p(mrb, c, MRB_SYM(hash), mrb_ary_hash) &&
+      ht_method_p(mrb, c, MRB_SYM_Q(eql), mrb_ary_eql);
+  case MRB_TT_RANGE:
+    return ht_method_p(mrb, c, MRB_SYM(hash), mrb_range_hash) &&
+      ht_method_p(mrb, c, MRB_SYM_Q(eql), mrb_range_eql);
+  default:
+    return FALSE;
+  }
+}
+
+static uint32_t
+ht_builtin_keys(mrb_state *mrb)
+{
+  uint32_t b = 0;
+
+  if (mrb->hash_key_serial == mrb->method_serial) return mrb->hash_key_builtin;
+  if (ht_class_builtin_p(mrb, mrb->string_class, MRB_TT_STRING)) b |= HT_KEY_STRING;
+  if (ht_class_builtin_p(mrb, mrb->symbol_class, MRB_TT_SYMBOL)) b |= HT_KEY_SYMBOL;
+  if (ht_class_builtin_p(mrb, mrb->fixnum_class, MRB_TT_FIXNUM)) b |= HT_KEY_FIXNUM;
+  if (ht_class_builtin_p(mrb, mrb->float_class, MRB_TT_FLOAT)) b |= HT_KEY_FLOAT;
+  if (ht_class_builtin_p(mrb, mrb->array_class, MRB_TT_ARRAY)) b |= HT_KEY_ARRAY;
+  if (ht_class_builtin_p(mrb, mrb->range_class, MRB_TT_RANGE)) b |= HT_KEY_RANGE;
+  mrb->hash_key_builtin = b;
+  mrb->hash_key_serial = mrb->method_serial;
+  return b;
+}
+
+/* whether key can be hashed and compared natively */
+static mrb_bool
+ht_builtin_p(mrb_state *mrb, mrb_value key)
+{
+  struct RClass *c;
+  uint32_t bit;
+
+  switch (mrb_type(key)) {
+  case MRB_TT_SYMBOL:
+    return (ht_builtin_keys(mrb) & HT_KEY_SYMBOL) != 0;
+  case MRB_TT_FIXNUM:
+    return (ht_builtin_keys(mrb) & HT_KEY_FIXNUM) != 0;
+  case MRB_TT_FLOAT:
+    return (ht_builtin_keys(mrb) & HT_KEY_FLOAT) != 0;
+  case MRB_TT_STRING:
+    c = mrb->string_class; bit = HT_KEY_STRING;
+    break;
+  case MRB_TT_ARRAY:
+    c = mrb->array_class; bit = HT_KEY_ARRAY;
+    break;
+  case MRB_TT_RANGE:
+    c = mrb->range_class; bit = HT_KEY_RANGE;
+    break;
+  default:
+    return FALSE;
+  }
+  if (mrb_basic_ptr(key)->c == c) {
+    return (ht_builtin_keys(mrb) & bit) != 0;
+  }
+  return ht_class_builtin_p(mrb, mrb_basic_ptr(key)->c, mrb_type(key));
+}
+
+static inline uint32_t
+ht_mix(uint32_t h, uint32_t v)
+{
+  h = (h ^ v) * 0x9e3779b1;
+  return h ^ (h >> 16);
+}
+
+static uint32_t ht_hash(mrb_state *mrb, mrb_value key, struct ht_rec *rec);
+
+static uint32_t
+ht_hash_ary(mrb_state *mrb, mrb_value ary, struct ht_rec *rec)
+{
+  struct ht_rec r, *p;
+  uint32_t h = ht_mix(MRB_TT_ARRAY, (uint32_t)RARRAY_LEN(ary));
+  mrb_int i;
+
+  for (p = rec; p; p = p->prev) {
+    if (mrb_ptr(p->a) == mrb_ptr(ary)) return h;
+  }
+  if (rec && rec->depth >= HT_REC_MAX) return h;
+  r.prev = rec;
+  r.a = r.b = ary;
+  r.depth = rec ? rec->depth + 1 : 1;
+  /* the hash of an element may change the array */
+  for (i = 0; i < RARRAY_LEN(ary); i++) {
+    h = ht_mix(h, ht_hash(mrb, RARRAY_PTR(ary)[i], &r));
+  }
+  return h;
+}
+
+static uint32_t
+ht_hash_range(mrb_state *mrb, mrb_value range, struct ht_rec *rec)
+{
+  struct RRange *r = mrb_range_ptr(range);
+  uint32_t h = ht_mix(MRB_TT_RANGE, (uint32_t)r->excl);
+
+  h = ht_mix(h, ht_hash(mrb, r->edges->beg, rec));
+  return ht_mix(h, ht_hash(mrb, r->edges->end, rec));
+}
+
+static uint32_t
+ht_hash(mrb_state *mrb, mrb_value key, struct ht_rec *rec)
 {
   enum mrb_vtype t = mrb_type(key);
   mrb_value hv;
-  const char *p;
-  mrb_int i, len;
-  khint_t h;
+  mrb_sym sym;
+  mrb_float f;
 
   switch (t) {
   case MRB_TT_STRING:
-    p = RSTRING_PTR(key);
-    len = RSTRING_LEN(key);
-    break;
+    return (uint32_t)mrb_str_hash(mrb, key);
 
   case MRB_TT_SYMBOL:
-    p = mrb_sym2name_len(mrb, mrb_symbol(key), &len);
-    break;
+    sym = mrb_symbol(key);
+    return (uint32_t)mrb_str_hash_bytes(mrb, (const char*)&sym, sizeof(sym));
 
   case MRB_TT_FIXNUM:
-    return (khint_t)mrb_float_id((mrb_float)mrb_fixnum(key));
+    return (uint32_t)mrb_float_id((mrb_float)mrb_fixnum(key));
 
   case MRB_TT_FLOAT:
-    return (khint_t)mrb_float_id(mrb_float(key));
+    f = mrb_float(key);
+    /* -0.0 is eql? to 0.0; normalize it as Float#hash does */
+    if (f == 0) f = 0.0;
+    return (uint32_t)mrb_float_id(f);
+
+  case MRB_TT_ARRAY:
+    if (ht_builtin_p(mrb, key)) return ht_hash_ary(mrb, key, rec);
+    break;
+
+  case MRB_TT_RANGE:
+    if (ht_builtin_p(mrb, key)) return ht_hash_range(mrb, key, rec);
+    break;
 
   default:
-    hv = mrb_funcall(mrb, key, "hash", 0);
-    return (khint_t)t ^ mrb_fixnum(hv);
+    break;
   }
+  hv = mrb_funcall(mrb, key, "hash", 0);
+  return (uint32_t)t ^ (uint32_t)mrb_fixnum(hv);
+}
 
-  h = 0;
-  for (i=0; i<len; i++) {
-    h = (h << 5) - h + *p++;
+static mrb_bool ht_eql(mrb_state *mrb, mrb_value a, mrb_value b, struct ht_rec *rec);
+
+static mrb_bool
+ht_eql_ary(mrb_state *mrb, mrb_value a, mrb_value b, struct ht_rec *rec)
+{
+  struct ht_rec r, *p;
+  mrb_int i;
+
+  if (!mrb_array_p(b)) return FALSE;
+  if (RARRAY_LEN(a) != RARRAY_LEN(b)) return FALSE;
+  for (p = rec; p; p = p->prev) {
+    if (mrb_ptr(p->a) == mrb_ptr(a) && mrb_ptr(p->b) == mrb_ptr(b)) return TRUE;
   }
-  return h;
+  if (rec && rec->depth >= HT_REC_MAX) {
+    return mrb_test(mrb_funcall(mrb, a, "eql?", 1, b));
+  }
+  r.prev = rec;
+  r.a = a;
+  r.b = b;
+  r.depth = rec ? rec->depth + 1 : 1;
+  for (i = 0; i < RARRAY_LEN(a); i++) {
+    /* eql? of an element may have shrunk b */
+    if (i >= RARRAY_LEN(b)) return FALSE;
+    if (!ht_eql(mrb, RARRAY_PTR(a)[i], RARRAY_PTR(b)[i], &r)) return FALSE;
+  }
+  return TRUE;
 }
 
-static inline khint_t
+static mrb_bool
+ht_eql_range(mrb_state *mrb, mrb_value a, mrb_value b, struct ht_rec *rec)
+{
+  struct RRange *ra, *rb;
+
+  if (mrb_type(b) != MRB_TT_RANGE) return FALSE;
+  ra = mrb_range_ptr(a);
+  rb = mrb_range_ptr(b);
+  if (ra->excl != rb->excl) return FALSE;
+  return ht_eql(mrb, ra->edges->beg, rb->edges->beg, rec) &&
+    ht_eql(mrb, ra->edges->end, rb->edges->end, rec);
+}
+
+/* a.eql?(b) */
+static mrb_bool
+ht_eql(mrb_state *mrb, mrb_value a, mrb_value b, struct ht_rec *rec)
+{
+  if (mrb_obj_eq(mrb, a, b)) return TRUE;
+  if (ht_builtin_p(mrb, a)) {
+    switch (mrb_type(a)) {
+    case MRB_TT_STRING:
+      return mrb_string_p(b) && mrb_str_equal(mrb, a, b);
+    case MRB_TT_ARRAY:
+      return ht_eql_ary(mrb, a, b, rec);
+    case MRB_TT_RANGE:
+      return ht_eql_range(mrb, a, b, rec);
+    default:
+      /* Symbol, Fixnum and Float are eql? only when identical */
+      return FALSE;
+    }
+  }
+  return mrb_test(mrb_funcall(mrb, a, "eql?", 1, b));
+}
+
+static inline uint32_t
+mrb_hash_ht_hash_func(mrb_state *mrb, mrb_value key)
+{
+  return ht_hash(mrb, key, NULL);
+}
+
+static inline mrb_bool
 mrb_hash_ht_hash_equal(mrb_state *mrb, mrb_value a, mrb_value b)
 {
-  return mrb_eql(mrb, a, b);
+  return ht_eql(mrb, a, b, NULL);
+}
+
+/* hash codes of Array#hash and Range#hash, the same a key gets here */
+mrb_int
+mrb_hash_code(mrb_state *mrb, mrb_value obj)
+{
+  if (mrb_array_p(obj)) return (mrb_int)ht_hash_ary(mrb, obj, NULL);
+  return (mrb_int)ht_hash_range(mrb, obj, NULL);
+}
+
+/*
+  = Hash table
+
+  A Hash keeps its pairs in insertion order in a dense array of entries,
+  as CPython's dict and CRuby's st_table do.  Lookups go through a
+  separate open addressing index whose slots hold entry numbers + 1 (0
+  for an empty slot) in 1, 2 or 4 bytes depending on its size, so an
+  index slot costs a byte or two instead of a whole key/value bucket, and
+  iteration is a linear scan of the entries.
+
+  The index has 2^bits slots and the entries array room for 2/3 of that
+  (HT_USABLE), which keeps at least a third of the slots empty and every
+  probe sequence short.  Both live in a single allocation, the index
+  first.  Deleting a pair turns its entry into a hole (an undef key)
+  that the index keeps pointing at, so probe chains stay intact; holes
+  are squeezed out when the entries array fills up and the table is
+  rebuilt.  Each entry records the hash of its key, so rebuilding never
+  calls back into Ruby.
+
+  Most hashes are small (option hashes, keyword arguments, records
+  parsed from JSON or HTTP headers), so a table of up to HT_SMALL_MAX
+  pairs has no index at all and is searched by a linear scan of its
+  entries.  Keys that are immediates (Fixnum, Symbol, true, false and
+  nil) are then compared directly, without hashing them.  The table gets
+  an index when it grows past HT_SMALL_MAX pairs.
+
+  The GC sees the entries as the hash's slots: mrb_hash_set() reports the
+  entry it wrote with mrb_write_barrier_slots(), and a rebuild, which
+  renumbers entries, with mrb_write_barrier().
+*/
+
+#define HT_MIN_BITS 4
+#define HT_SMALL_MAX 8          /* most pairs kept without an index */
+#define HT_USABLE(bits) (((uint32_t)1 << (bits)) * 2 / 3)
+
+typedef struct hash_entry {
+  mrb_value key;                /* undef for a deleted pair */
+  mrb_value val;
+  uint32_t hash;
+} hash_entry;
+
+typedef struct htable {
+  uint32_t size;                /* live pairs */
+  uint32_t n_ents;              /* entries used, live or deleted */
+  uint32_t first;               /* no live entry before this one */
+  uint32_t capa;                /* entries allocated */
+  uint32_t bits;                /* log2 of index slots; 0 for no index */
+  uint32_t gen;                 /* changed whenever the entries move */
+  void *index;                  /* start of the allocation, or NULL */
+  hash_entry *ents;
+} htable;
+
+static inline size_t
+ht_index_bytes(uint32_t bits)
+{
+  size_t width = bits <= 8 ? 1 : bits <= 16 ? 2 : 4;
+  size_t bytes = ((size_t)1 << bits) * width;
+
+  if (bits == 0) return 0;
+  /* align the entries that follow */
+  return (bytes + sizeof(mrb_value) - 1) & ~(sizeof(mrb_value) - 1);
+}
+
+static inline uint32_t
+ht_index_get(const htable *t, uint32_t i)
+{
+  if (t->bits <= 8) return ((const uint8_t*)t->index)[i];
+  if (t->bits <= 16) return ((const uint16_t*)t->index)[i];
+  return ((const uint32_t*)t->index)[i];
+}
+
+/* stores entry number n in the first empty slot for hash */
+static inline void
+ht_index_add(htable *t, uint32_t hash, uint32_t n)
+{
+  uint32_t mask = ((uint32_t)1 << t->bits) - 1;
+  uint32_t i = hash & mask;
+  uint32_t step = 0;
+
+  while (ht_index_get(t, i) != 0) {
+    i = (i + ++step) & mask;
+  }
+  if (t->bits <= 8) ((uint8_t*)t->index)[i] = (uint8_t)(n + 1);
+  else if (t->bits <= 16) ((uint16_t*)t->index)[i] = (uint16_t)(n + 1);
+  else ((uint32_t*)t->index)[i] = n + 1;
+}
+
+static htable*
+ht_new(mrb_state *mrb)
+{
+  return (htable*)mrb_calloc(mrb, 1, sizeof(htable));
+}
+
+/* moves the live entries, in order, to a new allocation of capa entries
+   and, unless bits is 0, an index of 2^bits slots */
+static void
+ht_rebuild(mrb_state *mrb, htable *t, uint32_t bits, uint32_t capa)
+{
+  size_t ibytes = ht_index_bytes(bits);
+  void *block = mrb_malloc(mrb, ibytes + sizeof(hash_entry) * capa);
+  hash_entry *ents = (hash_entry*)((char*)block + ibytes);
+  uint32_t i, n = 0;
+
+  memset(block, 0, ibytes);
+  for (i = t->first; i < t->n_ents; i++) {
+    if (!mrb_undef_p(t->ents[i].key)) {
+      ents[n++] = t->ents[i];
+    }
+  }
+  mrb_free(mrb, t->index);
+  t->index = block;
+  t->ents = ents;
+  t->capa = capa;
+  t->bits = bits;
+  t->n_ents = n;
+  t->first = 0;
+  t->gen++;
+  if (bits > 0) {
+    for (i = 0; i < n; i++) {
+      ht_index_add(t, ents[i].hash, i);
+    }
+  }
+}
+
+/* a table for capa pairs, small if it fits */
+static void
+ht_init(mrb_state *mrb, htable *t, uint32_t capa)
+{
+  uint32_t bits = HT_MIN_BITS;
+
+  if (capa <= HT_SMALL_MAX) {
+    ht_rebuild(mrb, t, 0, capa);
+    return;
+  }
+  while (HT_USABLE(bits) < capa) bits++;
+  ht_rebuild(mrb, t, bits, HT_USABLE(bits));
 }
 
-KHASH_DECLARE(ht, mrb_value, mrb_value, 1)
-KHASH_DEFINE (ht, mrb_value, mrb_value, 1, mrb_hash_ht_hash_func, mrb_hash_ht_hash_equal)
+/* makes room for one more entry; returns TRUE if entries were renumbered */
+static mrb_bool
+ht_reserve(mrb_state *mrb, htable *t)
+{
+  uint32_t bits = HT_MIN_BITS;
+
+  if (t->n_ents < t->capa) return FALSE;
+  if (t->bits == 0 && t->n_ents == t->size && t->capa < HT_SMALL_MAX) {
+    /* a small table without holes just gets longer */
+    uint32_t capa = t->capa < 2 ? 4 : t->capa * 2;
+
+    if (capa > HT_SMALL_MAX) capa = HT_SMALL_MAX;
+    t->index = mrb_realloc(mrb, t->index, sizeof(hash_entry) * capa);
+    t->ents = (hash_entry*)t->index;
+    t->capa = capa;
+    t->gen++;
+    return FALSE;
+  }
+  if (t->size < HT_SMALL_MAX) {
+    ht_rebuild(mrb, t, 0, t->bits > 0 ? HT_SMALL_MAX : t->capa);
+    return TRUE;
+  }
+  /* grow when more than half the entries are live, else just compact */
+  while (HT_USABLE(bits) < t->size * 2 + 1) bits++;
+  ht_rebuild(mrb, t, bits, HT_USABLE(bits));
+  return TRUE;
+}
 
-static void mrb_hash_modify(mrb_state *mrb, mrb_value hash);
+/* appends a pair known not to be in t, which has room for it; returns
+   its entry number */
+static uint32_t
+ht_add(htable *t, mrb_value key, mrb_value val, uint32_t hash)
+{
+  uint32_t n = t->n_ents++;
+  hash_entry *e = &t->ents[n];
+
+  e->key = key;
+  e->val = val;
+  e->hash = hash;
+  if (t->bits > 0) ht_index_add(t, hash, n);
+  t->size++;
+  return n;
+}
+
+static inline mrb_bool
+ht_immediate_p(mrb_value key)
+{
+  switch (mrb_type(key)) {
+  case MRB_TT_FALSE:
+  case MRB_TT_TRUE:
+  case MRB_TT_FIXNUM:
+  case MRB_TT_SYMBOL:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+/* whether a is eql? to key, an immediate */
+static inline mrb_bool
+ht_immediate_eq(mrb_value a, mrb_value key)
+{
+  if (mrb_type(a) != mrb_type(key)) return FALSE;
+  switch (mrb_type(key)) {
+  case MRB_TT_FIXNUM:
+    return mrb_fixnum(a) == mrb_fixnum(key);
+  case MRB_TT_SYMBOL:
+    return mrb_symbol(a) == mrb_symbol(key);
+  case MRB_TT_FALSE:
+    return mrb_nil_p(a) == mrb_nil_p(key);
+  default:
+    return TRUE;
+  }
+}
+
+/* the entry number of key, or -1.  When key is not found and hashp is
+   given, the hash of key is stored there for ht_add(). */
+static mrb_int
+ht_lookup(mrb_state *mrb, htable *t, mrb_value key, uint32_t *hashp)
+{
+  uint32_t hash, mask, i, step, ix, gen;
+
+  if (t->bits == 0 && ht_immediate_p(key)) {
+    for (i = t->first; i < t->n_ents; i++) {
+      if (ht_immediate_eq(t->ents[i].key, key)) return i;
+    }
+    if (hashp) *hashp = mrb_hash_ht_hash_func(mrb, key);
+    return -1;
+  }
+
+  hash = mrb_hash_ht_hash_func(mrb, key);
+  if (hashp) *hashp = hash;
+ retry:
+  gen = t->gen;
+  if (t->bits == 0) {
+    for (i = t->first; i < t->n_ents; i++) {
+      hash_entry *e = &t->ents[i];
+      mrb_bool eq;
+
+      if (e->hash != hash || mrb_undef_p(e->key)) continue;
+      eq = mrb_hash_ht_hash_equal(mrb, e->key, key);
+      /* eql? may have changed the table */
+      if (t->gen != gen) goto retry;
+      if (eq) return i;
+    }
+    return -1;
+  }
+  mask = ((uint32_t)1 << t->bits) - 1;
+  for (i = hash & mask, step = 0; (ix = ht_index_get(t, i)) != 0; i = (i + ++step) & mask) {
+    hash_entry *e = &t->ents[ix - 1];
+    mrb_bool eq;
+
+    if (e->hash != hash || mrb_undef_p(e->key)) continue;
+    eq = mrb_hash_ht_hash_equal(mrb, e->key, key);
+    if (t->gen != gen) goto retry;
+    if (eq) return ix - 1;
+  }
+  return -1;
+}
+
+static void
+ht_delete_at(htable *t, uint32_t n)
+{
+  t->ents[n].key = mrb_undef_value();
+  t->ents[n].val = mrb_nil_value();
+  t->size--;
+  if (t->size == 0) {
+    /* start over, keeping the allocation */
+    memset(t->index, 0, ht_index_bytes(t->bits));
+    t->n_ents = t->first = 0;
+  }
+  else if (n == t->first) {
+    while (mrb_undef_p(t->ents[t->first].key)) t->first++;
+  }
+}
+
+static void
+ht_clear(mrb_state *mrb, htable *t)
+{
+  mrb_free(mrb, t->index);
+  t->index = NULL;
+  t->ents = NULL;
+  t->size = t->n_ents = t->first = t->capa = t->bits = 0;
+  t->gen++;
+}
+
+/* makes dst, an empty table, a copy of src */
+static void
+ht_copy(mrb_state *mrb, htable *dst, const htable *src)
+{
+  size_t ibytes = ht_index_bytes(src->bits);
+  size_t bytes = ibytes + sizeof(hash_entry) * src->capa;
+
+  dst->index = mrb_malloc(mrb, bytes);
+  memcpy(dst->index, src->index, bytes);
+  dst->ents = (hash_entry*)((char*)dst->index + ibytes);
+  dst->size = src->size;
+  dst->n_ents = src->n_ents;
+  dst->first = src->first;
+  dst->capa = src->capa;
+  dst->bits = src->bits;
+}
 
 static inline mrb_value
 mrb_hash_ht_key(mrb_state *mrb, mrb_value key)
 {
+  /* string keys are the VM's deduplicated frozen strings, so a key
+     already in some hash is not copied again */
   if (mrb_string_p(key))
-    return mrb_str_dup(mrb, key);
+    return mrb_str_fstring(mrb, key);
   else
     return key;
 }
 
 #define KEY(key) mrb_hash_ht_key(mrb, key)
 
+/*
+ * Calls func for each pair of hash in order until it returns non-zero.
+ * func must not modify hash.
+ */
+void
+mrb_hash_foreach(mrb_state *mrb, struct RHash *hash, mrb_hash_foreach_func *func, void *p)
+{
+  htable *t = hash->ht;
+  uint32_t i;
+
+  if (!t) return;
+  for (i = t->first; i < t->n_ents; i++) {
+    if (mrb_undef_p(t->ents[i].key)) continue;
+    if ((*func)(mrb, t->ents[i].key, t->ents[i].val, p) != 0) return;
+  }
+}
+
 void
 mrb_gc_mark_hash(mrb_state *mrb, struct RHash *hash)
 {
-  khiter_t k;
-  khash_t(ht) *h = hash->ht;
+  htable *t = hash->ht;
+  uint32_t i;
 
-  if (!h) return;
-  for (k = kh_begin(h); k != kh_end(h); k++) {
-    if (kh_exist(h, k)) {
-      mrb_value key = kh_key(h, k);
-      mrb_value val = kh_value(h, k);
+  if (!t) return;
+  for (i = t->first; i < t->n_ents; i++) {
+    mrb_gc_mark_value(mrb, t->ents[i].key);
+    mrb_gc_mark_value(mrb, t->ents[i].val);
+  }
+}
 
-      mrb_gc_mark_value(mrb, key);
-      mrb_gc_mark_value(mrb, val);
-    }
+void
+mrb_gc_mark_hash_slots(mrb_state *mrb, struct RHash *hash, size_t from, size_t to)
+{
+  htable *t = hash->ht;
+  size_t i;
+
+  if (!t) return;
+  if (to > t->n_ents) to = t->n_ents;
+  for (i = from; i < to; i++) {
+    mrb_gc_mark_value(mrb, t->ents[i].key);
+    mrb_gc_mark_value(mrb, t->ents[i].val);
   }
 }
 
+size_t
+mrb_gc_hash_slots(mrb_state *mrb, struct RHash *hash)
+{
+  if (!hash->ht) return 0;
+  return hash->ht->n_ents;
+}
+
+size_t
+mrb_gc_hash_bytes(mrb_state *mrb, struct RHash *hash)
+{
+  htable *t = hash->ht;
+
+  if (!t) return 0;
+  return sizeof(htable) + ht_index_bytes(t->bits) + sizeof(hash_entry) * t->capa;
+}
+
 size_t
 mrb_gc_mark_hash_size(mrb_state *mrb, struct RHash *hash)
 {
   if (!hash->ht) return 0;
-  return kh_size(hash->ht)*2;
+  return hash->ht->size*2;
 }
 
 void
 mrb_gc_free_hash(mrb_state *mrb, struct RHash *hash)
 {
-  if (hash->ht) kh_destroy(ht, mrb, hash->ht);
+  if (hash->ht) {
+    mrb_free(mrb, hash->ht->index);
+    mrb_free(mrb, hash->ht);
+  }
 }
 
 
@@ -112,11 +701,12 @@ mrb_hash_new_capa(mrb_state *mrb, int capa)
   struct RHash *h;
 
   h = (struct RHash*)mrb_obj_alloc(mrb, MRB_TT_HASH, mrb->hash_class);
-  h->ht = kh_init(ht, mrb);
+  h->ht = NULL;
+  h->iv = 0;
   if (capa > 0) {
-    kh_resize(ht, mrb, h->ht, capa);
+    h->ht = ht_new(mrb);
+    ht_init(mrb, h->ht, capa);
   }
-  h->iv = 0;
   return mrb_obj_value(h);
 }
 
@@ -129,13 +719,13 @@ mrb_hash_new(mrb_state *mrb)
 mrb_value
 mrb_hash_get(mrb_state *mrb, mrb_value hash, mrb_value key)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  htable *t = RHASH_TBL(hash);
+  mrb_int n;
 
-  if (h) {
-    k = kh_get(ht, mrb, h, key);
-    if (k != kh_end(h))
-      return kh_value(h, k);
+  if (t && t->size > 0) {
+    n = ht_lookup(mrb, t, key, NULL);
+    if (n >= 0)
+      return t->ents[n].val;
   }
 
   /* not found */
@@ -148,13 +738,13 @@ mrb_hash_get(mrb_state *mrb, mrb_value hash, mrb_value key)
 mrb_value
 mrb_hash_fetch(mrb_state *mrb, mrb_value hash, mrb_value key, mrb_value def)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  htable *t = RHASH_TBL(hash);
+  mrb_int n;
 
-  if (h) {
-    k = kh_get(ht, mrb, h, key);
-    if (k != kh_end(h))
-      return kh_value(h, k);
+  if (t && t->size > 0) {
+    n = ht_lookup(mrb, t, key, NULL);
+    if (n >= 0)
+      return t->ents[n].val;
   }
 
   /* not found */
@@ -164,48 +754,42 @@ mrb_hash_fetch(mrb_state *mrb, mrb_value hash, mrb_value key, mrb_value def)
 void
 mrb_hash_set(mrb_state *mrb, mrb_value hash, mrb_value key, mrb_value val)
 {
-  khash_t(ht) *h;
-  khiter_t k;
+  htable *t = mrb_hash_tbl(mrb, hash);
+  uint32_t h;
+  mrb_int n = ht_lookup(mrb, t, key, &h);
 
-  mrb_hash_modify(mrb, hash);
-  h = RHASH_TBL(hash);
-
-  if (!h) h = RHASH_TBL(hash) = kh_init(ht, mrb);
-  k = kh_get(ht, mrb, h, key);
-  if (k == kh_end(h)) {
-    /* expand */
+  if (n >= 0) {
+    t->ents[n].val = val;
+  }
+  else {
     int ai = mrb_gc_arena_save(mrb);
-    k = kh_put(ht, mrb, h, KEY(key));
+    mrb_bool moved;
+
+    key = KEY(key);
+    moved = ht_reserve(mrb, t);
+    n = ht_add(t, key, val, h);
     mrb_gc_arena_restore(mrb, ai);
+    if (moved) {
+      /* rebuilt; every entry may have been renumbered */
+      mrb_write_barrier(mrb, (struct RBasic*)RHASH(hash));
+      return;
+    }
   }
-
-  kh_value(h, k) = val;
-  mrb_write_barrier(mrb, (struct RBasic*)RHASH(hash));
-  return;
+  mrb_write_barrier_slots(mrb, (struct RBasic*)RHASH(hash), n, 1);
 }
 
 static mrb_value
 mrb_hash_dup(mrb_state *mrb, mrb_value hash)
 {
   struct RHash* ret;
-  khash_t(ht) *h, *ret_h;
-  khiter_t k, ret_k;
+  htable *t = RHASH_TBL(hash);
 
-  h = RHASH_TBL(hash);
   ret = (struct RHash*)mrb_obj_alloc(mrb, MRB_TT_HASH, mrb->hash_class);
-  ret->ht = kh_init(ht, mrb);
-
-  if (kh_size(h) > 0) {
-    ret_h = ret->ht;
-
-    for (k = kh_begin(h); k != kh_end(h); k++) {
-      if (kh_exist(h,k)) {
-        int ai = mrb_gc_arena_save(mrb);
-        ret_k = kh_put(ht, mrb, ret_h, KEY(kh_key(h,k)));
-        mrb_gc_arena_restore(mrb, ai);
-        kh_val(ret_h, ret_k) = kh_val(h,k);
-      }
-    }
+  ret->ht = NULL;
+  if (t && t->size > 0) {
+    /* keys are already the ones KEY() gives */
+    ret->ht = ht_new(mrb);
+    ht_copy(mrb, ret->ht, t);
   }
 
   return mrb_obj_value(ret);
@@ -217,21 +801,15 @@ mrb_check_hash_type(mrb_state *mrb, mrb_value hash)
   return mrb_check_convert_type(mrb, hash, MRB_TT_HASH, "Hash", "to_hash");
 }
 
-khash_t(ht) *
+struct htable *
 mrb_hash_tbl(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
+  htable *t = RHASH_TBL(hash);
 
-  if (!h) {
-    RHASH_TBL(hash) = kh_init(ht, mrb);
+  if (!t) {
+    t = RHASH_TBL(hash) = ht_new(mrb);
   }
-  return h;
-}
-
-static void
-mrb_hash_modify(mrb_state *mrb, mrb_value hash)
-{
-  mrb_hash_tbl(mrb, hash);
+  return t;
 }
 
 /* 15.2.13.4.16 */
@@ -278,7 +856,6 @@ mrb_hash_init_core(mrb_state *mrb, mrb_value hash)
   int argc;
 
   mrb_get_args(mrb, "o*", &block, &argv, &argc);
-  mrb_hash_modify(mrb, hash);
   if (mrb_nil_p(block)) {
     if (argc > 0) {
       if (argc != 1) mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments");
@@ -295,7 +872,7 @@ mrb_hash_init_core(mrb_state *mrb, mrb_value hash)
     RHASH(hash)->flags |= MRB_HASH_PROC_DEFAULT;
     ifnone = block;
   }
-  mrb_iv_set(mrb, hash, mrb_intern_lit(mrb, "ifnone"), ifnone);
+  mrb_iv_set(mrb, hash, MRB_SYM(ifnone), ifnone);
   return hash;
 }
 
@@ -395,8 +972,7 @@ mrb_hash_set_default(mrb_state *mrb, mrb_value hash)
   mrb_value ifnone;
 
   mrb_get_args(mrb, "o", &ifnone);
-  mrb_hash_modify(mrb, hash);
-  mrb_iv_set(mrb, hash, mrb_intern_lit(mrb, "ifnone"), ifnone);
+  mrb_iv_set(mrb, hash, MRB_SYM(ifnone), ifnone);
   RHASH(hash)->flags &= ~(MRB_HASH_PROC_DEFAULT);
 
   return ifnone;
@@ -446,8 +1022,7 @@ mrb_hash_set_default_proc(mrb_state *mrb, mrb_value hash)
   mrb_value ifnone;
 
   mrb_get_args(mrb, "o", &ifnone);
-  mrb_hash_modify(mrb, hash);
-  mrb_iv_set(mrb, hash, mrb_intern_lit(mrb, "ifnone"), ifnone);
+  mrb_iv_set(mrb, hash, MRB_SYM(ifnone), ifnone);
   RHASH(hash)->flags |= MRB_HASH_PROC_DEFAULT;
 
   return ifnone;
@@ -456,15 +1031,15 @@ mrb_hash_set_default_proc(mrb_state *mrb, mrb_value hash)
 mrb_value
 mrb_hash_delete_key(mrb_state *mrb, mrb_value hash, mrb_value key)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  htable *t = RHASH_TBL(hash);
+  mrb_int n;
   mrb_value delVal;
 
-  if (h) {
-    k = kh_get(ht, mrb, h, key);
-    if (k != kh_end(h)) {
-      delVal = kh_value(h, k);
-      kh_del(ht, mrb, h, k);
+  if (t && t->size > 0) {
+    n = ht_lookup(mrb, t, key, NULL);
+    if (n >= 0) {
+      delVal = t->ents[n].val;
+      ht_delete_at(t, n);
       return delVal;
     }
   }
@@ -517,24 +1092,16 @@ mrb_hash_delete(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_hash_shift(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  htable *t = RHASH_TBL(hash);
   mrb_value delKey, delVal;
 
-  mrb_hash_modify(mrb, hash);
-  if (h) {
-    if (kh_size(h) > 0) {
-      for (k = kh_begin(h); k != kh_end(h); k++) {
-        if (!kh_exist(h,k)) continue;
-
-        delKey = kh_key(h,k);
-        mrb_gc_protect(mrb, delKey);
-        delVal = mrb_hash_delete_key(mrb, hash, delKey);
-        mrb_gc_protect(mrb, delVal);
-
-        return mrb_assoc_new(mrb, delKey, delVal);
-      }
-    }
+  if (t && t->size > 0) {
+    delKey = t->ents[t->first].key;
+    delVal = t->ents[t->first].val;
+    ht_delete_at(t, t->first);
+    mrb_gc_protect(mrb, delKey);
+    mrb_gc_protect(mrb, delVal);
+    return mrb_assoc_new(mrb, delKey, delVal);
   }
 
   if (MRB_RHASH_PROCDEFAULT_P(hash)) {
@@ -560,9 +1127,9 @@ mrb_hash_shift(mrb_state *mrb, mrb_value hash)
 mrb_value
 mrb_hash_clear(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
+  htable *t = RHASH_TBL(hash);
 
-  if (h) kh_clear(ht, mrb, h);
+  if (t) ht_clear(mrb, t);
   return hash;
 }
 
@@ -613,20 +1180,22 @@ static mrb_value
 mrb_hash_replace(mrb_state *mrb, mrb_value hash)
 {
   mrb_value hash2, ifnone;
-  khash_t(ht) *h2;
-  khiter_t k;
+  uint32_t i;
 
   mrb_get_args(mrb, "o", &hash2);
   hash2 = to_hash(mrb, hash2);
   if (mrb_obj_equal(mrb, hash, hash2)) return hash;
   mrb_hash_clear(mrb, hash);
 
-  h2 = RHASH_TBL(hash2);
-  if (h2) {
+  if (RHASH_TBL(hash2)) {
     int hi = mrb_gc_arena_save(mrb);
-    for (k = kh_begin(h2); k != kh_end(h2); k++) {
-      if (kh_exist(h2, k))
-        mrb_hash_set(mrb, hash, kh_key(h2, k), kh_value(h2, k));
+
+    /* the table is fetched again after each call, which may change it */
+    for (i = RHASH_TBL(hash2)->first; i < RHASH_TBL(hash2)->n_ents; i++) {
+      hash_entry *e = &RHASH_TBL(hash2)->ents[i];
+
+      if (!mrb_undef_p(e->key))
+        mrb_hash_set(mrb, hash, e->key, e->val);
       mrb_gc_arena_restore(mrb, hi);
     }
   }
@@ -638,7 +1207,7 @@ mrb_hash_replace(mrb_state *mrb, mrb_value hash)
   else {
     ifnone = RHASH_IFNONE(hash2);
   }
-  mrb_iv_set(mrb, hash, mrb_intern_lit(mrb, "ifnone"), ifnone);
+  mrb_iv_set(mrb, hash, MRB_SYM(ifnone), ifnone);
 
   return hash;
 }
@@ -660,10 +1229,10 @@ mrb_hash_replace(mrb_state *mrb, mrb_value hash)
 static mrb_value
 mrb_hash_size_m(mrb_state *mrb, mrb_value self)
 {
-  khash_t(ht) *h = RHASH_TBL(self);
+  htable *t = RHASH_TBL(self);
 
-  if (!h) return mrb_fixnum_value(0);
-  return mrb_fixnum_value(kh_size(h));
+  if (!t) return mrb_fixnum_value(0);
+  return mrb_fixnum_value(t->size);
 }
 
 /* 15.2.13.4.12 */
@@ -679,9 +1248,9 @@ mrb_hash_size_m(mrb_state *mrb, mrb_value self)
 mrb_value
 mrb_hash_empty_p(mrb_state *mrb, mrb_value self)
 {
-  khash_t(ht) *h = RHASH_TBL(self);
+  htable *t = RHASH_TBL(self);
 
-  if (h) return mrb_bool_value(kh_size(h) == 0);
+  if (t) return mrb_bool_value(t->size == 0);
   return mrb_true_value();
 }
 
@@ -689,30 +1258,32 @@ static mrb_value
 inspect_hash(mrb_state *mrb, mrb_value hash, int recur)
 {
   mrb_value str, str2;
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  htable *t = RHASH_TBL(hash);
+  uint32_t i;
 
   if (recur) return mrb_str_new_lit(mrb, "{...}");
 
   str = mrb_str_new_lit(mrb, "{");
-  if (h && kh_size(h) > 0) {
-    for (k = kh_begin(h); k != kh_end(h); k++) {
-      int ai;
+  /* inspect may change the table, so its fields are read each time */
+  for (i = t ? t->first : 0; t && i < t->n_ents; i++) {
+    mrb_value key = t->ents[i].key;
+    mrb_value val = t->ents[i].val;
+    int ai;
 
-      if (!kh_exist(h,k)) continue;
+    if (mrb_undef_p(key)) continue;
 
-      ai = mrb_gc_arena_save(mrb);
+    ai = mrb_gc_arena_save(mrb);
 
-      if (RSTRING_LEN(str) > 1) mrb_str_cat_lit(mrb, str, ", ");
+    if (RSTRING_LEN(str) > 1) mrb_str_cat_lit(mrb, str, ", ");
 
-      str2 = mrb_inspect(mrb, kh_key(h,k));
-      mrb_str_append(mrb, str, str2);
-      mrb_str_cat_lit(mrb, str, "=>");
-      str2 = mrb_inspect(mrb, kh_value(h,k));
-      mrb_str_append(mrb, str, str2);
+    mrb_gc_protect(mrb, val);
+    str2 = mrb_inspect(mrb, key);
+    mrb_str_append(mrb, str, str2);
+    mrb_str_cat_lit(mrb, str, "=>");
+    str2 = mrb_inspect(mrb, val);
+    mrb_str_append(mrb, str, str2);
 
-      mrb_gc_arena_restore(mrb, ai);
-    }
+    mrb_gc_arena_restore(mrb, ai);
   }
   mrb_str_cat_lit(mrb, str, "}");
 
@@ -734,9 +1305,9 @@ inspect_hash(mrb_state *mrb, mrb_value hash, int recur)
 static mrb_value
 mrb_hash_inspect(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
+  htable *t = RHASH_TBL(hash);
 
-  if (!h || kh_size(h) == 0)
+  if (!t || t->size == 0)
     return mrb_str_new_lit(mrb, "{}");
   return inspect_hash(mrb, hash, 0);
 }
@@ -755,6 +1326,25 @@ mrb_hash_to_hash(mrb_state *mrb, mrb_value hash)
     return hash;
 }
 
+static mrb_value
+hash_entries_to_ary(mrb_state *mrb, mrb_value hash, mrb_bool keys)
+{
+  htable *t = RHASH_TBL(hash);
+  mrb_value ary;
+  struct RArray *a;
+  uint32_t i;
+
+  if (!t || t->size == 0) return mrb_ary_new(mrb);
+  ary = mrb_ary_new_capa(mrb, t->size);
+  a = mrb_ary_ptr(ary);
+  for (i = t->first; i < t->n_ents; i++) {
+    if (!mrb_undef_p(t->ents[i].key)) {
+      a->ptr[a->len++] = keys ? t->ents[i].key : t->ents[i].val;
+    }
+  }
+  return ary;
+}
+
 /* 15.2.13.4.19 */
 /*
  *  call-seq:
@@ -771,19 +1361,7 @@ mrb_hash_to_hash(mrb_state *mrb, mrb_value hash)
 mrb_value
 mrb_hash_keys(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
-  mrb_value ary;
-
-  if (!h) return mrb_ary_new(mrb);
-  ary = mrb_ary_new_capa(mrb, kh_size(h));
-  for (k = kh_begin(h); k != kh_end(h); k++) {
-    if (kh_exist(h, k)) {
-      mrb_value v = kh_key(h,k);
-      mrb_ary_push(mrb, ary, v);
-    }
-  }
-  return ary;
+  return hash_entries_to_ary(mrb, hash, TRUE);
 }
 
 /* 15.2.13.4.28 */
@@ -802,30 +1380,16 @@ mrb_hash_keys(mrb_state *mrb, mrb_value hash)
 static mrb_value
 mrb_hash_values(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
-  mrb_value ary;
-
-  if (!h) return mrb_ary_new(mrb);
-  ary = mrb_ary_new_capa(mrb, kh_size(h));
-  for (k = kh_begin(h); k != kh_end(h); k++) {
-    if (kh_exist(h, k)){
-      mrb_value v = kh_value(h,k);
-      mrb_ary_push(mrb, ary, v);
-    }
-  }
-  return ary;
+  return hash_entries_to_ary(mrb, hash, FALSE);
 }
 
 static mrb_value
 mrb_hash_has_keyWithKey(mrb_state *mrb, mrb_value hash, mrb_value key)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  htable *t = RHASH_TBL(hash);
 
-  if (h) {
-    k = kh_get(ht, mrb, h, key);
-    return mrb_bool_value(k != kh_end(h));
+  if (t && t->size > 0) {
+    return mrb_bool_value(ht_lookup(mrb, t, key, NULL) >= 0);
   }
   return mrb_false_value();
 }
@@ -861,16 +1425,15 @@ mrb_hash_has_key(mrb_state *mrb, mrb_value hash)
 static mrb_value
 mrb_hash_has_valueWithvalue(mrb_state *mrb, mrb_value hash, mrb_value value)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  htable *t = RHASH_TBL(hash);
+  uint32_t i;
 
-  if (h) {
-    for (k = kh_begin(h); k != kh_end(h); k++) {
-      if (!kh_exist(h, k)) continue;
+  /* == may change the table, so its fields are read each time */
+  for (i = t ? t->first : 0; t && i < t->n_ents; i++) {
+    if (mrb_undef_p(t->ents[i].key)) continue;
 
-      if (mrb_equal(mrb, kh_value(h,k), value)) {
-        return mrb_true_value();
-      }
+    if (mrb_equal(mrb, t->ents[i].val, value)) {
+      return mrb_true_value();
     }
   }
 
@@ -904,12 +1467,12 @@ mrb_hash_has_value(mrb_state *mrb, mrb_value hash)
 static mrb_value
 hash_equal(mrb_state *mrb, mrb_value hash1, mrb_value hash2, mrb_bool eql)
 {
-  khash_t(ht) *h1, *h2;
+  htable *t1, *t2;
   mrb_bool eq;
 
   if (mrb_obj_equal(mrb, hash1, hash2)) return mrb_true_value();
   if (!mrb_hash_p(hash2)) {
-      if (!mrb_respond_to(mrb, hash2, mrb_intern_lit(mrb, "to_hash"))) {
+      if (!mrb_respond_to(mrb, hash2, MRB_SYM(to_hash))) {
           return mrb_false_value();
       }
       else {
@@ -922,26 +1485,28 @@ hash_equal(mrb_state *mrb, mrb_value hash1, mrb_value hash2, mrb_bool eql)
         return mrb_bool_value(eq);
       }
   }
-  h1 = RHASH_TBL(hash1);
-  h2 = RHASH_TBL(hash2);
-  if (!h1) {
-    return mrb_bool_value(!h2);
+  t1 = RHASH_TBL(hash1);
+  t2 = RHASH_TBL(hash2);
+  if (!t1 || t1->size == 0) {
+    return mrb_bool_value(!t2 || t2->size == 0);
   }
-  if (!h2) return mrb_false_value();
-  if (kh_size(h1) != kh_size(h2)) return mrb_false_value();
+  if (!t2) return mrb_false_value();
+  if (t1->size != t2->size) return mrb_false_value();
   else {
-    khiter_t k1, k2;
+    uint32_t i;
+    mrb_int n;
     mrb_value key;
 
-    for (k1 = kh_begin(h1); k1 != kh_end(h1); k1++) {
-      if (!kh_exist(h1, k1)) continue;
-      key = kh_key(h1,k1);
-      k2 = kh_get(ht, mrb, h2, key);
-      if (k2 != kh_end(h2)) {
+    /* the comparisons may change either table */
+    for (i = t1->first; i < t1->n_ents; i++) {
+      key = t1->ents[i].key;
+      if (mrb_undef_p(key)) continue;
+      n = ht_lookup(mrb, t2, key, NULL);
+      if (n >= 0 && i < t1->n_ents) {
         if (eql)
-          eq = mrb_eql(mrb, kh_value(h1,k1), kh_value(h2,k2));
+          eq = mrb_eql(mrb, t1->ents[i].val, t2->ents[n].val);
         else
-          eq = mrb_equal(mrb, kh_value(h1,k1), kh_value(h2,k2));
+          eq = mrb_equal(mrb, t1->ents[i].val, t2->ents[n].val);
         if (eq) {
           continue; /* next key */
         }
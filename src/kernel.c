@@ -11,6 +11,7 @@
 #include "mruby/string.h"
 #include "mruby/variable.h"
 #include "mruby/error.h"
+#include "mruby/presym.h"
 
 typedef enum {
   NOEX_PUBLIC    = 0x00,
@@ -29,7 +30,7 @@ typedef enum {
 mrb_bool
 mrb_obj_basic_to_s_p(mrb_state *mrb, mrb_value obj)
 {
-  struct RProc *me = mrb_method_search(mrb, mrb_class(mrb, obj), mrb_intern_lit(mrb, "to_s"));
+  struct RProc *me = mrb_method_search(mrb, mrb_class(mrb, obj), MRB_SYM(to_s));
   if (me && MRB_PROC_CFUNC_P(me) && (me->body.func == mrb_any_to_s))
     return TRUE;
   return FALSE;
@@ -89,7 +90,7 @@ mrb_obj_inspect(mrb_state *mrb, mrb_value obj)
  *     1 == 1.0     #=> true
  *     1.eql? 1.0   #=> false
  */
-static mrb_value
+mrb_value
 mrb_obj_equal_m(mrb_state *mrb, mrb_value self)
 {
   mrb_value arg;
@@ -250,7 +251,7 @@ mrb_singleton_class_clone(mrb_state *mrb, mrb_value obj)
     clone->super = klass->super;
     if (klass->iv) {
       mrb_iv_copy(mrb, mrb_obj_value(clone), mrb_obj_value(klass));
-      mrb_obj_iv_set(mrb, (struct RObject*)clone, mrb_intern_lit(mrb, "__attached__"), obj);
+      mrb_obj_iv_set(mrb, (struct RObject*)clone, MRB_SYM(__attached__), obj);
     }
     if (klass->mt) {
       clone->mt = kh_copy(mt, mrb, klass->mt);
@@ -923,7 +924,7 @@ mrb_f_raise(mrb_state *mrb, mrb_value self)
     /* fall through */
   default:
     exc = mrb_make_exception(mrb, argc, a);
-    mrb_obj_iv_set(mrb, mrb_obj_ptr(exc), mrb_intern_lit(mrb, "lastpc"), mrb_cptr_value(mrb, mrb->c->ci->pc));
+    mrb_obj_iv_set(mrb, mrb_obj_ptr(exc), MRB_SYM(lastpc), mrb_cptr_value(mrb, mrb->c->ci->pc));
     mrb_exc_raise(mrb, exc);
     break;
   }
@@ -1028,7 +1029,7 @@ obj_respond_to(mrb_state *mrb, mrb_value self)
   }
 
   if (!respond_to_p) {
-    rtm_id = mrb_intern_lit(mrb, "respond_to_missing?");
+    rtm_id = MRB_SYM_Q(respond_to_missing);
     if (basic_obj_respond_to(mrb, self, rtm_id, !mrb_test(priv))) {
       return mrb_funcall_argv(mrb, self, rtm_id, argc, argv);
     }
@@ -1148,5 +1149,5 @@ mrb_init_kernel(mrb_state *mrb)
   mrb_define_method(mrb, krn, "__case_eqq",                 mrb_obj_ceqq,                    MRB_ARGS_REQ(1));    /* internal */
 
   mrb_include_module(mrb, mrb->object_class, mrb->kernel_module);
-  mrb_alias_method(mrb, mrb->module_class, mrb_intern_lit(mrb, "dup"), mrb_intern_lit(mrb, "clone"));
+  mrb_alias_method(mrb, mrb->module_class, MRB_SYM(dup), MRB_SYM(clone));
 }
@@ -113,6 +113,10 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool all
         irep->pool[i] = mrb_str_pool(mrb, s);
         break;
 
+      case IREP_TT_FSTRING:
+        irep->pool[i] = mrb_str_pool(mrb, mrb_str_freeze(mrb, s));
+        break;
+
       default:
         /* should not happen */
         irep->pool[i] = mrb_nil_value();
@@ -18,7 +18,7 @@
 #define YYSTACK_USE_ALLOCA 0
 
 #include <ctype.h>
-#include <errno.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include "mruby.h"
@@ -3385,6 +3385,42 @@ skip(parser_state *p, char term)
   }
 }
 
+/*
+ * Reads the rest of a comment line that precedes the first token and
+ * applies the magic comment in it, if any:
+ *
+ *   # frozen_string_literal: true
+ *   # -*- frozen_string_literal: true -*-
+ */
+static void
+magic_comment(parser_state *p)
+{
+  static const char name[] = "frozen_string_literal";
+  char buf[128];
+  char *s;
+  int c, len = 0;
+
+  for (;;) {
+    c = nextc(p);
+    if (c < 0 || c == '\n') break;
+    if (len < (int)sizeof(buf) - 1) buf[len++] = (char)c;
+  }
+  buf[len] = '\0';
+
+  s = strstr(buf, name);
+  if (!s) return;
+  s += sizeof(name) - 1;
+  while (ISSPACE(*s)) s++;
+  if (*s++ != ':') return;
+  while (ISSPACE(*s)) s++;
+  if (strncmp(s, "true", 4) == 0 && !ISALNUM(s[4])) {
+    p->frozen_string_literal = TRUE;
+  }
+  else if (strncmp(s, "false", 5) == 0 && !ISALNUM(s[5])) {
+    p->frozen_string_literal = FALSE;
+  }
+}
+
 static mrb_bool
 peek_n(parser_state *p, int c, int n)
 {
@@ -4054,7 +4090,12 @@ parser_yylex(parser_state *p)
     goto retry;
 
   case '#':     /* it's a comment */
-    skip(p, '\n');
+    if (p->token_seen) {
+      skip(p, '\n');
+    }
+    else {
+      magic_comment(p);
+    }
     /* fall through */
   case -2:      /* end of partial script. */
   case '\n':
@@ -4688,17 +4729,25 @@ parser_yylex(parser_state *p)
     }
     tokfix(p);
     if (is_float) {
-      double d;
+      mrb_float d;
       char *endp;
+      const char *s;
 
-      errno = 0;
-      d = strtod(tok(p), &endp);
+      d = (mrb_float)mrb_float_read(tok(p), &endp);
       if (d == 0 && endp == tok(p)) {
         yywarning_s(p, "corrupted float value %s", tok(p));
       }
-      else if (errno == ERANGE) {
+      else if (isinf(d)) {
         yywarning_s(p, "float %s out of range", tok(p));
-        errno = 0;
+      }
+      else if (d == 0) {
+        /* subnormals are fine; only a nonzero literal read as 0 is not */
+        for (s = tok(p); *s && *s != 'e' && *s != 'E'; s++) {
+          if ('1' <= *s && *s <= '9') {
+            yywarning_s(p, "float %s out of range", tok(p));
+            break;
+          }
+        }
       }
       yylval.nd = new_float(p, tok(p));
       return tFLOAT;
@@ -5228,6 +5277,7 @@ yylex(void *lval, parser_state *p)
 
   p->ylval = lval;
   t = parser_yylex(p);
+  p->token_seen = TRUE;
 
   return t;
 }
@@ -5247,6 +5297,7 @@ parser_init_cxt(parser_state *p, mrbc_context *cxt)
     }
   }
   p->capture_errors = cxt->capture_errors;
+  p->frozen_string_literal = cxt->frozen_string_literal;
   if (cxt->partial_hook) {
     p->cxt = cxt;
   }
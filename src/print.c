@@ -7,6 +7,7 @@
 #include "mruby.h"
 #include "mruby/string.h"
 #include "mruby/variable.h"
+#include "mruby/presym.h"
 
 static void
 printstr(mrb_state *mrb, mrb_value obj)
@@ -53,7 +54,7 @@ mrb_show_version(mrb_state *mrb)
 {
   mrb_value msg;
 
-  msg = mrb_const_get(mrb, mrb_obj_value(mrb->object_class), mrb_intern_lit(mrb, "MRUBY_DESCRIPTION"));
+  msg = mrb_const_get(mrb, mrb_obj_value(mrb->object_class), MRB_SYM(MRUBY_DESCRIPTION));
   printstr(mrb, msg);
   printstr(mrb, mrb_str_new_lit(mrb, "\n"));
 }
@@ -63,7 +64,7 @@ mrb_show_copyright(mrb_state *mrb)
 {
   mrb_value msg;
 
-  msg = mrb_const_get(mrb, mrb_obj_value(mrb->object_class), mrb_intern_lit(mrb, "MRUBY_COPYRIGHT"));
+  msg = mrb_const_get(mrb, mrb_obj_value(mrb->object_class), MRB_SYM(MRUBY_COPYRIGHT));
   printstr(mrb, msg);
   printstr(mrb, mrb_str_new_lit(mrb, "\n"));
 }
@@ -9,7 +9,7 @@
 #include "mruby/range.h"
 #include "mruby/string.h"
 
-#define RANGE_CLASS (mrb_class_get(mrb, "Range"))
+#define RANGE_CLASS (mrb->range_class)
 
 static void
 range_check(mrb_state *mrb, mrb_value a, mrb_value b)
@@ -336,6 +336,24 @@ range_inspect(mrb_state *mrb, mrb_value range)
   return str;
 }
 
+/* see hash.c */
+mrb_int mrb_hash_code(mrb_state *mrb, mrb_value obj);
+
+/*
+ *  call-seq:
+ *     rng.hash    -> fixnum
+ *
+ *  Compute a hash-code for this range. Two ranges with equal beginning
+ *  and end points (using <code>eql?</code>), and the same #exclude_end?
+ *  value will generate the same hash-code.
+ */
+
+mrb_value
+mrb_range_hash(mrb_state *mrb, mrb_value range)
+{
+  return mrb_fixnum_value(mrb_hash_code(mrb, range));
+}
+
 /* 15.2.14.4.14(x) */
 /*
  *  call-seq:
@@ -351,8 +369,8 @@ range_inspect(mrb_state *mrb, mrb_value range)
  *
  */
 
-static mrb_value
-range_eql(mrb_state *mrb, mrb_value range)
+mrb_value
+mrb_range_eql(mrb_state *mrb, mrb_value range)
 {
   mrb_value obj;
   struct RRange *r, *o;
@@ -400,7 +418,7 @@ mrb_init_range(mrb_state *mrb)
 {
   struct RClass *r;
 
-  r = mrb_define_class(mrb, "Range", mrb->object_class);
+  r = mrb->range_class = mrb_define_class(mrb, "Range", mrb->object_class);
   MRB_SET_INSTANCE_TT(r, MRB_TT_RANGE);
 
   mrb_define_method(mrb, r, "begin",           mrb_range_beg,         MRB_ARGS_NONE()); /* 15.2.14.4.3  */
@@ -417,6 +435,7 @@ mrb_init_range(mrb_state *mrb)
 
   mrb_define_method(mrb, r, "to_s",            range_to_s,            MRB_ARGS_NONE()); /* 15.2.14.4.12(x) */
   mrb_define_method(mrb, r, "inspect",         range_inspect,         MRB_ARGS_NONE()); /* 15.2.14.4.13(x) */
-  mrb_define_method(mrb, r, "eql?",            range_eql,             MRB_ARGS_REQ(1)); /* 15.2.14.4.14(x) */
+  mrb_define_method(mrb, r, "eql?",            mrb_range_eql,         MRB_ARGS_REQ(1)); /* 15.2.14.4.14(x) */
+  mrb_define_method(mrb, r, "hash",            mrb_range_hash,        MRB_ARGS_NONE());
   mrb_define_method(mrb, r, "initialize_copy", range_initialize_copy, MRB_ARGS_REQ(1)); /* 15.2.14.4.15(x) */
 }
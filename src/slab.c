@@ -0,0 +1,356 @@
+/*
+** slab.c - size-class slab allocator
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mruby.h"
+
+#ifdef MRB_SLAB_USE_MMAP
+#include <sys/mman.h>
+#endif
+
+/*
+  = Slab allocator
+
+  mrb_slab_allocf is an mrb_allocf that serves small requests (up to
+  SLAB_MAX_SIZE bytes) from per-VM free lists, one per size class.
+  Chunks of SLAB_CHUNK_SIZE bytes are taken from the system (malloc, or
+  mmap when MRB_SLAB_USE_MMAP is defined) and cut into pages of
+  SLAB_PAGE_SIZE bytes; each page is dedicated to a single size class
+  and carved into blocks when that class runs out of free blocks.
+  Blocks carry no header; the size class of a block is found from the
+  page it belongs to, so chunks are kept sorted by address.
+
+  Requests larger than SLAB_MAX_SIZE go to realloc(3) with a header
+  recording their size, padded to the strictest alignment.  Pages are returned to the system only
+  when the slab is closed.
+*/
+
+/* configuration section */
+/* page size; each page holds blocks of one size class */
+#ifndef MRB_SLAB_PAGE_SIZE
+#define MRB_SLAB_PAGE_SIZE 8192
+#endif
+/* number of pages per chunk */
+#ifndef MRB_SLAB_CHUNK_PAGES
+#define MRB_SLAB_CHUNK_PAGES 32
+#endif
+/* end of configuration section */
+
+#define SLAB_PAGE_SIZE MRB_SLAB_PAGE_SIZE
+#define SLAB_CHUNK_SIZE (MRB_SLAB_PAGE_SIZE * MRB_SLAB_CHUNK_PAGES)
+#define SLAB_MAX_SIZE 1024
+#define SLAB_CLASSES 20
+
+static const uint16_t slab_class_size[SLAB_CLASSES] = {
+  16, 32, 48, 64, 80, 96, 112, 128,
+  160, 192, 224, 256,
+  320, 384, 448, 512,
+  640, 768, 896, 1024,
+};
+
+struct slab_block {
+  struct slab_block *next;
+};
+
+struct slab_chunk {
+  char *base;
+  size_t npages;                        /* pages carved so far */
+  uint8_t klass[MRB_SLAB_CHUNK_PAGES];  /* size class of each page */
+};
+
+/* header of a large block; padded so the block is as aligned as malloc's */
+union slab_large {
+  size_t size;
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+  max_align_t align;
+#else
+  long double ld;
+  long long ll;
+  double d;
+  void *p;
+#endif
+};
+
+struct mrb_slab {
+  struct slab_block *free[SLAB_CLASSES];
+  size_t used[SLAB_CLASSES];            /* blocks in use */
+  size_t pages[SLAB_CLASSES];           /* pages carved */
+  struct slab_chunk **chunks;           /* sorted by base address */
+  size_t nchunks;
+  size_t chunks_capa;
+  struct slab_chunk *current;           /* chunk to carve new pages from */
+  size_t large_count;
+  size_t large_bytes;
+};
+
+static int
+slab_class(size_t size)
+{
+  if (size <= 128) return (int)((size - 1) >> 4);
+  if (size <= 256) return 8 + (int)((size - 129) >> 5);
+  if (size <= 512) return 12 + (int)((size - 257) >> 6);
+  return 16 + (int)((size - 513) >> 7);
+}
+
+static void*
+chunk_map(void)
+{
+#ifdef MRB_SLAB_USE_MMAP
+  void *p = mmap(NULL, SLAB_CHUNK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+
+  return (p == MAP_FAILED) ? NULL : p;
+#else
+  return malloc(SLAB_CHUNK_SIZE);
+#endif
+}
+
+static void
+chunk_unmap(void *p)
+{
+#ifdef MRB_SLAB_USE_MMAP
+  munmap(p, SLAB_CHUNK_SIZE);
+#else
+  free(p);
+#endif
+}
+
+static struct slab_chunk*
+chunk_new(mrb_slab *slab)
+{
+  struct slab_chunk *chunk;
+  size_t lo, hi;
+
+  if (slab->nchunks == slab->chunks_capa) {
+    size_t capa = slab->chunks_capa ? slab->chunks_capa * 2 : 8;
+    struct slab_chunk **chunks = (struct slab_chunk**)realloc(slab->chunks, sizeof(struct slab_chunk*) * capa);
+
+    if (!chunks) return NULL;
+    slab->chunks = chunks;
+    slab->chunks_capa = capa;
+  }
+  chunk = (struct slab_chunk*)malloc(sizeof(struct slab_chunk));
+  if (!chunk) return NULL;
+  chunk->base = (char*)chunk_map();
+  if (!chunk->base) {
+    free(chunk);
+    return NULL;
+  }
+  chunk->npages = 0;
+
+  /* keep chunks sorted by address */
+  lo = 0; hi = slab->nchunks;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+
+    if (slab->chunks[mid]->base < chunk->base) lo = mid + 1;
+    else hi = mid;
+  }
+  memmove(slab->chunks + lo + 1, slab->chunks + lo, sizeof(struct slab_chunk*) * (slab->nchunks - lo));
+  slab->chunks[lo] = chunk;
+  slab->nchunks++;
+  return chunk;
+}
+
+/* returns the chunk containing p, or NULL for large blocks */
+static struct slab_chunk*
+chunk_find(mrb_slab *slab, const char *p)
+{
+  size_t lo = 0, hi = slab->nchunks;
+
+  if (slab->current && slab->current->base <= p && p < slab->current->base + SLAB_CHUNK_SIZE) {
+    return slab->current;
+  }
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    struct slab_chunk *chunk = slab->chunks[mid];
+
+    if (p < chunk->base) hi = mid;
+    else if (p >= chunk->base + SLAB_CHUNK_SIZE) lo = mid + 1;
+    else return chunk;
+  }
+  return NULL;
+}
+
+static int
+page_carve(mrb_slab *slab, int klass)
+{
+  struct slab_chunk *chunk = slab->current;
+  size_t bsize = slab_class_size[klass];
+  char *page, *p, *end;
+
+  if (!chunk || chunk->npages == MRB_SLAB_CHUNK_PAGES) {
+    chunk = chunk_new(slab);
+    if (!chunk) return FALSE;
+    slab->current = chunk;
+  }
+  chunk->klass[chunk->npages] = (uint8_t)klass;
+  page = chunk->base + chunk->npages * SLAB_PAGE_SIZE;
+  chunk->npages++;
+  slab->pages[klass]++;
+
+  end = page + (SLAB_PAGE_SIZE / bsize) * bsize;
+  for (p = end - bsize; p >= page; p -= bsize) {
+    struct slab_block *b = (struct slab_block*)p;
+
+    b->next = slab->free[klass];
+    slab->free[klass] = b;
+  }
+  return TRUE;
+}
+
+static void*
+small_alloc(mrb_slab *slab, int klass)
+{
+  struct slab_block *b = slab->free[klass];
+
+  if (!b) {
+    if (!page_carve(slab, klass)) return NULL;
+    b = slab->free[klass];
+  }
+  slab->free[klass] = b->next;
+  slab->used[klass]++;
+  return b;
+}
+
+static void
+small_free(mrb_slab *slab, void *p, int klass)
+{
+  struct slab_block *b = (struct slab_block*)p;
+
+  b->next = slab->free[klass];
+  slab->free[klass] = b;
+  slab->used[klass]--;
+}
+
+static void*
+large_realloc(mrb_slab *slab, void *p, size_t size)
+{
+  union slab_large *h = p ? (union slab_large*)p - 1 : NULL;
+  size_t old = h ? h->size : 0;
+
+  if (size > SIZE_MAX - sizeof(union slab_large)) return NULL;
+  h = (union slab_large*)realloc(h, sizeof(union slab_large) + size);
+  if (!h) return NULL;
+  if (!p) slab->large_count++;
+  slab->large_bytes += size - old;
+  h->size = size;
+  return h + 1;
+}
+
+static void
+large_free(mrb_slab *slab, void *p)
+{
+  union slab_large *h = (union slab_large*)p - 1;
+
+  slab->large_count--;
+  slab->large_bytes -= h->size;
+  free(h);
+}
+
+mrb_slab*
+mrb_slab_open(void)
+{
+  mrb_slab *slab = (mrb_slab*)malloc(sizeof(mrb_slab));
+
+  if (slab) {
+    memset(slab, 0, sizeof(mrb_slab));
+  }
+  return slab;
+}
+
+void
+mrb_slab_close(mrb_slab *slab)
+{
+  size_t i;
+
+  if (!slab) return;
+  for (i = 0; i < slab->nchunks; i++) {
+    chunk_unmap(slab->chunks[i]->base);
+    free(slab->chunks[i]);
+  }
+  free(slab->chunks);
+  free(slab);
+}
+
+void*
+mrb_slab_allocf(mrb_state *mrb, void *p, size_t size, void *ud)
+{
+  mrb_slab *slab = (mrb_slab*)ud;
+  struct slab_chunk *chunk = p ? chunk_find(slab, (char*)p) : NULL;
+  int klass = -1;
+  void *np;
+
+  if (chunk) {
+    klass = chunk->klass[((char*)p - chunk->base) / SLAB_PAGE_SIZE];
+  }
+  if (size == 0) {
+    if (chunk) small_free(slab, p, klass);
+    else if (p) large_free(slab, p);
+    return NULL;
+  }
+  if (size > SLAB_MAX_SIZE) {
+    if (!chunk) return large_realloc(slab, p, size);
+    np = large_realloc(slab, NULL, size);
+    if (np) {
+      memcpy(np, p, slab_class_size[klass]);
+      small_free(slab, p, klass);
+    }
+    return np;
+  }
+
+  /* small request */
+  if (chunk && klass == slab_class(size)) return p;
+  np = small_alloc(slab, slab_class(size));
+  if (np && p) {
+    size_t old = chunk ? slab_class_size[klass] : ((union slab_large*)p - 1)->size;
+
+    memcpy(np, p, old < size ? old : size);
+    if (chunk) small_free(slab, p, klass);
+    else large_free(slab, p);
+  }
+  return np;
+}
+
+mrb_bool
+mrb_slab_get_stat(mrb_state *mrb, mrb_slab_stat *stat)
+{
+  mrb_slab *slab;
+  int i;
+
+  if (mrb->allocf != mrb_slab_allocf) return FALSE;
+  slab = (mrb_slab*)mrb->ud;
+  memset(stat, 0, sizeof(mrb_slab_stat));
+  stat->chunks = slab->nchunks;
+  stat->chunk_bytes = slab->nchunks * SLAB_CHUNK_SIZE;
+  for (i = 0; i < SLAB_CLASSES; i++) {
+    size_t bsize = slab_class_size[i];
+    size_t blocks = slab->pages[i] * (SLAB_PAGE_SIZE / bsize);
+
+    stat->page_bytes += slab->pages[i] * SLAB_PAGE_SIZE;
+    stat->used_bytes += slab->used[i] * bsize;
+    stat->free_bytes += (blocks - slab->used[i]) * bsize;
+  }
+  stat->large_count = slab->large_count;
+  stat->large_bytes = slab->large_bytes;
+  return TRUE;
+}
+
+mrb_state*
+mrb_open_slab(void)
+{
+  mrb_slab *slab = mrb_slab_open();
+  mrb_state *mrb;
+
+  if (!slab) return NULL;
+  mrb = mrb_open_allocf(mrb_slab_allocf, slab);
+  if (!mrb) {
+    mrb_slab_close(slab);
+  }
+  return mrb;
+}
@@ -6,6 +6,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "mruby.h"
 #include "mruby/irep.h"
 #include "mruby/variable.h"
@@ -22,6 +23,30 @@ inspect_main(mrb_state *mrb, mrb_value mod)
   return mrb_str_new_lit(mrb, "main");
 }
 
+static uint64_t
+str_hash_seed(mrb_state *mrb)
+{
+#ifdef MRB_STR_HASH_SEED
+  return (uint64_t)MRB_STR_HASH_SEED;
+#else
+  uint64_t seed = 0;
+#ifdef ENABLE_STDIO
+  FILE *fp = fopen("/dev/urandom", "rb");
+
+  if (fp) {
+    if (fread(&seed, sizeof(seed), 1, fp) != 1) seed = 0;
+    fclose(fp);
+  }
+#endif
+  /* mix in whatever varies between runs in case there is no urandom */
+  seed = seed * 6364136223846793005ULL + (uint64_t)time(NULL);
+  seed = seed * 6364136223846793005ULL + (uint64_t)clock();
+  seed = seed * 6364136223846793005ULL + (uint64_t)(uintptr_t)mrb;
+  seed = seed * 6364136223846793005ULL + (uint64_t)(uintptr_t)&seed;
+  return seed;
+#endif
+}
+
 mrb_state*
 mrb_open_allocf(mrb_allocf f, void *ud)
 {
@@ -40,6 +65,7 @@ mrb_open_allocf(mrb_allocf f, void *ud)
   mrb->ud = ud;
   mrb->allocf = f;
   mrb->current_white_part = MRB_GC_WHITE_A;
+  mrb->str_hash_seed = str_hash_seed(mrb);
 
 #ifndef MRB_GC_FIXED_ARENA
   mrb->arena = (struct RBasic**)mrb_malloc(mrb, sizeof(struct RBasic*)*MRB_GC_ARENA_SIZE);
@@ -55,6 +81,7 @@ mrb_open_allocf(mrb_allocf f, void *ud)
   return mrb;
 }
 
+#ifndef MRB_USE_SLAB_ALLOCF
 static void*
 allocf(mrb_state *mrb, void *p, size_t size, void *ud)
 {
@@ -66,6 +93,7 @@ allocf(mrb_state *mrb, void *p, size_t size, void *ud)
     return realloc(p, size);
   }
 }
+#endif
 
 struct alloca_header {
   struct alloca_header *next;
@@ -102,12 +130,17 @@ mrb_alloca_free(mrb_state *mrb)
 mrb_state*
 mrb_open(void)
 {
+#ifdef MRB_USE_SLAB_ALLOCF
+  mrb_state *mrb = mrb_open_slab();
+#else
   mrb_state *mrb = mrb_open_allocf(allocf, NULL);
+#endif
 
   return mrb;
 }
 
 void mrb_free_symtbl(mrb_state *mrb);
+void mrb_free_fstr_table(mrb_state *mrb);
 void mrb_free_heap(mrb_state *mrb);
 
 void
@@ -134,6 +167,9 @@ mrb_irep_free(mrb_state *mrb, mrb_irep *irep)
     mrb_free(mrb, irep->iseq);
   for (i=0; i<irep->plen; i++) {
     if (mrb_type(irep->pool[i]) == MRB_TT_STRING) {
+      if (MRB_STR_FROZEN_P(mrb_str_ptr(irep->pool[i]))) {
+        mrb_str_forget_literal(mrb, irep->pool[i]);
+      }
       if ((mrb_str_ptr(irep->pool[i])->flags & (MRB_STR_NOFREE|MRB_STR_EMBED)) == 0) {
         mrb_free(mrb, RSTRING_PTR(irep->pool[i]));
       }
@@ -186,8 +222,7 @@ mrb_str_pool(mrb_state *mrb, mrb_value str)
     }
 
     if (len < RSTRING_EMBED_LEN_MAX) {
-      ns->flags |= MRB_STR_EMBED;
-      ns->flags &= ~MRB_STR_EMBED_LEN_MASK;
+      ns->flags = MRB_STR_EMBED;
       ns->flags |= (size_t)len << MRB_STR_EMBED_LEN_SHIFT;
       if (ptr) {
         memcpy(ns->as.ary, ptr, len);
@@ -205,6 +240,8 @@ mrb_str_pool(mrb_state *mrb, mrb_value str)
       ns->as.heap.ptr[len] = '\0';
     }
   }
+  /* a frozen_string_literal literal; see mrb_str_frozen_literal() */
+  ns->flags |= s->flags & MRB_STR_FROZEN;
   return mrb_obj_value(ns);
 }
 
@@ -222,18 +259,25 @@ mrb_free_context(mrb_state *mrb, struct mrb_context *c)
 void
 mrb_close(mrb_state *mrb)
 {
+  mrb_allocf f = mrb->allocf;
+  void *ud = mrb->ud;
+
   mrb_final_core(mrb);
 
   /* free */
   mrb_gc_free_gv(mrb);
   mrb_free_context(mrb, mrb->root_c);
   mrb_free_symtbl(mrb);
+  mrb_free_fstr_table(mrb);
   mrb_free_heap(mrb);
   mrb_alloca_free(mrb);
 #ifndef MRB_GC_FIXED_ARENA
   mrb_free(mrb, mrb->arena);
 #endif
   mrb_free(mrb, mrb);
+  if (f == mrb_slab_allocf) {
+    mrb_slab_close((mrb_slab*)ud);
+  }
 }
 
 mrb_irep*
@@ -12,17 +12,20 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/khash.h"
 #include "mruby/range.h"
 #include "mruby/string.h"
 #include "mruby/variable.h"
+#include "mruby/presym.h"
 #include "re.h"
 
 #define STR_EMBED_P(s) ((s)->flags & MRB_STR_EMBED)
 #define STR_SET_EMBED_FLAG(s) ((s)->flags |= MRB_STR_EMBED)
-#define STR_UNSET_EMBED_FLAG(s) ((s)->flags &= ~(MRB_STR_EMBED|MRB_STR_EMBED_LEN_MASK))
+#define STR_UNSET_EMBED_FLAG(s) ((s)->flags &= ~(MRB_STR_EMBED|MRB_STR_EMBED_LEN_MASK|MRB_STR_CACHE_MASK))
 #define STR_SET_EMBED_LEN(s, n) do {\
   size_t tmp_n = (n);\
-  s->flags &= ~MRB_STR_EMBED_LEN_MASK;\
+  s->flags &= ~(MRB_STR_EMBED_LEN_MASK|MRB_STR_CACHE_MASK);\
   s->flags |= (tmp_n) << MRB_STR_EMBED_LEN_SHIFT;\
 } while (0)
 #define STR_SET_LEN(s, n) do {\
@@ -43,6 +46,8 @@ const char mrb_digitmap[] = "0123456789abcdefghijklmnopqrstuvwxyz";
 
 typedef struct mrb_shared_string {
   mrb_bool nofree : 1;
+  mrb_bool hashed : 1;  /* hash holds mrb_str_hash() of the whole buffer */
+  uint32_t hash;
   int refcnt;
   char *ptr;
   mrb_int len;
@@ -54,6 +59,7 @@ typedef struct mrb_shared_string {
 
 static mrb_value str_replace(mrb_state *mrb, struct RString *s1, struct RString *s2);
 static mrb_value mrb_str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len);
+static void fstr_forget(mrb_state *mrb, struct RString *s);
 
 mrb_int
 mrb_str_strlen(mrb_state *mrb, struct RString *s)
@@ -102,6 +108,10 @@ str_decref(mrb_state *mrb, mrb_shared_string *shared)
 void
 mrb_str_modify(mrb_state *mrb, struct RString *s)
 {
+  if (MRB_STR_FROZEN_P(s)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "can't modify frozen String");
+  }
+  s->flags &= ~MRB_STR_CACHE_MASK;
   if (STR_SHARED_P(s)) {
     mrb_shared_string *shared = s->as.heap.aux.shared;
 
@@ -262,7 +272,7 @@ str_buf_cat(mrb_state *mrb, struct RString *s, const char *ptr, size_t len)
   if (capa <= total) {
     while (total > capa) {
         if (capa + 1 >= MRB_INT_MAX / 2) {
-          capa = (total + 4095) / 4096;
+          capa = (total + 4095) / 4096 * 4096;
           break;
         }
         capa = (capa + 1) * 2;
@@ -339,6 +349,8 @@ mrb_str_new_static(mrb_state *mrb, const char *p, size_t len)
 void
 mrb_gc_free_str(mrb_state *mrb, struct RString *str)
 {
+  if (str->flags & MRB_STR_FSTRING)
+    fstr_forget(mrb, str);
   if (STR_EMBED_P(str))
     /* no code */;
   else if (STR_SHARED_P(str))
@@ -370,6 +382,7 @@ str_make_shared(mrb_state *mrb, struct RString *s)
     mrb_shared_string *shared = (mrb_shared_string *)mrb_malloc(mrb, sizeof(mrb_shared_string));
 
     shared->refcnt = 1;
+    shared->hashed = FALSE;
     if (STR_EMBED_P(s)) {
       const mrb_int len = STR_EMBED_LEN(s);
       char *const tmp = (char *)mrb_malloc(mrb, len+1);
@@ -426,21 +439,15 @@ void
 mrb_str_concat(mrb_state *mrb, mrb_value self, mrb_value other)
 {
   struct RString *s1 = mrb_str_ptr(self), *s2;
-  mrb_int len;
 
   mrb_str_modify(mrb, s1);
   if (!mrb_string_p(other)) {
     other = mrb_str_to_str(mrb, other);
   }
   s2 = mrb_str_ptr(other);
-  len = STR_LEN(s1) + STR_LEN(s2);
-
-  if (RSTRING_CAPA(self) < len) {
-    RESIZE_CAPA(s1, len);
-  }
-  memcpy(STR_PTR(s1)+STR_LEN(s1), STR_PTR(s2), STR_LEN(s2));
-  STR_SET_LEN(s1, len);
-  STR_PTR(s1)[len] = '\0';
+  /* str_buf_cat() grows the buffer geometrically, so a loop of << or
+     an OP_STRCAT chain copies each byte amortized O(1) times */
+  str_buf_cat(mrb, s1, STR_PTR(s2), STR_LEN(s2));
 }
 
 /*
@@ -615,7 +622,7 @@ mrb_str_cmp_m(mrb_state *mrb, mrb_value str1)
 
   mrb_get_args(mrb, "o", &str2);
   if (!mrb_string_p(str2)) {
-    if (!mrb_respond_to(mrb, str2, mrb_intern_lit(mrb, "to_s"))) {
+    if (!mrb_respond_to(mrb, str2, MRB_SYM(to_s))) {
       return mrb_nil_value();
     }
     else if (!mrb_respond_to(mrb, str2, mrb_intern_lit(mrb, "<=>"))) {
@@ -654,7 +661,7 @@ mrb_str_equal(mrb_state *mrb, mrb_value str1, mrb_value str2)
   if (mrb_obj_equal(mrb, str1, str2)) return TRUE;
   if (!mrb_string_p(str2)) {
     if (mrb_nil_p(str2)) return FALSE;
-    if (!mrb_respond_to(mrb, str2, mrb_intern_lit(mrb, "to_str"))) {
+    if (!mrb_respond_to(mrb, str2, MRB_SYM(to_str))) {
       return FALSE;
     }
     str2 = mrb_funcall(mrb, str2, "to_str", 0);
@@ -723,6 +730,31 @@ regexp_check(mrb_state *mrb, mrb_value obj)
   }
 }
 
+/*
+  = Substring search
+
+  mrb_memsearch() finds the first occurrence of needle x (m bytes) in
+  haystack y (n bytes); mrb_memrsearch() finds the last one.  Both
+  return the byte offset of the match or -1.
+
+  On x86 the candidates are filtered 16 (SSE2) or 32 (AVX2) positions
+  at a time by comparing the first and the last byte of the needle
+  against the haystack; only positions where both match are verified
+  with memcmp().  AVX2 is chosen at run time, so a single binary runs
+  on CPUs without it.  Other targets use memchr() for single bytes and
+  quick search for longer needles.  Define DISABLE_SIMD to always use
+  the portable code.
+*/
+
+#if defined(ENABLE_SIMD) && defined(__GNUC__) && defined(__SSE2__)
+#define MRB_MEMSEARCH_SSE2
+#include <emmintrin.h>
+#if (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ >= 5 || defined(__clang__))
+#define MRB_MEMSEARCH_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 static inline mrb_int
 mrb_memsearch_qs(const unsigned char *xs, mrb_int m, const unsigned char *ys, mrb_int n)
 {
@@ -743,7 +775,115 @@ mrb_memsearch_qs(const unsigned char *xs, mrb_int m, const unsigned char *ys, mr
   return -1;
 }
 
+/* check candidate positions [i, e] one at a time */
+static inline mrb_int
+memsearch_scan(const unsigned char *x, mrb_int m, const unsigned char *y, mrb_int i, mrb_int e)
+{
+  unsigned char c0 = x[0], c1 = x[m-1];
+
+  for (; i <= e; i++) {
+    if (y[i] == c0 && y[i+m-1] == c1 && memcmp(x, y+i, m) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static inline mrb_int
+memrsearch_scan(const unsigned char *x, mrb_int m, const unsigned char *y, mrb_int i, mrb_int e)
+{
+  unsigned char c0 = x[0], c1 = x[m-1];
+
+  for (; e >= i; e--) {
+    if (y[e] == c0 && y[e+m-1] == c1 && memcmp(x, y+e, m) == 0)
+      return e;
+  }
+  return -1;
+}
+
+#ifdef MRB_MEMSEARCH_SSE2
+static mrb_int
+memsearch_sse2(const unsigned char *x, mrb_int m, const unsigned char *y, mrb_int n)
+{
+  const __m128i first = _mm_set1_epi8((char)x[0]);
+  const __m128i last = _mm_set1_epi8((char)x[m-1]);
+  mrb_int i;
+
+  for (i = 0; i + m - 1 + 16 <= n; i += 16) {
+    __m128i bf = _mm_loadu_si128((const __m128i*)(y + i));
+    __m128i bl = _mm_loadu_si128((const __m128i*)(y + i + m - 1));
+    unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, bf),
+                                                        _mm_cmpeq_epi8(last, bl)));
+    while (mask) {
+      int bit = __builtin_ctz(mask);
+
+      if (memcmp(x + 1, y + i + bit + 1, m - 1) == 0) return i + bit;
+      mask &= mask - 1;
+    }
+  }
+  return memsearch_scan(x, m, y, i, n - m);
+}
+
+static mrb_int
+memrsearch_sse2(const unsigned char *x, mrb_int m, const unsigned char *y, mrb_int n)
+{
+  const __m128i first = _mm_set1_epi8((char)x[0]);
+  const __m128i last = _mm_set1_epi8((char)x[m-1]);
+  mrb_int i;
+
+  for (i = n - m - 15; i >= 0; i -= 16) {
+    __m128i bf = _mm_loadu_si128((const __m128i*)(y + i));
+    __m128i bl = _mm_loadu_si128((const __m128i*)(y + i + m - 1));
+    unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, bf),
+                                                        _mm_cmpeq_epi8(last, bl)));
+    while (mask) {
+      int bit = 31 - __builtin_clz(mask);
+
+      if (memcmp(x + 1, y + i + bit + 1, m - 1) == 0) return i + bit;
+      mask &= ~(1u << bit);
+    }
+  }
+  return memrsearch_scan(x, m, y, 0, i + 15);
+}
+#endif
+
+#ifdef MRB_MEMSEARCH_AVX2
+__attribute__((target("avx2")))
 static mrb_int
+memsearch_avx2(const unsigned char *x, mrb_int m, const unsigned char *y, mrb_int n)
+{
+  const __m256i first = _mm256_set1_epi8((char)x[0]);
+  const __m256i last = _mm256_set1_epi8((char)x[m-1]);
+  mrb_int i;
+
+  for (i = 0; i + m - 1 + 32 <= n; i += 32) {
+    __m256i bf = _mm256_loadu_si256((const __m256i*)(y + i));
+    __m256i bl = _mm256_loadu_si256((const __m256i*)(y + i + m - 1));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, bf),
+                                                                            _mm256_cmpeq_epi8(last, bl)));
+    while (mask) {
+      int bit = __builtin_ctz(mask);
+
+      if (memcmp(x + 1, y + i + bit + 1, m - 1) == 0) return i + bit;
+      mask &= mask - 1;
+    }
+  }
+  return memsearch_scan(x, m, y, i, n - m);
+}
+
+static int
+memsearch_avx2_p(void)
+{
+  static int avx2 = -1;
+
+  if (avx2 < 0) {
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return avx2;
+}
+#endif
+
+mrb_int
 mrb_memsearch(const void *x0, mrb_int m, const void *y0, mrb_int n)
 {
   const unsigned char *x = (const unsigned char *)x0, *y = (const unsigned char *)y0;
@@ -755,15 +895,51 @@ mrb_memsearch(const void *x0, mrb_int m, const void *y0, mrb_int n)
   else if (m < 1) {
     return 0;
   }
- else if (m == 1) {
-    const unsigned char *ys = y, *ye = ys + n;
-    for (; y < ye; ++y) {
-      if (*x == *y)
-        return y - ys;
+  else if (m == 1) {
+    const unsigned char *p = (const unsigned char *)memchr(y, *x, n);
+
+    return p ? p - y : -1;
+  }
+#ifdef MRB_MEMSEARCH_AVX2
+  if (n >= 64 && memsearch_avx2_p()) {
+    return memsearch_avx2(x, m, y, n);
+  }
+#endif
+#ifdef MRB_MEMSEARCH_SSE2
+  return memsearch_sse2(x, m, y, n);
+#else
+  if (n < 256) {
+    return memsearch_scan(x, m, y, 0, n - m);
+  }
+  return mrb_memsearch_qs(x, m, y, n);
+#endif
+}
+
+mrb_int
+mrb_memrsearch(const void *x0, mrb_int m, const void *y0, mrb_int n)
+{
+  const unsigned char *x = (const unsigned char *)x0, *y = (const unsigned char *)y0;
+
+  if (m > n) return -1;
+  else if (m == n) {
+    return memcmp(x0, y0, m) == 0 ? 0 : -1;
+  }
+  else if (m < 1) {
+    return n;
+  }
+  else if (m == 1) {
+    const unsigned char *p = y + n;
+
+    while (p > y) {
+      if (*--p == *x) return p - y;
     }
     return -1;
   }
-  return mrb_memsearch_qs((const unsigned char *)x0, m, (const unsigned char *)y0, n);
+#ifdef MRB_MEMSEARCH_SSE2
+  return memrsearch_sse2(x, m, y, n);
+#else
+  return memrsearch_scan(x, m, y, 0, n - m);
+#endif
 }
 
 static mrb_int
@@ -1203,7 +1379,7 @@ mrb_str_empty_p(mrb_state *mrb, mrb_value self)
  *
  * Two strings are equal if the have the same length and content.
  */
-static mrb_value
+mrb_value
 mrb_str_eql(mrb_state *mrb, mrb_value self)
 {
   mrb_value str2;
@@ -1222,8 +1398,11 @@ mrb_str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
   mrb_shared_string *shared;
 
   orig = mrb_str_ptr(str);
-  if (STR_EMBED_P(orig)) {
-    s = str_new(mrb, orig->as.ary+beg, len);
+  /* a piece that fits in the object, or that is a small part of its
+     buffer, is copied rather than keeping the whole buffer alive */
+  if (STR_EMBED_P(orig) || len < RSTRING_EMBED_LEN_MAX ||
+      len < (STR_SHARED_P(orig) ? orig->as.heap.aux.shared->len : orig->as.heap.len) / 8) {
+    s = str_new(mrb, STR_PTR(orig)+beg, len);
   } else {
     str_make_shared(mrb, orig);
     shared = orig->as.heap.aux.shared;
@@ -1269,21 +1448,159 @@ mrb_str_buf_append(mrb_state *mrb, mrb_value str, mrb_value str2)
   return str;
 }
 
+/*
+  = String hash
+
+  mrb_str_hash_bytes() is a keyed 64-bit multiply-mix hash in the style
+  of wyhash, folded to 32 bits.  The key is mrb->str_hash_seed, drawn
+  at mrb_open() (see MRB_STR_HASH_SEED), so hash values and therefore
+  collisions cannot be predicted from outside the process.
+
+  mrb_str_hash() caches the value of a string that is not modified in
+  between: short embedded strings keep it in the unused tail of their
+  buffer (flagged by MRB_STR_HASHED), strings sharing a whole buffer
+  keep it in the mrb_shared_string.  mrb_str_modify() drops the cache.
+*/
+
+#define STR_HASH_P0 0xa0761d6478bd642fULL
+#define STR_HASH_P1 0xe7037ed1a0b428dbULL
+#define STR_HASH_P2 0x8ebc6af09c88c6e3ULL
+#define STR_HASH_P3 0x589965cc75374cc3ULL
+
+/* offset of the cached hash in an embedded string */
+#define STR_HASH_EMBED_OFF (RSTRING_EMBED_LEN_MAX + 1 - (mrb_int)sizeof(uint32_t))
+
+static inline void
+str_hash_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), lo;
+  uint64_t c = t < rl;
+
+  lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+str_hash_mix(uint64_t a, uint64_t b)
+{
+  str_hash_mum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t
+str_hash_r8(const unsigned char *p)
+{
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t
+str_hash_r4(const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t
+mrb_str_hash_bytes(mrb_state *mrb, const char *ptr, size_t len)
+{
+  const unsigned char *p = (const unsigned char*)ptr;
+  uint64_t seed = mrb->str_hash_seed;
+  uint64_t a, b, h;
+
+  seed ^= str_hash_mix(seed ^ STR_HASH_P0, STR_HASH_P1);
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t off = (len >> 3) << 2;
+
+      a = (str_hash_r4(p) << 32) | str_hash_r4(p + off);
+      b = (str_hash_r4(p + len - 4) << 32) | str_hash_r4(p + len - 4 - off);
+    }
+    else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    }
+    else {
+      a = b = 0;
+    }
+  }
+  else {
+    size_t i = len;
+
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+
+      do {
+        seed = str_hash_mix(str_hash_r8(p) ^ STR_HASH_P1, str_hash_r8(p + 8) ^ seed);
+        see1 = str_hash_mix(str_hash_r8(p + 16) ^ STR_HASH_P2, str_hash_r8(p + 24) ^ see1);
+        see2 = str_hash_mix(str_hash_r8(p + 32) ^ STR_HASH_P3, str_hash_r8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = str_hash_mix(str_hash_r8(p) ^ STR_HASH_P1, str_hash_r8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = str_hash_r8(p + i - 16);
+    b = str_hash_r8(p + i - 8);
+  }
+  a ^= STR_HASH_P1;
+  b ^= seed;
+  str_hash_mum(&a, &b);
+  h = str_hash_mix(a ^ STR_HASH_P0 ^ (uint64_t)len, b ^ STR_HASH_P1);
+  return (uint32_t)(h ^ (h >> 32));
+}
+
 mrb_int
 mrb_str_hash(mrb_state *mrb, mrb_value str)
 {
-  /* 1-8-7 */
   struct RString *s = mrb_str_ptr(str);
-  mrb_int len = STR_LEN(s);
-  char *p = STR_PTR(s);
-  mrb_int key = 0;
+  uint32_t h;
 
-  while (len--) {
-    key = key*65599 + *p;
-    p++;
+  if (STR_EMBED_P(s)) {
+    mrb_int len = STR_EMBED_LEN(s);
+
+    if (s->flags & MRB_STR_HASHED) {
+      memcpy(&h, s->as.ary + STR_HASH_EMBED_OFF, sizeof(h));
+      return (mrb_int)h;
+    }
+    h = mrb_str_hash_bytes(mrb, s->as.ary, len);
+    if (len < STR_HASH_EMBED_OFF) {
+      memcpy(s->as.ary + STR_HASH_EMBED_OFF, &h, sizeof(h));
+      s->flags |= MRB_STR_HASHED;
+    }
+    return (mrb_int)h;
   }
-  key = key + (key>>5);
-  return key;
+  if (STR_SHARED_P(s)) {
+    mrb_shared_string *shared = s->as.heap.aux.shared;
+
+    if (s->as.heap.ptr == shared->ptr && s->as.heap.len == shared->len) {
+      if (!shared->hashed) {
+        shared->hash = mrb_str_hash_bytes(mrb, shared->ptr, shared->len);
+        shared->hashed = TRUE;
+      }
+      return (mrb_int)shared->hash;
+    }
+  }
+  return (mrb_int)mrb_str_hash_bytes(mrb, s->as.heap.ptr, s->as.heap.len);
 }
 
 /* 15.2.10.5.20 */
@@ -1300,6 +1617,360 @@ mrb_str_hash_m(mrb_state *mrb, mrb_value self)
   return mrb_fixnum_value(key);
 }
 
+/*
+  = String caches
+
+  Gems keep per-VM caches of data derived from strings (compiled
+  sprintf formats and pack templates, UTF-8 character indexes) in a
+  table of MRB_STR_CACHE_SLOTS Data objects, held by a hidden instance
+  variable so that the GC sees them and frees them with the VM.
+  mrb_str_cache_fetch() adds the lookup by contents: an entry is found
+  by the hash of the string and checked against a copy of its bytes.
+*/
+
+static mrb_value
+str_cache_table(mrb_state *mrb, struct RObject *owner, mrb_sym name)
+{
+  mrb_value cache = mrb_obj_iv_get(mrb, owner, name);
+
+  if (mrb_nil_p(cache)) {
+    cache = mrb_ary_new_capa(mrb, MRB_STR_CACHE_SLOTS);
+    mrb_ary_set(mrb, cache, MRB_STR_CACHE_SLOTS - 1, mrb_nil_value());
+    mrb_obj_iv_set(mrb, owner, name, cache);
+  }
+  return cache;
+}
+
+/* the entry in the slot of hash, or nil */
+mrb_value
+mrb_str_cache_get(mrb_state *mrb, struct RObject *owner, mrb_sym name, uint32_t hash)
+{
+  mrb_value cache = mrb_obj_iv_get(mrb, owner, name);
+
+  if (mrb_nil_p(cache)) return cache;
+  return RARRAY_PTR(cache)[hash % MRB_STR_CACHE_SLOTS];
+}
+
+void
+mrb_str_cache_set(mrb_state *mrb, struct RObject *owner, mrb_sym name, uint32_t hash, mrb_value obj)
+{
+  mrb_ary_set(mrb, str_cache_table(mrb, owner, name), hash % MRB_STR_CACHE_SLOTS, obj);
+}
+
+/*
+ * Returns the entry for the contents of str, compiling a new one with
+ * type->compile when the slot holds none.  The entry is protected by the
+ * GC arena, so a nested call replacing its slot does not free it while
+ * it is in use.
+ */
+void*
+mrb_str_cache_fetch(mrb_state *mrb, struct RObject *owner, mrb_sym name, mrb_value str, const mrb_str_cache_type *type)
+{
+  const char *src = RSTRING_PTR(str);
+  mrb_int len = RSTRING_LEN(str);
+  uint32_t hash = (uint32_t)mrb_str_hash(mrb, str);
+  mrb_value obj = mrb_str_cache_get(mrb, owner, name, hash);
+  struct RData *data;
+  mrb_str_cache_key *key;
+
+  if (!mrb_nil_p(obj) && DATA_TYPE(obj) == type->dtype) {
+    key = (mrb_str_cache_key*)DATA_PTR(obj);
+    if (key->hash == hash && key->len == len && memcmp(key->str, src, len) == 0) {
+      mrb_gc_protect(mrb, obj);
+      return key;
+    }
+  }
+
+  data = mrb_data_object_alloc(mrb, mrb->object_class, NULL, type->dtype);
+  key = (mrb_str_cache_key*)mrb_calloc(mrb, 1, type->size);
+  data->data = key;
+  key->hash = hash;
+  key->len = len;
+  key->str = (char*)mrb_malloc(mrb, len + 1);
+  memcpy(key->str, src, len);
+  type->compile(mrb, key);
+  if (len <= type->max_len) {
+    mrb_str_cache_set(mrb, owner, name, hash, mrb_obj_value(data));
+  }
+  return key;
+}
+
+/*
+  = Frozen strings
+
+  A string flagged MRB_STR_FROZEN raises on any change.  For each
+  contents the VM keeps at most one canonical frozen string in
+  mrb->fstr_table (flagged MRB_STR_FSTRING); String#-@ and hash key
+  insertion hand that string out instead of making a new copy.
+
+  The table does not keep its members alive: mrb_gc_free_str() takes a
+  member out, and a member that the running sweep has found dead is
+  replaced rather than handed out again.  Literals compiled in
+  frozen_string_literal mode are the exception.  Their pool entries
+  carry MRB_STR_FROZEN, and mrb->fstr_lits maps each of them to its
+  canonical string, which the GC marks until the irep owning the
+  literal is freed (see mrb_str_forget_literal()).
+*/
+
+typedef struct fstr_key {
+  struct RString *str;          /* member, or NULL in a lookup key */
+  const char *ptr;              /* contents of a lookup key */
+  mrb_int len;
+  uint32_t hash;
+} fstr_key;
+
+static inline khint_t
+fstr_hash_func(mrb_state *mrb, fstr_key key)
+{
+  return (khint_t)key.hash;
+}
+
+static inline mrb_bool
+fstr_hash_equal(mrb_state *mrb, fstr_key a, fstr_key b)
+{
+  const char *pa, *pb;
+  mrb_int la, lb;
+
+  if (a.hash != b.hash) return FALSE;
+  if (a.str) {
+    pa = STR_PTR(a.str);
+    la = STR_LEN(a.str);
+  }
+  else {
+    pa = a.ptr;
+    la = a.len;
+  }
+  if (b.str) {
+    pb = STR_PTR(b.str);
+    lb = STR_LEN(b.str);
+  }
+  else {
+    pb = b.ptr;
+    lb = b.len;
+  }
+  return la == lb && memcmp(pa, pb, la) == 0;
+}
+
+KHASH_SWISS_DECLARE(fstr, fstr_key, char, 0)
+KHASH_SWISS_DEFINE (fstr, fstr_key, char, 0, fstr_hash_func, fstr_hash_equal)
+
+#define fstr_lit_hash_func(mrb,key) kh_int64_hash_func(mrb, (uint64_t)(uintptr_t)(key))
+#define fstr_lit_hash_equal(mrb,a,b) ((a) == (b))
+
+KHASH_DECLARE(fstr_lit, struct RString*, struct RString*, 1)
+KHASH_DEFINE (fstr_lit, struct RString*, struct RString*, 1, fstr_lit_hash_func, fstr_lit_hash_equal)
+
+static fstr_key
+fstr_lookup_key(mrb_state *mrb, struct RString *s)
+{
+  fstr_key key;
+
+  key.str = NULL;
+  key.ptr = STR_PTR(s);
+  key.len = STR_LEN(s);
+  key.hash = (uint32_t)mrb_str_hash(mrb, mrb_obj_value(s));
+  return key;
+}
+
+/* the live member with the contents of key, or NULL */
+static struct RString*
+fstr_find(mrb_state *mrb, fstr_key key)
+{
+  kh_fstr_t *h = mrb->fstr_table;
+  khint_t k = kh_get(fstr, mrb, h, key);
+
+  if (k == kh_end(h)) return NULL;
+  if (is_dead(mrb, (struct RBasic*)kh_key(h, k).str)) return NULL;
+  return kh_key(h, k).str;
+}
+
+/* makes the frozen heap string s the member for its contents */
+static void
+fstr_enter(mrb_state *mrb, fstr_key key, struct RString *s)
+{
+  kh_fstr_t *h = mrb->fstr_table;
+  khint_t k = kh_get(fstr, mrb, h, key);
+
+  if (k == kh_end(h)) {
+    /* deleted slots count as occupied until a rehash; rehash without
+       growing when they are what fills the table */
+    if (h->n_occupied >= h->upper_bound && kh_size(h) < h->upper_bound / 2) {
+      kh_resize(fstr, mrb, h, kh_n_buckets(h));
+    }
+    k = kh_put(fstr, mrb, h, key);
+  }
+  key.str = s;
+  kh_key(h, k) = key;
+  s->flags |= MRB_STR_FSTRING;
+}
+
+static void
+fstr_forget(mrb_state *mrb, struct RString *s)
+{
+  kh_fstr_t *h = mrb->fstr_table;
+  khint_t k;
+
+  if (!h) return;
+  k = kh_get(fstr, mrb, h, fstr_lookup_key(mrb, s));
+  if (k != kh_end(h) && kh_key(h, k).str == s) {
+    kh_del(fstr, mrb, h, k);
+  }
+}
+
+mrb_value
+mrb_str_freeze(mrb_state *mrb, mrb_value str)
+{
+  mrb_str_ptr(str)->flags |= MRB_STR_FROZEN;
+  return str;
+}
+
+/*
+ * Returns the canonical frozen string with the contents of str: str
+ * itself if it is frozen and there is none yet, otherwise a frozen
+ * copy that shares its buffer when it can.
+ */
+mrb_value
+mrb_str_fstring(mrb_state *mrb, mrb_value str)
+{
+  struct RString *s = mrb_str_ptr(str);
+  struct RString *fs;
+  fstr_key key;
+
+  if (s->flags & MRB_STR_FSTRING) return str;
+  key = fstr_lookup_key(mrb, s);
+  fs = fstr_find(mrb, key);
+  if (fs) return mrb_obj_value(fs);
+  if (!MRB_STR_FROZEN_P(s)) {
+    str = mrb_str_subseq(mrb, str, 0, STR_LEN(s));
+    s = mrb_str_ptr(str);
+    s->flags |= MRB_STR_FROZEN;
+    key = fstr_lookup_key(mrb, s);
+  }
+  fstr_enter(mrb, key, s);
+  return str;
+}
+
+/*
+ * Returns the canonical string of a frozen pool literal; OP_STRING
+ * calls this instead of copying the literal.
+ */
+mrb_value
+mrb_str_frozen_literal(mrb_state *mrb, mrb_value lit)
+{
+  kh_fstr_lit_t *h = mrb->fstr_lits;
+  struct RString *l = mrb_str_ptr(lit);
+  struct RString *fs;
+  fstr_key key;
+  khint_t k;
+
+  k = kh_get(fstr_lit, mrb, h, l);
+  if (k != kh_end(h)) return mrb_obj_value(kh_value(h, k));
+
+  key = fstr_lookup_key(mrb, l);
+  fs = fstr_find(mrb, key);
+  if (!fs) {
+    fs = str_new(mrb, STR_PTR(l), STR_LEN(l));
+    fs->flags |= MRB_STR_FROZEN;
+    key = fstr_lookup_key(mrb, fs);
+    fstr_enter(mrb, key, fs);
+  }
+  k = kh_put(fstr_lit, mrb, h, l);
+  kh_value(h, k) = fs;
+  return mrb_obj_value(fs);
+}
+
+/* called when the irep holding the frozen pool literal lit is freed */
+void
+mrb_str_forget_literal(mrb_state *mrb, mrb_value lit)
+{
+  kh_fstr_lit_t *h = mrb->fstr_lits;
+  khint_t k;
+
+  if (!h) return;
+  k = kh_get(fstr_lit, mrb, h, mrb_str_ptr(lit));
+  if (k != kh_end(h)) {
+    kh_del(fstr_lit, mrb, h, k);
+  }
+}
+
+void
+mrb_gc_mark_fstr_lits(mrb_state *mrb)
+{
+  kh_fstr_lit_t *h = mrb->fstr_lits;
+  khint_t k;
+
+  if (!h) return;
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      mrb_gc_mark(mrb, (struct RBasic*)kh_value(h, k));
+    }
+  }
+}
+
+void
+mrb_free_fstr_table(mrb_state *mrb)
+{
+  kh_destroy(fstr, mrb, mrb->fstr_table);
+  kh_destroy(fstr_lit, mrb, mrb->fstr_lits);
+  mrb->fstr_table = NULL;
+  mrb->fstr_lits = NULL;
+}
+
+/*
+ *  call-seq:
+ *     str.freeze   => str
+ *
+ *  Prevents further modifications to <i>str</i>.  A
+ *  <code>RuntimeError</code> is raised if modification is attempted.
+ */
+static mrb_value
+mrb_str_freeze_m(mrb_state *mrb, mrb_value self)
+{
+  return mrb_str_freeze(mrb, self);
+}
+
+/*
+ *  call-seq:
+ *     str.frozen?   => true or false
+ *
+ *  Returns <code>true</code> if <i>str</i> is frozen.
+ */
+static mrb_value
+mrb_str_frozen_p(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(MRB_STR_FROZEN_P(mrb_str_ptr(self)));
+}
+
+/*
+ *  call-seq:
+ *     +str   => str or new_str
+ *
+ *  Returns <i>str</i> if it is not frozen, otherwise an unfrozen copy.
+ */
+static mrb_value
+mrb_str_uplus(mrb_state *mrb, mrb_value self)
+{
+  if (MRB_STR_FROZEN_P(mrb_str_ptr(self))) {
+    return mrb_str_dup(mrb, self);
+  }
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     -str   => frozen_str
+ *
+ *  Returns the deduplicated frozen string with the contents of
+ *  <i>str</i>; equal strings give the same object.
+ *
+ *     (-"abc").equal?(-"abc")   #=> true
+ */
+static mrb_value
+mrb_str_uminus(mrb_state *mrb, mrb_value self)
+{
+  return mrb_str_fstring(mrb, self);
+}
+
 /* 15.2.10.5.21 */
 /*
  *  call-seq:
@@ -1423,6 +2094,9 @@ str_replace(mrb_state *mrb, struct RString *s1, struct RString *s2)
 {
   long len;
 
+  if (MRB_STR_FROZEN_P(s1)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "can't modify frozen String");
+  }
   len = STR_LEN(s2);
   if (STR_SHARED_P(s2)) {
   L_SHARE:
@@ -1510,13 +2184,17 @@ mrb_str_init(mrb_state *mrb, mrb_value self)
  *  <code>:xxx</code> notation.
  *
  *     'cat and dog'.to_sym   #=> :"cat and dog"
+ *
+ *  A symbol created only this way is freed by <code>GC.start</code> (or by a
+ *  later <code>to_sym</code>) once no value, method, variable or constant
+ *  refers to it.
  */
 mrb_value
 mrb_str_intern(mrb_state *mrb, mrb_value self)
 {
   mrb_sym id;
 
-  id = mrb_intern_str(mrb, self);
+  id = mrb_intern_collectable(mrb, RSTRING_PTR(self), RSTRING_LEN(self));
   return mrb_symbol_value(id);
 
 }
@@ -1654,7 +2332,6 @@ mrb_str_reverse_bang(mrb_state *mrb, mrb_value str)
 static mrb_int
 mrb_str_rindex(mrb_state *mrb, mrb_value str, mrb_value sub, mrb_int pos)
 {
-  char *s, *sbeg, *t;
   struct RString *ps = mrb_str_ptr(str);
   mrb_int len = RSTRING_LEN(sub);
 
@@ -1663,17 +2340,8 @@ mrb_str_rindex(mrb_state *mrb, mrb_value str, mrb_value sub, mrb_int pos)
   if (STR_LEN(ps) - pos < len) {
     pos = STR_LEN(ps) - len;
   }
-  sbeg = STR_PTR(ps);
-  s = STR_PTR(ps) + pos;
-  t = RSTRING_PTR(sub);
   if (len) {
-    while (sbeg <= s) {
-      if (memcmp(s, t, len) == 0) {
-        return s - STR_PTR(ps);
-      }
-      s--;
-    }
-    return -1;
+    return mrb_memrsearch(RSTRING_PTR(sub), len, STR_PTR(ps), pos + len);
   }
   else {
     return pos;
@@ -1866,6 +2534,9 @@ mrb_str_split_m(mrb_state *mrb, mrb_value str)
 
   result = mrb_ary_new(mrb);
   beg = 0;
+  /* the first piece that shares the buffer makes str shared, which can
+     move its buffer; the loops below pick up the new one after each
+     mrb_str_subseq() */
   if (split_type == awk) {
     char *ptr = RSTRING_PTR(str);
     char *eptr = RSTRING_END(str);
@@ -1888,10 +2559,15 @@ mrb_str_split_m(mrb_state *mrb, mrb_value str)
         }
       }
       else if (ascii_isspace(c)) {
+        mrb_int off = ptr - bptr;
+
         mrb_ary_push(mrb, result, mrb_str_subseq(mrb, str, beg, end-beg));
         mrb_gc_arena_restore(mrb, ai);
+        bptr = RSTRING_PTR(str);
+        ptr = bptr + off;
+        eptr = RSTRING_END(str);
         skip = 1;
-        beg = ptr - bptr;
+        beg = off;
         if (lim_p) ++i;
       }
       else {
@@ -1908,9 +2584,13 @@ mrb_str_split_m(mrb_state *mrb, mrb_value str)
     if (slen == 0) {
       int ai = mrb_gc_arena_save(mrb);
       while (ptr < eptr) {
-        mrb_ary_push(mrb, result, mrb_str_subseq(mrb, str, ptr-temp, 1));
+        mrb_int off = ptr - temp;
+
+        mrb_ary_push(mrb, result, mrb_str_subseq(mrb, str, off, 1));
         mrb_gc_arena_restore(mrb, ai);
-        ptr++;
+        temp = RSTRING_PTR(str);
+        ptr = temp + off + 1;
+        eptr = RSTRING_END(str);
         if (lim_p && lim <= ++i) break;
       }
     }
@@ -1920,9 +2600,14 @@ mrb_str_split_m(mrb_state *mrb, mrb_value str)
 
       while (ptr < eptr &&
         (end = mrb_memsearch(sptr, slen, ptr, eptr - ptr)) >= 0) {
-        mrb_ary_push(mrb, result, mrb_str_subseq(mrb, str, ptr - temp, end));
+        mrb_int off = ptr - temp;
+
+        mrb_ary_push(mrb, result, mrb_str_subseq(mrb, str, off, end));
         mrb_gc_arena_restore(mrb, ai);
-        ptr += end + slen;
+        temp = RSTRING_PTR(str);
+        ptr = temp + off + end + slen;
+        eptr = RSTRING_END(str);
+        sptr = RSTRING_PTR(spat);
         if (lim_p && lim <= ++i) break;
       }
     }
@@ -1956,8 +2641,7 @@ mrb_cstr_to_inum(mrb_state *mrb, const char *str, int base, int badcheck)
   char *end;
   char sign = 1;
   int c;
-  unsigned long n;
-  mrb_int val;
+  mrb_int n, cutoff, cutlim;
 
 #undef ISDIGIT
 #define ISDIGIT(c) ('0' <= (c) && (c) <= '9')
@@ -2061,18 +2745,24 @@ mrb_cstr_to_inum(mrb_state *mrb, const char *str, int base, int badcheck)
     return mrb_fixnum_value(0);
   }
 
-  n = strtoul((char*)str, &end, base);
-  if (n > MRB_INT_MAX) {
-    mrb_raisef(mrb, E_ARGUMENT_ERROR, "string (%S) too big for integer", mrb_str_new_cstr(mrb, str));
+  /* accumulate without strtoul(), whose unsigned long may be
+     narrower or wider than mrb_int */
+  cutoff = MRB_INT_MAX / base;
+  cutlim = MRB_INT_MAX % base;
+  n = 0;
+  for (end = (char*)str; (c = conv_digit(*end)) >= 0 && c < base; end++) {
+    if (n > cutoff || (n == cutoff && c > cutlim)) {
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "string (%S) too big for integer", mrb_str_new_cstr(mrb, str));
+    }
+    n = n * base + c;
   }
-  val = n;
   if (badcheck) {
     if (end == str) goto bad; /* no number */
     while (*end && ISSPACE(*end)) end++;
     if (*end) goto bad;        /* trailing garbage */
   }
 
-  return mrb_fixnum_value(sign ? val : -val);
+  return mrb_fixnum_value(sign ? n : -n);
 bad:
   mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid string for number(%S)", mrb_str_new_cstr(mrb, str));
   /* not reached */
@@ -2176,7 +2866,7 @@ mrb_cstr_to_dbl(mrb_state *mrb, const char * p, mrb_bool badcheck)
   if (!badcheck && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
     return 0.0;
   }
-  d = strtod(p, &end);
+  d = mrb_float_read(p, &end);
   if (p == end) {
     if (badcheck) {
 bad:
@@ -2215,7 +2905,7 @@ bad:
       return 0.0;
     }
 
-    d = strtod(p, &end);
+    d = mrb_float_read(p, &end);
     if (badcheck) {
       if (!end || p == end) goto bad;
       while (*end && ISSPACE(*end)) end++;
@@ -2613,6 +3303,13 @@ mrb_init_string(mrb_state *mrb)
   mrb_define_method(mrb, s, "upcase!",         mrb_str_upcase_bang,     MRB_ARGS_REQ(1)); /* 15.2.10.5.43 */
   mrb_define_method(mrb, s, "inspect",         mrb_str_inspect,         MRB_ARGS_NONE()); /* 15.2.10.5.46(x) */
   mrb_define_method(mrb, s, "bytes",           mrb_str_bytes,           MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "freeze",          mrb_str_freeze_m,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "frozen?",         mrb_str_frozen_p,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "+@",              mrb_str_uplus,           MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "-@",              mrb_str_uminus,          MRB_ARGS_NONE());
+
+  mrb->fstr_table = kh_init(fstr, mrb);
+  mrb->fstr_lits = kh_init(fstr_lit, mrb);
 
   mrb_gv_set(mrb, mrb_intern_lit(mrb, "$;"), mrb_nil_value());
 }
@@ -9,10 +9,29 @@
 #include "mruby.h"
 #include "mruby/khash.h"
 #include "mruby/string.h"
+#include "mruby/presym.h"
+#include "mruby/presym/table.h"
+
+/*
+  = Symbol table
+
+  Symbols 1..MRB_PRESYM_MAX are pre-interned at build time; their names
+  live in one static arena, sorted by length and bytes, and are found by
+  binary search.  Symbols above MRB_PRESYM_MAX are created at run time:
+  name2sym maps their names to ids and symtbl maps ids back to names.
+
+  Symbols made by mrb_intern_collectable() (String#to_sym) are mortal:
+  mrb_gc_collect_symbols() marks the ones still referred to by values,
+  method tables, variable tables or call frames and frees the rest.  A
+  freed entry has a NULL name and its len links the next free id.  Any
+  other way of interning a name makes its symbol immortal.
+*/
 
 /* ------------------------------------------------------ */
 typedef struct symbol_name {
   mrb_bool lit : 1;
+  mrb_bool mortal : 1;
+  mrb_bool marked : 1;
   uint16_t len;
   const char *name;
 } symbol_name;
@@ -31,11 +50,36 @@ sym_hash_func(mrb_state *mrb, const symbol_name s)
 }
 #define sym_hash_equal(mrb,a, b) (a.len == b.len && memcmp(a.name, b.name, a.len) == 0)
 
-KHASH_DECLARE(n2s, symbol_name, mrb_sym, 1)
-KHASH_DEFINE (n2s, symbol_name, mrb_sym, 1, sym_hash_func, sym_hash_equal)
+/* a Swiss table: its tags spare most memcmp()s, and it mixes the weak
+   string hash above */
+KHASH_SWISS_DECLARE(n2s, symbol_name, mrb_sym, 1)
+KHASH_SWISS_DEFINE (n2s, symbol_name, mrb_sym, 1, sym_hash_func, sym_hash_equal)
 /* ------------------------------------------------------ */
 static mrb_sym
-sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
+presym_find(const char *name, size_t len)
+{
+  int lo = 0, hi = MRB_PRESYM_MAX;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = (int)len - (int)presym_length_table[mid];
+
+    if (cmp == 0) {
+      cmp = memcmp(name, presym_name_arena + presym_offset_table[mid], len);
+    }
+    if (cmp == 0) return (mrb_sym)(mid + 1);
+    if (cmp < 0) hi = mid;
+    else lo = mid + 1;
+  }
+  return 0;
+}
+
+#define SYMMORTAL_MIN 1024
+
+#define sym_entry(mrb, sym) (&(mrb)->symtbl[(sym) - MRB_PRESYM_MAX - 1])
+
+static mrb_sym
+sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit, mrb_bool mortal)
 {
   khash_t(n2s) *h = mrb->name2sym;
   symbol_name sname;
@@ -46,14 +90,44 @@ sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
   if (len > UINT16_MAX) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "symbol length too long");
   }
+  sym = presym_find(name, len);
+  if (sym) return sym;
+
   sname.lit = lit;
+  sname.mortal = mortal;
+  sname.marked = FALSE;
   sname.len = len;
   sname.name = name;
   k = kh_get(n2s, mrb, h, sname);
-  if (k != kh_end(h))
-    return kh_value(h, k);
+  if (k != kh_end(h)) {
+    sym = kh_value(h, k);
+    if (!mortal && sym_entry(mrb, sym)->mortal) {
+      sym_entry(mrb, sym)->mortal = FALSE;
+      mrb->symmortal--;
+    }
+    return sym;
+  }
 
-  sym = ++mrb->symidx;
+  if (mortal) {
+    if (mrb->symmortal >= mrb->symmortal_limit) {
+      mrb_gc_collect_symbols(mrb);
+      mrb->symmortal_limit = mrb->symmortal * 2 + SYMMORTAL_MIN;
+    }
+    mrb->symmortal++;
+  }
+  if (mrb->symfree) {
+    sym = mrb->symfree;
+    mrb->symfree = (mrb_sym)sym_entry(mrb, sym)->len;
+  }
+  else {
+    if ((size_t)(mrb->symidx - MRB_PRESYM_MAX) >= mrb->symcapa) {
+      size_t capa = mrb->symcapa ? mrb->symcapa * 2 : 256;
+
+      mrb->symtbl = (struct symbol_name*)mrb_realloc(mrb, mrb->symtbl, sizeof(symbol_name) * capa);
+      mrb->symcapa = capa;
+    }
+    sym = ++mrb->symidx;
+  }
   if (lit) {
     sname.name = name;
   }
@@ -65,6 +139,7 @@ sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
   }
   k = kh_put(n2s, mrb, h, sname);
   kh_value(h, k) = sym;
+  *sym_entry(mrb, sym) = sname;
 
   return sym;
 }
@@ -72,13 +147,19 @@ sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
 mrb_sym
 mrb_intern(mrb_state *mrb, const char *name, size_t len)
 {
-  return sym_intern(mrb, name, len, FALSE);
+  return sym_intern(mrb, name, len, FALSE, FALSE);
 }
 
 mrb_sym
 mrb_intern_static(mrb_state *mrb, const char *name, size_t len)
 {
-  return sym_intern(mrb, name, len, TRUE);
+  return sym_intern(mrb, name, len, TRUE, FALSE);
+}
+
+mrb_sym
+mrb_intern_collectable(mrb_state *mrb, const char *name, size_t len)
+{
+  return sym_intern(mrb, name, len, FALSE, TRUE);
 }
 
 mrb_sym
@@ -99,10 +180,14 @@ mrb_check_intern(mrb_state *mrb, const char *name, size_t len)
   khash_t(n2s) *h = mrb->name2sym;
   symbol_name sname = { 0 };
   khiter_t k;
+  mrb_sym sym;
 
   if (len > UINT16_MAX) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "symbol length too long");
   }
+  sym = presym_find(name, len);
+  if (sym) return mrb_symbol_value(sym);
+
   sname.len = len;
   sname.name = name;
 
@@ -129,17 +214,16 @@ mrb_check_intern_str(mrb_state *mrb, mrb_value str)
 const char*
 mrb_sym2name_len(mrb_state *mrb, mrb_sym sym, mrb_int *lenp)
 {
-  khash_t(n2s) *h = mrb->name2sym;
-  khiter_t k;
-  symbol_name sname;
+  if (sym > 0 && sym <= MRB_PRESYM_MAX) {
+    if (lenp) *lenp = presym_length_table[sym - 1];
+    return presym_name_arena + presym_offset_table[sym - 1];
+  }
+  if (sym > MRB_PRESYM_MAX && sym <= mrb->symidx) {
+    symbol_name *sname = sym_entry(mrb, sym);
 
-  for (k = kh_begin(h); k != kh_end(h); k++) {
-    if (kh_exist(h, k)) {
-      if (kh_value(h, k) == sym) {
-        sname = kh_key(h, k);
-        if (lenp) *lenp = sname.len;
-        return sname.name;
-      }
+    if (sname->name) {
+      if (lenp) *lenp = sname->len;
+      return sname->name;
     }
   }
   if (lenp) *lenp = 0;
@@ -147,19 +231,49 @@ mrb_sym2name_len(mrb_state *mrb, mrb_sym sym, mrb_int *lenp)
 }
 
 void
-mrb_free_symtbl(mrb_state *mrb)
+mrb_gc_mark_sym(mrb_state *mrb, mrb_sym sym)
+{
+  if (sym > MRB_PRESYM_MAX && sym <= mrb->symidx) {
+    sym_entry(mrb, sym)->marked = TRUE;
+  }
+}
+
+/* frees the mortal symbols left unmarked by mrb_gc_collect_symbols() */
+void
+mrb_gc_sweep_symtbl(mrb_state *mrb)
 {
   khash_t(n2s) *h = mrb->name2sym;
-  khiter_t k;
+  int i;
 
-  for (k = kh_begin(h); k != kh_end(h); k++)
-    if (kh_exist(h, k)) {
-      symbol_name s = kh_key(h, k);
+  for (i = MRB_PRESYM_MAX + 1; i <= mrb->symidx; i++) {
+    symbol_name *sname = sym_entry(mrb, i);
 
-      if (!s.lit) {
-        mrb_free(mrb, (char*)s.name);
-      }
+    if (!sname->mortal) continue;
+    if (sname->marked) {
+      sname->marked = FALSE;
+      continue;
     }
+    kh_del(n2s, mrb, h, kh_get(n2s, mrb, h, *sname));
+    mrb_free(mrb, (char*)sname->name);
+    sname->name = NULL;
+    sname->mortal = FALSE;
+    sname->len = (uint16_t)mrb->symfree;
+    mrb->symfree = (mrb_sym)i;
+    mrb->symmortal--;
+  }
+}
+
+void
+mrb_free_symtbl(mrb_state *mrb)
+{
+  int i;
+
+  for (i = 0; i < mrb->symidx - MRB_PRESYM_MAX; i++) {
+    if (mrb->symtbl[i].name && !mrb->symtbl[i].lit) {
+      mrb_free(mrb, (char*)mrb->symtbl[i].name);
+    }
+  }
+  mrb_free(mrb, mrb->symtbl);
   kh_destroy(n2s, mrb, mrb->name2sym);
 }
 
@@ -167,6 +281,8 @@ void
 mrb_init_symtbl(mrb_state *mrb)
 {
   mrb->name2sym = kh_init(n2s, mrb);
+  mrb->symidx = MRB_PRESYM_MAX;
+  mrb->symmortal_limit = SYMMORTAL_MIN;
 }
 
 /**********************************************************************
@@ -243,6 +359,10 @@ mrb_sym_to_s(mrb_state *mrb, mrb_value sym)
   mrb_int len;
 
   p = mrb_sym2name_len(mrb, id, &len);
+  if (id > MRB_PRESYM_MAX && sym_entry(mrb, id)->mortal) {
+    /* the name may be freed before the string */
+    return mrb_str_new(mrb, p, len);
+  }
   return mrb_str_new_static(mrb, p, len);
 }
 
@@ -413,6 +533,9 @@ mrb_sym2str(mrb_state *mrb, mrb_sym sym)
   const char *name = mrb_sym2name_len(mrb, sym, &len);
 
   if (!name) return mrb_undef_value(); /* can't happen */
+  if (sym > MRB_PRESYM_MAX && sym_entry(mrb, sym)->mortal) {
+    return mrb_str_new(mrb, name, len);
+  }
   return mrb_str_new_static(mrb, name, len);
 }
 
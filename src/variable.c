@@ -10,6 +10,7 @@
 #include "mruby/class.h"
 #include "mruby/proc.h"
 #include "mruby/string.h"
+#include "mruby/variable.h"
 
 static const char *const mrb_gv_alias_names[] = {
   "$LOAD_PATH=$:",
@@ -17,7 +18,7 @@ static const char *const mrb_gv_alias_names[] = {
   NULL
 };
 
-typedef int (iv_foreach_func)(mrb_state*,mrb_sym,mrb_value,void*);
+typedef mrb_iv_foreach_func iv_foreach_func;
 
 #ifdef MRB_USE_IV_SEGLIST
 
@@ -273,6 +274,18 @@ iv_copy(mrb_state *mrb, iv_tbl *t)
   return t2;
 }
 
+static size_t
+iv_bytes(mrb_state *mrb, iv_tbl *t)
+{
+  segment *seg;
+  size_t size = sizeof(iv_tbl);
+
+  for (seg = t->rootseg; seg; seg = seg->next) {
+    size += sizeof(segment);
+  }
+  return size;
+}
+
 static void
 iv_free(mrb_state *mrb, iv_tbl *t)
 {
@@ -290,6 +303,7 @@ iv_free(mrb_state *mrb, iv_tbl *t)
 #else
 
 #include "mruby/khash.h"
+#include "mruby/presym.h"
 
 #ifndef MRB_IVHASH_INIT_SIZE
 #define MRB_IVHASH_INIT_SIZE 8
@@ -388,6 +402,14 @@ iv_copy(mrb_state *mrb, iv_tbl *t)
   return (iv_tbl*)kh_copy(iv, mrb, &t->h);
 }
 
+static size_t
+iv_bytes(mrb_state *mrb, iv_tbl *t)
+{
+  khint_t n = kh_n_buckets(&t->h);
+
+  return sizeof(iv_tbl) + kh_flags_bytes(&t->h) + n*(sizeof(mrb_sym)+sizeof(mrb_value));
+}
+
 static void
 iv_free(mrb_state *mrb, iv_tbl *t)
 {
@@ -399,6 +421,7 @@ iv_free(mrb_state *mrb, iv_tbl *t)
 static int
 iv_mark_i(mrb_state *mrb, mrb_sym sym, mrb_value v, void *p)
 {
+  if (mrb->gc_mark_syms) mrb_gc_mark_sym(mrb, sym);
   mrb_gc_mark_value(mrb, v);
   return 0;
 }
@@ -436,6 +459,13 @@ mrb_gc_mark_iv_size(mrb_state *mrb, struct RObject *obj)
   return iv_size(mrb, obj->iv);
 }
 
+size_t
+mrb_gc_iv_bytes(mrb_state *mrb, struct RObject *obj)
+{
+  if (!obj->iv) return 0;
+  return iv_bytes(mrb, obj->iv);
+}
+
 void
 mrb_gc_free_iv(mrb_state *mrb, struct RObject *obj)
 {
@@ -471,6 +501,22 @@ obj_iv_p(mrb_value obj)
   }
 }
 
+/*
+ * Calls func for each instance variable of obj until it returns a
+ * positive value; a negative value removes the variable.
+ */
+void
+mrb_iv_foreach(mrb_state *mrb, mrb_value obj, mrb_iv_foreach_func *func, void *p)
+{
+  struct RObject *o;
+
+  if (!obj_iv_p(obj)) return;
+  o = mrb_obj_ptr(obj);
+  if (o->iv) {
+    iv_foreach(mrb, o->iv, func, p);
+  }
+}
+
 mrb_value
 mrb_obj_iv_get(mrb_state *mrb, struct RObject *obj, mrb_sym sym)
 {
@@ -879,7 +925,7 @@ L_RETRY:
     goto L_RETRY;
   }
   name = mrb_symbol_value(sym);
-  return mrb_funcall_argv(mrb, mrb_obj_value(base), mrb_intern_lit(mrb, "const_missing"), 1, &name);
+  return mrb_funcall_argv(mrb, mrb_obj_value(base), MRB_SYM(const_missing), 1, &name);
 }
 
 mrb_value
@@ -1147,7 +1193,7 @@ mrb_class_sym(mrb_state *mrb, struct RClass *c, struct RClass *outer)
 {
   mrb_value name;
 
-  name = mrb_obj_iv_get(mrb, (struct RObject*)c, mrb_intern_lit(mrb, "__classid__"));
+  name = mrb_obj_iv_get(mrb, (struct RObject*)c, MRB_SYM(__classid__));
   if (mrb_nil_p(name)) {
 
     if (!outer) return 0;
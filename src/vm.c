@@ -17,6 +17,7 @@
 #include "mruby/string.h"
 #include "mruby/variable.h"
 #include "mruby/error.h"
+#include "mruby/presym.h"
 #include "opcode.h"
 #include "value_array.h"
 #include "mrb_throw.h"
@@ -365,7 +366,7 @@ mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, mr
     p = mrb_method_search_vm(mrb, &c, mid);
     if (!p) {
       undef = mid;
-      mid = mrb_intern_lit(mrb, "method_missing");
+      mid = MRB_SYM(method_missing);
       p = mrb_method_search_vm(mrb, &c, mid);
       n++; argc++;
     }
@@ -976,7 +977,7 @@ RETRY_TRY_BLOCK:
       if (!m) {
         mrb_value sym = mrb_symbol_value(mid);
 
-        mid = mrb_intern_lit(mrb, "method_missing");
+        mid = MRB_SYM(method_missing);
         m = mrb_method_search_vm(mrb, &c, mid);
         if (n == CALL_MAXARGS) {
           mrb_ary_unshift(mrb, regs[a+1], sym);
@@ -1134,7 +1135,7 @@ RETRY_TRY_BLOCK:
       c = mrb->c->ci->target_class->super;
       m = mrb_method_search_vm(mrb, &c, mid);
       if (!m) {
-        mid = mrb_intern_lit(mrb, "method_missing");
+        mid = MRB_SYM(method_missing);
         m = mrb_method_search_vm(mrb, &c, mid);
         if (n == CALL_MAXARGS) {
           mrb_ary_unshift(mrb, regs[a+1], mrb_symbol_value(ci->mid));
@@ -1346,8 +1347,8 @@ RETRY_TRY_BLOCK:
 
       L_RAISE:
         ci = mrb->c->ci;
-        mrb_obj_iv_ifnone(mrb, mrb->exc, mrb_intern_lit(mrb, "lastpc"), mrb_cptr_value(mrb, pc));
-        mrb_obj_iv_ifnone(mrb, mrb->exc, mrb_intern_lit(mrb, "ciidx"), mrb_fixnum_value(ci - mrb->c->cibase));
+        mrb_obj_iv_ifnone(mrb, mrb->exc, MRB_SYM(lastpc), mrb_cptr_value(mrb, pc));
+        mrb_obj_iv_ifnone(mrb, mrb->exc, MRB_SYM(ciidx), mrb_fixnum_value(ci - mrb->c->cibase));
         eidx = ci->eidx;
         if (ci == mrb->c->cibase) {
           if (ci->ridx == 0) goto L_STOP;
@@ -1491,7 +1492,7 @@ RETRY_TRY_BLOCK:
       if (!m) {
         mrb_value sym = mrb_symbol_value(mid);
 
-        mid = mrb_intern_lit(mrb, "method_missing");
+        mid = MRB_SYM(method_missing);
         m = mrb_method_search_vm(mrb, &c, mid);
         if (n == CALL_MAXARGS) {
           mrb_ary_unshift(mrb, regs[a+1], sym);
@@ -1956,7 +1957,9 @@ RETRY_TRY_BLOCK:
 
     CASE(OP_ARRAY) {
       /* A B C          R(A) := ary_new(R(B),R(B+1)..R(B+C)) */
+      ERR_PC_SET(mrb, pc);
       regs[GETARG_A(i)] = mrb_ary_new_from_values(mrb, GETARG_C(i), &regs[GETARG_B(i)]);
+      ERR_PC_CLR(mrb);
       ARENA_RESTORE(mrb, ai);
       NEXT;
     }
@@ -2043,7 +2046,17 @@ RETRY_TRY_BLOCK:
 
     CASE(OP_STRING) {
       /* A Bx           R(A) := str_new(Lit(Bx)) */
-      regs[GETARG_A(i)] = mrb_str_dup(mrb, pool[GETARG_Bx(i)]);
+      mrb_value lit = pool[GETARG_Bx(i)];
+
+      ERR_PC_SET(mrb, pc);
+      if (MRB_STR_FROZEN_P(mrb_str_ptr(lit))) {
+        /* frozen_string_literal: the same object every time */
+        regs[GETARG_A(i)] = mrb_str_frozen_literal(mrb, lit);
+      }
+      else {
+        regs[GETARG_A(i)] = mrb_str_dup(mrb, lit);
+      }
+      ERR_PC_CLR(mrb);
       ARENA_RESTORE(mrb, ai);
       NEXT;
     }
@@ -2059,8 +2072,11 @@ RETRY_TRY_BLOCK:
       int b = GETARG_B(i);
       int c = GETARG_C(i);
       int lim = b+c*2;
-      mrb_value hash = mrb_hash_new_capa(mrb, c);
+      mrb_value hash;
 
+      ERR_PC_SET(mrb, pc);
+      hash = mrb_hash_new_capa(mrb, c);
+      ERR_PC_CLR(mrb);
       while (b < lim) {
         mrb_hash_set(mrb, hash, regs[b], regs[b+1]);
         b+=2;
@@ -2075,12 +2091,14 @@ RETRY_TRY_BLOCK:
       struct RProc *p;
       int c = GETARG_c(i);
 
+      ERR_PC_SET(mrb, pc);
       if (c & OP_L_CAPTURE) {
         p = mrb_closure_new(mrb, irep->reps[GETARG_b(i)]);
       }
       else {
         p = mrb_proc_new(mrb, irep->reps[GETARG_b(i)]);
       }
+      ERR_PC_CLR(mrb);
       if (c & OP_L_STRICT) p->flags |= MRB_PROC_STRICT;
       regs[GETARG_A(i)] = mrb_obj_value(p);
       ARENA_RESTORE(mrb, ai);
@@ -2203,7 +2221,9 @@ RETRY_TRY_BLOCK:
     CASE(OP_RANGE) {
       /* A B C  R(A) := range_new(R(B),R(B+1),C) */
       int b = GETARG_B(i);
+      ERR_PC_SET(mrb, pc);
       regs[GETARG_A(i)] = mrb_range_new(mrb, regs[b], regs[b+1], GETARG_C(i));
+      ERR_PC_CLR(mrb);
       ARENA_RESTORE(mrb, ai);
       NEXT;
     }
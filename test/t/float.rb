@@ -154,6 +154,38 @@ assert('Float#to_i', '15.2.9.3.14') do
   assert_equal(3, 3.123456789.to_i)
 end
 
+assert('Float#to_s') do
+  assert_equal("0.1", 0.1.to_s)
+  assert_equal("-0.0", -0.0.to_s)
+  assert_equal("0.3333333333333333", (1.0/3).to_s)
+  assert_equal("1.0e+16", 1e16.to_s)
+  assert_equal("1.0e+15", 1e15.to_s)
+  assert_equal("8.644273024543573e+15", 8644273024543573.0.to_s)
+  assert_equal("9.999999999999998e+15", 9999999999999998.0.to_s)
+  assert_equal("100000000000000.0", 1e14.to_s)
+  assert_equal("999999999999999.9", 999999999999999.9.to_s)
+  assert_equal("2425454668982187.5", 2425454668982187.5.to_s)
+  assert_equal("1000000000000000.2", 1000000000000000.2.to_s)
+  assert_equal("1234567890123456.8", 1234567890123456.7.to_s)
+  assert_equal("1.5e+15", 1.5e15.to_s)
+  assert_equal("1.2345678901234568e+16", 12345678901234567.0.to_s)
+  assert_equal("0.0001", 0.0001.to_s)
+  assert_equal("1.0e-05", 0.00001.to_s)
+  assert_equal("1.7976931348623157e+308", 1.7976931348623157e308.to_s)
+  assert_equal("inf", (1.0/0.0).to_s)
+  assert_equal("NaN", (0.0/0.0).to_s)
+  [0.1, 2.0/3, 123456.789, 5e-324, 2.2250738585072014e-308].each do |f|
+    assert_equal(f, f.to_s.to_f)
+  end
+end
+
+assert('Float literals at the ends of the range') do
+  assert_true 5e-324 > 0
+  assert_equal 5e-324, 2.5e-324
+  assert_equal 2.2250738585072014e-308 / 2, 1.1125369292536007e-308
+  assert_equal 0.0, 0.0e-400
+end
+
 assert('Float#truncate', '15.2.9.3.15') do
   assert_equal( 3,  3.123456789.truncate)
   assert_equal(-3, -3.1.truncate)
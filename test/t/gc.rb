@@ -43,3 +43,143 @@ assert('GC.generational_mode=') do
     GC.generational_mode = origin
   end
 end
+
+assert('GC.stat') do
+  GC.start
+  s = GC.stat
+  assert_kind_of Hash, s
+  assert_true s[:major_gc_count] > 0
+  assert_equal s[:minor_gc_count] + s[:major_gc_count], s[:count]
+  assert_true s[:sweep_count] > 0
+  assert_kind_of Float, s[:sweep_time]
+  assert_equal s[:step_count], s[:step_histogram].inject(0) { |sum, n| sum + n }
+  assert_equal GC.stat(:major_gc_count), GC.stat[:major_gc_count]
+  assert_raise(ArgumentError) { GC.stat(:no_such_key) }
+end
+
+assert('GC.stat with result hash') do
+  h = { :foo => 1 }
+  assert_equal h.object_id, GC.stat(h).object_id
+  assert_nil h[:foo]
+  assert_true h.key?(:root_scan_time)
+end
+
+assert('GC.stat slab keys') do
+  s = GC.stat
+  skip "the VM does not use the slab allocator" unless s.key?(:slab_used_bytes)
+  assert_true s[:slab_used_bytes] > 0
+  assert_true s[:slab_used_bytes] + s[:slab_free_bytes] <= s[:slab_chunk_bytes]
+  assert_kind_of Fixnum, s[:slab_large_count]
+  assert_kind_of Fixnum, s[:slab_large_bytes]
+end
+
+assert('GC.pause_target=') do
+  origin = GC.pause_target
+  ratio = GC.interval_ratio
+  begin
+    assert_equal 0, GC.pause_target
+    assert_equal 1000, (GC.pause_target = 1000)
+    assert_equal 1000, GC.pause_target
+    a = nil
+    3000.times { a = [a, "paced"] }
+    assert_true GC.stat(:step_limit) > 0
+    assert_true GC.interval_ratio <= 100 + GC.growth_budget
+    assert_raise(ArgumentError) { GC.pause_target = -1 }
+  ensure
+    GC.pause_target = origin
+    GC.interval_ratio = ratio
+  end
+end
+
+assert('GC.growth_budget=') do
+  origin = GC.growth_budget
+  begin
+    assert_equal 50, (GC.growth_budget = 50)
+    assert_equal 50, GC.growth_budget
+    max = 1
+    max = max + max + 1 while (max + max + 1).kind_of?(Fixnum)
+    GC.growth_budget = max
+    assert_equal 10000, GC.growth_budget
+    GC.growth_budget = 1
+    assert_equal 10, GC.growth_budget
+  ensure
+    GC.growth_budget = origin
+  end
+end
+
+assert('GC.step') do
+  GC.start
+  assert_true GC.step(1000)
+  a = []
+  2000.times { a << "step" }
+  a = nil
+  done = false
+  100.times { break if (done = GC.step(100000)) }
+  assert_true done
+  assert_raise(ArgumentError) { GC.step(-1) }
+end
+
+assert('GC.idle_mode=') do
+  begin
+    assert_false GC.idle_mode
+    assert_true (GC.idle_mode = true)
+    assert_true GC.idle_mode
+    GC.start
+    before = GC.stat(:step_count)
+    100.times { "idle" }
+    assert_equal before, GC.stat(:step_count)
+  ensure
+    GC.idle_mode = false
+  end
+end
+
+assert('GC card marking of large array') do
+  a = Array.new(4096)
+  h = {}
+  2000.times { |i| h[i] = i }
+  GC.start
+  10.times do |n|
+    a[n * 400] = "elem#{n}"
+    a.push "pushed#{n}"
+    h[n] = "value#{n}"
+    GC.step(0)
+  end
+  GC.start
+  10.times do |n|
+    assert_equal "elem#{n}", a[n * 400]
+    assert_equal "pushed#{n}", a[4096 + n]
+    assert_equal "value#{n}", h[n]
+  end
+end
+
+assert('GC card marking with moved array slots') do
+  [[:shift, 1023], [:reverse!, 3071], [:delete_at, 1023]].each do |op, idx|
+    b = Array.new(4096) { |i| i }
+    GC.start
+    b[1024] = "fresh" * 3
+    op == :delete_at ? b.delete_at(0) : b.__send__(op)
+    20000.times { "garbage" + "x" }
+    GC.start
+    20000.times { [1, 2, 3] }
+    assert_equal "freshfreshfresh", b[idx]
+  end
+end
+
+assert('GC.malloc_ratio=') do
+  origin = GC.malloc_ratio
+  begin
+    assert_equal 150, (GC.malloc_ratio = 150)
+    assert_equal 150, GC.malloc_ratio
+  ensure
+    GC.malloc_ratio = origin
+  end
+end
+
+assert('GC triggered by malloc bytes') do
+  GC.start
+  assert_true GC.stat(:malloc_limit) > 0
+  before = GC.stat(:malloc_step_count)
+  s = "x" * 1024
+  (GC.stat(:malloc_limit) / 100000 + 2).times { s * 100 }
+  assert_true GC.stat(:malloc_step_count) > before
+end
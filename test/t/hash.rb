@@ -331,3 +331,156 @@ assert('Hash#inspect') do
   assert_include ret, '"a"=>100'
   assert_include ret, '"d"=>400'
 end
+
+assert('Hash string keys are shared frozen strings') do
+  k = "key"
+  a = { k => 1 }
+  b = { k => 2 }
+  assert_true a.keys[0].frozen?
+  assert_true a.keys[0].equal?(b.keys[0])
+  k << "!"
+  assert_equal 1, a["key"]
+  assert_false k.frozen?
+end
+
+assert('Hash keeps insertion order') do
+  h = {}
+  [5, :a, "x", 2.5, 1].each_with_index { |k, i| h[k] = i }
+  assert_equal [5, :a, "x", 2.5, 1], h.keys
+  assert_equal [0, 1, 2, 3, 4], h.values
+  h.delete(:a)
+  h[:a] = 9
+  h["x"] = 7
+  assert_equal [5, "x", 2.5, 1, :a], h.keys
+  assert_equal [[5, 0], ["x", 7], [2.5, 3], [1, 4], [:a, 9]], h.to_a
+  assert_equal [5, 0], h.shift
+  assert_equal ["x", 7], h.shift
+end
+
+assert('Hash with many insertions and deletions') do
+  h = {}
+  1000.times { |i| h[i] = i }
+  500.times { |i| h.delete(i * 2) }
+  assert_equal 500, h.size
+  assert_equal Array.new(500) { |i| i * 2 + 1 }, h.keys
+  1000.times { |i| h["s#{i}"] = i }
+  assert_equal 1500, h.size
+  assert_equal 999, h["s999"]
+  assert_equal 3, h[3]
+  assert_nil h[2]
+  h.size.times { h.shift }
+  assert_true h.empty?
+  h[:k] = 1
+  assert_equal({:k => 1}, h)
+end
+
+assert('Hash lookup when eql? changes the hash') do
+  class HashMutatingKey
+    attr_reader :h
+    def initialize(h); @h = h; end
+    def hash; 1; end
+    def eql?(o)
+      20.times { |i| @h[i] = i } if @h.size < 10
+      equal?(o)
+    end
+  end
+  h = {}
+  k1 = HashMutatingKey.new(h)
+  k2 = HashMutatingKey.new(h)
+  h[k1] = 1
+  h[k2] = 2
+  assert_equal 2, h[k2]
+  assert_equal 1, h[k1]
+  assert_equal 22, h.size
+end
+
+assert('Hash with immediate keys of different types') do
+  h = {1 => :int, 1.0 => :float, nil => :nil, false => :false, true => :true, :a => :sym, "a" => :str}
+  assert_equal :int, h[1]
+  assert_equal :float, h[1.0]
+  assert_equal :nil, h[nil]
+  assert_equal :false, h[false]
+  assert_equal :true, h[true]
+  assert_equal :sym, h[:a]
+  assert_equal :str, h["a"]
+  assert_nil h[2]
+  assert_nil h[:b]
+end
+
+assert('Hash growing and shrinking across sizes') do
+  h = {}
+  20.times do |n|
+    assert_equal n, h.size
+    n.times { |i| assert_equal i, h[i] } if n % 4 == 0
+    h[n] = n
+    h["s#{n}"] = n
+    h.delete("s#{n}")
+    h["s#{n}"] = n
+    h.delete(n)
+    h[n] = n
+    h.delete("s#{n}")
+  end
+  assert_equal (0...20).to_a, h.keys
+  h.reject! { |k, v| k > 2 }
+  assert_equal({0 => 0, 1 => 1, 2 => 2}, h)
+  h[:x] = 1
+  assert_equal [0, 1, 2, :x], h.keys
+end
+
+assert('Hash with array and range keys') do
+  h = {[1, "a", :b, 2.5] => 1, [[1, 2], [3]] => 2, (1..3) => 3, (1...3) => 4, ("a".."c") => 5}
+  assert_equal 1, h[[1, "a", :b, 2.5]]
+  assert_nil h[[1.0, "a", :b, 2.5]]
+  assert_equal 2, h[[[1, 2], [3]]]
+  assert_equal 3, h[1..3]
+  assert_equal 4, h[1...3]
+  assert_equal 5, h["a".."c"]
+  assert_nil h[1..4]
+
+  a = [1]; a << a
+  b = [1]; b << b
+  assert_equal a.hash, b.hash
+  h = {a => :cyclic}
+  assert_equal :cyclic, h[a]
+  assert_equal :cyclic, h[b]
+end
+
+assert('Hash with float keys') do
+  h = {0.0 => 1, 2.0 => 2, 1.5 => 3}
+  assert_equal 1, h[-0.0]
+  assert_equal 2, h[2.0]
+  assert_equal 3, h[1.5]
+  assert_nil h[2]
+  assert_equal 4, {-0.0 => 4}[0.0]
+  assert_equal 5, {[0.0, 1] => 5}[[-0.0, 1]]
+  h[-0.0] = 6
+  assert_equal 3, h.size
+  assert_equal 6, h[0.0]
+end
+
+assert('Hash keys with redefined hash and eql?') do
+  class HashKeyArray < Array
+    def hash; 0; end
+    def eql?(o); true; end
+  end
+  k = HashKeyArray.new
+  k.push 5
+  assert_equal 1, {HashKeyArray.new => 1}[k]
+
+  class Array
+    alias hash_test_eql eql?
+    alias hash_test_hash hash
+    def eql?(o); true; end
+    def hash; 0; end
+  end
+  begin
+    assert_equal 1, {[1] => 1}[[2]]
+  ensure
+    class Array
+      alias eql? hash_test_eql
+      alias hash hash_test_hash
+    end
+  end
+  assert_nil({[1] => 1}[[2]])
+  assert_equal 1, {[1] => 1}[[1]]
+end
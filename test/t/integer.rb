@@ -197,6 +197,9 @@ end
 assert('Integer#to_s', '15.2.8.3.25') do
   assert_equal '1', 1.to_s
   assert_equal("-1", -1.to_s)
+  assert_equal("1234567890", 1234567890.to_s)
+  assert_equal("-100", -100.to_s)
+  assert_equal("1111011", 123.to_s(2))
 end
 
 assert('Integer#truncate', '15.2.8.3.26') do
@@ -269,6 +269,22 @@ assert('String#hash', '15.2.10.5.20') do
   assert_equal 'abc'.hash, a.hash
 end
 
+assert('String#hash after modification') do
+  short = 'abc'
+  long = 'x' * 100
+  key = long[0, 50]
+  h = { short => 1, long => 2, key => 3 }
+  short.hash
+  long.hash
+  short << 'd'
+  long << 'y'
+  assert_equal 'abcd'.hash, short.hash
+  assert_equal(('x' * 100 + 'y').hash, long.hash)
+  assert_equal [1, 2, 3], [h['abc'], h['x' * 100], h['x' * 50]]
+  assert_nil h[short]
+  assert_nil h[long]
+end
+
 assert('String#include?', '15.2.10.5.21') do
   assert_true 'abc'.include?(97)
   assert_false 'abc'.include?(100)
@@ -282,6 +298,21 @@ assert('String#index', '15.2.10.5.22') do
   assert_equal 3, 'abcabc'.index('a', 1)
 end
 
+assert('String#index/rindex with long haystack') do
+  s = 'ab' * 100 + 'xyz' + 'ab' * 100 + 'xyz' + 'ab' * 10
+  assert_equal 200, s.index('xyz')
+  assert_equal 403, s.index('xyz', 201)
+  assert_equal 403, s.rindex('xyz')
+  assert_equal 200, s.rindex('xyz', 402)
+  assert_equal 199, s.index('bxy')
+  assert_nil s.index('xyzxyz')
+  assert_nil s.rindex('ba' * 11 + 'x')
+  assert_true s.include?('abxyzab')
+  assert_equal 3, s.split('xyz').size
+  assert_equal 63, ('a' * 70 + 'b').index('a' * 7 + 'b')
+  assert_equal 0, ('b' + 'a' * 70).rindex('b' + 'a' * 7)
+end
+
 assert('String#initialize', '15.2.10.5.23') do
   a = ''
   a.initialize('abc')
@@ -444,6 +475,36 @@ assert('String#split with non-Regexp separator') do
   r
 end
 
+assert('String#split on a string built with <<') do
+  s = ""
+  100.times { |i| s << "item#{i}," }
+  a = s.split(",")
+  assert_equal 100, a.size
+  assert_equal "item0", a[0]
+  assert_equal "item99", a[99]
+  l = ""
+  50.times { |i| l << "w#{i} " }
+  assert_equal 50, l.split.size
+  assert_equal "w49", l.split.last
+  c = ""
+  30.times { c << "ab" }
+  assert_equal ["a", "b"] * 30, c.split("")
+  s << "tail"
+  assert_equal "tail", s.split(",").last
+end
+
+assert('String#split with long pieces of a growing buffer') do
+  f = "f" * 40
+  s = ""
+  4.times { s << f << "," }
+  assert_equal [f] * 4, s.split(",")
+  assert_equal f, s[0, 40]
+  t = ""
+  4.times { t << f << " " }
+  assert_equal [f] * 4, t.split
+  assert_equal ["f"] * 40, f.dup.concat("").split("")
+end
+
 # TODO Broken ATM
 assert('String#split', '15.2.10.5.35') do
   # without RegExp behavior is actually unspecified
@@ -453,6 +514,18 @@ assert('String#split', '15.2.10.5.35') do
   assert_equal ['a', 'b', 'c'], 'abc'.split("")
 end
 
+assert('String#split pieces and the receiver are independent') do
+  field = 'x' * 40
+  s = [field, field, 'y'].join(',')
+  a = s.split(',')
+  a[0] << '!'
+  s[0] = 'Z'
+  assert_equal field + '!', a[0]
+  assert_equal field, a[1]
+  assert_equal 'y', a[2]
+  assert_equal 'Z' + field[1..-1], s[0, 40]
+end
+
 assert('String#sub', '15.2.10.5.36') do
   assert_equal 'aBcabc', 'abcabc'.sub('b', 'B')
   assert_equal 'aBcabc', 'abcabc'.sub('b') { |w| w.capitalize }
@@ -478,6 +551,9 @@ assert('String#to_f', '15.2.10.5.38') do
   assert_float(0.0, a)
   assert_float(123456789.0, b)
   assert_float(12345.6789, c)
+  assert_equal(0.1, '0.1'.to_f)
+  assert_equal(1.7976931348623157e308, '1.7976931348623157e308'.to_f)
+  assert_equal(-2.5e-3, '-2_5e-4x'.to_f)
 end
 
 assert('String#to_i', '15.2.10.5.39') do
@@ -490,6 +566,9 @@ assert('String#to_i', '15.2.10.5.39') do
   assert_equal 32143, b
   assert_equal 10, c
   assert_equal 4, d
+  assert_equal 99, '99 red balloons'.to_i
+  assert_equal(-255, '-ff'.to_i(16))
+  assert_raise(ArgumentError) { ('9' * 30).to_i }
 end
 
 assert('String#to_s', '15.2.10.5.40') do
@@ -565,3 +644,36 @@ assert('String#inspect') do
   ("\1" * 100).inspect  # should not raise an exception - regress #1210
   assert_equal "\"\\000\"", "\0".inspect
 end
+
+assert('String#freeze') do
+  a = "frozen" * 5
+  assert_false a.frozen?
+  assert_equal a, a.freeze
+  assert_true a.frozen?
+  assert_raise(RuntimeError) { a << "x" }
+  assert_raise(RuntimeError) { a.upcase! }
+  assert_raise(RuntimeError) { a.replace "x" }
+  assert_equal "frozen" * 5, a
+  assert_false a.dup.frozen?
+end
+
+assert('String#+@') do
+  a = "abc"
+  assert_true((+a).equal?(a))
+  b = +a.freeze
+  assert_false b.frozen?
+  assert_equal "abc", b
+end
+
+assert('String#-@') do
+  a = -("de" + "dup")
+  assert_true a.frozen?
+  assert_true a.equal?(-"dedup")
+  assert_true a.equal?(-a)
+  b = "long enough to live outside the object"
+  c = -b
+  assert_false b.frozen?
+  assert_true c.equal?(-b.dup)
+  b << "!"
+  assert_equal "long enough to live outside the object", c
+end
@@ -25,3 +25,50 @@ end
 assert('Symbol#to_sym', '15.2.11.3.4') do
   assert_equal :abc, :abc.to_sym
 end
+
+assert('Symbol for pre-interned and dynamic names') do
+  dyn = "__symbol_dynamic_#{1 + 1}"
+  assert_equal :each, 'each'.to_sym
+  assert_equal 'initialize', :initialize.to_s
+  assert_equal '<=>', :<=>.to_s
+  assert_equal dyn, dyn.to_sym.to_s
+  assert_equal dyn.to_sym, "__symbol_dynamic_2".to_sym
+  assert_not_equal :each, dyn.to_sym
+end
+
+assert('Symbol from String#to_sym across GC') do
+  h = { "__symbol_gc_key".to_sym => 1 }
+  c = Class.new { define_method("__symbol_gc_meth".to_sym) { 2 } }
+  100.times { |i| "__symbol_gc_tmp_#{i}".to_sym }
+  GC.start
+  assert_equal 1, h["__symbol_gc_key".to_sym]
+  assert_equal "__symbol_gc_key", h.keys[0].to_s
+  assert_equal 2, c.new.__send__("__symbol_gc_meth".to_sym)
+end
+
+assert('Symbol table through many collected String#to_sym symbols') do
+  # fills the name table, frees most entries and reuses their ids, so
+  # that it deletes, reinserts and rehashes over and over
+  keep = {}
+  8.times do |round|
+    2500.times do |i|
+      name = "__symbol_churn_#{round}_#{i}"
+      sym = name.to_sym
+      keep[name] = sym if i % 97 == 0
+    end
+    GC.start
+  end
+  keep.each do |name, sym|
+    assert_equal name, sym.to_s
+    assert_equal sym, name.to_sym
+  end
+  if Symbol.respond_to?(:all_symbols)
+    assert_true Symbol.all_symbols.size < 8 * 2500
+  end
+  again = (0...2500).map { |i| "__symbol_churn_3_#{i}".to_sym }
+  again.each_with_index do |sym, i|
+    assert_equal "__symbol_churn_3_#{i}", sym.to_s
+  end
+  assert_equal again.size, again.uniq.size
+  assert_equal :each, "each".to_sym
+end
@@ -29,6 +29,7 @@ struct mrbc_args {
   mrb_bool check_syntax : 1;
   mrb_bool verbose      : 1;
   mrb_bool debug_info   : 1;
+  mrb_bool frozen_string_literal : 1;
 };
 
 static void
@@ -41,6 +42,7 @@ usage(const char *name)
   "-v           print version number, then turn on verbose mode",
   "-g           produce debugging information",
   "-B<symbol>   binary <symbol> output in C language format",
+  "--frozen-string-literal  make string literals frozen, as the magic comment does",
   "--verbose    run at verbose mode",
   "--version    print the version",
   "--copyright  print the copyright",
@@ -140,6 +142,10 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct mrbc_args *args)
           args->verbose = TRUE;
           break;
         }
+        else if (strcmp(argv[i] + 2, "frozen-string-literal") == 0) {
+          args->frozen_string_literal = TRUE;
+          break;
+        }
         else if (strcmp(argv[i] + 2, "copyright") == 0) {
           mrb_show_copyright(mrb);
           exit(EXIT_SUCCESS);
@@ -198,6 +204,8 @@ load_file(mrb_state *mrb, struct mrbc_args *args)
   c = mrbc_context_new(mrb);
   if (args->verbose)
     c->dump_result = TRUE;
+  if (args->frozen_string_literal)
+    c->frozen_string_literal = TRUE;
   c->no_exec = TRUE;
   if (input[0] == '-' && input[1] == '\0') {
     infile = stdin;
@@ -34,3 +34,13 @@ MRuby::Build.new('cxx_abi') do |conf|
 
   enable_cxx_abi
 end
+
+MRuby::Build.new('slab') do |conf|
+  toolchain :gcc
+
+  conf.gembox 'full-core'
+  conf.cc.flags += %w(-Werror=declaration-after-statement)
+  conf.compilers.each do |c|
+    c.defines += %w(MRB_DEBUG MRB_GC_FIXED_ARENA MRB_USE_SLAB_ALLOCF MRB_SLAB_USE_MMAP)
+  end
+end